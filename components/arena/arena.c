@@ -0,0 +1,35 @@
+#include "pool_pump/arena.h"
+
+void arena_init(arena_t *arena, void *buffer, size_t size) {
+    arena->base = (uint8_t *)buffer;
+    arena->size = buffer != NULL ? size : 0;
+    arena->used = 0;
+    arena->peak = 0;
+    arena->allocations = 0;
+    arena->failures = 0;
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    // The region is aligned, so rounding every size up keeps each block aligned
+    size_t rounded = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size == 0) {
+        return NULL;
+    }
+    if (rounded < size || rounded > arena->size - arena->used) {
+        arena->failures++;
+        return NULL;
+    }
+
+    void *block = arena->base + arena->used;
+    arena->used += rounded;
+    if (arena->used > arena->peak) {
+        arena->peak = arena->used;
+    }
+    arena->allocations++;
+    return block;
+}
+
+void arena_reset(arena_t *arena) {
+    arena->used = 0;
+    arena->allocations = 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARENA_ALIGN 8 // Every block is aligned for a double
+
+// Bump-pointer allocator over one fixed region; blocks are only given back all at once
+typedef struct {
+    uint8_t *base;
+    size_t size;
+    size_t used;
+    size_t peak;          // Most ever in use at once, since arena_init()
+    uint32_t allocations; // Since the last reset
+    uint32_t failures;    // Requests that did not fit, since arena_init()
+} arena_t;
+
+/**
+ * @brief Set up an arena over a caller-owned region
+ *
+ * The arena takes no lock; one task uses it at a time.
+ *
+ * @param arena Arena to set up
+ * @param buffer Region to allocate from, aligned to ARENA_ALIGN
+ * @param size Size of the region in bytes
+ */
+void arena_init(arena_t *arena, void *buffer, size_t size);
+
+/**
+ * @brief Take a block from the arena
+ * @param arena Arena
+ * @param size Block size in bytes
+ * @return Block aligned to ARENA_ALIGN, or NULL when it does not fit
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/**
+ * @brief Give back every block at once; the region is reused from its start
+ * @param arena Arena
+ */
+void arena_reset(arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
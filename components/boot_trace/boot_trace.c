@@ -0,0 +1,64 @@
+#include "pool_pump/boot_trace.h"
+
+#include <stdbool.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+static const char *TAG = "boot_trace";
+
+static const char *stage_names[BOOT_STAGE_COUNT] = {"app_start", "state_loaded", "relays", "scheduler", "network"};
+
+// Zero means not reached: nothing is marked before esp_timer starts counting
+static int64_t stage_us[BOOT_STAGE_COUNT];
+static portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void boot_trace_mark(boot_stage_t stage) {
+    if (stage >= BOOT_STAGE_COUNT) {
+        return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    bool first = false;
+    portENTER_CRITICAL(&trace_lock);
+    if (stage_us[stage] == 0) {
+        stage_us[stage] = now_us > 0 ? now_us : 1;
+        first = true;
+    }
+    portEXIT_CRITICAL(&trace_lock);
+
+    if (first && stage == BOOT_STAGE_NETWORK) {
+        boot_trace_log_report();
+    }
+}
+
+esp_err_t boot_trace_get(boot_trace_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&trace_lock);
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        out->stage_us[i] = stage_us[i] != 0 ? stage_us[i] : -1;
+    }
+    portEXIT_CRITICAL(&trace_lock);
+    return ESP_OK;
+}
+
+void boot_trace_log_report(void) {
+    boot_trace_t trace;
+    boot_trace_get(&trace);
+
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        if (trace.stage_us[i] >= 0) {
+            ESP_LOGI(TAG, "%-12s %8lld us", stage_names[i], (long long)trace.stage_us[i]);
+        }
+    }
+    if (trace.stage_us[BOOT_STAGE_RELAYS] >= 0) {
+        ESP_LOGI(TAG,
+                 "First relay decision %lld ms after start, network %lld ms",
+                 (long long)(trace.stage_us[BOOT_STAGE_RELAYS] / 1000),
+                 (long long)(trace.stage_us[BOOT_STAGE_NETWORK] >= 0 ? trace.stage_us[BOOT_STAGE_NETWORK] / 1000 : -1));
+    }
+}
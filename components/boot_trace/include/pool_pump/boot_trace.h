@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Milestones of a boot, in the order they are normally reached
+typedef enum {
+    BOOT_STAGE_APP_START = 0, // app_main() entered
+    BOOT_STAGE_STATE_LOADED,  // NVS and the RTC/NVS-backed plan, runtime and clock state are loaded
+    BOOT_STAGE_RELAYS,        // The relays run in the mode decided for this boot
+    BOOT_STAGE_SCHEDULER,     // Background init done and the scheduler task started
+    BOOT_STAGE_NETWORK,       // First IP address
+    BOOT_STAGE_COUNT,
+} boot_stage_t;
+
+typedef struct {
+    int64_t stage_us[BOOT_STAGE_COUNT]; // Time since the application started, -1 while not reached
+} boot_trace_t;
+
+/**
+ * @brief Record that a milestone was reached; only the first time counts
+ *
+ * Times are taken from esp_timer, so the ROM and the second stage bootloader come before zero.
+ * The timeline is logged once the network is up.
+ *
+ * @param stage Milestone reached
+ */
+void boot_trace_mark(boot_stage_t stage);
+
+/**
+ * @brief Get the milestones of this boot
+ * @param out Filled with the timeline
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for NULL
+ */
+esp_err_t boot_trace_get(boot_trace_t *out);
+
+/**
+ * @brief Log the milestones reached so far
+ */
+void boot_trace_log_report(void);
+
+#ifdef __cplusplus
+}
+#endif
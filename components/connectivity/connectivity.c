@@ -0,0 +1,241 @@
+#include "pool_pump/connectivity.h"
+
+#include <string.h>
+
+#include "config.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "pool_pump/static_alloc.h"
+#include "wifi_manager.h"
+
+static const char *TAG = "connectivity";
+
+typedef struct {
+    connectivity_job_t job;
+    void *arg;
+} deferred_job_t;
+
+static char network_ssid[WIFI_SSID_MAX_LEN + 1];
+static char network_password[WIFI_PASSWORD_MAX_LEN + 1];
+static bool configured = false;
+
+// Serializes the reference count with switching the radio, so a release never stops a radio just acquired
+static SemaphoreHandle_t radio_mutex = NULL;
+static uint32_t references = 0;
+
+// Radio state, deferred jobs and statistics, also read by tasks that do not take the radio
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool radio_on = false;
+static deferred_job_t jobs[CONNECTIVITY_MAX_JOBS];
+static uint32_t job_count = 0;
+static int64_t oldest_job_us = 0;
+static int64_t radio_on_since_us = 0;
+static int64_t day_start_us = 0;
+static uint64_t day_radio_on_us = 0;
+static uint32_t day_windows = 0;
+static uint32_t day_jobs_run = 0;
+
+esp_err_t connectivity_init(const char *ssid, const char *password) {
+    if (radio_mutex == NULL) {
+        radio_mutex = static_alloc_mutex();
+        if (radio_mutex == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        day_start_us = esp_timer_get_time();
+    }
+
+    configured = ssid != NULL && password != NULL;
+    if (configured) {
+        strlcpy(network_ssid, ssid, sizeof(network_ssid));
+        strlcpy(network_password, password, sizeof(network_password));
+    }
+    ESP_LOGI(TAG, "Radio off until the network is needed%s", configured ? "" : "; no network configured");
+    return ESP_OK;
+}
+
+esp_err_t connectivity_acquire(uint32_t timeout_ms) {
+    if (!configured || radio_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(radio_mutex, portMAX_DELAY);
+    references++;
+    if (!radio_on) {
+        // The WiFi driver allocates its buffers when it starts and frees them when it stops
+        static_alloc_exempt_begin();
+        esp_err_t ret = wifi_manager_connect(network_ssid, network_password);
+        static_alloc_exempt_end();
+        if (ret != ESP_OK) {
+            references--;
+            xSemaphoreGive(radio_mutex);
+            ESP_LOGW(TAG, "Failed to switch the radio on: %s", esp_err_to_name(ret));
+            return ret;
+        }
+        portENTER_CRITICAL(&stats_lock);
+        radio_on = true;
+        radio_on_since_us = esp_timer_get_time();
+        day_windows++;
+        portEXIT_CRITICAL(&stats_lock);
+    }
+    xSemaphoreGive(radio_mutex);
+
+    if (!wifi_manager_wait_connected(timeout_ms)) {
+        ESP_LOGW(TAG, "No connection within %lu ms", (unsigned long)timeout_ms);
+        connectivity_release();
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+// Run the queued jobs one at a time, so a job may itself defer work or take the network
+static void run_jobs(void) {
+    while (wifi_manager_is_connected()) {
+        deferred_job_t next;
+        portENTER_CRITICAL(&stats_lock);
+        if (job_count == 0) {
+            portEXIT_CRITICAL(&stats_lock);
+            return;
+        }
+        next = jobs[0];
+        job_count--;
+        memmove(&jobs[0], &jobs[1], job_count * sizeof(jobs[0]));
+        day_jobs_run++;
+        portEXIT_CRITICAL(&stats_lock);
+
+        next.job(next.arg);
+    }
+}
+
+void connectivity_release(void) {
+    if (radio_mutex == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(radio_mutex, portMAX_DELAY);
+    if (references == 0) {
+        xSemaphoreGive(radio_mutex);
+        ESP_LOGE(TAG, "Release without a matching acquire");
+        return;
+    }
+    bool last = references == 1;
+    xSemaphoreGive(radio_mutex);
+
+    // The last holder runs the batch while it still holds the network; later acquires just join in
+    if (last) {
+        run_jobs();
+    }
+
+    xSemaphoreTake(radio_mutex, portMAX_DELAY);
+    references--;
+    if (references == 0 && radio_on) {
+        static_alloc_exempt_begin();
+        wifi_manager_stop();
+        static_alloc_exempt_end();
+        int64_t now_us = esp_timer_get_time();
+        portENTER_CRITICAL(&stats_lock);
+        radio_on = false;
+        uint64_t window_us = (uint64_t)(now_us - radio_on_since_us);
+        day_radio_on_us += window_us;
+        portEXIT_CRITICAL(&stats_lock);
+        ESP_LOGI(TAG, "Radio off after %lu ms", (unsigned long)(window_us / 1000));
+    }
+    xSemaphoreGive(radio_mutex);
+}
+
+esp_err_t connectivity_defer(connectivity_job_t job, void *arg) {
+    if (job == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_OK;
+    portENTER_CRITICAL(&stats_lock);
+    bool queued = false;
+    for (uint32_t i = 0; i < job_count; i++) {
+        if (jobs[i].job == job && jobs[i].arg == arg) {
+            queued = true;
+        }
+    }
+    if (!queued) {
+        if (job_count == CONNECTIVITY_MAX_JOBS) {
+            ret = ESP_ERR_NO_MEM;
+        } else {
+            if (job_count == 0) {
+                oldest_job_us = esp_timer_get_time();
+            }
+            jobs[job_count].job = job;
+            jobs[job_count].arg = arg;
+            job_count++;
+        }
+    }
+    portEXIT_CRITICAL(&stats_lock);
+    return ret;
+}
+
+void connectivity_service(uint32_t timeout_ms) {
+    portENTER_CRITICAL(&stats_lock);
+    int64_t waited_us = esp_timer_get_time() - oldest_job_us;
+    bool overdue = job_count > 0 && waited_us >= (int64_t)CONNECTIVITY_MAX_DEFER_S * 1000000;
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (overdue && connectivity_acquire(timeout_ms) == ESP_OK) {
+        connectivity_release();
+    }
+}
+
+bool connectivity_radio_on(void) { return radio_on; }
+
+esp_err_t connectivity_get_stats(connectivity_stats_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&stats_lock);
+    uint64_t on_us = day_radio_on_us + (radio_on ? (uint64_t)(now_us - radio_on_since_us) : 0);
+    uint64_t period_us = (uint64_t)(now_us - day_start_us);
+    if (on_us > period_us) {
+        // A window that was already open when the day rolled over
+        on_us = period_us;
+    }
+    out->windows = day_windows;
+    out->jobs_run = day_jobs_run;
+    out->jobs_pending = job_count;
+    portEXIT_CRITICAL(&stats_lock);
+
+    out->radio_on_s = (uint32_t)(on_us / 1000000);
+    out->period_s = (uint32_t)(period_us / 1000000);
+    float off_hours = (float)(period_us - on_us) / 3600e6f;
+    out->saved_mah = off_hours * CONNECTIVITY_ASSOCIATED_MA;
+    out->average_saved_ma = period_us > 0 ? out->saved_mah / ((float)period_us / 3600e6f) : 0;
+    return ESP_OK;
+}
+
+void connectivity_roll_day(connectivity_stats_t *out) {
+    connectivity_stats_t day;
+    connectivity_get_stats(&day);
+    ESP_LOGI(TAG,
+             "Radio on %lu s in %lu windows over %lu s, saving about %.0f mAh (%.1f mA average)",
+             (unsigned long)day.radio_on_s,
+             (unsigned long)day.windows,
+             (unsigned long)day.period_s,
+             day.saved_mah,
+             day.average_saved_ma);
+
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&stats_lock);
+    day_start_us = now_us;
+    day_radio_on_us = 0;
+    if (radio_on) {
+        // The open window counts towards the new day from here on
+        radio_on_since_us = now_us;
+    }
+    day_windows = radio_on ? 1 : 0;
+    day_jobs_run = 0;
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (out != NULL) {
+        *out = day;
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Network work run inside a connectivity window, with the station connected */
+typedef void (*connectivity_job_t)(void *arg);
+
+typedef struct {
+    uint32_t windows;       // Times the radio was switched on
+    uint32_t radio_on_s;    // Time the radio was on, including a window still open
+    uint32_t period_s;      // Time covered by these statistics
+    uint32_t jobs_run;      // Deferred jobs run in a window
+    uint32_t jobs_pending;  // Deferred jobs waiting for the next window
+    float saved_mah;        // Charge saved against keeping the station associated all the time
+    float average_saved_ma; // saved_mah spread over period_s
+} connectivity_stats_t;
+
+/**
+ * @brief Set the network to join and leave the radio off until it is first needed
+ * @param ssid WiFi network SSID, NULL to run without a network
+ * @param password WiFi network password
+ * @return ESP_OK on success
+ */
+esp_err_t connectivity_init(const char *ssid, const char *password);
+
+/**
+ * @brief Take a reference on the network, switching the radio on for the first one
+ *
+ * Blocks until the station holds an IP address. On success the caller must drop the reference with
+ * connectivity_release() when its network work is done; on failure no reference is held.
+ *
+ * @param timeout_ms Maximum time to wait for the connection
+ * @return ESP_OK when connected, ESP_ERR_TIMEOUT if the connection did not come up in time,
+ *         ESP_ERR_INVALID_STATE without a configured network
+ */
+esp_err_t connectivity_acquire(uint32_t timeout_ms);
+
+/**
+ * @brief Drop a reference taken by connectivity_acquire()
+ *
+ * The last reference runs the deferred jobs while the station is still connected and then switches
+ * the radio off.
+ */
+void connectivity_release(void);
+
+/**
+ * @brief Queue network work for the next window instead of opening one for it
+ *
+ * Jobs are run by whichever component next releases the network, so telemetry and similar uploads
+ * ride along with the daily price fetch. A job already queued with the same argument is not queued
+ * twice. connectivity_service() opens a window for jobs that wait longer than CONNECTIVITY_MAX_DEFER_S.
+ *
+ * @param job Function to run
+ * @param arg Argument passed to the job
+ * @return ESP_OK on success, ESP_ERR_NO_MEM when CONNECTIVITY_MAX_JOBS are already queued
+ */
+esp_err_t connectivity_defer(connectivity_job_t job, void *arg);
+
+/**
+ * @brief Open a window for overdue deferred jobs; call periodically from a task that may block
+ * @param timeout_ms Maximum time to wait for the connection
+ */
+void connectivity_service(uint32_t timeout_ms);
+
+/**
+ * @brief Check if the radio is switched on
+ * @return true while a window is open
+ */
+bool connectivity_radio_on(void);
+
+/**
+ * @brief Get the radio statistics since the last connectivity_roll_day()
+ * @param out Pointer to store the statistics
+ * @return ESP_OK on success
+ */
+esp_err_t connectivity_get_stats(connectivity_stats_t *out);
+
+/**
+ * @brief Log the statistics of the day that just ended and start a new day
+ * @param out Optional pointer to store the statistics of the day that ended
+ */
+void connectivity_roll_day(connectivity_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,115 @@
+#include "pool_pump/daily_plan.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "config.h"
+#include "esp_log.h"
+
+static const char *TAG = "daily_plan";
+
+#define SLOTS_PER_HOUR (60 / DAILY_PLAN_SLOT_MINUTES)
+
+static pump_mode_t mode_for_price(float price) {
+    // Same speed choice as the live scheduler: slow down when power is expensive
+    return price > PRICE_THRESHOLD_HIGH ? PUMP_MODE_NIGHT : PUMP_MODE_DAY;
+}
+
+// Hours without a price (<= 0) rank after every priced hour; the plan never prefers hours it knows nothing about
+static bool ranks_after(float price, float other) {
+    bool known = price > 0;
+    bool other_known = other > 0;
+    if (known != other_known) {
+        return !known;
+    }
+    return known && price > other;
+}
+
+static void set_hour(daily_plan_t *plan, int hour, pump_mode_t mode) {
+    memset(&plan->mode[hour * SLOTS_PER_HOUR], mode, SLOTS_PER_HOUR);
+}
+
+esp_err_t daily_plan_build(const price_data_t prices[24], uint32_t date, daily_plan_t *plan) {
+    if (prices == NULL || plan == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(plan, 0, sizeof(*plan));
+    plan->date = date;
+
+    bool have_prices = false;
+    for (int hour = 0; hour < 24; hour++) {
+        if (prices[hour].price_eur_kwh > 0) {
+            have_prices = true;
+            break;
+        }
+    }
+
+    if (!have_prices) {
+        for (int hour = OPERATING_START_HOUR; hour < OPERATING_START_HOUR + MIN_DAILY_RUNTIME_HOURS; hour++) {
+            set_hour(plan, hour, PUMP_MODE_DAY);
+        }
+        ESP_LOGW(TAG, "No prices for %lu, using fixed %d h plan", (unsigned long)date, MIN_DAILY_RUNTIME_HOURS);
+        return ESP_OK;
+    }
+
+    // Operating hours ordered by price, unpriced ones last in hour order (insertion sort, at most 24 entries)
+    int order[24];
+    int count = 0;
+    for (int hour = OPERATING_START_HOUR; hour < OPERATING_END_HOUR; hour++) {
+        int pos = count++;
+        while (pos > 0 && ranks_after(prices[order[pos - 1]].price_eur_kwh, prices[hour].price_eur_kwh)) {
+            order[pos] = order[pos - 1];
+            pos--;
+        }
+        order[pos] = hour;
+    }
+
+    int planned_hours = 0;
+    for (int i = 0; i < count && planned_hours < MAX_DAILY_RUNTIME_HOURS; i++) {
+        float price = prices[order[i]].price_eur_kwh;
+        if (planned_hours >= MIN_DAILY_RUNTIME_HOURS && !(price > 0 && price < PRICE_THRESHOLD_LOW)) {
+            break;
+        }
+        set_hour(plan, order[i], mode_for_price(price));
+        planned_hours++;
+    }
+
+    ESP_LOGI(TAG, "Plan for %lu: %d h", (unsigned long)date, planned_hours);
+    return ESP_OK;
+}
+
+pump_mode_t daily_plan_mode_at(const daily_plan_t *plan, int minute_of_day) {
+    if (plan == NULL || minute_of_day < 0 || minute_of_day >= 24 * 60) {
+        return PUMP_MODE_OFF;
+    }
+    return (pump_mode_t)plan->mode[minute_of_day / DAILY_PLAN_SLOT_MINUTES];
+}
+
+int daily_plan_next_transition(const daily_plan_t *plan, int minute_of_day) {
+    if (plan == NULL || minute_of_day < 0 || minute_of_day >= 24 * 60) {
+        return -1;
+    }
+
+    int slot = minute_of_day / DAILY_PLAN_SLOT_MINUTES;
+    for (int next = slot + 1; next < DAILY_PLAN_SLOTS; next++) {
+        if (plan->mode[next] != plan->mode[slot]) {
+            return next * DAILY_PLAN_SLOT_MINUTES;
+        }
+    }
+    return -1;
+}
+
+int daily_plan_run_minutes(const daily_plan_t *plan) {
+    if (plan == NULL) {
+        return 0;
+    }
+
+    int slots = 0;
+    for (int i = 0; i < DAILY_PLAN_SLOTS; i++) {
+        if (plan->mode[i] != PUMP_MODE_OFF) {
+            slots++;
+        }
+    }
+    return slots * DAILY_PLAN_SLOT_MINUTES;
+}
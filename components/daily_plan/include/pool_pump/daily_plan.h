@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "price_fetcher.h"
+#include "pump_controller.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DAILY_PLAN_SLOT_MINUTES 15
+#define DAILY_PLAN_SLOTS (24 * 60 / DAILY_PLAN_SLOT_MINUTES)
+
+// Pump mode for every slot of one day. Slot n covers minutes [n * 15, (n + 1) * 15).
+typedef struct {
+    uint32_t date; // YYYYMMDD
+    uint8_t mode[DAILY_PLAN_SLOTS];
+} daily_plan_t;
+
+/**
+ * @brief Build a plan from hourly prices
+ *
+ * Runs the cheapest hours inside the operating window until MIN_DAILY_RUNTIME_HOURS is met,
+ * then any further hours below PRICE_THRESHOLD_LOW up to MAX_DAILY_RUNTIME_HOURS. Hours without
+ * a price (<= 0) are only used when the priced ones cannot meet the minimum. Without prices
+ * (all <= 0) it falls back to running from the start of the operating window.
+ *
+ * @param prices 24 hourly prices
+ * @param date Date in YYYYMMDD format
+ * @param plan Plan to fill
+ * @return ESP_OK on success
+ */
+esp_err_t daily_plan_build(const price_data_t prices[24], uint32_t date, daily_plan_t *plan);
+
+/**
+ * @brief Mode planned at a given minute of the day
+ */
+pump_mode_t daily_plan_mode_at(const daily_plan_t *plan, int minute_of_day);
+
+/**
+ * @brief Minute of the next mode change after minute_of_day, or -1 if none today
+ */
+int daily_plan_next_transition(const daily_plan_t *plan, int minute_of_day);
+
+/**
+ * @brief Total planned run time in minutes
+ */
+int daily_plan_run_minutes(const daily_plan_t *plan);
+
+#ifdef __cplusplus
+}
+#endif
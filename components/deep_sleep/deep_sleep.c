@@ -0,0 +1,185 @@
+#include "pool_pump/deep_sleep.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "config.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "pool_pump/nvs_cache.h"
+#include "pool_pump/runtime_accounting.h"
+#include "relay_control.h"
+
+static const char *TAG = "deep_sleep";
+
+#define RTC_MAGIC 0x44534C31 // "DSL1"; bump when the layout changes
+#define DAY_MINUTES (24 * 60)
+
+// Kept in RTC memory: the planned wake-up, and whether the relays are held for it
+typedef struct {
+    uint32_t magic;
+    deep_sleep_wake_t wake;
+    int64_t sleep_start_us; // System time the sleep started
+    deep_sleep_stats_t stats;
+    uint8_t held; // The relays were held when the chip went to sleep
+    uint8_t reserved[3];
+    uint32_t crc; // Over everything above
+} sleep_record_t;
+
+static RTC_NOINIT_ATTR sleep_record_t rtc_record;
+
+static portMUX_TYPE sleep_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool woke = false;
+static deep_sleep_wake_t wake_up;
+
+static uint32_t record_crc(const sleep_record_t *record) {
+    return esp_rom_crc32_le(0, (const uint8_t *)record, offsetof(sleep_record_t, crc));
+}
+
+static void seal_locked(void) { rtc_record.crc = record_crc(&rtc_record); }
+
+static bool rtc_valid(esp_reset_reason_t reason) {
+    // RTC memory is undefined after power-on, and a brownout may have corrupted it mid-write
+    if (reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT || reason == ESP_RST_UNKNOWN) {
+        return false;
+    }
+    return rtc_record.magic == RTC_MAGIC && rtc_record.crc == record_crc(&rtc_record);
+}
+
+static int64_t system_time_us(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+esp_err_t deep_sleep_init(esp_reset_reason_t reason) {
+    portENTER_CRITICAL(&sleep_lock);
+    if (!rtc_valid(reason)) {
+        memset(&rtc_record, 0, sizeof(rtc_record));
+        rtc_record.magic = RTC_MAGIC;
+    }
+    // Only the wake-up from our own sleep finds the pads held; a reset in between released them
+    woke = reason == ESP_RST_DEEPSLEEP && rtc_record.held;
+    if (woke) {
+        wake_up = rtc_record.wake;
+        wake_up.slept_us = system_time_us() - rtc_record.sleep_start_us;
+        rtc_record.stats.wakes++;
+        rtc_record.stats.slept_s += wake_up.slept_us > 0 ? (uint64_t)wake_up.slept_us / 1000000 : 0;
+    }
+    rtc_record.held = 0;
+    seal_locked();
+    portEXIT_CRITICAL(&sleep_lock);
+    return ESP_OK;
+}
+
+bool deep_sleep_get_wake(deep_sleep_wake_t *out) {
+    if (!woke) {
+        return false;
+    }
+    if (out != NULL) {
+        *out = wake_up;
+    }
+    return true;
+}
+
+void deep_sleep_note_switched(void) {
+    uint32_t switch_us = (uint32_t)esp_timer_get_time();
+
+    portENTER_CRITICAL(&sleep_lock);
+    rtc_record.stats.last_switch_us = switch_us;
+    if (switch_us > rtc_record.stats.max_switch_us) {
+        rtc_record.stats.max_switch_us = switch_us;
+    }
+    seal_locked();
+    portEXIT_CRITICAL(&sleep_lock);
+}
+
+int deep_sleep_next_wake(const daily_plan_t *plan,
+                         int minute_of_day,
+                         pump_mode_t mode,
+                         int run_budget_minutes,
+                         pump_mode_t *wake_mode) {
+    int next = daily_plan_next_transition(plan, minute_of_day);
+    pump_mode_t next_mode = next >= 0 ? daily_plan_mode_at(plan, next) : mode;
+    if (next < 0) {
+        next = DAY_MINUTES;
+    }
+
+    if (mode != PUMP_MODE_OFF) {
+        // Running until the budget is used up stops the pump before the plan would
+        int budget = run_budget_minutes > 0 ? run_budget_minutes : 0;
+        if (minute_of_day + budget < next) {
+            next = minute_of_day + budget;
+            next_mode = PUMP_MODE_OFF;
+        }
+        run_budget_minutes -= next - minute_of_day;
+    }
+    if (next_mode != PUMP_MODE_OFF && run_budget_minutes <= 0) {
+        next_mode = PUMP_MODE_OFF;
+    }
+
+    if (wake_mode != NULL) {
+        *wake_mode = next_mode;
+    }
+    return next;
+}
+
+esp_err_t deep_sleep_enter(const deep_sleep_wake_t *wake) {
+    if (wake == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t now_us = system_time_us();
+    int64_t sleep_us = wake->wake_time_s * 1000000 - now_us;
+    if (sleep_us < (int64_t)DEEP_SLEEP_MIN_S * 1000000) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t ret = relay_control_hold();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Relays cannot be held, staying awake: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    runtime_accounting_prepare_sleep();
+    // The cache is RAM; whatever it has not written yet would be lost with it
+    nvs_cache_flush();
+
+    deep_sleep_stats_t stats;
+    portENTER_CRITICAL(&sleep_lock);
+    rtc_record.wake = *wake;
+    rtc_record.wake.slept_us = 0;
+    rtc_record.sleep_start_us = now_us;
+    rtc_record.held = 1;
+    rtc_record.stats.sleeps++;
+    stats = rtc_record.stats;
+    seal_locked();
+    portEXIT_CRITICAL(&sleep_lock);
+
+    ESP_LOGI(TAG,
+             "Sleeping %lld s until %02d:%02d, mode %d then %d; last wake-up switched %lu us after start",
+             (long long)(sleep_us / 1000000),
+             wake->minute_of_day / 60 % 24,
+             wake->minute_of_day % 60,
+             wake->held_mode,
+             wake->wake_mode,
+             (unsigned long)stats.last_switch_us);
+    esp_sleep_enable_timer_wakeup((uint64_t)sleep_us);
+    esp_deep_sleep_start();
+    return ESP_OK; // Not reached
+}
+
+esp_err_t deep_sleep_get_stats(deep_sleep_stats_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&sleep_lock);
+    *out = rtc_record.stats;
+    portEXIT_CRITICAL(&sleep_lock);
+    return ESP_OK;
+}
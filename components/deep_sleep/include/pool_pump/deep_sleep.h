@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_system.h"
+#include "pool_pump/daily_plan.h"
+#include "pump_controller.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A wake-up planned before going to sleep
+typedef struct {
+    uint32_t date;         // YYYYMMDD of the plan the wake-up belongs to
+    int minute_of_day;     // Minute of that day to wake at, 24 * 60 for the start of the next day
+    pump_mode_t held_mode; // Mode the relays are held in through the sleep
+    pump_mode_t wake_mode; // Mode to switch to on waking
+    int64_t wake_time_s;   // System time to wake at
+    int64_t slept_us;      // Set on the wake-up: time since the sleep started
+} deep_sleep_wake_t;
+
+typedef struct {
+    uint32_t sleeps;         // Deep sleeps entered since power-on
+    uint32_t wakes;          // Wake-ups that took over the held relays
+    uint32_t last_switch_us; // From application start to the relay change, on the last wake-up
+    uint32_t max_switch_us;  // Slowest relay change on a wake-up
+    uint64_t slept_s;        // Total time in deep sleep
+} deep_sleep_stats_t;
+
+/**
+ * @brief Restore the sleep record and find out whether this boot is a wake-up with the relays held
+ *
+ * Must run before anything touches the relay outputs. The record survives soft resets like the
+ * other RTC state; power loss clears it.
+ *
+ * @param reason Reset reason of this boot, normally esp_reset_reason()
+ * @return ESP_OK on success
+ */
+esp_err_t deep_sleep_init(esp_reset_reason_t reason);
+
+/**
+ * @brief The wake-up this boot is, if it follows deep_sleep_enter()
+ * @param out Filled with the planned wake-up and the time slept
+ * @return true when the relays are held and have to be taken over with pump_controller_resume()
+ */
+bool deep_sleep_get_wake(deep_sleep_wake_t *out);
+
+/**
+ * @brief Record that the relays were switched on this wake-up; the time since boot is its latency
+ */
+void deep_sleep_note_switched(void);
+
+/**
+ * @brief When the plan next needs the controller awake
+ *
+ * That is the next mode change of the plan, the moment the daily runtime budget runs out while
+ * running, or the end of the day, when the next day's plan has to be fetched.
+ *
+ * @param plan Today's plan
+ * @param minute_of_day Current minute of the day
+ * @param mode Mode the pump is running in now
+ * @param run_budget_minutes Runtime left today before MAX_DAILY_RUNTIME_HOURS is reached
+ * @param wake_mode Mode to switch to at that minute; the current one at the end of the day
+ * @return Minute of the day to wake at, 24 * 60 for the start of the next day
+ */
+int deep_sleep_next_wake(const daily_plan_t *plan,
+                         int minute_of_day,
+                         pump_mode_t mode,
+                         int run_budget_minutes,
+                         pump_mode_t *wake_mode);
+
+/**
+ * @brief Hold the relays, save what RAM would lose and sleep until the planned wake-up
+ *
+ * Does not return on success: the chip resets on the wake-up and app_main() runs again.
+ *
+ * @param wake Wake-up to plan; slept_us is ignored
+ * @return ESP_ERR_INVALID_STATE if the wake-up is less than DEEP_SLEEP_MIN_S away,
+ *         ESP_ERR_NOT_SUPPORTED if the relay outputs cannot be held
+ */
+esp_err_t deep_sleep_enter(const deep_sleep_wake_t *wake);
+
+/**
+ * @brief Get the deep sleep statistics
+ * @param out Pointer to store the statistics
+ * @return ESP_OK on success
+ */
+esp_err_t deep_sleep_get_stats(deep_sleep_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
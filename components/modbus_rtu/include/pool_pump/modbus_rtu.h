@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MODBUS_RTU_MAX_ADU 256
+#define MODBUS_RTU_MAX_READ_REGS 125
+#define MODBUS_RTU_MAX_WRITE_REGS 123
+
+#define MODBUS_FC_READ_HOLDING 0x03
+#define MODBUS_FC_READ_INPUT 0x04
+#define MODBUS_FC_WRITE_SINGLE 0x06
+#define MODBUS_FC_WRITE_MULTIPLE 0x10
+
+// Byte transport underneath the master: an RS485 UART on target, a pty on the host
+typedef struct {
+    esp_err_t (*write)(void *ctx, const uint8_t *data, size_t len);
+    // Read up to len bytes, waiting at most timeout_ms for the first byte; returns bytes read or -1
+    int (*read)(void *ctx, uint8_t *buf, size_t len, uint32_t timeout_ms);
+    // Drop any stale bytes before a new request
+    void (*flush)(void *ctx);
+    // Optional: called with true before a transaction and false after it, e.g. to keep the UART out of light sleep
+    void (*busy)(void *ctx, bool busy);
+    void *ctx;
+} modbus_rtu_transport_t;
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t retries;
+    uint32_t timeouts;
+    uint32_t crc_errors;
+    uint32_t exceptions;
+    uint32_t last_exception;
+    int64_t last_rtt_us;
+    int64_t max_rtt_us;
+    int64_t total_rtt_us; // Sum over successful transactions, for averaging
+} modbus_rtu_stats_t;
+
+typedef struct {
+    modbus_rtu_transport_t transport;
+    uint32_t response_timeout_ms;
+    uint8_t retries;
+    modbus_rtu_stats_t stats;
+} modbus_rtu_master_t;
+
+/**
+ * @brief Initialize a master on top of a transport
+ * @param master Master instance
+ * @param transport Transport callbacks (copied)
+ * @param response_timeout_ms Time to wait for a reply
+ * @param retries Extra attempts after a timeout or CRC error
+ * @return ESP_OK on success
+ */
+esp_err_t modbus_rtu_master_init(modbus_rtu_master_t *master,
+                                 const modbus_rtu_transport_t *transport,
+                                 uint32_t response_timeout_ms,
+                                 uint8_t retries);
+
+/**
+ * @brief Modbus CRC-16 (poly 0xA001, init 0xFFFF), transmitted low byte first
+ */
+uint16_t modbus_rtu_crc16(const uint8_t *data, size_t len);
+
+/**
+ * @brief Read a block of holding (0x03) or input (0x04) registers in one transaction
+ * @param master Master instance
+ * @param slave Slave address
+ * @param function MODBUS_FC_READ_HOLDING or MODBUS_FC_READ_INPUT
+ * @param start First register address
+ * @param count Number of registers (1-125)
+ * @param values Destination for count registers
+ * @return ESP_OK, ESP_ERR_TIMEOUT, ESP_ERR_INVALID_CRC or ESP_ERR_INVALID_RESPONSE (slave exception)
+ */
+esp_err_t modbus_rtu_read_registers(modbus_rtu_master_t *master,
+                                    uint8_t slave,
+                                    uint8_t function,
+                                    uint16_t start,
+                                    uint16_t count,
+                                    uint16_t *values);
+
+/**
+ * @brief Write a single holding register (0x06)
+ */
+esp_err_t modbus_rtu_write_register(modbus_rtu_master_t *master, uint8_t slave, uint16_t address, uint16_t value);
+
+/**
+ * @brief Write a block of holding registers in one transaction (0x10)
+ */
+esp_err_t modbus_rtu_write_registers(modbus_rtu_master_t *master,
+                                     uint8_t slave,
+                                     uint16_t start,
+                                     uint16_t count,
+                                     const uint16_t *values);
+
+#ifdef __cplusplus
+}
+#endif
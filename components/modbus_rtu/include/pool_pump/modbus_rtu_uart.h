@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "pool_pump/modbus_rtu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int uart_num;
+    int tx_pin;
+    int rx_pin;
+    int de_pin; // RS485 driver-enable, driven by the UART's RTS line
+    uint32_t baud_rate;
+} modbus_rtu_uart_config_t;
+
+/**
+ * @brief Install the UART driver in RS485 half-duplex mode and fill a transport for it
+ * @param config UART and pin configuration
+ * @param transport Transport to fill
+ * @return ESP_OK on success
+ */
+esp_err_t modbus_rtu_uart_init(const modbus_rtu_uart_config_t *config, modbus_rtu_transport_t *transport);
+
+#ifdef __cplusplus
+}
+#endif
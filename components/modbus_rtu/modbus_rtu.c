@@ -0,0 +1,256 @@
+#include "pool_pump/modbus_rtu.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "modbus_rtu";
+
+esp_err_t modbus_rtu_master_init(modbus_rtu_master_t *master,
+                                 const modbus_rtu_transport_t *transport,
+                                 uint32_t response_timeout_ms,
+                                 uint8_t retries) {
+    if (master == NULL || transport == NULL || transport->write == NULL || transport->read == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(master, 0, sizeof(*master));
+    master->transport = *transport;
+    master->response_timeout_ms = response_timeout_ms;
+    master->retries = retries;
+    return ESP_OK;
+}
+
+uint16_t modbus_rtu_crc16(const uint8_t *data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+static void put_u16(uint8_t *dst, uint16_t value) {
+    dst[0] = (uint8_t)(value >> 8);
+    dst[1] = (uint8_t)(value & 0xFF);
+}
+
+static uint16_t get_u16(const uint8_t *src) { return (uint16_t)((src[0] << 8) | src[1]); }
+
+static bool crc_ok(const uint8_t *frame, size_t len) {
+    uint16_t crc = modbus_rtu_crc16(frame, len - 2);
+    return frame[len - 2] == (crc & 0xFF) && frame[len - 1] == (crc >> 8);
+}
+
+// Read exactly len bytes before the deadline; returns false on timeout
+static bool read_exact(modbus_rtu_master_t *master, uint8_t *buf, size_t len, int64_t deadline_us) {
+    size_t got = 0;
+    while (got < len) {
+        int64_t remaining_us = deadline_us - esp_timer_get_time();
+        if (remaining_us <= 0) {
+            return false;
+        }
+        uint32_t timeout_ms = (uint32_t)(remaining_us / 1000) + 1;
+        int n = master->transport.read(master->transport.ctx, buf + got, len - got, timeout_ms);
+        if (n < 0) {
+            return false;
+        }
+        got += (size_t)n;
+    }
+    return true;
+}
+
+// Send request (CRC appended here) and receive a reply of expected_len bytes into response
+static esp_err_t exchange(modbus_rtu_master_t *master,
+                          uint8_t *request,
+                          size_t request_len,
+                          uint8_t *response,
+                          size_t expected_len) {
+    uint16_t crc = modbus_rtu_crc16(request, request_len);
+    request[request_len++] = (uint8_t)(crc & 0xFF);
+    request[request_len++] = (uint8_t)(crc >> 8);
+
+    const uint8_t slave = request[0];
+    const uint8_t function = request[1];
+    esp_err_t result = ESP_ERR_TIMEOUT;
+
+    for (int attempt = 0; attempt <= master->retries; attempt++) {
+        if (attempt > 0) {
+            master->stats.retries++;
+        }
+        if (master->transport.flush != NULL) {
+            master->transport.flush(master->transport.ctx);
+        }
+
+        int64_t start_us = esp_timer_get_time();
+        int64_t deadline_us = start_us + (int64_t)master->response_timeout_ms * 1000;
+
+        esp_err_t ret = master->transport.write(master->transport.ctx, request, request_len);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        // Address + function code tell us whether this is a normal reply or an exception
+        if (!read_exact(master, response, 2, deadline_us)) {
+            master->stats.timeouts++;
+            result = ESP_ERR_TIMEOUT;
+            continue;
+        }
+
+        if (response[0] != slave) {
+            ESP_LOGW(TAG, "Reply from slave %u, expected %u", response[0], slave);
+            result = ESP_ERR_INVALID_RESPONSE;
+            continue;
+        }
+
+        if (response[1] == (function | 0x80)) {
+            if (!read_exact(master, response + 2, 3, deadline_us)) {
+                master->stats.timeouts++;
+                result = ESP_ERR_TIMEOUT;
+                continue;
+            }
+            if (!crc_ok(response, 5)) {
+                master->stats.crc_errors++;
+                result = ESP_ERR_INVALID_CRC;
+                continue;
+            }
+            master->stats.exceptions++;
+            master->stats.last_exception = response[2];
+            ESP_LOGW(TAG, "Slave %u exception 0x%02x for function 0x%02x", slave, response[2], function);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+
+        if (response[1] != function) {
+            result = ESP_ERR_INVALID_RESPONSE;
+            continue;
+        }
+
+        if (!read_exact(master, response + 2, expected_len - 2, deadline_us)) {
+            master->stats.timeouts++;
+            result = ESP_ERR_TIMEOUT;
+            continue;
+        }
+
+        if (!crc_ok(response, expected_len)) {
+            master->stats.crc_errors++;
+            result = ESP_ERR_INVALID_CRC;
+            continue;
+        }
+
+        int64_t rtt_us = esp_timer_get_time() - start_us;
+        master->stats.transactions++;
+        master->stats.last_rtt_us = rtt_us;
+        master->stats.total_rtt_us += rtt_us;
+        if (rtt_us > master->stats.max_rtt_us) {
+            master->stats.max_rtt_us = rtt_us;
+        }
+        return ESP_OK;
+    }
+
+    ESP_LOGW(TAG, "Function 0x%02x to slave %u failed: %s", function, slave, esp_err_to_name(result));
+    return result;
+}
+
+static esp_err_t transact(modbus_rtu_master_t *master,
+                          uint8_t *request,
+                          size_t request_len,
+                          uint8_t *response,
+                          size_t expected_len) {
+    if (master->transport.busy != NULL) {
+        master->transport.busy(master->transport.ctx, true);
+    }
+    esp_err_t ret = exchange(master, request, request_len, response, expected_len);
+    if (master->transport.busy != NULL) {
+        master->transport.busy(master->transport.ctx, false);
+    }
+    return ret;
+}
+
+esp_err_t modbus_rtu_read_registers(modbus_rtu_master_t *master,
+                                    uint8_t slave,
+                                    uint8_t function,
+                                    uint16_t start,
+                                    uint16_t count,
+                                    uint16_t *values) {
+    if (master == NULL || values == NULL || count == 0 || count > MODBUS_RTU_MAX_READ_REGS ||
+        (function != MODBUS_FC_READ_HOLDING && function != MODBUS_FC_READ_INPUT)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t request[8];
+    request[0] = slave;
+    request[1] = function;
+    put_u16(&request[2], start);
+    put_u16(&request[4], count);
+
+    uint8_t response[MODBUS_RTU_MAX_ADU];
+    size_t expected_len = 5 + 2 * (size_t)count;
+    esp_err_t ret = transact(master, request, 6, response, expected_len);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    if (response[2] != 2 * count) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        values[i] = get_u16(&response[3 + 2 * i]);
+    }
+    return ESP_OK;
+}
+
+esp_err_t modbus_rtu_write_register(modbus_rtu_master_t *master, uint8_t slave, uint16_t address, uint16_t value) {
+    if (master == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t request[8];
+    request[0] = slave;
+    request[1] = MODBUS_FC_WRITE_SINGLE;
+    put_u16(&request[2], address);
+    put_u16(&request[4], value);
+
+    uint8_t response[8];
+    esp_err_t ret = transact(master, request, 6, response, sizeof(response));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // A write-single reply echoes the request
+    return memcmp(response, request, sizeof(response)) == 0 ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+}
+
+esp_err_t modbus_rtu_write_registers(modbus_rtu_master_t *master,
+                                     uint8_t slave,
+                                     uint16_t start,
+                                     uint16_t count,
+                                     const uint16_t *values) {
+    if (master == NULL || values == NULL || count == 0 || count > MODBUS_RTU_MAX_WRITE_REGS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t request[MODBUS_RTU_MAX_ADU];
+    request[0] = slave;
+    request[1] = MODBUS_FC_WRITE_MULTIPLE;
+    put_u16(&request[2], start);
+    put_u16(&request[4], count);
+    request[6] = (uint8_t)(2 * count);
+    for (uint16_t i = 0; i < count; i++) {
+        put_u16(&request[7 + 2 * i], values[i]);
+    }
+
+    uint8_t response[8];
+    esp_err_t ret = transact(master, request, 7 + 2 * (size_t)count, response, sizeof(response));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    if (get_u16(&response[2]) != start || get_u16(&response[4]) != count) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    return ESP_OK;
+}
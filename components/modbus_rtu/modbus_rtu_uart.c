@@ -0,0 +1,96 @@
+#include "pool_pump/modbus_rtu_uart.h"
+
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "pool_pump/power.h"
+
+static const char *TAG = "modbus_rtu_uart";
+
+#define MODBUS_UART_RX_BUFFER 512
+// Modbus RTU frames end after 3.5 character times of silence
+#define MODBUS_UART_RX_TOUT_SYMBOLS 3
+
+static esp_err_t uart_transport_write(void *ctx, const uint8_t *data, size_t len) {
+    uart_port_t port = (uart_port_t)(intptr_t)ctx;
+    if (uart_write_bytes(port, (const char *)data, len) != (int)len) {
+        return ESP_FAIL;
+    }
+    // In RS485 half-duplex mode RTS drops once the last bit is out; wait so the reply is not clipped
+    return uart_wait_tx_done(port, pdMS_TO_TICKS(100));
+}
+
+static int uart_transport_read(void *ctx, uint8_t *buf, size_t len, uint32_t timeout_ms) {
+    uart_port_t port = (uart_port_t)(intptr_t)ctx;
+    int n = uart_read_bytes(port, buf, len, pdMS_TO_TICKS(timeout_ms));
+    return n < 0 ? -1 : n;
+}
+
+static void uart_transport_flush(void *ctx) { uart_flush_input((uart_port_t)(intptr_t)ctx); }
+
+// The UART does not receive in light sleep, so the chip stays awake until the reply is in
+static void uart_transport_busy(void *ctx, bool busy) {
+    if (busy) {
+        power_lock_acquire(POWER_LOCK_NO_SLEEP);
+    } else {
+        power_lock_release(POWER_LOCK_NO_SLEEP);
+    }
+}
+
+esp_err_t modbus_rtu_uart_init(const modbus_rtu_uart_config_t *config, modbus_rtu_transport_t *transport) {
+    if (config == NULL || transport == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const uart_config_t uart_config = {
+        .baud_rate = (int)config->baud_rate,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+#if SOC_UART_SUPPORT_REF_TICK
+        // APB follows frequency scaling; REF_TICK keeps the baud rate
+        .source_clk = UART_SCLK_REF_TICK,
+#elif SOC_UART_SUPPORT_XTAL_CLK
+        .source_clk = UART_SCLK_XTAL,
+#else
+        .source_clk = UART_SCLK_DEFAULT,
+#endif
+    };
+
+    uart_port_t port = (uart_port_t)config->uart_num;
+    // The inverter link may be opened more than once; later inits reconfigure the driver the first installed
+    bool install = !uart_is_driver_installed(port);
+    esp_err_t ret = install ? uart_driver_install(port, MODBUS_UART_RX_BUFFER, 0, 0, NULL, 0) : ESP_OK;
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to install UART driver: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = uart_param_config(port, &uart_config);
+    if (ret == ESP_OK) {
+        ret = uart_set_pin(port, config->tx_pin, config->rx_pin, config->de_pin, UART_PIN_NO_CHANGE);
+    }
+    if (ret == ESP_OK) {
+        ret = uart_set_mode(port, UART_MODE_RS485_HALF_DUPLEX);
+    }
+    if (ret == ESP_OK) {
+        ret = uart_set_rx_timeout(port, MODBUS_UART_RX_TOUT_SYMBOLS);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure RS485 UART: %s", esp_err_to_name(ret));
+        if (install) {
+            uart_driver_delete(port);
+        }
+        return ret;
+    }
+
+    transport->write = uart_transport_write;
+    transport->read = uart_transport_read;
+    transport->flush = uart_transport_flush;
+    transport->busy = uart_transport_busy;
+    transport->ctx = (void *)(intptr_t)port;
+
+    ESP_LOGI(TAG, "RS485 on UART%d at %lu baud", config->uart_num, (unsigned long)config->baud_rate);
+    return ESP_OK;
+}
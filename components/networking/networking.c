@@ -1,6 +1,8 @@
 #include "pool_pump/networking.h"
 
+#include "config.h"
 #include "esp_log.h"
+#include "pool_pump/time_service.h"
 
 static const char *TAG = "networking";
 
@@ -16,5 +18,5 @@ esp_err_t networking_connect(void) {
 
 esp_err_t networking_get_time(void) {
     ESP_LOGI(TAG, "Syncing SNTP time");
-    return ESP_OK;
+    return time_service_sync_sntp(TIME_SNTP_TIMEOUT_MS);
 }
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NVS_CACHE_MAX_ENTRIES 16
+#define NVS_CACHE_KEY_MAX_LEN 15 // NVS key limit without the terminator
+
+// Write amplification and flash wear of the cache compared with writing every update through
+typedef struct {
+    uint32_t entries;          // Registered counters
+    uint32_t dirty;            // Counters with unflushed changes
+    uint32_t updates;          // set/add calls that changed a value
+    uint32_t entries_written;  // NVS entries actually written
+    uint32_t flushes;          // Flushes that wrote at least one entry
+    uint32_t flush_failures;   // Flushes that hit an NVS error (values stay dirty)
+    int64_t max_flush_us;      // Longest flush, spent in the flush task
+    float write_ratio;         // entries_written / updates; 1.0 equals write-through
+    float lifetime_years;      // Flash endurance at the measured write rate
+    float write_through_years; // Flash endurance had every update been written through
+} nvs_cache_report_t;
+
+/**
+ * @brief Start the write-back cache and its low-priority flush task
+ *
+ * nvs_storage must be initialized. Dirty counters are written every flush_interval_s seconds,
+ * when a counter moves by its significant delta, and from a shutdown handler on esp_restart().
+ *
+ * @param flush_interval_s Periodic flush interval in seconds
+ * @return ESP_OK on success
+ */
+esp_err_t nvs_cache_init(uint32_t flush_interval_s);
+
+/**
+ * @brief Register a counter, loading its persisted value (0 if absent)
+ * @param key NVS key, at most NVS_CACHE_KEY_MAX_LEN characters
+ * @param significant_delta Change since the last flush that triggers an early flush, 0 for none
+ * @return ESP_OK on success, ESP_ERR_NO_MEM when the table is full
+ */
+esp_err_t nvs_cache_register(const char *key, int32_t significant_delta);
+
+/**
+ * @brief Set a counter in RAM; never touches flash
+ * @param key Registered key
+ * @param value New value
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND for an unregistered key
+ */
+esp_err_t nvs_cache_set(const char *key, int32_t value);
+
+/**
+ * @brief Add to a counter in RAM; never touches flash
+ * @param key Registered key
+ * @param delta Amount to add
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND for an unregistered key
+ */
+esp_err_t nvs_cache_add(const char *key, int32_t delta);
+
+/**
+ * @brief Read a counter from RAM
+ * @param key Registered key
+ * @param value Pointer to store the value
+ * @return ESP_OK on success
+ */
+esp_err_t nvs_cache_get(const char *key, int32_t *value);
+
+/**
+ * @brief Write all dirty counters now, in one NVS commit, from the calling task
+ * @return ESP_OK on success
+ */
+esp_err_t nvs_cache_flush(void);
+
+/**
+ * @brief Ask the flush task to write dirty counters soon without waiting for it
+ */
+void nvs_cache_request_flush(void);
+
+/**
+ * @brief Get write amplification and flash lifetime figures
+ * @param report Pointer to store the report
+ * @return ESP_OK on success
+ */
+esp_err_t nvs_cache_get_report(nvs_cache_report_t *report);
+
+/**
+ * @brief Log the report
+ */
+void nvs_cache_log_report(void);
+
+#ifdef __cplusplus
+}
+#endif
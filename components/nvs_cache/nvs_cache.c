@@ -0,0 +1,302 @@
+#include "pool_pump/nvs_cache.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "config.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "nvs_storage.h"
+#include "pool_pump/static_alloc.h"
+#include "pool_pump/task_map.h"
+
+static const char *TAG = "nvs_cache";
+
+// NVS stores each integer in one 32-byte entry; a 4 KB page holds 126 of them.
+// One page per partition is kept free for garbage collection.
+#define NVS_PAGE_SIZE 4096
+#define NVS_ENTRIES_PER_PAGE 126
+#define SECONDS_PER_YEAR (365.0f * 24 * 3600)
+
+typedef struct {
+    char key[NVS_CACHE_KEY_MAX_LEN + 1];
+    int32_t value;
+    int32_t persisted;
+    int32_t significant_delta;
+    bool dirty;
+} cache_entry_t;
+
+static cache_entry_t entries[NVS_CACHE_MAX_ENTRIES];
+static int entry_count = 0;
+
+// Guards the table for RAM-only updates; never held across a flash operation
+static portMUX_TYPE cache_lock = portMUX_INITIALIZER_UNLOCKED;
+// Serialises flushes so the flush task and an explicit flush never interleave
+static SemaphoreHandle_t flush_mutex = NULL;
+static TaskHandle_t flush_task_handle = NULL;
+static uint32_t flush_interval_s = 0;
+
+static uint32_t stat_updates = 0;
+static uint32_t stat_entries_written = 0;
+static uint32_t stat_flushes = 0;
+static uint32_t stat_flush_failures = 0;
+static int64_t stat_max_flush_us = 0;
+
+static int find_entry(const char *key) {
+    for (int i = 0; i < entry_count; i++) {
+        if (strcmp(entries[i].key, key) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void flush_task(void *arg) {
+    while (1) {
+        // Woken early by a significant change or nvs_cache_request_flush()
+        ulTaskNotifyTake(pdTRUE, (TickType_t)flush_interval_s * configTICK_RATE_HZ);
+        nvs_cache_flush();
+    }
+}
+
+static void shutdown_flush(void) {
+    // esp_restart() runs this; a brownout reset does not, which bounds the loss to one interval
+    nvs_cache_flush();
+}
+
+esp_err_t nvs_cache_init(uint32_t interval_s) {
+    if (interval_s == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (flush_task_handle != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    flush_interval_s = interval_s;
+    flush_mutex = static_alloc_mutex();
+    if (flush_mutex == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = task_map_create(TASK_NVS_CACHE, flush_task, NULL, &flush_task_handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ret = esp_register_shutdown_handler(shutdown_flush);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Shutdown flush not registered: %s", esp_err_to_name(ret));
+    }
+
+    ESP_LOGI(TAG, "Write-back cache flushing every %lu s", (unsigned long)interval_s);
+    return ESP_OK;
+}
+
+esp_err_t nvs_cache_register(const char *key, int32_t significant_delta) {
+    if (key == NULL || strlen(key) > NVS_CACHE_KEY_MAX_LEN || significant_delta < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (find_entry(key) >= 0) {
+        return ESP_OK;
+    }
+    if (entry_count >= NVS_CACHE_MAX_ENTRIES) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    int32_t value = 0;
+    esp_err_t ret = nvs_storage_load_int(key, &value);
+    if (ret != ESP_OK && ret != ESP_ERR_NVS_NOT_FOUND) {
+        return ret;
+    }
+
+    portENTER_CRITICAL(&cache_lock);
+    cache_entry_t *entry = &entries[entry_count];
+    strcpy(entry->key, key);
+    entry->value = value;
+    entry->persisted = value;
+    entry->significant_delta = significant_delta;
+    entry->dirty = false;
+    entry_count++;
+    portEXIT_CRITICAL(&cache_lock);
+    return ESP_OK;
+}
+
+static esp_err_t update(const char *key, int32_t value, bool relative) {
+    if (key == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    bool significant = false;
+    portENTER_CRITICAL(&cache_lock);
+    int index = find_entry(key);
+    if (index >= 0) {
+        cache_entry_t *entry = &entries[index];
+        int32_t next = relative ? entry->value + value : value;
+        if (next != entry->value) {
+            entry->value = next;
+            entry->dirty = next != entry->persisted;
+            stat_updates++;
+
+            int32_t drift = next - entry->persisted;
+            if (drift < 0) {
+                drift = -drift;
+            }
+            significant = entry->significant_delta > 0 && drift >= entry->significant_delta;
+        }
+    }
+    portEXIT_CRITICAL(&cache_lock);
+
+    if (index < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (significant) {
+        nvs_cache_request_flush();
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_cache_set(const char *key, int32_t value) { return update(key, value, false); }
+
+esp_err_t nvs_cache_add(const char *key, int32_t delta) { return update(key, delta, true); }
+
+esp_err_t nvs_cache_get(const char *key, int32_t *value) {
+    if (key == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&cache_lock);
+    int index = find_entry(key);
+    if (index >= 0) {
+        *value = entries[index].value;
+    }
+    portEXIT_CRITICAL(&cache_lock);
+
+    return index >= 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t nvs_cache_flush(void) {
+    if (flush_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(flush_mutex, portMAX_DELAY);
+
+    // Snapshot dirty values, then write them with the table unlocked so updates never wait on flash
+    int pending_index[NVS_CACHE_MAX_ENTRIES];
+    int32_t pending_value[NVS_CACHE_MAX_ENTRIES];
+    int pending = 0;
+    portENTER_CRITICAL(&cache_lock);
+    for (int i = 0; i < entry_count; i++) {
+        if (entries[i].dirty) {
+            pending_index[pending] = i;
+            pending_value[pending] = entries[i].value;
+            pending++;
+        }
+    }
+    portEXIT_CRITICAL(&cache_lock);
+
+    if (pending == 0) {
+        xSemaphoreGive(flush_mutex);
+        return ESP_OK;
+    }
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = nvs_storage_begin_batch();
+    for (int i = 0; i < pending && ret == ESP_OK; i++) {
+        ret = nvs_storage_save_int(entries[pending_index[i]].key, pending_value[i]);
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_storage_end_batch();
+    } else {
+        nvs_storage_end_batch();
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    portENTER_CRITICAL(&cache_lock);
+    if (ret == ESP_OK) {
+        for (int i = 0; i < pending; i++) {
+            cache_entry_t *entry = &entries[pending_index[i]];
+            entry->persisted = pending_value[i];
+            // An update that landed during the write keeps the entry dirty
+            entry->dirty = entry->value != entry->persisted;
+        }
+        stat_entries_written += pending;
+        stat_flushes++;
+    } else {
+        stat_flush_failures++;
+    }
+    if (elapsed > stat_max_flush_us) {
+        stat_max_flush_us = elapsed;
+    }
+    portEXIT_CRITICAL(&cache_lock);
+
+    xSemaphoreGive(flush_mutex);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Flush of %d counters failed: %s", pending, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+void nvs_cache_request_flush(void) {
+    if (flush_task_handle != NULL) {
+        xTaskNotifyGive(flush_task_handle);
+    }
+}
+
+esp_err_t nvs_cache_get_report(nvs_cache_report_t *report) {
+    if (report == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(report, 0, sizeof(*report));
+    portENTER_CRITICAL(&cache_lock);
+    report->entries = entry_count;
+    for (int i = 0; i < entry_count; i++) {
+        if (entries[i].dirty) {
+            report->dirty++;
+        }
+    }
+    report->updates = stat_updates;
+    report->entries_written = stat_entries_written;
+    report->flushes = stat_flushes;
+    report->flush_failures = stat_flush_failures;
+    report->max_flush_us = stat_max_flush_us;
+    portEXIT_CRITICAL(&cache_lock);
+
+    if (report->updates > 0) {
+        report->write_ratio = (float)report->entries_written / report->updates;
+    }
+
+    // Entries the partition can absorb before its pages reach their erase endurance
+    float capacity = (float)(NVS_PARTITION_SIZE / NVS_PAGE_SIZE - 1) * NVS_ENTRIES_PER_PAGE * FLASH_ERASE_CYCLES;
+    float uptime_years = esp_timer_get_time() / 1e6f / SECONDS_PER_YEAR;
+    if (uptime_years > 0 && report->entries_written > 0) {
+        report->lifetime_years = capacity / (report->entries_written / uptime_years);
+    }
+    if (uptime_years > 0 && report->updates > 0) {
+        report->write_through_years = capacity / (report->updates / uptime_years);
+    }
+    return ESP_OK;
+}
+
+void nvs_cache_log_report(void) {
+    nvs_cache_report_t report;
+    nvs_cache_get_report(&report);
+
+    ESP_LOGI(TAG,
+             "%lu updates -> %lu NVS writes in %lu flushes (ratio %.3f), max flush %lld us",
+             (unsigned long)report.updates,
+             (unsigned long)report.entries_written,
+             (unsigned long)report.flushes,
+             report.write_ratio,
+             (long long)report.max_flush_us);
+    ESP_LOGI(TAG,
+             "Flash lifetime at this rate: %.0f years (write-through: %.0f years)",
+             report.lifetime_years,
+             report.write_through_years);
+}
@@ -0,0 +1,227 @@
+#include "config.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "nvs_storage.h"
+#include "nvs_storage_priv.h"
+#include <stddef.h>
+#include <string.h>
+
+static const char *TAG = "config_blob";
+
+#define CONFIG_MAGIC 0x47464350 // "PCFG"
+// Room for blobs from newer firmware; their known prefix is still usable after a downgrade
+#define CONFIG_BLOB_MAX 512
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length; // Payload bytes following the header
+    uint32_t sequence;
+    uint32_t crc; // Over the header up to here and the payload
+} config_header_t;
+
+static const char *SLOT_KEYS[2] = {NVS_KEY_CONFIG_A, NVS_KEY_CONFIG_B};
+static const char *LEGACY_KEYS[] = {NVS_KEY_WIFI_SSID, NVS_KEY_WIFI_PASS, NVS_KEY_PUMP_MODE, "daily_runtime"};
+
+// RAM copy of the newest slot; only touched with the storage lock held through a batch
+static nvs_config_t current;
+static nvs_config_info_t info = {.slot = '-'};
+static int active_slot = -1;
+static bool loaded = false;
+static uint8_t blob[CONFIG_BLOB_MAX];
+
+// Version 0 -> 1: import the individual keys written by earlier firmware
+static esp_err_t migrate_from_keys(nvs_config_t *config) {
+    int32_t value;
+    nvs_storage_load_string(NVS_KEY_WIFI_SSID, config->wifi_ssid, sizeof(config->wifi_ssid));
+    nvs_storage_load_string(NVS_KEY_WIFI_PASS, config->wifi_password, sizeof(config->wifi_password));
+    if (nvs_storage_load_int(NVS_KEY_PUMP_MODE, &value) == ESP_OK) {
+        config->pump_mode = (uint8_t)value;
+    }
+    if (nvs_storage_load_int("daily_runtime", &value) == ESP_OK) {
+        config->daily_runtime = (uint16_t)value;
+    }
+    return ESP_OK;
+}
+
+// migrations[n] upgrades a configuration from version n to n + 1
+static esp_err_t (*const migrations[NVS_CONFIG_VERSION])(nvs_config_t *config) = {
+    migrate_from_keys,
+};
+
+static void set_defaults(nvs_config_t *config) {
+    memset(config, 0, sizeof(*config));
+    config->daily_runtime = MIN_DAILY_RUNTIME_HOURS * 60;
+}
+
+static uint32_t blob_crc(const config_header_t *header, const uint8_t *payload) {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)header, offsetof(config_header_t, crc));
+    return esp_rom_crc32_le(crc, payload, header->length);
+}
+
+// One blob read; fills config and header only if the slot is intact
+static bool read_slot(int slot, config_header_t *header, nvs_config_t *config) {
+    size_t length = sizeof(blob);
+    if (nvs_storage_load_blob(SLOT_KEYS[slot], blob, &length) != ESP_OK || length < sizeof(*header)) {
+        return false;
+    }
+
+    memcpy(header, blob, sizeof(*header));
+    const uint8_t *payload = blob + sizeof(*header);
+    if (header->magic != CONFIG_MAGIC || header->version == 0 || header->length != length - sizeof(*header) ||
+        header->crc != blob_crc(header, payload)) {
+        ESP_LOGW(TAG, "Config slot %c is damaged, ignoring it", 'A' + slot);
+        return false;
+    }
+
+    // Fields missing from an older layout stay zero until a migration fills them
+    memset(config, 0, sizeof(*config));
+    memcpy(config, payload, header->length < sizeof(*config) ? header->length : sizeof(*config));
+    return true;
+}
+
+static esp_err_t write_slot_locked(const nvs_config_t *config) {
+    int slot = active_slot == 0 ? 1 : 0;
+    config_header_t header = {
+        .magic = CONFIG_MAGIC,
+        .version = NVS_CONFIG_VERSION,
+        .length = sizeof(*config),
+        .sequence = info.sequence + 1,
+    };
+    memcpy(blob + sizeof(header), config, sizeof(*config));
+    header.crc = blob_crc(&header, blob + sizeof(header));
+    memcpy(blob, &header, sizeof(header));
+
+    esp_err_t ret = nvs_storage_save_blob(SLOT_KEYS[slot], blob, sizeof(header) + sizeof(*config));
+    if (ret == ESP_OK) {
+        current = *config;
+        active_slot = slot;
+        info.sequence = header.sequence;
+        info.slot = 'A' + slot;
+    }
+    return ret;
+}
+
+static esp_err_t ensure_loaded_locked(void) {
+    if (loaded) {
+        return ESP_OK;
+    }
+
+    config_header_t headers[2];
+    nvs_config_t configs[2];
+    bool valid[2];
+    for (int slot = 0; slot < 2; slot++) {
+        valid[slot] = read_slot(slot, &headers[slot], &configs[slot]);
+    }
+
+    int newest = -1;
+    if (valid[0] && valid[1]) {
+        // Wrap-safe comparison of the save counters
+        newest = (int32_t)(headers[1].sequence - headers[0].sequence) > 0 ? 1 : 0;
+    } else if (valid[0] || valid[1]) {
+        newest = valid[0] ? 0 : 1;
+    }
+
+    nvs_config_t config;
+    uint16_t version = 0;
+    if (newest >= 0) {
+        config = configs[newest];
+        version = headers[newest].version;
+        active_slot = newest;
+        info.sequence = headers[newest].sequence;
+        info.slot = 'A' + newest;
+    } else {
+        set_defaults(&config);
+    }
+    info.stored_version = version;
+    current = config;
+
+    esp_err_t ret = ESP_OK;
+    if (version < NVS_CONFIG_VERSION) {
+        for (uint16_t v = version; v < NVS_CONFIG_VERSION && ret == ESP_OK; v++) {
+            ESP_LOGI(TAG, "Migrating config from version %u to %u", v, v + 1);
+            ret = migrations[v](&config);
+        }
+        // Saved once, so the migrations do not run again on the next boot
+        if (ret == ESP_OK) {
+            ret = write_slot_locked(&config);
+        }
+        if (ret == ESP_OK && version == 0) {
+            // The blob is written first: a reset in between leaves stale keys, never no config
+            for (size_t i = 0; i < sizeof(LEGACY_KEYS) / sizeof(LEGACY_KEYS[0]); i++) {
+                nvs_storage_erase(LEGACY_KEYS[i]);
+            }
+        }
+        info.migrated = ret == ESP_OK;
+    } else if (version > NVS_CONFIG_VERSION) {
+        ESP_LOGW(TAG,
+                 "Config version %u is newer than %u, using the fields this firmware knows",
+                 version,
+                 NVS_CONFIG_VERSION);
+    }
+
+    if (ret == ESP_OK) {
+        loaded = true;
+        ESP_LOGI(TAG,
+                 "Config v%u loaded from slot %c (sequence %lu)",
+                 NVS_CONFIG_VERSION,
+                 info.slot,
+                 (unsigned long)info.sequence);
+    }
+    return ret;
+}
+
+void config_blob_invalidate(void) {
+    loaded = false;
+    active_slot = -1;
+    info = (nvs_config_info_t){.slot = '-'};
+}
+
+esp_err_t nvs_storage_load_config(nvs_config_t *config) {
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = nvs_storage_begin_batch();
+    if (ret != ESP_OK) return ret;
+
+    ret = ensure_loaded_locked();
+    if (ret == ESP_OK) {
+        *config = current;
+    }
+
+    esp_err_t end = nvs_storage_end_batch();
+    return ret != ESP_OK ? ret : end;
+}
+
+esp_err_t nvs_storage_save_config(const nvs_config_t *config) {
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = nvs_storage_begin_batch();
+    if (ret != ESP_OK) return ret;
+
+    ret = ensure_loaded_locked();
+    if (ret == ESP_OK && memcmp(config, &current, sizeof(*config)) != 0) {
+        ret = write_slot_locked(config);
+    }
+
+    esp_err_t end = nvs_storage_end_batch();
+    return ret != ESP_OK ? ret : end;
+}
+
+esp_err_t nvs_storage_get_config_info(nvs_config_info_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = nvs_storage_begin_batch();
+    if (ret != ESP_OK) return ret;
+
+    ret = ensure_loaded_locked();
+    *out = info;
+
+    esp_err_t end = nvs_storage_end_batch();
+    return ret != ESP_OK ? ret : end;
+}
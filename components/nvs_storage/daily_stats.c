@@ -0,0 +1,334 @@
+#include "config.h"
+#include "esp_log.h"
+#include "nvs_storage.h"
+#include "nvs_storage_priv.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "daily_stats";
+
+#define DAILY_STATS_VERSION 1
+#define DAILY_STATS_CAPACITY (DAILY_STATS_CHUNKS * DAILY_STATS_CHUNK_DAYS)
+#define EPOCH_YEAR 2020 // Day numbers count from 2020-01-01
+
+static const char *META_KEY = "ds_meta";
+
+// Stored form of one day; fixed-point so a year of history is about 6 KB
+typedef struct __attribute__((packed)) {
+    uint16_t day; // Days since EPOCH_YEAR-01-01
+    uint16_t runtime_minutes[NVS_DAILY_STATS_MODES];
+    uint16_t energy_wh;
+    int16_t cost_meur;           // 0.001 EUR
+    int16_t avg_price_deci_meur; // 0.0001 EUR/kWh
+    int16_t min_price_deci_meur; // 0.0001 EUR/kWh
+    uint8_t starts;
+} daily_record_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t record_size; // Guards against a layout change without a version bump
+    uint16_t head;       // Slot the next day goes into
+    uint16_t count;      // Days stored
+} daily_meta_t;
+
+// Only touched with the storage lock held through a batch
+static daily_record_t chunk[DAILY_STATS_CHUNK_DAYS];
+static int loaded_chunk = -1;
+
+void daily_stats_invalidate(void) { loaded_chunk = -1; }
+
+static int32_t days_from_civil(int32_t y, int32_t m, int32_t d) {
+    // Howard Hinnant's algorithm, exact for the proleptic Gregorian calendar
+    y -= m <= 2;
+    int32_t era = (y >= 0 ? y : y - 399) / 400;
+    int32_t yoe = y - era * 400;
+    int32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static uint16_t date_to_day(uint32_t date) {
+    int32_t days = days_from_civil(date / 10000, date / 100 % 100, date % 100) - days_from_civil(EPOCH_YEAR, 1, 1);
+    if (days < 0) return 0;
+    return days > UINT16_MAX ? UINT16_MAX : (uint16_t)days;
+}
+
+static uint32_t day_to_date(uint16_t day) {
+    int32_t z = day + days_from_civil(EPOCH_YEAR, 1, 1) + 719468;
+    int32_t era = z / 146097;
+    int32_t doe = z - era * 146097;
+    int32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int32_t mp = (5 * doy + 2) / 153;
+    int32_t d = doy - (153 * mp + 2) / 5 + 1;
+    int32_t m = mp < 10 ? mp + 3 : mp - 9;
+    int32_t y = yoe + era * 400 + (m <= 2);
+    return (uint32_t)(y * 10000 + m * 100 + d);
+}
+
+static int32_t to_fixed(float value, float scale, int32_t min, int32_t max) {
+    float scaled = value * scale + (value < 0 ? -0.5f : 0.5f);
+    if (scaled <= (float)min) return min;
+    if (scaled >= (float)max) return max;
+    return (int32_t)scaled;
+}
+
+static void pack(const nvs_daily_stats_t *stats, daily_record_t *record) {
+    record->day = date_to_day(stats->date);
+    for (int i = 0; i < NVS_DAILY_STATS_MODES; i++) {
+        record->runtime_minutes[i] = stats->runtime_minutes[i];
+    }
+    record->energy_wh = (uint16_t)to_fixed(stats->energy_kwh, 1000.0f, 0, UINT16_MAX);
+    record->cost_meur = (int16_t)to_fixed(stats->cost_eur, 1000.0f, INT16_MIN, INT16_MAX);
+    record->avg_price_deci_meur = (int16_t)to_fixed(stats->avg_price, 10000.0f, INT16_MIN, INT16_MAX);
+    record->min_price_deci_meur = (int16_t)to_fixed(stats->min_price, 10000.0f, INT16_MIN, INT16_MAX);
+    record->starts = stats->starts;
+}
+
+static void unpack(const daily_record_t *record, nvs_daily_stats_t *stats) {
+    stats->date = day_to_date(record->day);
+    for (int i = 0; i < NVS_DAILY_STATS_MODES; i++) {
+        stats->runtime_minutes[i] = record->runtime_minutes[i];
+    }
+    stats->energy_kwh = record->energy_wh / 1000.0f;
+    stats->cost_eur = record->cost_meur / 1000.0f;
+    stats->avg_price = record->avg_price_deci_meur / 10000.0f;
+    stats->min_price = record->min_price_deci_meur / 10000.0f;
+    stats->starts = record->starts;
+}
+
+static void chunk_key(int index, char *key) { sprintf(key, "ds_%d", index); }
+
+static esp_err_t load_meta(daily_meta_t *meta) {
+    size_t length = sizeof(*meta);
+    esp_err_t ret = nvs_storage_load_blob(META_KEY, meta, &length);
+    if (ret == ESP_OK && length == sizeof(*meta) && meta->version == DAILY_STATS_VERSION &&
+        meta->record_size == sizeof(daily_record_t) && meta->count <= DAILY_STATS_CAPACITY &&
+        meta->head < DAILY_STATS_CAPACITY) {
+        return ESP_OK;
+    }
+    if (ret == ESP_OK) {
+        ESP_LOGW(TAG, "Daily history has an unknown layout, starting over");
+    } else if (ret != ESP_ERR_NVS_NOT_FOUND) {
+        return ret;
+    }
+
+    memset(meta, 0, sizeof(*meta));
+    meta->version = DAILY_STATS_VERSION;
+    meta->record_size = sizeof(daily_record_t);
+    return ESP_OK;
+}
+
+// One blob read per chunk; a missing or short chunk reads as empty
+static esp_err_t load_chunk(int index) {
+    if (index == loaded_chunk) {
+        return ESP_OK;
+    }
+
+    char key[8];
+    chunk_key(index, key);
+    size_t length = sizeof(chunk);
+    esp_err_t ret = nvs_storage_load_blob(key, chunk, &length);
+    if (ret == ESP_ERR_NVS_NOT_FOUND || (ret == ESP_OK && length != sizeof(chunk))) {
+        memset(chunk, 0, sizeof(chunk));
+        ret = ESP_OK;
+    }
+    loaded_chunk = ret == ESP_OK ? index : -1;
+    return ret;
+}
+
+static const daily_record_t *record_at(const daily_meta_t *meta, int ordinal, esp_err_t *ret) {
+    int slot = (meta->head + DAILY_STATS_CAPACITY - meta->count + ordinal) % DAILY_STATS_CAPACITY;
+    *ret = load_chunk(slot / DAILY_STATS_CHUNK_DAYS);
+    return &chunk[slot % DAILY_STATS_CHUNK_DAYS];
+}
+
+esp_err_t nvs_storage_set_daily_stats(const nvs_daily_stats_t *stats) {
+    if (stats == NULL || stats->date < EPOCH_YEAR * 10000) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = nvs_storage_begin_batch();
+    if (ret != ESP_OK) return ret;
+
+    daily_meta_t meta;
+    ret = load_meta(&meta);
+
+    daily_record_t record;
+    pack(stats, &record);
+    int slot = meta.head;
+    if (ret == ESP_OK && meta.count > 0) {
+        const daily_record_t *newest = record_at(&meta, meta.count - 1, &ret);
+        if (ret == ESP_OK && record.day < newest->day) {
+            ret = ESP_ERR_INVALID_ARG;
+        } else if (ret == ESP_OK && record.day == newest->day) {
+            slot = (meta.head + DAILY_STATS_CAPACITY - 1) % DAILY_STATS_CAPACITY;
+        }
+    }
+
+    if (ret == ESP_OK) {
+        ret = load_chunk(slot / DAILY_STATS_CHUNK_DAYS);
+    }
+    if (ret == ESP_OK) {
+        chunk[slot % DAILY_STATS_CHUNK_DAYS] = record;
+        char key[8];
+        chunk_key(slot / DAILY_STATS_CHUNK_DAYS, key);
+        ret = nvs_storage_save_blob(key, chunk, sizeof(chunk));
+    }
+    if (ret == ESP_OK && slot == meta.head) {
+        meta.head = (meta.head + 1) % DAILY_STATS_CAPACITY;
+        if (meta.count < DAILY_STATS_CAPACITY) {
+            meta.count++;
+        }
+        ret = nvs_storage_save_blob(META_KEY, &meta, sizeof(meta));
+    }
+
+    // Chunk and ring position are committed together
+    esp_err_t end = nvs_storage_end_batch();
+    if (ret != ESP_OK || end != ESP_OK) {
+        // The cached chunk may hold a record that never reached flash
+        loaded_chunk = -1;
+    }
+    return ret != ESP_OK ? ret : end;
+}
+
+esp_err_t nvs_storage_get_daily_stats_range(uint32_t from_date,
+                                            uint32_t to_date,
+                                            nvs_daily_stats_t *out,
+                                            size_t max_records,
+                                            size_t *count) {
+    if (count == NULL || (out == NULL && max_records > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *count = 0;
+
+    esp_err_t ret = nvs_storage_begin_batch();
+    if (ret != ESP_OK) return ret;
+
+    daily_meta_t meta;
+    ret = load_meta(&meta);
+    uint16_t from_day = date_to_day(from_date);
+    uint16_t to_day = date_to_day(to_date);
+    for (int i = 0; i < meta.count && ret == ESP_OK; i++) {
+        const daily_record_t *record = record_at(&meta, i, &ret);
+        if (ret != ESP_OK || record->day > to_day) {
+            break;
+        }
+        if (record->day < from_day) {
+            continue;
+        }
+        if (*count < max_records) {
+            unpack(record, &out[*count]);
+        }
+        (*count)++;
+    }
+
+    esp_err_t end = nvs_storage_end_batch();
+    return ret != ESP_OK ? ret : end;
+}
+
+esp_err_t nvs_storage_sum_daily_stats(uint32_t from_date, uint32_t to_date, nvs_daily_stats_t *total, size_t *days) {
+    if (total == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(total, 0, sizeof(*total));
+
+    esp_err_t ret = nvs_storage_begin_batch();
+    if (ret != ESP_OK) return ret;
+
+    daily_meta_t meta;
+    ret = load_meta(&meta);
+    uint16_t from_day = date_to_day(from_date);
+    uint16_t to_day = date_to_day(to_date);
+    size_t summed = 0;
+    float priced_energy = 0;
+    for (int i = 0; i < meta.count && ret == ESP_OK; i++) {
+        const daily_record_t *record = record_at(&meta, i, &ret);
+        if (ret != ESP_OK || record->day > to_day) {
+            break;
+        }
+        if (record->day < from_day) {
+            continue;
+        }
+
+        nvs_daily_stats_t day;
+        unpack(record, &day);
+        for (int m = 0; m < NVS_DAILY_STATS_MODES; m++) {
+            total->runtime_minutes[m] += day.runtime_minutes[m];
+        }
+        total->energy_kwh += day.energy_kwh;
+        total->cost_eur += day.cost_eur;
+        priced_energy += day.avg_price * day.energy_kwh;
+        if (summed == 0 || day.min_price < total->min_price) {
+            total->min_price = day.min_price;
+        }
+        total->starts = total->starts + day.starts > UINT8_MAX ? UINT8_MAX : total->starts + day.starts;
+        total->date = day.date;
+        summed++;
+    }
+    if (total->energy_kwh > 0) {
+        total->avg_price = priced_energy / total->energy_kwh;
+    }
+    if (days != NULL) {
+        *days = summed;
+    }
+
+    esp_err_t end = nvs_storage_end_batch();
+    return ret != ESP_OK ? ret : end;
+}
+
+esp_err_t nvs_storage_drop_daily_stats_after(uint32_t date, size_t *dropped) {
+    if (date < EPOCH_YEAR * 10000) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = nvs_storage_begin_batch();
+    if (ret != ESP_OK) return ret;
+
+    daily_meta_t meta;
+    ret = load_meta(&meta);
+    uint16_t day = date_to_day(date);
+    size_t count = 0;
+    while (ret == ESP_OK && meta.count > 0) {
+        const daily_record_t *newest = record_at(&meta, meta.count - 1, &ret);
+        if (ret != ESP_OK || newest->day <= day) {
+            break;
+        }
+        // The record stays in its chunk until the ring comes round to the slot again
+        meta.head = (meta.head + DAILY_STATS_CAPACITY - 1) % DAILY_STATS_CAPACITY;
+        meta.count--;
+        count++;
+    }
+    if (ret == ESP_OK && count > 0) {
+        ret = nvs_storage_save_blob(META_KEY, &meta, sizeof(meta));
+    }
+
+    esp_err_t end = nvs_storage_end_batch();
+    if (dropped != NULL) {
+        *dropped = ret == ESP_OK ? count : 0;
+    }
+    return ret != ESP_OK ? ret : end;
+}
+
+esp_err_t nvs_storage_clear_daily_stats(void) {
+    esp_err_t ret = nvs_storage_begin_batch();
+    if (ret != ESP_OK) return ret;
+
+    for (int i = 0; i < DAILY_STATS_CHUNKS; i++) {
+        char key[8];
+        chunk_key(i, key);
+        esp_err_t erased = nvs_storage_erase(key);
+        if (erased != ESP_OK && erased != ESP_ERR_NVS_NOT_FOUND) {
+            ret = erased;
+        }
+    }
+    esp_err_t erased = nvs_storage_erase(META_KEY);
+    if (erased != ESP_OK && erased != ESP_ERR_NVS_NOT_FOUND) {
+        ret = erased;
+    }
+    loaded_chunk = -1;
+
+    esp_err_t end = nvs_storage_end_batch();
+    return ret != ESP_OK ? ret : end;
+}
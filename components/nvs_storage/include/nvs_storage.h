@@ -2,14 +2,107 @@
 #define NVS_STORAGE_H
 
 #include "esp_err.h"
+#include "nvs.h"
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+typedef struct {
+    uint32_t commits;       // nvs_commit calls
+    uint32_t writes;        // Values written or erased
+    uint32_t reads;         // Values read
+    int64_t last_commit_us; // Duration of the most recent commit
+    int64_t max_commit_us;  // Longest commit so far
+} nvs_storage_stats_t;
+
+#define NVS_CONFIG_VERSION 1
+
+// Persistent configuration, stored as one CRC-protected blob. Fields are append-only:
+// a blob written by an older version is zero-extended and brought up to date by migrations.
+typedef struct {
+    char wifi_ssid[32];
+    char wifi_password[64];
+    uint8_t pump_mode;
+    uint16_t daily_runtime; // Minutes
+} nvs_config_t;
+
+typedef struct {
+    uint16_t stored_version; // Schema version found at boot, 0 for individual keys or nothing
+    uint32_t sequence;       // Increments with every save; the higher slot wins
+    char slot;               // 'A' or 'B', '-' before the first save
+    bool migrated;           // Boot ran at least one migration
+} nvs_config_info_t;
+
+#define NVS_DAILY_STATS_MODES 3 // Night, day and backwash, in pump_mode_t order after off
+
+// One day of pump history; stored packed into 17 bytes, so values are rounded on the way in
+typedef struct {
+    uint32_t date;                                   // YYYYMMDD
+    uint16_t runtime_minutes[NVS_DAILY_STATS_MODES]; // Minutes in night, day and backwash mode
+    float energy_kwh;                                // 1 Wh resolution, at most 65.5 kWh
+    float cost_eur;                                  // 0.001 EUR resolution, may be negative
+    float avg_price;                                 // Energy-weighted price paid, EUR/kWh
+    float min_price;                                 // Lowest price paid while running, EUR/kWh
+    uint8_t starts;                                  // Pump starts
+} nvs_daily_stats_t;
+
 /**
- * @brief Initialize NVS storage
+ * @brief Initialize NVS storage and open the namespace handle used by all calls
  * @return ESP_OK on success
  */
 esp_err_t nvs_storage_init(void);
 
+/**
+ * @brief Close the namespace handle; writes outside a batch are already committed
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE when not initialized or called inside a batch
+ */
+esp_err_t nvs_storage_deinit(void);
+
+/**
+ * @brief Start a batch: writes until the matching end are committed together
+ *
+ * Batches nest; only the outermost end commits. The calling task holds the storage lock
+ * for the whole batch, so writes from other tasks wait rather than join it.
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t nvs_storage_begin_batch(void);
+
+/**
+ * @brief End a batch, committing its writes in one nvs_commit if it is the outermost
+ * @return ESP_OK on success
+ */
+esp_err_t nvs_storage_end_batch(void);
+
+/**
+ * @brief Get the configuration, loading it on first use
+ *
+ * Both slots are read once and the valid one with the higher sequence wins. Migrations run
+ * when its version is older than NVS_CONFIG_VERSION, and their result is saved once.
+ * With no valid slot the individual keys of earlier firmware are imported.
+ *
+ * @param config Pointer to store the configuration
+ * @return ESP_OK on success
+ */
+esp_err_t nvs_storage_load_config(nvs_config_t *config);
+
+/**
+ * @brief Save the configuration into the older slot in a single blob write
+ *
+ * The newer slot is left untouched, so a write torn by a reset falls back to it.
+ *
+ * @param config Configuration to save
+ * @return ESP_OK on success
+ */
+esp_err_t nvs_storage_save_config(const nvs_config_t *config);
+
+/**
+ * @brief Describe where the configuration came from
+ * @param info Pointer to store the description
+ * @return ESP_OK on success
+ */
+esp_err_t nvs_storage_get_config_info(nvs_config_info_t *info);
+
 /**
  * @brief Store WiFi credentials
  * @param ssid WiFi SSID
@@ -43,13 +136,62 @@ esp_err_t nvs_storage_set_pump_config(uint8_t mode, uint16_t daily_runtime);
 esp_err_t nvs_storage_get_pump_config(uint8_t *mode, uint16_t *daily_runtime);
 
 /**
- * @brief Store daily statistics
- * @param date Date in YYYYMMDD format
- * @param runtime_minutes Runtime in minutes
- * @param avg_price Average electricity price
+ * @brief Store a day's statistics in the daily history ring
+ *
+ * The ring holds DAILY_STATS_CHUNKS * DAILY_STATS_CHUNK_DAYS days; the oldest day is dropped
+ * once it is full. Only the chunk holding the new record is rewritten.
+ *
+ * @param stats Statistics; a date equal to the newest stored day replaces that day
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a date older than the newest stored day
+ */
+esp_err_t nvs_storage_set_daily_stats(const nvs_daily_stats_t *stats);
+
+/**
+ * @brief Read stored days within a date range, oldest first
+ * @param from_date First date, YYYYMMDD, inclusive
+ * @param to_date Last date, YYYYMMDD, inclusive
+ * @param out Array for the records, may be NULL to only count
+ * @param max_records Capacity of out
+ * @param count Pointer to store the number of matching days (may exceed max_records)
+ * @return ESP_OK on success
+ */
+esp_err_t nvs_storage_get_daily_stats_range(uint32_t from_date,
+                                            uint32_t to_date,
+                                            nvs_daily_stats_t *out,
+                                            size_t max_records,
+                                            size_t *count);
+
+/**
+ * @brief Sum stored days within a date range for telemetry
+ *
+ * Runtimes, energy, cost and starts are added up; avg_price is weighted by energy, min_price is
+ * the lowest of the days and date is the newest day in the range.
+ *
+ * @param from_date First date, YYYYMMDD, inclusive
+ * @param to_date Last date, YYYYMMDD, inclusive
+ * @param total Pointer to store the totals
+ * @param days Pointer to store the number of days summed, may be NULL
+ * @return ESP_OK on success
+ */
+esp_err_t nvs_storage_sum_daily_stats(uint32_t from_date, uint32_t to_date, nvs_daily_stats_t *total, size_t *days);
+
+/**
+ * @brief Drop stored days dated after a date
+ *
+ * For history written while the clock was wrongly ahead: without it the newest, future day would
+ * refuse every real day that follows.
+ *
+ * @param date Newest date to keep, YYYYMMDD
+ * @param dropped Pointer to store the number of days dropped, may be NULL
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a date before 2020
+ */
+esp_err_t nvs_storage_drop_daily_stats_after(uint32_t date, size_t *dropped);
+
+/**
+ * @brief Drop the whole daily history
  * @return ESP_OK on success
  */
-esp_err_t nvs_storage_set_daily_stats(uint32_t date, uint16_t runtime_minutes, float avg_price);
+esp_err_t nvs_storage_clear_daily_stats(void);
 
 /**
  * @brief Erase a key from NVS
@@ -91,4 +233,29 @@ esp_err_t nvs_storage_save_int(const char *key, int32_t value);
  */
 esp_err_t nvs_storage_load_int(const char *key, int32_t *value);
 
+/**
+ * @brief Save a binary blob to NVS
+ * @param key Key to save
+ * @param data Data to save
+ * @param length Length of data in bytes
+ * @return ESP_OK on success
+ */
+esp_err_t nvs_storage_save_blob(const char *key, const void *data, size_t length);
+
+/**
+ * @brief Load a binary blob from NVS
+ * @param key Key to load
+ * @param buffer Buffer to store the data
+ * @param length In: size of buffer; out: length of the stored blob
+ * @return ESP_OK on success
+ */
+esp_err_t nvs_storage_load_blob(const char *key, void *buffer, size_t *length);
+
+/**
+ * @brief Get commit and access counters
+ * @param stats Pointer to store statistics
+ * @return ESP_OK on success
+ */
+esp_err_t nvs_storage_get_stats(nvs_storage_stats_t *stats);
+
 #endif // NVS_STORAGE_H
@@ -1,12 +1,75 @@
 #include "nvs_storage.h"
+#include "nvs_storage_priv.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "nvs.h"
 #include "nvs_flash.h"
+#include "pool_pump/static_alloc.h"
+#include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 
 static const char *TAG = "nvs_storage";
 static const char *NVS_NAMESPACE = "pool_pump";
 
+// One handle for the lifetime of the component instead of an open/commit/close per value
+static nvs_handle_t storage_handle = 0;
+static bool handle_open = false;
+
+// Held for the whole of a batch so other tasks' writes cannot slip into it
+static SemaphoreHandle_t nvs_mutex = NULL;
+static int batch_depth = 0;
+static bool batch_dirty = false;
+
+static nvs_storage_stats_t stats = {0};
+
+static esp_err_t commit_locked(void) {
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = nvs_commit(storage_handle);
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    stats.commits++;
+    stats.last_commit_us = elapsed;
+    if (elapsed > stats.max_commit_us) {
+        stats.max_commit_us = elapsed;
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Commit failed: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+// Take the lock for one operation; fails if the handle is not open
+static esp_err_t lock(void) {
+    if (!handle_open) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTakeRecursive(nvs_mutex, portMAX_DELAY);
+    // NVS grows its entry index on the heap as keys are written
+    static_alloc_exempt_begin();
+    return ESP_OK;
+}
+
+static void unlock(void) {
+    static_alloc_exempt_end();
+    xSemaphoreGiveRecursive(nvs_mutex);
+}
+
+// Finish a write: commit now, or leave it for the end of the enclosing batch
+static esp_err_t finish_write_locked(esp_err_t ret) {
+    stats.writes++;
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (batch_depth > 0) {
+        batch_dirty = true;
+        return ESP_OK;
+    }
+    return commit_locked();
+}
+
 esp_err_t nvs_storage_init(void) {
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -14,133 +77,229 @@ esp_err_t nvs_storage_init(void) {
         ret = nvs_flash_init();
     }
 
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "NVS storage initialized");
-    } else {
+    if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to initialize NVS storage: %s", esp_err_to_name(ret));
+        return ret;
     }
 
+    if (nvs_mutex == NULL) {
+        nvs_mutex = static_alloc_recursive_mutex();
+        if (nvs_mutex == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (!handle_open) {
+        ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &storage_handle);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(ret));
+            return ret;
+        }
+        handle_open = true;
+    }
+
+    ESP_LOGI(TAG, "NVS storage initialized");
+    return ESP_OK;
+}
+
+esp_err_t nvs_storage_deinit(void) {
+    esp_err_t ret = lock();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Only the batch's own task gets past the lock while it is open; it has to end the batch first
+    if (batch_depth > 0) {
+        ESP_LOGE(TAG, "Deinit inside a batch refused");
+        unlock();
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    config_blob_invalidate();
+    daily_stats_invalidate();
+    nvs_close(storage_handle);
+    handle_open = false;
+
+    unlock();
+    return ret;
+}
+
+esp_err_t nvs_storage_begin_batch(void) {
+    esp_err_t ret = lock();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // The lock stays held until the matching nvs_storage_end_batch()
+    batch_depth++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_storage_end_batch(void) {
+    if (!handle_open || batch_depth == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t ret = ESP_OK;
+    if (--batch_depth == 0 && batch_dirty) {
+        batch_dirty = false;
+        ret = commit_locked();
+    }
+
+    unlock();
     return ret;
 }
 
 esp_err_t nvs_storage_set_wifi_credentials(const char *ssid, const char *password) {
-    esp_err_t ret = nvs_storage_save_string("wifi_ssid", ssid);
+    nvs_config_t config;
+    esp_err_t ret = nvs_storage_load_config(&config);
     if (ret != ESP_OK) return ret;
-    return nvs_storage_save_string("wifi_pass", password);
+
+    snprintf(config.wifi_ssid, sizeof(config.wifi_ssid), "%s", ssid);
+    snprintf(config.wifi_password, sizeof(config.wifi_password), "%s", password);
+    ret = nvs_storage_save_config(&config);
+    ESP_LOGI(TAG, "WiFi credentials for \"%s\" %s", config.wifi_ssid, ret == ESP_OK ? "saved" : "not saved");
+    return ret;
 }
 
 esp_err_t nvs_storage_get_wifi_credentials(char *ssid, char *password) {
-    esp_err_t ret = nvs_storage_load_string("wifi_ssid", ssid, 32);
+    nvs_config_t config;
+    esp_err_t ret = nvs_storage_load_config(&config);
     if (ret != ESP_OK) return ret;
-    return nvs_storage_load_string("wifi_pass", password, 64);
+    if (config.wifi_ssid[0] == '\0') return ESP_ERR_NVS_NOT_FOUND;
+
+    strcpy(ssid, config.wifi_ssid);
+    strcpy(password, config.wifi_password);
+    return ESP_OK;
 }
 
 esp_err_t nvs_storage_set_pump_config(uint8_t mode, uint16_t daily_runtime) {
-    esp_err_t ret = nvs_storage_save_int("pump_mode", mode);
+    nvs_config_t config;
+    esp_err_t ret = nvs_storage_load_config(&config);
     if (ret != ESP_OK) return ret;
-    return nvs_storage_save_int("daily_runtime", daily_runtime);
+
+    config.pump_mode = mode;
+    config.daily_runtime = daily_runtime;
+    return nvs_storage_save_config(&config);
 }
 
 esp_err_t nvs_storage_get_pump_config(uint8_t *mode, uint16_t *daily_runtime) {
-    int32_t temp_mode, temp_runtime;
-    esp_err_t ret = nvs_storage_load_int("pump_mode", &temp_mode);
+    nvs_config_t config;
+    esp_err_t ret = nvs_storage_load_config(&config);
     if (ret != ESP_OK) return ret;
-    ret = nvs_storage_load_int("daily_runtime", &temp_runtime);
-    if (ret != ESP_OK) return ret;
-    *mode = (uint8_t)temp_mode;
-    *daily_runtime = (uint16_t)temp_runtime;
-    return ESP_OK;
-}
 
-esp_err_t nvs_storage_set_daily_stats(uint32_t date, uint16_t runtime_minutes, float avg_price) {
-    // For now, just store the runtime. Could be extended to store more stats
-    return nvs_storage_save_int("last_runtime", runtime_minutes);
+    *mode = config.pump_mode;
+    *daily_runtime = config.daily_runtime;
+    return ESP_OK;
 }
 
 esp_err_t nvs_storage_save_string(const char *key, const char *value) {
-    nvs_handle_t handle;
-    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(ret));
-        return ret;
-    }
+    esp_err_t ret = lock();
+    if (ret != ESP_OK) return ret;
 
-    ret = nvs_set_str(handle, key, value);
+    ret = nvs_set_str(storage_handle, key, value);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to write string: %s", esp_err_to_name(ret));
-        nvs_close(handle);
-        return ret;
+        ESP_LOGE(TAG, "Failed to write string %s: %s", key, esp_err_to_name(ret));
     }
+    ret = finish_write_locked(ret);
 
-    ret = nvs_commit(handle);
-    nvs_close(handle);
-
-    ESP_LOGI(TAG, "Saved string: %s = %s", key, value);
+    unlock();
+    // Values are not logged: some of them are secrets
+    ESP_LOGD(TAG, "Saved string: %s", key);
     return ret;
 }
 
 esp_err_t nvs_storage_load_string(const char *key, char *buffer, size_t buffer_size) {
-    nvs_handle_t handle;
-    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(ret));
-        return ret;
-    }
+    esp_err_t ret = lock();
+    if (ret != ESP_OK) return ret;
 
     size_t required_size = buffer_size;
-    ret = nvs_get_str(handle, key, buffer, &required_size);
-    nvs_close(handle);
+    ret = nvs_get_str(storage_handle, key, buffer, &required_size);
+    stats.reads++;
 
+    unlock();
     if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "Loaded string: %s = %s", key, buffer);
-    } else {
-        ESP_LOGE(TAG, "Failed to read string: %s", esp_err_to_name(ret));
+        ESP_LOGD(TAG, "Loaded string: %s", key);
+    } else if (ret != ESP_ERR_NVS_NOT_FOUND) {
+        // A missing key is normal on first boot; callers fall back to their defaults
+        ESP_LOGE(TAG, "Failed to read string %s: %s", key, esp_err_to_name(ret));
     }
 
     return ret;
 }
 
 esp_err_t nvs_storage_save_int(const char *key, int32_t value) {
-    nvs_handle_t handle;
-    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    esp_err_t ret = lock();
     if (ret != ESP_OK) return ret;
 
-    ret = nvs_set_i32(handle, key, value);
-    if (ret == ESP_OK) {
-        ret = nvs_commit(handle);
-    }
+    ret = finish_write_locked(nvs_set_i32(storage_handle, key, value));
 
-    nvs_close(handle);
-    ESP_LOGI(TAG, "Saved int: %s = %ld", key, (long)value);
+    unlock();
+    ESP_LOGD(TAG, "Saved int: %s = %ld", key, (long)value);
     return ret;
 }
 
 esp_err_t nvs_storage_load_int(const char *key, int32_t *value) {
-    nvs_handle_t handle;
-    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    esp_err_t ret = lock();
     if (ret != ESP_OK) return ret;
 
-    ret = nvs_get_i32(handle, key, value);
-    nvs_close(handle);
+    ret = nvs_get_i32(storage_handle, key, value);
+    stats.reads++;
 
+    unlock();
     if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "Loaded int: %s = %ld", key, (long)*value);
+        ESP_LOGD(TAG, "Loaded int: %s = %ld", key, (long)*value);
     }
 
     return ret;
 }
 
-esp_err_t nvs_storage_erase(const char *key) {
-    nvs_handle_t handle;
-    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+esp_err_t nvs_storage_save_blob(const char *key, const void *data, size_t length) {
+    esp_err_t ret = lock();
+    if (ret != ESP_OK) return ret;
+
+    ret = nvs_set_blob(storage_handle, key, data, length);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write blob %s: %s", key, esp_err_to_name(ret));
+    }
+    ret = finish_write_locked(ret);
+
+    unlock();
+    ESP_LOGD(TAG, "Saved blob: %s (%u bytes)", key, (unsigned)length);
+    return ret;
+}
+
+esp_err_t nvs_storage_load_blob(const char *key, void *buffer, size_t *length) {
+    esp_err_t ret = lock();
     if (ret != ESP_OK) return ret;
 
-    ret = nvs_erase_key(handle, key);
+    ret = nvs_get_blob(storage_handle, key, buffer, length);
+    stats.reads++;
+
+    unlock();
     if (ret == ESP_OK) {
-        ret = nvs_commit(handle);
+        ESP_LOGD(TAG, "Loaded blob: %s (%u bytes)", key, (unsigned)*length);
     }
 
-    nvs_close(handle);
-    ESP_LOGI(TAG, "Erased key: %s", key);
     return ret;
-}
\ No newline at end of file
+}
+
+esp_err_t nvs_storage_erase(const char *key) {
+    esp_err_t ret = lock();
+    if (ret != ESP_OK) return ret;
+
+    ret = finish_write_locked(nvs_erase_key(storage_handle, key));
+
+    unlock();
+    ESP_LOGD(TAG, "Erased key: %s", key);
+    return ret;
+}
+
+esp_err_t nvs_storage_get_stats(nvs_storage_stats_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *out = stats;
+    return ESP_OK;
+}
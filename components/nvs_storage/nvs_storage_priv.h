@@ -0,0 +1,8 @@
+#ifndef NVS_STORAGE_PRIV_H
+#define NVS_STORAGE_PRIV_H
+
+// Drop RAM copies so the next access reads flash again; called with the storage lock held
+void config_blob_invalidate(void);
+void daily_stats_invalidate(void);
+
+#endif // NVS_STORAGE_PRIV_H
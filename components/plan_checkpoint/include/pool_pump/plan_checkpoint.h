@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_system.h"
+#include "pool_pump/daily_plan.h"
+#include "price_fetcher.h"
+#include "pump_controller.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PLAN_POSITION_NONE -1 // No slot of the plan has been executed yet
+
+// Where the checkpoint came from at boot
+typedef enum {
+    PLAN_SOURCE_NONE = 0, // No plan was saved, or it failed its checksum
+    PLAN_SOURCE_RTC,      // RTC memory survived a soft reset; no flash involved
+    PLAN_SOURCE_NVS,      // Power was lost; the copy saved at the last plan or mode change
+} plan_source_t;
+
+typedef struct {
+    daily_plan_t plan;      // plan.date is 0 when there is no plan
+    uint32_t price_version; // Prices the plan was built from, see plan_checkpoint_price_version()
+    int16_t position;       // Last slot executed, or PLAN_POSITION_NONE
+    uint8_t mode;           // pump_mode_t applied at that slot
+    plan_source_t source;
+} plan_checkpoint_t;
+
+/**
+ * @brief Restore the checkpoint of the plan being executed
+ *
+ * RTC memory is trusted after a soft reset if its checksum holds. After a power-on or brownout
+ * reset, or a bad checksum, the copy in NVS is used. nvs_storage must be initialized.
+ *
+ * @param reason Reset reason of this boot, normally esp_reset_reason()
+ * @return ESP_OK on success, also when there was nothing to restore
+ */
+esp_err_t plan_checkpoint_init(esp_reset_reason_t reason);
+
+/**
+ * @brief Version of a price snapshot: equal prices give equal versions, 0 means no prices
+ * @param prices 24 hourly prices
+ */
+uint32_t plan_checkpoint_price_version(const price_data_t prices[24]);
+
+/**
+ * @brief Make a plan the one being executed
+ *
+ * Written to RTC memory and NVS unless the plan and price version are unchanged. A new plan
+ * for the same day keeps the executed position.
+ *
+ * @param plan Plan to execute
+ * @param price_version Version of the prices it was built from
+ * @return ESP_OK on success
+ */
+esp_err_t plan_checkpoint_set_plan(const daily_plan_t *plan, uint32_t price_version);
+
+/**
+ * @brief Record the mode applied at a minute of the plan's day
+ *
+ * Every call updates RTC memory; NVS is only written when the mode changes, since the
+ * positions in between follow from the plan.
+ *
+ * @param minute_of_day Minute the mode was applied at
+ * @param mode Mode the pump is running in
+ */
+void plan_checkpoint_mark_executed(int minute_of_day, pump_mode_t mode);
+
+/**
+ * @brief Mode to resume at boot, decided without the network
+ *
+ * The planned mode when the clock is set and the plan is for today; the last executed mode
+ * while the clock is not set yet; off for a plan of another day or when there is none.
+ *
+ * @param date Today as YYYYMMDD; dates before 2024 mean the clock is not set
+ * @param minute_of_day Current minute of the day
+ */
+pump_mode_t plan_checkpoint_resume_mode(uint32_t date, int minute_of_day);
+
+/**
+ * @brief Get a copy of the checkpoint
+ * @param out Pointer to store the checkpoint
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no plan
+ */
+esp_err_t plan_checkpoint_get(plan_checkpoint_t *out);
+
+#ifdef __cplusplus
+}
+#endif
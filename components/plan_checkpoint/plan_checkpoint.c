@@ -0,0 +1,207 @@
+#include "pool_pump/plan_checkpoint.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "config.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "nvs_storage.h"
+
+static const char *TAG = "plan_checkpoint";
+
+#define RTC_MAGIC 0x504C4E31 // "PLN1"; bump when the layout changes
+#define FIRST_VALID_DATE 20240101
+
+// Kept in RTC memory, and as the same bytes in NVS
+typedef struct {
+    uint32_t magic;
+    daily_plan_t plan;
+    uint32_t price_version;
+    int16_t position;
+    uint8_t mode;
+    uint8_t reserved;
+    uint32_t crc; // Over everything above
+} checkpoint_record_t;
+
+static RTC_NOINIT_ATTR checkpoint_record_t rtc_record;
+
+static portMUX_TYPE checkpoint_lock = portMUX_INITIALIZER_UNLOCKED;
+static plan_source_t source = PLAN_SOURCE_NONE;
+static uint8_t nvs_mode = 0xFF; // Mode in the NVS copy; it is rewritten only when this changes
+static bool initialized = false;
+
+static uint32_t record_crc(const checkpoint_record_t *record) {
+    return esp_rom_crc32_le(0, (const uint8_t *)record, offsetof(checkpoint_record_t, crc));
+}
+
+static bool record_valid(const checkpoint_record_t *record) {
+    return record->magic == RTC_MAGIC && record->crc == record_crc(record);
+}
+
+static void seal_locked(void) { rtc_record.crc = record_crc(&rtc_record); }
+
+static bool rtc_valid(esp_reset_reason_t reason) {
+    // RTC memory is undefined after power-on, and a brownout may have corrupted it mid-write
+    if (reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT || reason == ESP_RST_UNKNOWN) {
+        return false;
+    }
+    return record_valid(&rtc_record);
+}
+
+static esp_err_t save_to_nvs(const checkpoint_record_t *snapshot) {
+    esp_err_t ret = nvs_storage_save_blob(NVS_KEY_PLAN_CHECKPOINT, snapshot, sizeof(*snapshot));
+    if (ret == ESP_OK) {
+        nvs_mode = snapshot->mode;
+    } else {
+        ESP_LOGW(TAG, "Failed to save the checkpoint: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+esp_err_t plan_checkpoint_init(esp_reset_reason_t reason) {
+    checkpoint_record_t restored;
+    plan_source_t restored_from = PLAN_SOURCE_NONE;
+    if (rtc_valid(reason)) {
+        restored = rtc_record;
+        restored_from = PLAN_SOURCE_RTC;
+    } else {
+        size_t length = sizeof(restored);
+        if (nvs_storage_load_blob(NVS_KEY_PLAN_CHECKPOINT, &restored, &length) == ESP_OK &&
+            length == sizeof(restored) && record_valid(&restored)) {
+            restored_from = PLAN_SOURCE_NVS;
+        }
+    }
+    if (restored_from == PLAN_SOURCE_NONE) {
+        memset(&restored, 0, sizeof(restored));
+        restored.magic = RTC_MAGIC;
+        restored.position = PLAN_POSITION_NONE;
+        restored.mode = PUMP_MODE_OFF;
+    }
+
+    portENTER_CRITICAL(&checkpoint_lock);
+    rtc_record = restored;
+    seal_locked();
+    source = restored_from;
+    // The NVS copy is rewritten on every mode change, so it holds the restored mode
+    nvs_mode = restored_from == PLAN_SOURCE_NONE ? 0xFF : restored.mode;
+    initialized = true;
+    portEXIT_CRITICAL(&checkpoint_lock);
+
+    static const char *source_names[] = {"nothing", "RTC memory", "NVS"};
+    ESP_LOGI(TAG,
+             "Plan for %lu restored from %s, slot %d executed in mode %u",
+             (unsigned long)restored.plan.date,
+             source_names[restored_from],
+             restored.position,
+             restored.mode);
+    return ESP_OK;
+}
+
+uint32_t plan_checkpoint_price_version(const price_data_t prices[24]) {
+    if (prices == NULL) {
+        return 0;
+    }
+
+    bool have_prices = false;
+    uint32_t crc = 0;
+    for (int hour = 0; hour < 24; hour++) {
+        have_prices |= prices[hour].price_eur_kwh > 0;
+        crc = esp_rom_crc32_le(crc, (const uint8_t *)&prices[hour].price_eur_kwh, sizeof(float));
+    }
+    if (!have_prices) {
+        return 0;
+    }
+    return crc != 0 ? crc : 1;
+}
+
+esp_err_t plan_checkpoint_set_plan(const daily_plan_t *plan, uint32_t price_version) {
+    if (plan == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    checkpoint_record_t snapshot;
+    portENTER_CRITICAL(&checkpoint_lock);
+    bool same = rtc_record.price_version == price_version && memcmp(&rtc_record.plan, plan, sizeof(*plan)) == 0;
+    if (!same) {
+        if (rtc_record.plan.date != plan->date) {
+            rtc_record.position = PLAN_POSITION_NONE;
+        }
+        rtc_record.plan = *plan;
+        rtc_record.price_version = price_version;
+        seal_locked();
+    }
+    snapshot = rtc_record;
+    portEXIT_CRITICAL(&checkpoint_lock);
+
+    if (same) {
+        return ESP_OK;
+    }
+    ESP_LOGI(TAG,
+             "Checkpointed the plan for %lu, prices %08lx",
+             (unsigned long)plan->date,
+             (unsigned long)price_version);
+    return save_to_nvs(&snapshot);
+}
+
+void plan_checkpoint_mark_executed(int minute_of_day, pump_mode_t mode) {
+    if (!initialized || minute_of_day < 0 || minute_of_day >= 24 * 60 || (unsigned)mode > PUMP_MODE_BACKWASH) {
+        return;
+    }
+
+    checkpoint_record_t snapshot;
+    portENTER_CRITICAL(&checkpoint_lock);
+    rtc_record.position = (int16_t)(minute_of_day / DAILY_PLAN_SLOT_MINUTES);
+    rtc_record.mode = (uint8_t)mode;
+    seal_locked();
+    snapshot = rtc_record;
+    portEXIT_CRITICAL(&checkpoint_lock);
+
+    if (snapshot.mode != nvs_mode) {
+        save_to_nvs(&snapshot);
+    }
+}
+
+pump_mode_t plan_checkpoint_resume_mode(uint32_t date, int minute_of_day) {
+    if (!initialized) {
+        return PUMP_MODE_OFF;
+    }
+
+    checkpoint_record_t snapshot;
+    portENTER_CRITICAL(&checkpoint_lock);
+    snapshot = rtc_record;
+    portEXIT_CRITICAL(&checkpoint_lock);
+
+    // Without a clock the position in the plan is unknown; carry on with what was running
+    if (date < FIRST_VALID_DATE) {
+        return snapshot.position != PLAN_POSITION_NONE ? (pump_mode_t)snapshot.mode : PUMP_MODE_OFF;
+    }
+    if (snapshot.plan.date != date) {
+        return PUMP_MODE_OFF;
+    }
+    return daily_plan_mode_at(&snapshot.plan, minute_of_day);
+}
+
+esp_err_t plan_checkpoint_get(plan_checkpoint_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    portENTER_CRITICAL(&checkpoint_lock);
+    out->plan = rtc_record.plan;
+    out->price_version = rtc_record.price_version;
+    out->position = rtc_record.position;
+    out->mode = rtc_record.mode;
+    out->source = source;
+    portEXIT_CRITICAL(&checkpoint_lock);
+    return out->plan.date != 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
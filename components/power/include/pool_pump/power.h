@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// What a holder needs from the chip while the lock is held
+typedef enum {
+    POWER_LOCK_CPU_MAX = 0, // Full CPU frequency: TLS handshakes, JSON parsing
+    POWER_LOCK_NO_SLEEP,    // No light sleep: relay sequences, UART traffic
+    POWER_LOCK_COUNT,
+} power_lock_t;
+
+typedef struct {
+    uint64_t period_us;      // Time since power_init()
+    uint64_t held_us[POWER_LOCK_COUNT];
+    uint32_t acquires[POWER_LOCK_COUNT];
+    bool sleep_measured;     // Light sleep is only measured with CONFIG_POOL_PUMP_PM_MEASURE
+    uint64_t light_sleep_us; // Time spent in automatic light sleep
+    uint32_t light_sleeps;
+} power_stats_t;
+
+/**
+ * @brief Enable frequency scaling and automatic light sleep, and create the locks
+ *
+ * The CPU runs between POWER_MIN_CPU_FREQ_MHZ and the configured CPU frequency and sleeps whenever
+ * every task is blocked. Without CONFIG_PM_ENABLE only the lock accounting works.
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t power_init(void);
+
+/**
+ * @brief Hold a lock; holders nest and the lock is released with the last of them
+ * @param lock Lock to take
+ */
+void power_lock_acquire(power_lock_t lock);
+
+/**
+ * @brief Drop a hold taken by power_lock_acquire()
+ * @param lock Lock to release
+ */
+void power_lock_release(power_lock_t lock);
+
+/**
+ * @brief Time spent per power state since power_init()
+ * @param out Filled with the statistics
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for NULL
+ */
+esp_err_t power_get_stats(power_stats_t *out);
+
+/**
+ * @brief Log the time spent per power state, with the per-mode breakdown of esp_pm in measurement mode
+ */
+void power_log_report(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,178 @@
+#include "pool_pump/power.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "power";
+
+static const char *lock_names[POWER_LOCK_COUNT] = {"cpu_max", "no_sleep"};
+
+typedef struct {
+    esp_pm_lock_handle_t handle; // NULL without CONFIG_PM_ENABLE
+    uint32_t holders;
+    int64_t held_since_us;
+    uint64_t held_us;
+    uint32_t acquires;
+} power_lock_state_t;
+
+// Also taken by the light sleep callbacks, which run with interrupts disabled
+static portMUX_TYPE power_lock = portMUX_INITIALIZER_UNLOCKED;
+static power_lock_state_t locks[POWER_LOCK_COUNT];
+static int64_t start_us = 0;
+static uint64_t light_sleep_us = 0;
+static uint32_t light_sleeps = 0;
+
+#ifdef CONFIG_POOL_PUMP_PM_MEASURE
+static esp_err_t IRAM_ATTR on_light_sleep_exit(int64_t slept_us, void *arg) {
+    portENTER_CRITICAL_SAFE(&power_lock);
+    light_sleep_us += slept_us;
+    light_sleeps++;
+    portEXIT_CRITICAL_SAFE(&power_lock);
+    return ESP_OK;
+}
+#endif
+
+esp_err_t power_init(void) {
+    if (start_us != 0) {
+        return ESP_OK;
+    }
+    start_us = esp_timer_get_time();
+
+#ifdef CONFIG_PM_ENABLE
+    static const esp_pm_lock_type_t lock_types[POWER_LOCK_COUNT] = {ESP_PM_CPU_FREQ_MAX, ESP_PM_NO_LIGHT_SLEEP};
+    for (int i = 0; i < POWER_LOCK_COUNT; i++) {
+        esp_err_t ret = esp_pm_lock_create(lock_types[i], 0, lock_names[i], &locks[i].handle);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create the %s lock: %s", lock_names[i], esp_err_to_name(ret));
+            return ret;
+        }
+    }
+
+    esp_pm_config_t config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = POWER_MIN_CPU_FREQ_MHZ,
+        .light_sleep_enable = true,
+    };
+    esp_err_t ret = esp_pm_configure(&config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure power management: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+#ifdef CONFIG_POOL_PUMP_PM_MEASURE
+    esp_pm_sleep_cbs_register_config_t callbacks = {
+        .exit_cb = on_light_sleep_exit,
+    };
+    ret = esp_pm_light_sleep_register_cbs(&callbacks);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Light sleep is not measured: %s", esp_err_to_name(ret));
+    }
+#endif
+
+    ESP_LOGI(TAG,
+             "CPU scales between %d and %d MHz, light sleep when idle",
+             POWER_MIN_CPU_FREQ_MHZ,
+             CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+#else
+    ESP_LOGW(TAG, "Power management disabled in sdkconfig, the CPU never sleeps");
+#endif
+    return ESP_OK;
+}
+
+void power_lock_acquire(power_lock_t lock) {
+    if (lock >= POWER_LOCK_COUNT) {
+        return;
+    }
+
+    power_lock_state_t *state = &locks[lock];
+    portENTER_CRITICAL(&power_lock);
+    if (state->holders++ == 0) {
+        state->held_since_us = esp_timer_get_time();
+    }
+    state->acquires++;
+    portEXIT_CRITICAL(&power_lock);
+
+    // esp_pm counts holders of a lock itself
+    if (state->handle != NULL) {
+        esp_pm_lock_acquire(state->handle);
+    }
+}
+
+void power_lock_release(power_lock_t lock) {
+    if (lock >= POWER_LOCK_COUNT) {
+        return;
+    }
+
+    power_lock_state_t *state = &locks[lock];
+    portENTER_CRITICAL(&power_lock);
+    bool held = state->holders > 0;
+    if (held && --state->holders == 0) {
+        state->held_us += (uint64_t)(esp_timer_get_time() - state->held_since_us);
+    }
+    portEXIT_CRITICAL(&power_lock);
+
+    if (!held) {
+        ESP_LOGE(TAG, "Release of %s without a matching acquire", lock_names[lock]);
+        return;
+    }
+    if (state->handle != NULL) {
+        esp_pm_lock_release(state->handle);
+    }
+}
+
+esp_err_t power_get_stats(power_stats_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(out, 0, sizeof(*out));
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&power_lock);
+    out->period_us = (uint64_t)(now_us - start_us);
+    for (int i = 0; i < POWER_LOCK_COUNT; i++) {
+        // A lock held right now counts up to this moment
+        out->held_us[i] = locks[i].held_us + (locks[i].holders > 0 ? (uint64_t)(now_us - locks[i].held_since_us) : 0);
+        out->acquires[i] = locks[i].acquires;
+    }
+    out->light_sleep_us = light_sleep_us;
+    out->light_sleeps = light_sleeps;
+    portEXIT_CRITICAL(&power_lock);
+
+#ifdef CONFIG_POOL_PUMP_PM_MEASURE
+    out->sleep_measured = true;
+#endif
+    return ESP_OK;
+}
+
+void power_log_report(void) {
+    power_stats_t stats;
+    power_get_stats(&stats);
+    uint64_t period_ms = stats.period_us / 1000 > 0 ? stats.period_us / 1000 : 1;
+
+    ESP_LOGI(TAG,
+             "Over %llu s: cpu_max %llu ms (%lu holds), no_sleep %llu ms (%lu holds)",
+             (unsigned long long)(stats.period_us / 1000000),
+             (unsigned long long)(stats.held_us[POWER_LOCK_CPU_MAX] / 1000),
+             (unsigned long)stats.acquires[POWER_LOCK_CPU_MAX],
+             (unsigned long long)(stats.held_us[POWER_LOCK_NO_SLEEP] / 1000),
+             (unsigned long)stats.acquires[POWER_LOCK_NO_SLEEP]);
+    if (stats.sleep_measured) {
+        ESP_LOGI(TAG,
+                 "Light sleep %llu ms in %lu sleeps, %.2f%% of the time",
+                 (unsigned long long)(stats.light_sleep_us / 1000),
+                 (unsigned long)stats.light_sleeps,
+                 (double)(stats.light_sleep_us / 1000) * 100.0 / (double)period_ms);
+#ifdef CONFIG_PM_PROFILING
+        // Time per frequency mode and per lock, as esp_pm sees it
+        esp_pm_dump_locks(stdout);
+#endif
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "price_fetcher.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PRICE_ARCHIVE_HOURS 24
+#define PRICE_ARCHIVE_SCALE 1000 // Prices are archived in 0.001 EUR/kWh
+
+typedef struct {
+    uint32_t first_date; // YYYYMMDD of the oldest archived day, 0 when empty
+    uint32_t last_date;  // YYYYMMDD of the newest archived day, 0 when empty
+    uint32_t days;       // Days with prices; gaps are not counted
+    uint32_t bytes_used; // Headers and records in the blocks in use
+    uint32_t bytes_total;
+} price_archive_info_t;
+
+/**
+ * @brief Map the price archive partition and index its blocks
+ *
+ * The whole partition is mapped once; lookups decode straight from the mapping.
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the partition table has no archive partition
+ */
+esp_err_t price_archive_init(void);
+
+/**
+ * @brief Append one day of hourly prices
+ *
+ * Days are append-only and must come in date order. When the partition is full the oldest
+ * block of days is erased to make room.
+ *
+ * @param date Day as YYYYMMDD
+ * @param prices Prices for hours 0-23
+ * @return ESP_OK on success, also when the day is already archived with the same prices;
+ *         ESP_ERR_INVALID_STATE for a day older than the newest one or archived with other prices
+ */
+esp_err_t price_archive_append(uint32_t date, const price_data_t prices[PRICE_ARCHIVE_HOURS]);
+
+/**
+ * @brief Decode one archived day
+ * @param date Day as YYYYMMDD
+ * @param prices Array to store the prices for hours 0-23
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the day is not archived,
+ *         ESP_ERR_INVALID_CRC if its record is damaged
+ */
+esp_err_t price_archive_get_day(uint32_t date, price_data_t prices[PRICE_ARCHIVE_HOURS]);
+
+/**
+ * @brief Get the archived date range and space usage
+ * @param out Pointer to store the summary
+ * @return ESP_OK on success
+ */
+esp_err_t price_archive_get_info(price_archive_info_t *out);
+
+/**
+ * @brief Drop archived days dated after a date
+ *
+ * For days archived while the clock was wrongly ahead, which would otherwise refuse every real day
+ * that follows. A dropped day can be archived again.
+ *
+ * @param date Newest date to keep, YYYYMMDD
+ * @param dropped Pointer to store the number of days dropped, may be NULL
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a date before 2020, ESP_ERR_INVALID_STATE before init
+ */
+esp_err_t price_archive_drop_after(uint32_t date, size_t *dropped);
+
+/**
+ * @brief Erase every archived day
+ * @return ESP_OK on success
+ */
+esp_err_t price_archive_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
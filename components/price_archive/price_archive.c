@@ -0,0 +1,473 @@
+#include "pool_pump/price_archive.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "config.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "pool_pump/static_alloc.h"
+
+static const char *TAG = "price_archive";
+
+#define ARCHIVE_MAGIC 0x43524150 // "PARC"
+#define ARCHIVE_VERSION 1
+#define BLOCK_SIZE 4096    // One flash sector, erased as a unit
+#define MAX_BLOCKS 16
+#define DAYS_PER_BLOCK 160 // More than fit even if every delta takes one byte (26-byte records)
+#define NO_RECORD 0xFFFF
+#define DROPPED_RECORD 0x0000 // Programmed over the offset of a dropped day; the slot cannot be used again
+#define MAX_RECORD_SIZE (3 + (PRICE_ARCHIVE_HOURS - 1) * 3)
+#define EPOCH_YEAR 2020 // Day numbers count from 2020-01-01
+
+// Each sector covers days first_day to first_day + DAYS_PER_BLOCK - 1. Records are appended
+// behind the header and located through offsets[], so finding a day takes no scan of the data.
+typedef struct {
+    uint32_t magic; // Written last, so a block with a torn header reads as unused
+    uint32_t sequence;
+    uint16_t first_day;
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t offsets[DAYS_PER_BLOCK]; // Programmed once the record is complete
+} block_header_t;
+
+#define DATA_OFFSET sizeof(block_header_t)
+
+typedef struct {
+    bool used;
+    uint32_t sequence;
+    uint16_t first_day;
+    uint16_t tail; // First unwritten byte
+} block_info_t;
+
+static const esp_partition_t *partition = NULL;
+static const uint8_t *mapped = NULL;
+static esp_partition_mmap_handle_t map_handle;
+static SemaphoreHandle_t archive_mutex = NULL;
+static block_info_t blocks[MAX_BLOCKS];
+static int block_count = 0;
+static int newest = -1;
+static int32_t last_day = -1;
+
+static int32_t days_from_civil(int32_t y, int32_t m, int32_t d) {
+    // Howard Hinnant's days_from_civil, shifted to EPOCH_YEAR below
+    y -= m <= 2;
+    int32_t era = (y >= 0 ? y : y - 399) / 400;
+    int32_t yoe = y - era * 400;
+    int32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+static int32_t date_to_day(uint32_t date) {
+    return days_from_civil(date / 10000, date / 100 % 100, date % 100) - days_from_civil(EPOCH_YEAR, 1, 1);
+}
+
+static uint32_t day_to_date(int32_t day) {
+    int32_t z = day + days_from_civil(EPOCH_YEAR, 1, 1) + 719468;
+    int32_t era = z / 146097;
+    int32_t doe = z - era * 146097;
+    int32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int32_t mp = (5 * doy + 2) / 153;
+    int32_t m = mp < 10 ? mp + 3 : mp - 9;
+    return (uint32_t)((yoe + era * 400 + (m <= 2)) * 10000 + m * 100 + doy - (153 * mp + 2) / 5 + 1);
+}
+
+static const block_header_t *header_of(int block) { return (const block_header_t *)(mapped + block * BLOCK_SIZE); }
+
+// Check byte, first price as int16, then 23 hour-to-hour deltas as zigzag varints:
+// steps under 6.4 ct/kWh take one byte, so a typical day is about 30 bytes
+static size_t encode_day(const int16_t prices[PRICE_ARCHIVE_HOURS], uint8_t *out) {
+    size_t length = 1;
+    out[length++] = (uint8_t)prices[0];
+    out[length++] = (uint8_t)((uint16_t)prices[0] >> 8);
+    for (int hour = 1; hour < PRICE_ARCHIVE_HOURS; hour++) {
+        int32_t delta = prices[hour] - prices[hour - 1];
+        uint32_t zigzag = delta < 0 ? ((uint32_t)-delta << 1) - 1 : (uint32_t)delta << 1;
+        do {
+            uint8_t byte = zigzag & 0x7F;
+            zigzag >>= 7;
+            out[length++] = byte | (zigzag ? 0x80 : 0);
+        } while (zigzag);
+    }
+    out[0] = esp_rom_crc8_le(0, out + 1, length - 1);
+    return length;
+}
+
+static esp_err_t decode_day(const uint8_t *record, size_t available, int16_t prices[PRICE_ARCHIVE_HOURS]) {
+    if (available < 3) {
+        return ESP_ERR_INVALID_CRC;
+    }
+    prices[0] = (int16_t)(record[1] | record[2] << 8);
+    size_t pos = 3;
+    for (int hour = 1; hour < PRICE_ARCHIVE_HOURS; hour++) {
+        uint32_t zigzag = 0;
+        uint8_t byte;
+        int shift = 0;
+        do {
+            if (pos >= available || shift > 14) return ESP_ERR_INVALID_CRC;
+            byte = record[pos++];
+            zigzag |= (uint32_t)(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        int32_t delta = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+        prices[hour] = (int16_t)(prices[hour - 1] + delta);
+    }
+    return esp_rom_crc8_le(0, record + 1, pos - 1) == record[0] ? ESP_OK : ESP_ERR_INVALID_CRC;
+}
+
+// Zero-copy: points into the mapping, or NULL if no block holds the day
+static const uint8_t *find_record(int32_t day, size_t *available) {
+    for (int block = 0; block < block_count; block++) {
+        if (!blocks[block].used || day < blocks[block].first_day || day >= blocks[block].first_day + DAYS_PER_BLOCK) {
+            continue;
+        }
+        // Ranges of consecutive blocks overlap when a block filled up early, so keep looking
+        uint16_t offset = header_of(block)->offsets[day - blocks[block].first_day];
+        if (offset >= DATA_OFFSET && offset < blocks[block].tail) {
+            *available = blocks[block].tail - offset;
+            return mapped + block * BLOCK_SIZE + offset;
+        }
+    }
+    return NULL;
+}
+
+static void scan_block(int block) {
+    const block_header_t *header = header_of(block);
+    block_info_t *info = &blocks[block];
+    memset(info, 0, sizeof(*info));
+    if (header->magic != ARCHIVE_MAGIC || header->version != ARCHIVE_VERSION) {
+        return;
+    }
+
+    info->used = true;
+    info->sequence = header->sequence;
+    info->first_day = header->first_day;
+
+    // Appends are sequential, so the last programmed byte ends the data, including a torn record
+    const uint8_t *data = mapped + block * BLOCK_SIZE;
+    int tail = BLOCK_SIZE;
+    while (tail > (int)DATA_OFFSET && data[tail - 1] == 0xFF) {
+        tail--;
+    }
+    info->tail = (uint16_t)tail;
+
+    for (int i = DAYS_PER_BLOCK - 1; i >= 0; i--) {
+        if (header->offsets[i] != NO_RECORD && header->offsets[i] != DROPPED_RECORD) {
+            if (info->first_day + i > last_day) last_day = info->first_day + i;
+            break;
+        }
+    }
+    if (newest < 0 || info->sequence > blocks[newest].sequence) {
+        newest = block;
+    }
+}
+
+static bool block_is_blank(int block) {
+    const uint32_t *words = (const uint32_t *)(mapped + block * BLOCK_SIZE);
+    for (size_t i = 0; i < BLOCK_SIZE / sizeof(uint32_t); i++) {
+        if (words[i] != UINT32_MAX) return false;
+    }
+    return true;
+}
+
+// Take an unused block, or the oldest one, and make it the newest starting at the given day
+static esp_err_t start_block(int32_t day) {
+    int target = -1;
+    for (int block = 0; block < block_count; block++) {
+        if (!blocks[block].used) {
+            target = block;
+            break;
+        }
+        if (target < 0 || blocks[block].sequence < blocks[target].sequence) {
+            target = block;
+        }
+    }
+
+    if (blocks[target].used) {
+        ESP_LOGI(TAG,
+                 "Archive full, dropping the block from %lu",
+                 (unsigned long)day_to_date(blocks[target].first_day));
+    }
+    esp_err_t ret = ESP_OK;
+    if (!block_is_blank(target)) {
+        blocks[target].used = false;
+        ret = esp_partition_erase_range(partition, (size_t)target * BLOCK_SIZE, BLOCK_SIZE);
+        if (ret != ESP_OK) return ret;
+    }
+
+    block_header_t header;
+    header.sequence = newest >= 0 ? blocks[newest].sequence + 1 : 0;
+    header.first_day = (uint16_t)day;
+    header.version = ARCHIVE_VERSION;
+    header.reserved = 0xFF;
+    header.magic = ARCHIVE_MAGIC;
+    size_t base = (size_t)target * BLOCK_SIZE;
+    ret = esp_partition_write(partition,
+                              base + offsetof(block_header_t, sequence),
+                              &header.sequence,
+                              offsetof(block_header_t, offsets) - offsetof(block_header_t, sequence));
+    if (ret == ESP_OK) {
+        ret = esp_partition_write(partition, base, &header.magic, sizeof(header.magic));
+    }
+    if (ret != ESP_OK) return ret;
+
+    blocks[target] = (block_info_t){
+        .used = true,
+        .sequence = header.sequence,
+        .first_day = header.first_day,
+        .tail = DATA_OFFSET,
+    };
+    newest = target;
+    return ESP_OK;
+}
+
+static void to_fixed(const price_data_t prices[PRICE_ARCHIVE_HOURS], int16_t out[PRICE_ARCHIVE_HOURS]) {
+    for (int hour = 0; hour < PRICE_ARCHIVE_HOURS; hour++) {
+        float scaled = prices[hour].price_eur_kwh * PRICE_ARCHIVE_SCALE;
+        scaled += scaled < 0 ? -0.5f : 0.5f;
+        out[hour] = scaled >= INT16_MAX ? INT16_MAX : scaled <= INT16_MIN ? INT16_MIN : (int16_t)scaled;
+    }
+}
+
+esp_err_t price_archive_init(void) {
+    if (mapped != NULL) {
+        return ESP_OK;
+    }
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                         (esp_partition_subtype_t)PRICE_ARCHIVE_SUBTYPE,
+                                         PRICE_ARCHIVE_PARTITION);
+    if (partition == NULL) {
+        ESP_LOGW(TAG, "No \"%s\" partition, price history is not archived", PRICE_ARCHIVE_PARTITION);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const void *ptr;
+    esp_err_t ret = esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &ptr, &map_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map the archive: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    archive_mutex = static_alloc_mutex();
+    if (archive_mutex == NULL) {
+        esp_partition_munmap(map_handle);
+        return ESP_ERR_NO_MEM;
+    }
+
+    mapped = ptr;
+    block_count = partition->size / BLOCK_SIZE > MAX_BLOCKS ? MAX_BLOCKS : partition->size / BLOCK_SIZE;
+    newest = -1;
+    last_day = -1;
+    for (int block = 0; block < block_count; block++) {
+        scan_block(block);
+    }
+
+    price_archive_info_t info;
+    price_archive_get_info(&info);
+    ESP_LOGI(TAG,
+             "%lu days archived (%lu to %lu), %lu of %lu bytes used",
+             (unsigned long)info.days,
+             (unsigned long)info.first_date,
+             (unsigned long)info.last_date,
+             (unsigned long)info.bytes_used,
+             (unsigned long)info.bytes_total);
+    return ESP_OK;
+}
+
+esp_err_t price_archive_append(uint32_t date, const price_data_t prices[PRICE_ARCHIVE_HOURS]) {
+    if (prices == NULL || date < EPOCH_YEAR * 10000) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (mapped == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int32_t day = date_to_day(date);
+    int16_t fixed[PRICE_ARCHIVE_HOURS];
+    to_fixed(prices, fixed);
+    uint8_t record[MAX_RECORD_SIZE];
+    size_t length = encode_day(fixed, record);
+
+    xSemaphoreTake(archive_mutex, portMAX_DELAY);
+    esp_err_t ret = ESP_OK;
+    if (day <= last_day) {
+        // Day-ahead prices do not change once published, so a repeat is normally a re-fetch
+        size_t available;
+        const uint8_t *stored = find_record(day, &available);
+        bool same = stored != NULL && available >= length && memcmp(stored, record, length) == 0;
+        ret = same ? ESP_OK : ESP_ERR_INVALID_STATE;
+        xSemaphoreGive(archive_mutex);
+        return ret;
+    }
+
+    if (newest < 0 || day < blocks[newest].first_day || day >= blocks[newest].first_day + DAYS_PER_BLOCK ||
+        blocks[newest].tail + length > BLOCK_SIZE ||
+        header_of(newest)->offsets[day - blocks[newest].first_day] != NO_RECORD) {
+        ret = start_block(day);
+    }
+
+    // The record goes first and its offset last: a power cut leaves at most unreferenced bytes
+    if (ret == ESP_OK) {
+        block_info_t *block = &blocks[newest];
+        size_t base = (size_t)newest * BLOCK_SIZE;
+        uint16_t offset = block->tail;
+        block->tail += length;
+        ret = esp_partition_write(partition, base + offset, record, length);
+        if (ret == ESP_OK) {
+            ret = esp_partition_write(partition,
+                                      base + offsetof(block_header_t, offsets) +
+                                          (day - block->first_day) * sizeof(uint16_t),
+                                      &offset,
+                                      sizeof(offset));
+        }
+        if (ret == ESP_OK) {
+            last_day = day;
+        }
+    }
+    xSemaphoreGive(archive_mutex);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to archive %lu: %s", (unsigned long)date, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+esp_err_t price_archive_get_day(uint32_t date, price_data_t prices[PRICE_ARCHIVE_HOURS]) {
+    if (prices == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (mapped == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int16_t fixed[PRICE_ARCHIVE_HOURS];
+    xSemaphoreTake(archive_mutex, portMAX_DELAY);
+    size_t available;
+    const uint8_t *record = date < EPOCH_YEAR * 10000 ? NULL : find_record(date_to_day(date), &available);
+    esp_err_t ret = record != NULL ? decode_day(record, available, fixed) : ESP_ERR_NOT_FOUND;
+    xSemaphoreGive(archive_mutex);
+
+    if (ret == ESP_OK) {
+        for (int hour = 0; hour < PRICE_ARCHIVE_HOURS; hour++) {
+            prices[hour].hour = hour;
+            prices[hour].price_eur_kwh = (float)fixed[hour] / PRICE_ARCHIVE_SCALE;
+        }
+    }
+    return ret;
+}
+
+esp_err_t price_archive_get_info(price_archive_info_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(out, 0, sizeof(*out));
+    if (mapped == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(archive_mutex, portMAX_DELAY);
+    int32_t first_day = -1;
+    out->bytes_total = block_count * BLOCK_SIZE;
+    for (int block = 0; block < block_count; block++) {
+        if (!blocks[block].used) continue;
+
+        const block_header_t *header = header_of(block);
+        out->bytes_used += blocks[block].tail;
+        for (int i = 0; i < DAYS_PER_BLOCK; i++) {
+            if (header->offsets[i] == NO_RECORD || header->offsets[i] == DROPPED_RECORD) continue;
+            out->days++;
+            if (first_day < 0 || blocks[block].first_day + i < first_day) {
+                first_day = blocks[block].first_day + i;
+            }
+        }
+    }
+    if (out->days > 0) {
+        out->first_date = day_to_date(first_day);
+        out->last_date = day_to_date(last_day);
+    }
+    xSemaphoreGive(archive_mutex);
+    return ESP_OK;
+}
+
+esp_err_t price_archive_drop_after(uint32_t date, size_t *dropped) {
+    if (date < EPOCH_YEAR * 10000) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (mapped == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int32_t day = date_to_day(date);
+    size_t count = 0;
+    esp_err_t ret = ESP_OK;
+    xSemaphoreTake(archive_mutex, portMAX_DELAY);
+    if (day < last_day) {
+        for (int block = 0; block < block_count && ret == ESP_OK; block++) {
+            if (!blocks[block].used || blocks[block].first_day + DAYS_PER_BLOCK - 1 <= day) {
+                continue;
+            }
+            const block_header_t *header = header_of(block);
+            size_t base = (size_t)block * BLOCK_SIZE;
+            int from = blocks[block].first_day > day ? 0 : day + 1 - blocks[block].first_day;
+            int kept = 0;
+            int future = 0;
+            for (int i = 0; i < DAYS_PER_BLOCK; i++) {
+                if (header->offsets[i] != NO_RECORD && header->offsets[i] != DROPPED_RECORD) {
+                    if (i < from) {
+                        kept++;
+                    } else {
+                        future++;
+                    }
+                }
+            }
+            count += future;
+            if (kept == 0) {
+                // Nothing left to keep: erased, so the block can be taken for new days
+                blocks[block].used = false;
+                ret = esp_partition_erase_range(partition, base, BLOCK_SIZE);
+                continue;
+            }
+            for (int i = from; i < DAYS_PER_BLOCK && ret == ESP_OK; i++) {
+                if (header->offsets[i] == NO_RECORD || header->offsets[i] == DROPPED_RECORD) continue;
+                // Clearing the offset's bits needs no erase
+                const uint16_t cleared = DROPPED_RECORD;
+                ret = esp_partition_write(partition,
+                                          base + offsetof(block_header_t, offsets) + i * sizeof(uint16_t),
+                                          &cleared,
+                                          sizeof(cleared));
+            }
+        }
+
+        // Rebuilt from flash: the newest block and the last day may both have gone
+        newest = -1;
+        last_day = -1;
+        for (int block = 0; block < block_count; block++) {
+            scan_block(block);
+        }
+    }
+    xSemaphoreGive(archive_mutex);
+
+    if (dropped != NULL) {
+        *dropped = count;
+    }
+    return ret;
+}
+
+esp_err_t price_archive_clear(void) {
+    if (mapped == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(archive_mutex, portMAX_DELAY);
+    esp_err_t ret = esp_partition_erase_range(partition, 0, (size_t)block_count * BLOCK_SIZE);
+    memset(blocks, 0, sizeof(blocks));
+    newest = -1;
+    last_day = -1;
+    xSemaphoreGive(archive_mutex);
+    return ret;
+}
@@ -2,6 +2,7 @@
 #define PRICE_FETCHER_H
 
 #include "esp_err.h"
+#include "pool_pump/arena.h"
 #include <stdbool.h>
 
 typedef struct {
@@ -15,13 +16,31 @@ typedef struct {
  */
 esp_err_t price_fetcher_init(void);
 
+/**
+ * @brief Point later fetches at another price API endpoint; PRICE_API_URL until called
+ * @param url Endpoint URL
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for NULL, an empty URL or one too long
+ */
+esp_err_t price_fetcher_set_endpoint(const char *url);
+
 /**
  * @brief Fetch current day electricity prices
+ *
+ * Prices are published, and copied to @p prices, only when a 200 response priced all 24 hours;
+ * on any error both are left untouched.
+ *
  * @param prices Array to store 24-hour price data
- * @return ESP_OK on success
+ * @return ESP_OK on success, ESP_ERR_INVALID_RESPONSE for a non-200 status or a response missing hours,
+ *         ESP_ERR_NO_MEM when the response does not fit the fetch arena, or the HTTP client's error
  */
 esp_err_t price_fetcher_get_today_prices(price_data_t prices[24]);
 
+/**
+ * @brief Publish prices obtained without a fetch, such as today's from the price archive after a reset
+ * @param prices 24-hour price data
+ */
+void price_fetcher_set_today_prices(const price_data_t prices[24]);
+
 /**
  * @brief Get current hour price
  * @return Current electricity price in EUR/kWh
@@ -34,4 +53,11 @@ float price_fetcher_get_current_price(void);
  */
 bool price_fetcher_is_low_price_period(void);
 
+/**
+ * @brief Get the use of the fetch arena, which holds the response and JSON tree of a fetch
+ * @param out Filled with a copy of the arena; its peak and failures cover every fetch so far
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for NULL
+ */
+esp_err_t price_fetcher_get_arena_stats(arena_t *out);
+
 #endif // PRICE_FETCHER_H
@@ -3,19 +3,57 @@
 #include "config.h"
 #include "esp_http_client.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "pool_pump/arena.h"
+#include "pool_pump/power.h"
+#include "pool_pump/static_alloc.h"
+#include "pool_pump/time_service.h"
 #include <string.h>
+#include <strings.h>
 
 static const char *TAG = "PRICE_FETCHER";
 
-#define MAX_HTTP_OUTPUT_BUFFER 2048
-
+// Read by the control loop while the network task fetches; a fetch fills parsed_prices and publishes them at the end
+static portMUX_TYPE prices_lock = portMUX_INITIALIZER_UNLOCKED;
 static price_data_t daily_prices[24];
+static price_data_t parsed_prices[24];
 static float current_price = 0.0f;
+static char endpoint[128] = PRICE_API_URL; // Set once at boot, before the first fetch
 
-static esp_err_t _http_event_handler(esp_http_client_event_t *evt) {
-    static char *output_buffer;
-    static int output_len;
+// Every block of a fetch comes from this one region: the response body and the JSON tree. It is rewound at the
+// end of each fetch, so fetches leave no holes in the heap
+static uint8_t arena_buffer[PRICE_FETCH_ARENA_BYTES] __attribute__((aligned(ARENA_ALIGN)));
+static arena_t fetch_arena = {.base = arena_buffer, .size = sizeof(arena_buffer)};
+
+// Body of the response being received; NUL-terminated for the parser
+static char *output_buffer;
+static int output_len;
+static int output_capacity;
+
+// What the handler made of the response. The client ignores a handler's error, so these are checked before
+// anything is published
+static bool body_rejected; // Did not fit the arena
+static bool parse_failed;  // Not JSON, or no records array
+static int hours_parsed;   // Hours of the day given a price
+
+static void *json_alloc(size_t size) { return arena_alloc(&fetch_arena, size); }
+
+static void json_free(void *block) {} // Given back with the rest of the arena
 
+static esp_err_t take_output_buffer(int64_t content_length) {
+    output_capacity = content_length > 0 ? (int)content_length + 1 : 0;
+    output_buffer = output_capacity > 0 ? (char *)arena_alloc(&fetch_arena, output_capacity) : NULL;
+    output_len = 0;
+    return output_buffer != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+// The block itself goes back with the arena reset at the end of the fetch
+static void release_output_buffer(void) {
+    output_buffer = NULL;
+    output_len = 0;
+}
+
+static esp_err_t _http_event_handler(esp_http_client_event_t *evt) {
     switch (evt->event_id) {
         case HTTP_EVENT_ERROR:
             ESP_LOGD(TAG, "HTTP_EVENT_ERROR");
@@ -28,28 +66,47 @@ static esp_err_t _http_event_handler(esp_http_client_event_t *evt) {
             break;
         case HTTP_EVENT_ON_HEADER:
             ESP_LOGD(TAG, "HTTP_EVENT_ON_HEADER, key=%s, value=%s", evt->header_key, evt->header_value);
+            // The response carries the server's clock for free; it is used when ours is worse
+            if (strcasecmp(evt->header_key, "Date") == 0) {
+                time_service_on_http_date(evt->header_value);
+            }
             break;
         case HTTP_EVENT_ON_DATA:
             ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, len=%d", evt->data_len);
             if (!esp_http_client_is_chunked_response(evt->client)) {
-                if (output_buffer == NULL) {
-                    output_buffer = (char *)malloc(esp_http_client_get_content_length(evt->client));
-                    output_len = 0;
-                    if (output_buffer == NULL) {
-                        ESP_LOGE(TAG, "Failed to allocate memory for output buffer");
-                        return ESP_FAIL;
-                    }
+                if (body_rejected) {
+                    return ESP_FAIL;
+                }
+                if (output_buffer == NULL &&
+                    take_output_buffer(esp_http_client_get_content_length(evt->client)) != ESP_OK) {
+                    ESP_LOGE(TAG, "No room for the response in the %d byte fetch arena", PRICE_FETCH_ARENA_BYTES);
+                    body_rejected = true;
+                    return ESP_FAIL;
+                }
+                if (output_len + evt->data_len >= output_capacity) {
+                    ESP_LOGE(TAG, "Response does not fit the %d byte buffer", output_capacity);
+                    body_rejected = true;
+                    release_output_buffer();
+                    return ESP_FAIL;
                 }
                 memcpy(output_buffer + output_len, evt->data, evt->data_len);
                 output_len += evt->data_len;
+                output_buffer[output_len] = '\0';
             }
             break;
         case HTTP_EVENT_ON_FINISH:
             ESP_LOGD(TAG, "HTTP_EVENT_ON_FINISH");
             if (output_buffer != NULL) {
-                // Parse JSON response
+                // cJSON's hooks are global; they point at the arena only while our parse runs
+                cJSON_Hooks hooks = {.malloc_fn = json_alloc, .free_fn = json_free};
+                cJSON_InitHooks(&hooks);
                 cJSON *root = cJSON_Parse(output_buffer);
-                if (root != NULL) {
+                if (root == NULL) {
+                    parse_failed = true;
+                    ESP_LOGE(TAG,
+                             "Failed to parse the response, %lu arena bytes in use",
+                             (unsigned long)fetch_arena.used);
+                } else {
                     cJSON *records = cJSON_GetObjectItem(root, "records");
                     if (records != NULL && cJSON_IsArray(records)) {
                         int num_records = cJSON_GetArraySize(records);
@@ -58,26 +115,24 @@ static esp_err_t _http_event_handler(esp_http_client_event_t *evt) {
                             if (record != NULL) {
                                 cJSON *price = cJSON_GetObjectItem(record, "SpotPriceEUR");
                                 if (price != NULL && cJSON_IsNumber(price)) {
-                                    daily_prices[i].price_eur_kwh = price->valuedouble;
-                                    daily_prices[i].hour = i;
+                                    parsed_prices[i].price_eur_kwh = price->valuedouble;
+                                    hours_parsed++;
                                 }
                             }
                         }
+                    } else {
+                        parse_failed = true;
+                        ESP_LOGE(TAG, "Response has no records array");
                     }
                     cJSON_Delete(root);
                 }
-                free(output_buffer);
-                output_buffer = NULL;
+                cJSON_InitHooks(NULL);
             }
-            output_len = 0;
+            release_output_buffer();
             break;
         case HTTP_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "HTTP_EVENT_DISCONNECTED");
-            if (output_buffer != NULL) {
-                free(output_buffer);
-                output_buffer = NULL;
-            }
-            output_len = 0;
+            release_output_buffer();
             break;
         case HTTP_EVENT_REDIRECT:
             ESP_LOGD(TAG, "HTTP_EVENT_REDIRECT");
@@ -92,7 +147,35 @@ static esp_err_t _http_event_handler(esp_http_client_event_t *evt) {
 esp_err_t price_fetcher_init(void) {
     ESP_LOGI(TAG, "Initializing price fetcher");
     // Initialize daily prices to zero
+    portENTER_CRITICAL(&prices_lock);
     memset(daily_prices, 0, sizeof(daily_prices));
+    portEXIT_CRITICAL(&prices_lock);
+    return ESP_OK;
+}
+
+esp_err_t price_fetcher_set_endpoint(const char *url) {
+    if (url == NULL || url[0] == '\0' || strlen(url) >= sizeof(endpoint)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    strcpy(endpoint, url);
+    return ESP_OK;
+}
+
+// A fetch counts only when a 200 response priced every hour of the day; anything less would plan on stale or
+// missing prices
+static esp_err_t check_response(esp_http_client_handle_t client) {
+    int status = esp_http_client_get_status_code(client);
+    if (status != 200) {
+        ESP_LOGE(TAG, "HTTP GET returned status %d", status);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (body_rejected) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (parse_failed || hours_parsed < 24) {
+        ESP_LOGE(TAG, "Response priced %d of 24 hours", hours_parsed);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
     return ESP_OK;
 }
 
@@ -100,27 +183,64 @@ esp_err_t price_fetcher_get_today_prices(price_data_t prices[24]) {
     ESP_LOGI(TAG, "Fetching today's electricity prices");
 
     esp_http_client_config_t config = {
-        .url = PRICE_API_URL,
+        .url = endpoint,
         .event_handler = _http_event_handler,
     };
 
+    for (int i = 0; i < 24; i++) {
+        parsed_prices[i].hour = i;
+        parsed_prices[i].price_eur_kwh = 0.0f;
+    }
+    body_rejected = false;
+    parse_failed = false;
+    hours_parsed = 0;
+
+    // The TLS handshake and the JSON parse are the only heavy work of the day; run them at full speed
+    power_lock_acquire(POWER_LOCK_CPU_MAX);
+    // The HTTP client and TLS allocate on their own, and free it all before returning
+    static_alloc_exempt_begin();
+    arena_reset(&fetch_arena);
     esp_http_client_handle_t client = esp_http_client_init(&config);
     esp_err_t err = esp_http_client_perform(client);
-
     if (err == ESP_OK) {
         ESP_LOGI(TAG,
                  "HTTP GET Status = %d, content_length = %lld",
                  esp_http_client_get_status_code(client),
                  esp_http_client_get_content_length(client));
-        memcpy(prices, daily_prices, sizeof(daily_prices));
+        err = check_response(client);
     } else {
         ESP_LOGE(TAG, "HTTP GET request failed: %s", esp_err_to_name(err));
     }
 
+    // A failed fetch leaves the published prices as they were
+    if (err == ESP_OK) {
+        portENTER_CRITICAL(&prices_lock);
+        memcpy(daily_prices, parsed_prices, sizeof(daily_prices));
+        portEXIT_CRITICAL(&prices_lock);
+        memcpy(prices, parsed_prices, sizeof(parsed_prices));
+    }
+
     esp_http_client_cleanup(client);
+    static_alloc_exempt_end();
+    ESP_LOGD(TAG,
+             "Fetch used %lu of %d arena bytes in %lu blocks",
+             (unsigned long)fetch_arena.used,
+             PRICE_FETCH_ARENA_BYTES,
+             (unsigned long)fetch_arena.allocations);
+    arena_reset(&fetch_arena);
+    power_lock_release(POWER_LOCK_CPU_MAX);
     return err;
 }
 
+void price_fetcher_set_today_prices(const price_data_t prices[24]) {
+    portENTER_CRITICAL(&prices_lock);
+    for (int i = 0; i < 24; i++) {
+        daily_prices[i].hour = i;
+        daily_prices[i].price_eur_kwh = prices[i].price_eur_kwh;
+    }
+    portEXIT_CRITICAL(&prices_lock);
+}
+
 float price_fetcher_get_current_price(void) {
     // Get current hour
     time_t now;
@@ -129,14 +249,25 @@ float price_fetcher_get_current_price(void) {
     localtime_r(&now, &timeinfo);
 
     int hour = timeinfo.tm_hour;
+    float price;
+    portENTER_CRITICAL(&prices_lock);
     if (hour >= 0 && hour < 24) {
         current_price = daily_prices[hour].price_eur_kwh;
     }
-
-    return current_price;
+    price = current_price;
+    portEXIT_CRITICAL(&prices_lock);
+    return price;
 }
 
 bool price_fetcher_is_low_price_period(void) {
     float current = price_fetcher_get_current_price();
     return (current > 0 && current < PRICE_THRESHOLD_LOW);
-}
\ No newline at end of file
+}
+
+esp_err_t price_fetcher_get_arena_stats(arena_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = fetch_arena;
+    return ESP_OK;
+}
@@ -24,6 +24,34 @@ typedef struct {
  */
 esp_err_t pump_controller_init(void);
 
+/**
+ * @brief Initialize the pump controller straight into a mode, without stopping the pump first
+ *
+ * For the boot after a reset: relays start in the mode's state, and the inverter link is sent the
+ * mode's speed instead of a stop.
+ *
+ * @param mode Mode to run in from the start
+ * @return ESP_OK on success
+ */
+esp_err_t pump_controller_restore(pump_mode_t mode);
+
+/**
+ * @brief Initialize the pump controller without commanding the pump at all
+ *
+ * For the inverter timer offload: the inverter's own timer runs the pump, so the boot only opens the
+ * link for the daily re-programming and neither starts nor stops it.
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED when driving the inverter through relays
+ */
+esp_err_t pump_controller_attach(void);
+
+/**
+ * @brief Initialize the pump controller over relays held through deep sleep, without stopping the pump
+ * @param mode Mode to run in once the hold is released: the held one, or the next one of the plan
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED with the RS485 inverter link
+ */
+esp_err_t pump_controller_resume(pump_mode_t mode);
+
 /**
  * @brief Set pump operating mode
  * @param mode Pump operating mode
@@ -38,6 +66,13 @@ esp_err_t pump_controller_set_mode(pump_mode_t mode);
  */
 esp_err_t pump_controller_get_status(pump_status_t *status);
 
+/**
+ * @brief Speed a mode runs the pump at
+ * @param mode Pump operating mode
+ * @return RPM, 0 for off or an invalid mode
+ */
+int pump_controller_get_mode_rpm(pump_mode_t mode);
+
 /**
  * @brief Start pump operation
  * @return ESP_OK on success
@@ -50,6 +85,13 @@ esp_err_t pump_controller_start(void);
  */
 esp_err_t pump_controller_stop(void);
 
+/**
+ * @brief Run the pump at an arbitrary speed (RS485 inverter link only)
+ * @param rpm Speed in RPM
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED when driving the inverter through relays
+ */
+esp_err_t pump_controller_set_rpm(int rpm);
+
 /**
  * @brief Run backwash cycle
  * @param duration_minutes Duration of backwash in minutes
@@ -1,7 +1,9 @@
 #include "pump_controller.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "pool_pump/vario_inverter.h"
 #include "relay_control.h"
+#include "sdkconfig.h"
 #include <string.h>
 
 static const char *TAG = "pump_controller";
@@ -29,12 +31,30 @@ static const pump_config_t pump_configs[] = {[PUMP_MODE_OFF] = {false, false, fa
 static pump_status_t current_status = {
     .mode = PUMP_MODE_OFF, .runtime_hours = 0, .is_running = false, .current_rpm = 0};
 
+#ifndef CONFIG_POOL_PUMP_INVERTER_MODBUS
+static uint32_t relay_mask_of(const pump_config_t *config) {
+    return (config->relay1 ? 1UL << RELAY_1 : 0) | (config->relay2 ? 1UL << RELAY_2 : 0) |
+           (config->relay3 ? 1UL << RELAY_3 : 0);
+}
+#endif
+
 esp_err_t pump_controller_init(void) {
+#ifdef CONFIG_POOL_PUMP_INVERTER_MODBUS
+    esp_err_t ret = vario_inverter_init();
+    if (ret == ESP_OK) {
+        ret = vario_inverter_stop();
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize inverter link");
+        return ret;
+    }
+#else
     esp_err_t ret = relay_control_init();
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to initialize relay control");
         return ret;
     }
+#endif
 
     // Ensure pump starts in OFF state
     current_status.mode = PUMP_MODE_OFF;
@@ -45,6 +65,68 @@ esp_err_t pump_controller_init(void) {
     return ESP_OK;
 }
 
+esp_err_t pump_controller_restore(pump_mode_t mode) {
+    if (mode < PUMP_MODE_OFF || mode > PUMP_MODE_BACKWASH) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const pump_config_t *config = &pump_configs[mode];
+#ifdef CONFIG_POOL_PUMP_INVERTER_MODBUS
+    // The inverter kept running through our reset; only a different speed changes anything
+    esp_err_t ret = vario_inverter_init();
+    if (ret == ESP_OK) {
+        ret = (config->rpm > 0) ? vario_inverter_set_speed(config->rpm) : vario_inverter_stop();
+    }
+#else
+    esp_err_t ret = relay_control_restore(relay_mask_of(config));
+#endif
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to restore mode %d", mode);
+        return ret;
+    }
+
+    current_status.mode = mode;
+    current_status.is_running = config->rpm > 0;
+    current_status.current_rpm = config->rpm;
+    ESP_LOGI(TAG, "Pump controller restored in mode %d (RPM: %d)", mode, config->rpm);
+    return ESP_OK;
+}
+
+esp_err_t pump_controller_attach(void) {
+#ifdef CONFIG_POOL_PUMP_INVERTER_MODBUS
+    esp_err_t ret = vario_inverter_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize inverter link");
+        return ret;
+    }
+    ESP_LOGI(TAG, "Pump controller attached, the inverter keeps its own schedule");
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t pump_controller_resume(pump_mode_t mode) {
+    if (mode < PUMP_MODE_OFF || mode > PUMP_MODE_BACKWASH) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+#ifdef CONFIG_POOL_PUMP_INVERTER_MODBUS
+    return ESP_ERR_NOT_SUPPORTED;
+#else
+    const pump_config_t *config = &pump_configs[mode];
+    esp_err_t ret = relay_control_resume(relay_mask_of(config));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    current_status.mode = mode;
+    current_status.is_running = config->rpm > 0;
+    current_status.current_rpm = config->rpm;
+    return ESP_OK;
+#endif
+}
+
 esp_err_t pump_controller_set_mode(pump_mode_t mode) {
     if (mode < PUMP_MODE_OFF || mode > PUMP_MODE_BACKWASH) {
         ESP_LOGE(TAG, "Invalid pump mode: %d", mode);
@@ -53,11 +135,13 @@ esp_err_t pump_controller_set_mode(pump_mode_t mode) {
 
     const pump_config_t *config = &pump_configs[mode];
 
-    // Set relay states for the selected mode
-    esp_err_t ret = ESP_OK;
-    ret |= relay_control_set(RELAY_1, config->relay1);
-    ret |= relay_control_set(RELAY_2, config->relay2);
-    ret |= relay_control_set(RELAY_3, config->relay3);
+#ifdef CONFIG_POOL_PUMP_INVERTER_MODBUS
+    esp_err_t ret = (config->rpm > 0) ? vario_inverter_set_speed(config->rpm) : vario_inverter_stop();
+#else
+    // Set relay states for the selected mode in one output transaction
+    uint32_t mode_mask = relay_mask_of(config);
+    esp_err_t ret = relay_control_update_mask((1UL << RELAY_1) | (1UL << RELAY_2) | (1UL << RELAY_3), mode_mask);
+#endif
 
     if (ret == ESP_OK) {
         current_status.mode = mode;
@@ -79,6 +163,13 @@ esp_err_t pump_controller_get_status(pump_status_t *status) {
     return ESP_OK;
 }
 
+int pump_controller_get_mode_rpm(pump_mode_t mode) {
+    if (mode < PUMP_MODE_OFF || mode > PUMP_MODE_BACKWASH) {
+        return 0;
+    }
+    return pump_configs[mode].rpm;
+}
+
 esp_err_t pump_controller_start(void) {
     if (current_status.mode == PUMP_MODE_OFF) {
         ESP_LOGW(TAG, "Cannot start pump in OFF mode");
@@ -95,13 +186,36 @@ esp_err_t pump_controller_stop(void) {
     current_status.mode = PUMP_MODE_OFF;
     current_status.current_rpm = 0;
 
+#ifdef CONFIG_POOL_PUMP_INVERTER_MODBUS
+    esp_err_t ret = vario_inverter_stop();
+#else
     // Turn off all relays
     esp_err_t ret = relay_control_all_off();
+#endif
 
     ESP_LOGI(TAG, "Pump stopped");
     return ret;
 }
 
+esp_err_t pump_controller_set_rpm(int rpm) {
+#ifdef CONFIG_POOL_PUMP_INVERTER_MODBUS
+    if (rpm < VARIO_MIN_RPM || rpm > VARIO_MAX_RPM) {
+        ESP_LOGE(TAG, "Invalid pump speed: %d RPM", rpm);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = vario_inverter_set_speed((uint16_t)rpm);
+    if (ret == ESP_OK) {
+        current_status.current_rpm = rpm;
+        current_status.is_running = true;
+    }
+    return ret;
+#else
+    ESP_LOGW(TAG, "Continuous speed control requires the RS485 inverter link");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
 esp_err_t pump_controller_run_backwash(int duration_minutes) {
     ESP_LOGI(TAG, "Starting backwash cycle for %d minutes", duration_minutes);
 
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RELAY_OUTPUT_MAX_CHANNELS 32
+
+// Output hardware underneath relay_control: native GPIOs, an I2C expander or a shift register chain.
+// Every call commits or samples the whole output mask in a single bus transaction.
+typedef struct {
+    const char *name;
+    uint8_t channels; // Usable outputs, bit n of a mask is channel n
+    esp_err_t (*init)(void *ctx);
+    esp_err_t (*write)(void *ctx, uint32_t mask);
+    // Read the output levels back; NULL when the hardware cannot be read (74HC595)
+    esp_err_t (*read)(void *ctx, uint32_t *mask);
+    // Latch the output levels so they survive deep sleep and a restart; NULL when the hardware cannot hold them
+    esp_err_t (*hold)(void *ctx, bool hold);
+    void *ctx;
+} relay_output_backend_t;
+
+typedef struct {
+    int pins[RELAY_OUTPUT_MAX_CHANNELS]; // GPIO per channel, all below 32
+    uint8_t count;
+} relay_output_gpio_config_t;
+
+typedef enum {
+    RELAY_EXPANDER_PCF8574 = 0, // 8 quasi-bidirectional outputs
+    RELAY_EXPANDER_MCP23017,    // 16 outputs on ports A and B
+} relay_expander_type_t;
+
+typedef struct {
+    relay_expander_type_t type;
+    int port;
+    int sda_pin;
+    int scl_pin;
+    uint32_t clock_hz;
+    uint8_t address; // 7-bit I2C address
+    bool active_low; // Relay board energises on a low output (typical for PCF8574 boards)
+    uint32_t timeout_ms;
+} relay_output_i2c_config_t;
+
+typedef struct {
+    int host; // SPI host, e.g. SPI2_HOST
+    int data_pin;
+    int clock_pin;
+    int latch_pin; // RCLK, driven as chip select so the outputs latch at the end of the transfer
+    int clock_hz;
+    uint8_t chain_length; // Number of daisy-chained 74HC595s (1-4)
+} relay_output_hc595_config_t;
+
+/**
+ * @brief Describe native GPIO outputs; each write is one set and one clear register access
+ *
+ * The pads can be held through deep sleep and software resets; their levels are then frozen until the hold is released.
+ *
+ * @param config Pin per channel (copied)
+ * @param backend Backend to fill
+ * @return ESP_OK on success
+ */
+esp_err_t relay_output_gpio_create(const relay_output_gpio_config_t *config, relay_output_backend_t *backend);
+
+/**
+ * @brief Describe a PCF8574 or MCP23017 expander; each write is one I2C transaction
+ * @param config Bus and device settings (copied)
+ * @param backend Backend to fill
+ * @return ESP_OK on success
+ */
+esp_err_t relay_output_i2c_create(const relay_output_i2c_config_t *config, relay_output_backend_t *backend);
+
+/**
+ * @brief Describe a 74HC595 chain on SPI; each write shifts the whole chain and latches once
+ * @param config Bus and chain settings (copied)
+ * @param backend Backend to fill
+ * @return ESP_OK on success
+ */
+esp_err_t relay_output_hc595_create(const relay_output_hc595_config_t *config, relay_output_backend_t *backend);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,7 +2,10 @@
 #define RELAY_CONTROL_H
 
 #include "esp_err.h"
+#include "esp_event.h"
+#include "pool_pump/relay_output.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef enum {
     RELAY_1 = 0, // DI2 - Night mode (1400 RPM)
@@ -12,15 +15,85 @@ typedef enum {
     RELAY_MAX
 } relay_num_t;
 
+ESP_EVENT_DECLARE_BASE(RELAY_CONTROL_EVENT);
+
+typedef enum {
+    RELAY_EVENT_STUCK_FAULT = 0, // Output readback disagrees with the commanded state
+    RELAY_EVENT_FEEDBACK_FAULT,  // Contact feedback input disagrees with the pump relays
+    RELAY_EVENT_FAULT_CLEARED,   // Readback matches again after a fault
+} relay_event_id_t;
+
+typedef struct {
+    uint32_t commanded_mask; // Bit n set = RELAY_n commanded ON
+    uint32_t actual_mask;    // Bit n set = RELAY_n output reads back ON
+    bool feedback_level;     // Level of the contact feedback input (if configured)
+} relay_fault_event_t;
+
+typedef struct {
+    uint32_t samples;          // Readback samples taken
+    uint32_t skipped;          // Samples discarded because a write overlapped them
+    uint32_t mismatches;       // Samples where readback differed from the command
+    uint32_t stuck_faults;     // Confirmed stuck-relay faults raised
+    uint32_t feedback_faults;  // Confirmed contact-feedback faults raised
+    uint32_t last_actual_mask; // Relay mask from the most recent sample
+    bool fault_active;         // A fault is currently latched
+} relay_verify_stats_t;
+
 /**
- * @brief Initialize relay control system
+ * @brief Select the output backend used by the next relay_control_init() or relay_control_restore()
+ *
+ * Without a call, the backend chosen in menuconfig is used with the pins from config.h.
+ *
+ * @param backend Backend (copied), or NULL for the menuconfig default
+ * @return ESP_OK on success
+ */
+esp_err_t relay_control_set_backend(const relay_output_backend_t *backend);
+
+/**
+ * @brief Initialize relay control system with all relays off
  * @return ESP_OK on success
  */
 esp_err_t relay_control_init(void);
 
+/**
+ * @brief Initialize relay control with the relays in a known state instead of all off
+ *
+ * For the boot after a reset, when the state to run in is already known. The mask is driven as the
+ * first state of the outputs; pads held through esp_restart() switch to it in one step. Backends
+ * that can hold their outputs hold them on every esp_restart() from here on.
+ *
+ * @param mask Relay mask to start with
+ * @return ESP_OK on success
+ */
+esp_err_t relay_control_restore(uint32_t mask);
+
+/**
+ * @brief Initialize relay control over outputs held through deep sleep, without resetting them
+ *
+ * The mask is loaded into the backend before the hold is released, so the outputs go straight
+ * from the held levels to it: the held mask keeps them, a new one switches in the same step.
+ * Use instead of relay_control_init() after relay_control_hold().
+ *
+ * @param mask Relay mask to drive once the hold is released
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if the backend cannot hold its outputs
+ */
+esp_err_t relay_control_resume(uint32_t mask);
+
+/**
+ * @brief Freeze the outputs at their current levels until relay_control_resume()
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if the backend cannot hold its outputs
+ */
+esp_err_t relay_control_hold(void);
+
+/**
+ * @brief Get the number of outputs on the active backend
+ * @return Channel count, 0 before initialization
+ */
+uint8_t relay_control_get_channel_count(void);
+
 /**
  * @brief Set relay state
- * @param relay_num Relay number (0-3)
+ * @param relay_num Relay number (0 to channel count - 1)
  * @param state true to activate, false to deactivate
  * @return ESP_OK on success
  */
@@ -28,12 +101,20 @@ esp_err_t relay_control_set(relay_num_t relay_num, bool state);
 
 /**
  * @brief Get relay state
- * @param relay_num Relay number (0-3)
+ * @param relay_num Relay number (0 to channel count - 1)
  * @param state Pointer to store state
  * @return ESP_OK on success
  */
 esp_err_t relay_control_get(relay_num_t relay_num, bool *state);
 
+/**
+ * @brief Change several relays at once in a single bus transaction
+ * @param clear_mask Relays to switch off
+ * @param set_mask Relays to switch on (applied after clear_mask)
+ * @return ESP_OK on success
+ */
+esp_err_t relay_control_update_mask(uint32_t clear_mask, uint32_t set_mask);
+
 /**
  * @brief Turn off all relays
  * @return ESP_OK on success
@@ -47,4 +128,37 @@ esp_err_t relay_control_all_off(void);
  */
 esp_err_t relay_control_set_pump_mode(int mode);
 
+/**
+ * @brief Get the commanded relay states as a bit mask
+ * @return Bit n set when RELAY_n is commanded ON
+ */
+uint32_t relay_control_get_mask(void);
+
+/**
+ * @brief Start periodic readback verification of the relay outputs
+ *
+ * Runs from an esp_timer callback; each sample is a single backend read (one GPIO input
+ * register read or one I2C transaction) compared against the commanded mask. A mismatch must persist for
+ * RELAY_VERIFY_CONFIRM_SAMPLES samples before RELAY_EVENT_STUCK_FAULT is posted, so
+ * in-flight switching is never reported and the switching path takes no lock.
+ *
+ * @param period_ms Sampling period in milliseconds
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if the backend has no readback
+ */
+esp_err_t relay_control_start_verification(uint32_t period_ms);
+
+/**
+ * @brief Take one readback sample immediately
+ * @return ESP_OK if readback matches, ESP_ERR_INVALID_STATE on mismatch, ESP_ERR_TIMEOUT if a write
+ *         overlapped the sample and it was discarded
+ */
+esp_err_t relay_control_verify_now(void);
+
+/**
+ * @brief Get readback verification statistics
+ * @param stats Pointer to store statistics
+ * @return ESP_OK on success
+ */
+esp_err_t relay_control_get_verify_stats(relay_verify_stats_t *stats);
+
 #endif // RELAY_CONTROL_H
@@ -2,65 +2,271 @@
 #include "config.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "pool_pump/power.h"
+#include "pool_pump/static_alloc.h"
+#include "sdkconfig.h"
 
 static const char *TAG = "RELAY_CONTROL";
 
-static bool relay_states[RELAY_MAX] = {false};
-
-static gpio_num_t relay_pin_from_num(relay_num_t relay_num) {
-    switch (relay_num) {
-        case RELAY_1:
-            return RELAY_1_PIN;
-        case RELAY_2:
-            return RELAY_2_PIN;
-        case RELAY_3:
-            return RELAY_3_PIN;
-        case RELAY_4:
-            return RELAY_4_PIN;
-        default:
-            return GPIO_NUM_NC;
+ESP_EVENT_DEFINE_BASE(RELAY_CONTROL_EVENT);
+
+#define PUMP_RELAY_MASK ((1UL << RELAY_1) | (1UL << RELAY_2) | (1UL << RELAY_3))
+
+// Backend picked for the next init, and the one currently driving the outputs
+static relay_output_backend_t selected_backend;
+static bool backend_selected = false;
+static relay_output_backend_t backend;
+static bool initialized = false;
+
+// Serialises read-modify-write of the mask with the bus transaction that commits it
+static SemaphoreHandle_t relay_mutex = NULL;
+
+// Bit n set = RELAY_n commanded ON. Written only by the switching path, read by the verifier.
+static volatile uint32_t relay_commanded_mask = 0;
+
+// Odd while a write is on its way to the outputs. The verifier takes no lock and instead discards a sample
+// that overlapped a write, so switching never waits on a readback
+static uint32_t write_generation = 0;
+
+static esp_timer_handle_t verify_timer = NULL;
+// Guards the statistics and streaks; both sampling contexts update them, never across a bus transaction
+static portMUX_TYPE verify_lock = portMUX_INITIALIZER_UNLOCKED;
+static relay_verify_stats_t verify_stats = {0};
+static uint32_t mismatch_streak = 0;
+static uint32_t feedback_streak = 0;
+
+static void begin_write(void) { __atomic_fetch_add(&write_generation, 1, __ATOMIC_ACQ_REL); }
+
+static void end_write(void) { __atomic_fetch_add(&write_generation, 1, __ATOMIC_ACQ_REL); }
+
+static esp_err_t create_default_backend(relay_output_backend_t *out) {
+#if defined(CONFIG_POOL_PUMP_RELAY_BACKEND_PCF8574) || defined(CONFIG_POOL_PUMP_RELAY_BACKEND_MCP23017)
+    const relay_output_i2c_config_t config = {
+#ifdef CONFIG_POOL_PUMP_RELAY_BACKEND_MCP23017
+        .type = RELAY_EXPANDER_MCP23017,
+#else
+        .type = RELAY_EXPANDER_PCF8574,
+#endif
+        .port = RELAY_I2C_PORT,
+        .sda_pin = RELAY_I2C_SDA_PIN,
+        .scl_pin = RELAY_I2C_SCL_PIN,
+        .clock_hz = RELAY_I2C_CLOCK_HZ,
+        .address = RELAY_EXPANDER_ADDRESS,
+        .active_low = RELAY_EXPANDER_ACTIVE_LOW,
+        .timeout_ms = RELAY_I2C_TIMEOUT_MS,
+    };
+    return relay_output_i2c_create(&config, out);
+#elif defined(CONFIG_POOL_PUMP_RELAY_BACKEND_HC595)
+    const relay_output_hc595_config_t config = {
+        .host = RELAY_HC595_SPI_HOST,
+        .data_pin = RELAY_HC595_DATA_PIN,
+        .clock_pin = RELAY_HC595_CLOCK_PIN,
+        .latch_pin = RELAY_HC595_LATCH_PIN,
+        .clock_hz = RELAY_HC595_CLOCK_HZ,
+        .chain_length = RELAY_HC595_CHAIN_LENGTH,
+    };
+    return relay_output_hc595_create(&config, out);
+#else
+    // Native outputs are written and read back through the GPIO0-31 registers
+    _Static_assert(RELAY_1_PIN < 32 && RELAY_2_PIN < 32 && RELAY_3_PIN < 32 && RELAY_4_PIN < 32,
+                   "Native relay outputs must be in GPIO0-31");
+    const relay_output_gpio_config_t config = {
+        .pins = {RELAY_1_PIN, RELAY_2_PIN, RELAY_3_PIN, RELAY_4_PIN},
+        .count = RELAY_MAX,
+    };
+    return relay_output_gpio_create(&config, out);
+#endif
+}
+
+esp_err_t relay_control_set_backend(const relay_output_backend_t *new_backend) {
+    if (new_backend != NULL && (new_backend->write == NULL || new_backend->channels == 0 ||
+                                new_backend->channels > RELAY_OUTPUT_MAX_CHANNELS)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    backend_selected = new_backend != NULL;
+    if (backend_selected) {
+        selected_backend = *new_backend;
     }
+    return ESP_OK;
 }
 
-esp_err_t relay_control_init(void) {
-    ESP_LOGI(TAG, "Initializing relay control...");
+// Bring up the backend and the feedback input without touching the outputs
+static esp_err_t init_backend(bool held) {
+    if (relay_mutex == NULL) {
+        relay_mutex = static_alloc_mutex();
+        if (relay_mutex == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    relay_output_backend_t next = selected_backend;
+    esp_err_t ret = backend_selected ? ESP_OK : create_default_backend(&next);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Invalid relay output configuration");
+        return ret;
+    }
+    if (held && next.hold == NULL) {
+        // Outputs that cannot be held were not kept through the sleep
+        return ESP_ERR_NOT_SUPPORTED;
+    }
 
-    gpio_config_t io_conf = {
-        .mode = GPIO_MODE_OUTPUT,
-        .pull_up_en = GPIO_PULLUP_DISABLE,
+    ret = next.init != NULL ? next.init(next.ctx) : ESP_OK;
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize %s outputs", next.name);
+        return ret;
+    }
+
+    xSemaphoreTake(relay_mutex, portMAX_DELAY);
+    begin_write();
+    backend = next;
+    initialized = true;
+    end_write();
+    xSemaphoreGive(relay_mutex);
+
+#if RELAY_FEEDBACK_PIN >= 0
+    gpio_config_t feedback_conf = {
+        .pin_bit_mask = 1ULL << RELAY_FEEDBACK_PIN,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
         .intr_type = GPIO_INTR_DISABLE,
     };
+    ret = gpio_config(&feedback_conf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure relay feedback input");
+        return ret;
+    }
+#endif
+    return ESP_OK;
+}
+
+// Load the first mask and let go of any hold, so held outputs switch to it in one step
+static esp_err_t drive_first_mask(uint32_t mask) {
+    xSemaphoreTake(relay_mutex, portMAX_DELAY);
+    begin_write();
+    esp_err_t ret = backend.write(backend.ctx, mask);
+    if (ret == ESP_OK) {
+        relay_commanded_mask = mask;
+        // Held pads ignore the output registers, so the release is the only edge the relays see
+        ret = backend.hold != NULL ? backend.hold(backend.ctx, false) : ESP_OK;
+    }
+    end_write();
+    xSemaphoreGive(relay_mutex);
+    return ret;
+}
+
+// Run by esp_restart(): the pads keep their levels through the reboot until relay_control_restore()
+static void hold_for_restart(void) {
+    if (initialized && backend.hold != NULL) {
+        backend.hold(backend.ctx, true);
+    }
+}
 
-    // Configure all relay pins
-    io_conf.pin_bit_mask =
-        (1ULL << RELAY_1_PIN) | (1ULL << RELAY_2_PIN) | (1ULL << RELAY_3_PIN) | (1ULL << RELAY_4_PIN);
+esp_err_t relay_control_init(void) {
+    ESP_LOGI(TAG, "Initializing relay control...");
+
+    return relay_control_restore(0);
+}
 
-    esp_err_t ret = gpio_config(&io_conf);
+esp_err_t relay_control_restore(uint32_t mask) {
+    esp_err_t ret = init_backend(false);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to configure GPIO pins");
         return ret;
     }
 
-    // Initialize all relays to OFF state
-    relay_control_all_off();
+    uint32_t valid = backend.channels >= 32 ? UINT32_MAX : (1UL << backend.channels) - 1;
+    ret = drive_first_mask(mask & valid);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to restore relay mask 0x%02lx: %s", (unsigned long)mask, esp_err_to_name(ret));
+        return ret;
+    }
 
-    ESP_LOGI(TAG, "Relay control initialized successfully");
+    static bool restart_hold_registered = false;
+    if (backend.hold != NULL && !restart_hold_registered) {
+        restart_hold_registered = esp_register_shutdown_handler(hold_for_restart) == ESP_OK;
+    }
+
+    ESP_LOGI(TAG,
+             "Relay control initialized on %s backend (%d outputs), relays at 0x%02lx",
+             backend.name,
+             backend.channels,
+             (unsigned long)relay_commanded_mask);
     return ESP_OK;
 }
 
+esp_err_t relay_control_resume(uint32_t mask) {
+    esp_err_t ret = init_backend(true);
+    if (ret == ESP_OK) {
+        ret = drive_first_mask(mask);
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to take over held relays: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+esp_err_t relay_control_hold(void) {
+    if (!initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (backend.hold == NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    xSemaphoreTake(relay_mutex, portMAX_DELAY);
+    esp_err_t ret = backend.hold(backend.ctx, true);
+    xSemaphoreGive(relay_mutex);
+
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Relays held at 0x%02lx", (unsigned long)relay_commanded_mask);
+    }
+    return ret;
+}
+
+uint8_t relay_control_get_channel_count(void) { return initialized ? backend.channels : 0; }
+
+esp_err_t relay_control_update_mask(uint32_t clear_mask, uint32_t set_mask) {
+    if (!initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t valid = backend.channels >= 32 ? UINT32_MAX : (1UL << backend.channels) - 1;
+    if ((set_mask & ~valid) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(relay_mutex, portMAX_DELAY);
+    uint32_t mask = ((relay_commanded_mask & ~clear_mask) | set_mask) & valid;
+    begin_write();
+    esp_err_t ret = backend.write(backend.ctx, mask);
+    if (ret == ESP_OK) {
+        relay_commanded_mask = mask;
+    }
+    end_write();
+    xSemaphoreGive(relay_mutex);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write relay mask 0x%02lx: %s", (unsigned long)mask, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
 esp_err_t relay_control_set(relay_num_t relay_num, bool state) {
-    if (relay_num >= RELAY_MAX) {
+    if (relay_num >= relay_control_get_channel_count()) {
         ESP_LOGE(TAG, "Invalid relay number: %d", relay_num);
         return ESP_ERR_INVALID_ARG;
     }
 
-    gpio_num_t pin = relay_pin_from_num(relay_num);
-    esp_err_t ret = gpio_set_level(pin, state);
+    uint32_t bit = 1UL << relay_num;
+    esp_err_t ret = relay_control_update_mask(bit, state ? bit : 0);
     if (ret == ESP_OK) {
-        relay_states[relay_num] = state;
         ESP_LOGI(TAG, "Relay %d set to %s", relay_num, state ? "ON" : "OFF");
     }
 
@@ -68,30 +274,26 @@ esp_err_t relay_control_set(relay_num_t relay_num, bool state) {
 }
 
 esp_err_t relay_control_get(relay_num_t relay_num, bool *state) {
-    if (relay_num >= RELAY_MAX || state == NULL) {
+    if (relay_num >= RELAY_OUTPUT_MAX_CHANNELS || state == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    *state = relay_states[relay_num];
+    *state = (relay_commanded_mask & (1UL << relay_num)) != 0;
     return ESP_OK;
 }
 
 esp_err_t relay_control_all_off(void) {
     ESP_LOGI(TAG, "Turning off all relays");
 
-    for (int i = 0; i < RELAY_MAX; i++) {
-        gpio_set_level(relay_pin_from_num((relay_num_t)i), 0);
-        relay_states[i] = false;
-    }
-
-    return ESP_OK;
+    return relay_control_update_mask(UINT32_MAX, 0);
 }
 
-esp_err_t relay_control_set_pump_mode(int mode) {
-    // First turn off all pump relays
-    relay_control_set(RELAY_1, false); // Night mode off
-    relay_control_set(RELAY_2, false); // Day mode off
-    relay_control_set(RELAY_3, false); // Backwash mode off
+static esp_err_t switch_pump_relays(int mode) {
+    // First turn off all pump relays in one transaction
+    esp_err_t ret = relay_control_update_mask(PUMP_RELAY_MASK, 0);
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
     // Small delay to ensure clean switching
     vTaskDelay(pdMS_TO_TICKS(100));
@@ -101,15 +303,15 @@ esp_err_t relay_control_set_pump_mode(int mode) {
             ESP_LOGI(TAG, "Pump mode set to OFF");
             break;
         case 1: // Night mode (1400 RPM)
-            relay_control_set(RELAY_1, true);
+            ret = relay_control_update_mask(0, 1UL << RELAY_1);
             ESP_LOGI(TAG, "Pump mode set to NIGHT (1400 RPM)");
             break;
         case 2: // Day mode (2000 RPM)
-            relay_control_set(RELAY_2, true);
+            ret = relay_control_update_mask(0, 1UL << RELAY_2);
             ESP_LOGI(TAG, "Pump mode set to DAY (2000 RPM)");
             break;
         case 3: // Backwash mode (2900 RPM)
-            relay_control_set(RELAY_3, true);
+            ret = relay_control_update_mask(0, 1UL << RELAY_3);
             ESP_LOGI(TAG, "Pump mode set to BACKWASH (2900 RPM)");
             break;
         default:
@@ -117,5 +319,151 @@ esp_err_t relay_control_set_pump_mode(int mode) {
             return ESP_ERR_INVALID_ARG;
     }
 
+    return ret;
+}
+
+esp_err_t relay_control_set_pump_mode(int mode) {
+    // Stay awake through the break-before-make sequence so the gap between its writes is not stretched
+    power_lock_acquire(POWER_LOCK_NO_SLEEP);
+    esp_err_t ret = switch_pump_relays(mode);
+    power_lock_release(POWER_LOCK_NO_SLEEP);
+    return ret;
+}
+
+uint32_t relay_control_get_mask(void) { return relay_commanded_mask; }
+
+static void post_fault_event(relay_event_id_t event_id, uint32_t commanded, uint32_t actual, bool feedback) {
+    relay_fault_event_t event = {
+        .commanded_mask = commanded,
+        .actual_mask = actual,
+        .feedback_level = feedback,
+    };
+    // Never block the sampling context; a full event queue only drops the notification
+    esp_event_post(RELAY_CONTROL_EVENT, event_id, &event, sizeof(event), 0);
+}
+
+// Runs on the esp_timer task and from relay_control_verify_now(). It never takes relay_mutex: the backends
+// serialise their own bus transactions, and a sample taken while a write was in flight is discarded
+static esp_err_t verify_sample(void) {
+    uint32_t generation = __atomic_load_n(&write_generation, __ATOMIC_ACQUIRE);
+    uint32_t commanded = relay_commanded_mask;
+    uint32_t actual = 0;
+    esp_err_t ret = (generation & 1) == 0 ? backend.read(backend.ctx, &actual) : ESP_ERR_TIMEOUT;
+    if (ret == ESP_OK && __atomic_load_n(&write_generation, __ATOMIC_ACQUIRE) != generation) {
+        ret = ESP_ERR_TIMEOUT;
+    }
+    if (ret == ESP_ERR_TIMEOUT) {
+        portENTER_CRITICAL(&verify_lock);
+        verify_stats.skipped++;
+        portEXIT_CRITICAL(&verify_lock);
+        return ret;
+    }
+    if (ret != ESP_OK) {
+        // A bus error is not evidence of a stuck relay; the next sample tries again
+        return ESP_OK;
+    }
+
+    bool feedback = false;
+    bool feedback_ok = true;
+#if RELAY_FEEDBACK_PIN >= 0
+    feedback = gpio_get_level(RELAY_FEEDBACK_PIN) == RELAY_FEEDBACK_ACTIVE_LEVEL;
+    feedback_ok = feedback == ((commanded & PUMP_RELAY_MASK) != 0);
+#endif
+
+    portENTER_CRITICAL(&verify_lock);
+    verify_stats.samples++;
+    verify_stats.last_actual_mask = actual;
+
+    bool outputs_ok = (actual == commanded);
+    if (!outputs_ok) {
+        verify_stats.mismatches++;
+    }
+
+    mismatch_streak = outputs_ok ? 0 : mismatch_streak + 1;
+    feedback_streak = feedback_ok ? 0 : feedback_streak + 1;
+
+    bool stuck_raised = mismatch_streak == RELAY_VERIFY_CONFIRM_SAMPLES;
+    if (stuck_raised) {
+        verify_stats.stuck_faults++;
+        verify_stats.fault_active = true;
+    }
+    bool feedback_raised = feedback_streak == RELAY_VERIFY_CONFIRM_SAMPLES;
+    if (feedback_raised) {
+        verify_stats.feedback_faults++;
+        verify_stats.fault_active = true;
+    }
+    bool ok = outputs_ok && feedback_ok;
+    bool cleared = ok && verify_stats.fault_active;
+    if (cleared) {
+        verify_stats.fault_active = false;
+    }
+    portEXIT_CRITICAL(&verify_lock);
+
+    if (stuck_raised) {
+        ESP_LOGE(TAG,
+                 "Stuck relay: commanded 0x%02lx, read back 0x%02lx",
+                 (unsigned long)commanded,
+                 (unsigned long)actual);
+        post_fault_event(RELAY_EVENT_STUCK_FAULT, commanded, actual, feedback);
+    }
+    if (feedback_raised) {
+        ESP_LOGE(TAG,
+                 "Relay feedback %s while pump relays are %s",
+                 feedback ? "active" : "inactive",
+                 (commanded & PUMP_RELAY_MASK) ? "on" : "off");
+        post_fault_event(RELAY_EVENT_FEEDBACK_FAULT, commanded, actual, feedback);
+    }
+    if (cleared) {
+        ESP_LOGI(TAG, "Relay readback matches again");
+        post_fault_event(RELAY_EVENT_FAULT_CLEARED, commanded, actual, feedback);
+    }
+
+    return ok ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+static void verify_timer_callback(void *arg) { verify_sample(); }
+
+esp_err_t relay_control_start_verification(uint32_t period_ms) {
+    if (period_ms == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!initialized || backend.read == NULL) {
+        ESP_LOGW(TAG, "Relay outputs cannot be read back, verification disabled");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (verify_timer == NULL) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = verify_timer_callback,
+            .name = "relay_verify",
+        };
+        esp_err_t ret = esp_timer_create(&timer_args, &verify_timer);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create verification timer: %s", esp_err_to_name(ret));
+            return ret;
+        }
+    } else {
+        esp_timer_stop(verify_timer);
+    }
+
+    ESP_LOGI(TAG, "Relay readback verification every %lu ms", (unsigned long)period_ms);
+    return esp_timer_start_periodic(verify_timer, (uint64_t)period_ms * 1000);
+}
+
+esp_err_t relay_control_verify_now(void) {
+    if (!initialized || backend.read == NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return verify_sample();
+}
+
+esp_err_t relay_control_get_verify_stats(relay_verify_stats_t *stats) {
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&verify_lock);
+    *stats = verify_stats;
+    portEXIT_CRITICAL(&verify_lock);
     return ESP_OK;
 }
@@ -0,0 +1,98 @@
+#include "driver/gpio.h"
+#include "pool_pump/relay_output.h"
+#include "soc/gpio_reg.h"
+#include "soc/soc.h"
+
+static relay_output_gpio_config_t gpio_config_copy;
+
+static esp_err_t gpio_backend_init(void *ctx) {
+    const relay_output_gpio_config_t *config = ctx;
+
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 0,
+        // Keep the input path enabled so the pad level can be read back for verification
+        .mode = GPIO_MODE_INPUT_OUTPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+    for (int i = 0; i < config->count; i++) {
+        io_conf.pin_bit_mask |= 1ULL << config->pins[i];
+    }
+    return gpio_config(&io_conf);
+}
+
+static esp_err_t gpio_backend_write(void *ctx, uint32_t mask) {
+    const relay_output_gpio_config_t *config = ctx;
+
+    uint32_t set = 0;
+    uint32_t clear = 0;
+    for (int i = 0; i < config->count; i++) {
+        if (mask & (1UL << i)) {
+            set |= 1UL << config->pins[i];
+        } else {
+            clear |= 1UL << config->pins[i];
+        }
+    }
+
+    // Clear before set so a mode change never briefly has two speed inputs active
+    REG_WRITE(GPIO_OUT_W1TC_REG, clear);
+    REG_WRITE(GPIO_OUT_W1TS_REG, set);
+    return ESP_OK;
+}
+
+static esp_err_t gpio_backend_read(void *ctx, uint32_t *mask) {
+    const relay_output_gpio_config_t *config = ctx;
+
+    uint32_t levels = REG_READ(GPIO_IN_REG);
+    uint32_t result = 0;
+    for (int i = 0; i < config->count; i++) {
+        if (levels & (1UL << config->pins[i])) {
+            result |= 1UL << i;
+        }
+    }
+    *mask = result;
+    return ESP_OK;
+}
+
+static esp_err_t gpio_backend_hold(void *ctx, bool hold) {
+    const relay_output_gpio_config_t *config = ctx;
+
+    for (int i = 0; i < config->count; i++) {
+        esp_err_t ret = hold ? gpio_hold_en(config->pins[i]) : gpio_hold_dis(config->pins[i]);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    // Digital pads only keep their hold in deep sleep with this on as well
+    if (hold) {
+        gpio_deep_sleep_hold_en();
+    } else {
+        gpio_deep_sleep_hold_dis();
+    }
+    return ESP_OK;
+}
+
+esp_err_t relay_output_gpio_create(const relay_output_gpio_config_t *config, relay_output_backend_t *backend) {
+    if (config == NULL || backend == NULL || config->count == 0 || config->count > RELAY_OUTPUT_MAX_CHANNELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < config->count; i++) {
+        // The set/clear and input registers only cover GPIO0-31
+        if (config->pins[i] < 0 || config->pins[i] >= 32) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    gpio_config_copy = *config;
+    *backend = (relay_output_backend_t){
+        .name = "gpio",
+        .channels = config->count,
+        .init = gpio_backend_init,
+        .write = gpio_backend_write,
+        .read = gpio_backend_read,
+        .hold = gpio_backend_hold,
+        .ctx = &gpio_config_copy,
+    };
+    return ESP_OK;
+}
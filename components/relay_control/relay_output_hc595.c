@@ -0,0 +1,81 @@
+#include "driver/spi_master.h"
+#include "esp_log.h"
+#include "pool_pump/relay_output.h"
+
+static const char *TAG = "RELAY_HC595";
+
+#define HC595_MAX_CHAIN 4
+
+static relay_output_hc595_config_t hc595_config_copy;
+static spi_device_handle_t hc595_device = NULL;
+static bool bus_ready = false;
+
+static esp_err_t hc595_backend_write(void *ctx, uint32_t mask) {
+    const relay_output_hc595_config_t *config = ctx;
+
+    // The last chip in the chain is shifted out first; RCLK (chip select) rises once at the end
+    spi_transaction_t transaction = {
+        .flags = SPI_TRANS_USE_TXDATA,
+        .length = 8 * config->chain_length,
+    };
+    for (int i = 0; i < config->chain_length; i++) {
+        transaction.tx_data[i] = (mask >> (8 * (config->chain_length - 1 - i))) & 0xFF;
+    }
+    return spi_device_polling_transmit(hc595_device, &transaction);
+}
+
+static esp_err_t hc595_backend_init(void *ctx) {
+    const relay_output_hc595_config_t *config = ctx;
+
+    // The bus and device stay set up across re-inits, such as a restore after init; setting them up twice
+    // fails. The latches keep the relays as they are until the next write
+    if (hc595_device != NULL) {
+        return ESP_OK;
+    }
+
+    const spi_bus_config_t bus_config = {
+        .mosi_io_num = config->data_pin,
+        .miso_io_num = -1,
+        .sclk_io_num = config->clock_pin,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = HC595_MAX_CHAIN,
+    };
+    esp_err_t ret = bus_ready ? ESP_OK : spi_bus_initialize(config->host, &bus_config, SPI_DMA_DISABLED);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up SPI host %d: %s", config->host, esp_err_to_name(ret));
+        return ret;
+    }
+    bus_ready = true;
+
+    const spi_device_interface_config_t device_config = {
+        .mode = 0,
+        .clock_speed_hz = config->clock_hz,
+        .spics_io_num = config->latch_pin,
+        .queue_size = 1,
+    };
+    ret = spi_bus_add_device(config->host, &device_config, &hc595_device);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to add shift register: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    return hc595_backend_write(ctx, 0);
+}
+
+esp_err_t relay_output_hc595_create(const relay_output_hc595_config_t *config, relay_output_backend_t *backend) {
+    if (config == NULL || backend == NULL || config->chain_length == 0 || config->chain_length > HC595_MAX_CHAIN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    hc595_config_copy = *config;
+    *backend = (relay_output_backend_t){
+        .name = "74hc595",
+        .channels = 8 * config->chain_length,
+        .init = hc595_backend_init,
+        .write = hc595_backend_write,
+        .read = NULL, // Shift register outputs cannot be read back
+        .ctx = &hc595_config_copy,
+    };
+    return ESP_OK;
+}
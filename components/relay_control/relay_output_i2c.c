@@ -0,0 +1,120 @@
+#include "driver/i2c.h"
+#include "esp_log.h"
+#include "pool_pump/relay_output.h"
+
+static const char *TAG = "RELAY_I2C";
+
+#define MCP23017_REG_IODIRA 0x00
+#define MCP23017_REG_GPIOA 0x12
+#define MCP23017_REG_OLATA 0x14
+
+static relay_output_i2c_config_t i2c_config_copy;
+
+// Port whose driver this backend installed, or -1. The driver stays installed across re-inits, such as a
+// restore after init or a retry after a fault, and installing it twice fails
+static int installed_port = -1;
+static bool expander_ready = false; // Latched all-off and switched to outputs once
+
+static uint32_t channel_mask(const relay_output_i2c_config_t *config) {
+    return config->type == RELAY_EXPANDER_MCP23017 ? 0xFFFF : 0xFF;
+}
+
+// Relay mask to pin levels, taking an active-low relay board into account
+static uint32_t to_levels(const relay_output_i2c_config_t *config, uint32_t mask) {
+    return (config->active_low ? ~mask : mask) & channel_mask(config);
+}
+
+static esp_err_t i2c_backend_write(void *ctx, uint32_t mask) {
+    const relay_output_i2c_config_t *config = ctx;
+    uint32_t levels = to_levels(config, mask);
+    TickType_t timeout = pdMS_TO_TICKS(config->timeout_ms);
+
+    if (config->type == RELAY_EXPANDER_MCP23017) {
+        // Sequential mode: OLATA and OLATB in one write
+        const uint8_t frame[3] = {MCP23017_REG_OLATA, levels & 0xFF, levels >> 8};
+        return i2c_master_write_to_device(config->port, config->address, frame, sizeof(frame), timeout);
+    }
+
+    const uint8_t frame[1] = {levels};
+    return i2c_master_write_to_device(config->port, config->address, frame, sizeof(frame), timeout);
+}
+
+static esp_err_t i2c_backend_read(void *ctx, uint32_t *mask) {
+    const relay_output_i2c_config_t *config = ctx;
+    TickType_t timeout = pdMS_TO_TICKS(config->timeout_ms);
+    uint8_t levels[2] = {0};
+    esp_err_t ret;
+
+    if (config->type == RELAY_EXPANDER_MCP23017) {
+        const uint8_t reg = MCP23017_REG_GPIOA;
+        ret = i2c_master_write_read_device(config->port, config->address, &reg, 1, levels, 2, timeout);
+    } else {
+        ret = i2c_master_read_from_device(config->port, config->address, levels, 1, timeout);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    *mask = to_levels(config, levels[0] | ((uint32_t)levels[1] << 8));
+    return ESP_OK;
+}
+
+static esp_err_t i2c_backend_init(void *ctx) {
+    const relay_output_i2c_config_t *config = ctx;
+    esp_err_t ret;
+
+    if (installed_port != config->port) {
+        const i2c_config_t bus_config = {
+            .mode = I2C_MODE_MASTER,
+            .sda_io_num = config->sda_pin,
+            .scl_io_num = config->scl_pin,
+            .sda_pullup_en = GPIO_PULLUP_ENABLE,
+            .scl_pullup_en = GPIO_PULLUP_ENABLE,
+            .master.clk_speed = config->clock_hz,
+        };
+        ret = i2c_param_config(config->port, &bus_config);
+        if (ret == ESP_OK) {
+            ret = i2c_driver_install(config->port, I2C_MODE_MASTER, 0, 0, 0);
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to set up I2C port %d: %s", config->port, esp_err_to_name(ret));
+            return ret;
+        }
+        installed_port = config->port;
+    }
+
+    // Latch the all-off state before any pin becomes an output. A re-init leaves the outputs as they are and
+    // only makes sure the pins are outputs, which an expander that lost power no longer has
+    ret = expander_ready ? ESP_OK : i2c_backend_write(ctx, 0);
+    if (ret == ESP_OK && config->type == RELAY_EXPANDER_MCP23017) {
+        const uint8_t frame[3] = {MCP23017_REG_IODIRA, 0x00, 0x00};
+        ret = i2c_master_write_to_device(
+            config->port, config->address, frame, sizeof(frame), pdMS_TO_TICKS(config->timeout_ms));
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Expander at 0x%02x not responding: %s", config->address, esp_err_to_name(ret));
+        return ret;
+    }
+    expander_ready = true;
+    return ESP_OK;
+}
+
+esp_err_t relay_output_i2c_create(const relay_output_i2c_config_t *config, relay_output_backend_t *backend) {
+    if (config == NULL || backend == NULL || config->address > 0x7F ||
+        (config->type != RELAY_EXPANDER_PCF8574 && config->type != RELAY_EXPANDER_MCP23017)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    i2c_config_copy = *config;
+    expander_ready = false;
+    bool mcp = config->type == RELAY_EXPANDER_MCP23017;
+    *backend = (relay_output_backend_t){
+        .name = mcp ? "mcp23017" : "pcf8574",
+        .channels = mcp ? 16 : 8,
+        .init = i2c_backend_init,
+        .write = i2c_backend_write,
+        .read = i2c_backend_read,
+        .ctx = &i2c_config_copy,
+    };
+    return ESP_OK;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_system.h"
+#include "pump_controller.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RUNTIME_MODE_COUNT (PUMP_MODE_BACKWASH + 1)
+
+// Where today's counters came from at boot
+typedef enum {
+    RUNTIME_SOURCE_NONE = 0, // Nothing valid found, counting from zero
+    RUNTIME_SOURCE_RTC,      // RTC memory survived a soft reset; no flash involved
+    RUNTIME_SOURCE_NVS,      // Power was lost; last flushed snapshot from NVS
+} runtime_source_t;
+
+typedef struct {
+    uint32_t date;                        // YYYYMMDD the counters belong to, 0 before the clock is set
+    uint64_t mode_us[RUNTIME_MODE_COUNT]; // Time spent in each mode today, indexed by pump_mode_t
+    uint32_t soft_resets;                 // Resets survived today through RTC memory, deep sleep not included
+    runtime_source_t source;
+} runtime_accounting_t;
+
+/**
+ * @brief Restore today's counters and start accounting in the mode the relays come up in
+ *
+ * RTC memory is trusted after a soft reset if its checksum holds. After a power-on or brownout
+ * reset, or a bad checksum, the snapshot the write-back cache last flushed to NVS is used.
+ * After a wake-up from deep sleep the time asleep is charged to the mode the relays were held
+ * in, and accounting carries on in that mode. nvs_cache must be initialized.
+ *
+ * @param reason Reset reason of this boot, normally esp_reset_reason()
+ * @return ESP_OK on success
+ */
+esp_err_t runtime_accounting_init(esp_reset_reason_t reason);
+
+/**
+ * @brief Charge the time since the last call to the current mode, then switch to a new one
+ * @param mode Mode the pump is running in from now on
+ */
+void runtime_accounting_set_mode(pump_mode_t mode);
+
+/**
+ * @brief Charge the time since the last call to the current mode
+ */
+void runtime_accounting_update(void);
+
+/**
+ * @brief Charge the time so far and record the current mode as held through the deep sleep that follows
+ */
+void runtime_accounting_prepare_sleep(void);
+
+/**
+ * @brief Start a new day if the date changed; dates before the clock is synchronised are ignored
+ * @param date Today as YYYYMMDD
+ * @return true if the counters were cleared
+ */
+bool runtime_accounting_roll_day(uint32_t date);
+
+/**
+ * @brief Whole minutes the pump ran today in any mode other than off
+ */
+uint32_t runtime_accounting_get_run_minutes(void);
+
+/**
+ * @brief Get a copy of today's counters
+ * @param out Pointer to store the counters
+ * @return ESP_OK on success
+ */
+esp_err_t runtime_accounting_get(runtime_accounting_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,242 @@
+#include "pool_pump/runtime_accounting.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "pool_pump/nvs_cache.h"
+
+static const char *TAG = "runtime";
+
+#define RTC_MAGIC 0x52544D32 // "RTM2"; bump when the layout changes
+#define FIRST_VALID_DATE 20240101
+#define MAX_SLEEP_US (24LL * 3600 * 1000000)
+
+// Survives every reset except power loss and is never initialised by the startup code
+typedef struct {
+    uint32_t magic;
+    uint32_t date;
+    uint64_t mode_us[RUNTIME_MODE_COUNT];
+    uint32_t soft_resets;
+    uint32_t held_mode;     // Mode the relays were held in through deep sleep, PUMP_MODE_OFF if not asleep
+    int64_t sleep_start_us; // System time the deep sleep started; esp_timer restarts from zero on the wake-up
+    uint32_t crc;           // Over everything above
+} runtime_rtc_t;
+
+static RTC_NOINIT_ATTR runtime_rtc_t rtc_state;
+
+// Power-loss fallback, written to flash only by the write-back cache's periodic flush
+static const char *NVS_KEY_DATE = "rt_date";
+static const char *NVS_KEY_MODE[RUNTIME_MODE_COUNT] = {NULL, "rt_night_s", "rt_day_s", "rt_backwash_s"};
+
+static portMUX_TYPE runtime_lock = portMUX_INITIALIZER_UNLOCKED;
+static pump_mode_t current_mode = PUMP_MODE_OFF;
+static int64_t last_us = 0;
+static runtime_source_t source = RUNTIME_SOURCE_NONE;
+static bool initialized = false;
+
+static uint32_t rtc_crc(void) {
+    return esp_rom_crc32_le(0, (const uint8_t *)&rtc_state, offsetof(runtime_rtc_t, crc));
+}
+
+static void seal_locked(void) { rtc_state.crc = rtc_crc(); }
+
+static bool rtc_valid(esp_reset_reason_t reason) {
+    // RTC memory is undefined after power-on, and a brownout may have corrupted it mid-write
+    if (reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT || reason == ESP_RST_UNKNOWN) {
+        return false;
+    }
+    return rtc_state.magic == RTC_MAGIC && rtc_state.crc == rtc_crc();
+}
+
+// Mirror whole seconds into the cache; it only touches flash on its own schedule
+static void mirror_to_cache(const runtime_rtc_t *snapshot) {
+    nvs_cache_set(NVS_KEY_DATE, (int32_t)snapshot->date);
+    for (int mode = PUMP_MODE_NIGHT; mode < RUNTIME_MODE_COUNT; mode++) {
+        nvs_cache_set(NVS_KEY_MODE[mode], (int32_t)(snapshot->mode_us[mode] / 1000000));
+    }
+}
+
+static int64_t system_time_us(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static void accrue_locked(int64_t now) {
+    if (current_mode != PUMP_MODE_OFF && now > last_us) {
+        rtc_state.mode_us[current_mode] += now - last_us;
+    }
+    last_us = now;
+    seal_locked();
+}
+
+esp_err_t runtime_accounting_init(esp_reset_reason_t reason) {
+    esp_err_t ret = nvs_cache_register(NVS_KEY_DATE, 0);
+    for (int mode = PUMP_MODE_NIGHT; mode < RUNTIME_MODE_COUNT && ret == ESP_OK; mode++) {
+        ret = nvs_cache_register(NVS_KEY_MODE[mode], 0);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register NVS fallback: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    runtime_rtc_t restored = {0};
+    runtime_source_t restored_from = RUNTIME_SOURCE_NONE;
+    pump_mode_t held_mode = PUMP_MODE_OFF;
+    if (rtc_valid(reason)) {
+        restored = rtc_state;
+        restored_from = RUNTIME_SOURCE_RTC;
+        if (reason != ESP_RST_DEEPSLEEP) {
+            restored.soft_resets++;
+        } else if (restored.held_mode < RUNTIME_MODE_COUNT) {
+            // The relays kept the pump running while we slept
+            held_mode = (pump_mode_t)restored.held_mode;
+            int64_t slept_us = system_time_us() - restored.sleep_start_us;
+            if (held_mode != PUMP_MODE_OFF && slept_us > 0 && slept_us < MAX_SLEEP_US) {
+                restored.mode_us[held_mode] += (uint64_t)slept_us;
+            }
+        }
+    } else {
+        int32_t value = 0;
+        nvs_cache_get(NVS_KEY_DATE, &value);
+        restored.date = (uint32_t)value;
+        for (int mode = PUMP_MODE_NIGHT; mode < RUNTIME_MODE_COUNT; mode++) {
+            value = 0;
+            nvs_cache_get(NVS_KEY_MODE[mode], &value);
+            restored.mode_us[mode] = (uint64_t)value * 1000000;
+        }
+        if (restored.date != 0) {
+            restored_from = RUNTIME_SOURCE_NVS;
+        }
+    }
+    restored.magic = RTC_MAGIC;
+    restored.held_mode = PUMP_MODE_OFF;
+    restored.sleep_start_us = 0;
+
+    portENTER_CRITICAL(&runtime_lock);
+    rtc_state = restored;
+    // The relays come up released after any reset but a wake-up from deep sleep, which held them
+    current_mode = held_mode;
+    last_us = esp_timer_get_time();
+    source = restored_from;
+    initialized = true;
+    seal_locked();
+    portEXIT_CRITICAL(&runtime_lock);
+
+    static const char *source_names[] = {"nothing", "RTC memory", "NVS"};
+    ESP_LOGI(TAG,
+             "Runtime for %lu restored from %s: %lu min",
+             (unsigned long)restored.date,
+             source_names[restored_from],
+             (unsigned long)runtime_accounting_get_run_minutes());
+    return ESP_OK;
+}
+
+void runtime_accounting_set_mode(pump_mode_t mode) {
+    if (!initialized || (unsigned)mode >= RUNTIME_MODE_COUNT) {
+        return;
+    }
+
+    runtime_rtc_t snapshot;
+    portENTER_CRITICAL(&runtime_lock);
+    accrue_locked(esp_timer_get_time());
+    current_mode = mode;
+    snapshot = rtc_state;
+    portEXIT_CRITICAL(&runtime_lock);
+
+    mirror_to_cache(&snapshot);
+}
+
+void runtime_accounting_update(void) {
+    if (!initialized) {
+        return;
+    }
+    runtime_accounting_set_mode(current_mode);
+}
+
+void runtime_accounting_prepare_sleep(void) {
+    if (!initialized) {
+        return;
+    }
+
+    runtime_rtc_t snapshot;
+    portENTER_CRITICAL(&runtime_lock);
+    accrue_locked(esp_timer_get_time());
+    rtc_state.held_mode = current_mode;
+    rtc_state.sleep_start_us = system_time_us();
+    seal_locked();
+    snapshot = rtc_state;
+    portEXIT_CRITICAL(&runtime_lock);
+
+    mirror_to_cache(&snapshot);
+}
+
+bool runtime_accounting_roll_day(uint32_t date) {
+    if (!initialized || date < FIRST_VALID_DATE) {
+        return false;
+    }
+
+    bool rolled = false;
+    uint32_t previous;
+    runtime_rtc_t snapshot;
+    portENTER_CRITICAL(&runtime_lock);
+    previous = rtc_state.date;
+    if (previous != date) {
+        accrue_locked(esp_timer_get_time());
+        // Counters restored before the clock was set belong to whatever day it is now
+        if (previous != 0) {
+            memset(rtc_state.mode_us, 0, sizeof(rtc_state.mode_us));
+            rtc_state.soft_resets = 0;
+            rolled = true;
+        }
+        rtc_state.date = date;
+        seal_locked();
+    }
+    snapshot = rtc_state;
+    portEXIT_CRITICAL(&runtime_lock);
+
+    if (previous != date) {
+        mirror_to_cache(&snapshot);
+    }
+    if (rolled) {
+        ESP_LOGI(TAG, "New day %lu started, runtime counters cleared", (unsigned long)date);
+    }
+    return rolled;
+}
+
+uint32_t runtime_accounting_get_run_minutes(void) {
+    if (!initialized) {
+        return 0;
+    }
+
+    uint64_t run_us = 0;
+    portENTER_CRITICAL(&runtime_lock);
+    for (int mode = PUMP_MODE_NIGHT; mode < RUNTIME_MODE_COUNT; mode++) {
+        run_us += rtc_state.mode_us[mode];
+    }
+    portEXIT_CRITICAL(&runtime_lock);
+    return (uint32_t)(run_us / 60000000);
+}
+
+esp_err_t runtime_accounting_get(runtime_accounting_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    portENTER_CRITICAL(&runtime_lock);
+    out->date = rtc_state.date;
+    memcpy(out->mode_us, rtc_state.mode_us, sizeof(out->mode_us));
+    out->soft_resets = rtc_state.soft_resets;
+    out->source = source;
+    portEXIT_CRITICAL(&runtime_lock);
+    return ESP_OK;
+}
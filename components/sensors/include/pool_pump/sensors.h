@@ -6,6 +6,8 @@
 extern "C" {
 #endif
 
+#define SENSORS_SERIES_WATER_TEMPERATURE 0 // Time-series store number of the water temperature history
+
 esp_err_t sensors_init(void);
 void sensors_poll(void);
 esp_err_t sensors_get_water_temperature(float *temperature_c);
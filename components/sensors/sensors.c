@@ -1,15 +1,42 @@
 #include "pool_pump/sensors.h"
 
+#include <time.h>
+
+#include "config.h"
 #include "esp_log.h"
+#include "pool_pump/timeseries.h"
 
 static const char *TAG = "sensors";
 
+#define CLOCK_SET_AFTER 1577836800 // 2020-01-01; earlier readings mean the clock has not been synced
+
+static time_t last_sample = 0;
+
 esp_err_t sensors_init(void) {
     ESP_LOGI(TAG, "Initializing temperature and flow sensors");
+
+    // Without a history partition the sensors still work, readings are just not kept
+    timeseries_init();
     return ESP_OK;
 }
 
-void sensors_poll(void) { ESP_LOGD(TAG, "Polling sensors for new readings"); }
+void sensors_poll(void) {
+    ESP_LOGD(TAG, "Polling sensors for new readings");
+
+    // One sample per interval of wall-clock time, so the store's timestamps compress to a bit each
+    time_t now = time(NULL);
+    if (now < CLOCK_SET_AFTER || now / SENSORS_SAMPLE_INTERVAL_S == last_sample / SENSORS_SAMPLE_INTERVAL_S) {
+        return;
+    }
+    last_sample = now;
+
+    float temperature_c;
+    if (sensors_get_water_temperature(&temperature_c) == ESP_OK) {
+        timeseries_append(SENSORS_SERIES_WATER_TEMPERATURE,
+                          (uint32_t)(now - now % SENSORS_SAMPLE_INTERVAL_S),
+                          temperature_c);
+    }
+}
 
 esp_err_t sensors_get_water_temperature(float *temperature_c) {
     if (temperature_c == NULL) {
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Kernel objects taken through the helpers, and heap allocations the guard saw after boot
+typedef struct {
+    bool static_mode;          // CONFIG_POOL_PUMP_STATIC_ALLOCATION: objects come from fixed pools
+    uint32_t semaphores;       // Mutexes handed out
+    uint32_t event_groups;     // Event groups handed out
+    uint32_t tasks;            // Tasks created
+    uint32_t stack_bytes;      // Task stack handed out, from the stack pool in static mode
+    bool sealed;               // static_alloc_seal() was called
+    uint32_t heap_allocs;      // Allocations from our tasks after the seal, outside an exempt window
+    uint32_t last_alloc_bytes; // Size of the most recent of them
+} static_alloc_stats_t;
+
+/**
+ * @brief Create a mutex: from the fixed pool in static mode, from the heap otherwise
+ * @return Handle, or NULL when the pool or the heap is exhausted
+ */
+SemaphoreHandle_t static_alloc_mutex(void);
+
+/**
+ * @brief Create a recursive mutex, see static_alloc_mutex()
+ * @return Handle, or NULL when the pool or the heap is exhausted
+ */
+SemaphoreHandle_t static_alloc_recursive_mutex(void);
+
+/**
+ * @brief Create an event group, see static_alloc_mutex()
+ * @return Handle, or NULL when the pool or the heap is exhausted
+ */
+EventGroupHandle_t static_alloc_event_group(void);
+
+/**
+ * @brief Create a task whose stack and control block come from the fixed pools in static mode
+ *
+ * Tasks created here count as ours for the heap guard. They are meant to run for good: a pool
+ * slot is not given back when the task ends.
+ *
+ * @param function Task function
+ * @param name Task name
+ * @param stack_bytes Stack size in bytes
+ * @param arg Task argument
+ * @param priority Task priority
+ * @param handle Set to the task handle; may be NULL
+ * @param core Core to pin the task to, or tskNO_AFFINITY
+ * @return pdPASS on success, like xTaskCreatePinnedToCore()
+ */
+BaseType_t static_alloc_task(TaskFunction_t function,
+                             const char *name,
+                             uint32_t stack_bytes,
+                             void *arg,
+                             UBaseType_t priority,
+                             TaskHandle_t *handle,
+                             BaseType_t core);
+
+/**
+ * @brief Mark the end of boot: from now on heap allocations from our tasks are flagged
+ *
+ * With CONFIG_POOL_PUMP_STATIC_ALLOCATION the heap allocation hook counts and logs every
+ * allocation made from a task created by static_alloc_task(), and aborts with
+ * CONFIG_POOL_PUMP_HEAP_GUARD_ABORT. Without it, this only records the seal.
+ */
+void static_alloc_seal(void);
+
+/**
+ * @brief Let the calling task allocate from the heap until the matching static_alloc_exempt_end()
+ *
+ * For library calls that allocate on their own: the HTTP client and TLS of a fetch, the WiFi
+ * driver, SNTP and NVS. Windows nest.
+ */
+void static_alloc_exempt_begin(void);
+
+/**
+ * @brief End the window opened by static_alloc_exempt_begin()
+ */
+void static_alloc_exempt_end(void);
+
+/**
+ * @brief Get the pool use and the allocations the guard flagged
+ * @param out Filled with the statistics
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for NULL
+ */
+esp_err_t static_alloc_get_stats(static_alloc_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
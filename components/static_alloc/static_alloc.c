@@ -0,0 +1,245 @@
+#include "pool_pump/static_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "static_alloc";
+
+#ifdef CONFIG_POOL_PUMP_STATIC_ALLOCATION
+static StaticSemaphore_t semaphore_pool[STATIC_ALLOC_SEMAPHORES];
+static StaticEventGroup_t event_group_pool[STATIC_ALLOC_EVENT_GROUPS];
+static StaticTask_t task_pool[STATIC_ALLOC_TASKS];
+// Stack depth is given in bytes on ESP-IDF, where StackType_t is a byte
+static StackType_t stack_pool[STATIC_ALLOC_STACK_BYTES] __attribute__((aligned(16)));
+#endif
+
+// Also taken by the heap hook, which may run with the scheduler suspended
+static portMUX_TYPE alloc_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t semaphores = 0;
+static uint32_t event_groups = 0;
+static uint32_t stack_bytes_used = 0;
+static TaskHandle_t our_tasks[STATIC_ALLOC_TASKS];
+static uint32_t task_count = 0;
+static uint8_t exempt_depth[STATIC_ALLOC_TASKS]; // Open exempt windows per task of our_tasks
+static bool sealed = false;
+static uint32_t heap_allocs = 0;
+static uint32_t last_alloc_bytes = 0;
+
+#ifdef CONFIG_POOL_PUMP_STATIC_ALLOCATION
+// Claim the next slot of a pool of `size`; false once it is used up
+static bool claim(uint32_t *used, uint32_t size, uint32_t *slot) {
+    bool ok;
+    portENTER_CRITICAL(&alloc_lock);
+    ok = *used < size;
+    if (ok) {
+        *slot = (*used)++;
+    }
+    portEXIT_CRITICAL(&alloc_lock);
+    return ok;
+}
+#endif
+
+static SemaphoreHandle_t create_mutex(bool recursive) {
+#ifdef CONFIG_POOL_PUMP_STATIC_ALLOCATION
+    uint32_t slot;
+    if (!claim(&semaphores, STATIC_ALLOC_SEMAPHORES, &slot)) {
+        ESP_LOGE(TAG, "All %d static mutexes are in use", STATIC_ALLOC_SEMAPHORES);
+        return NULL;
+    }
+    return recursive ? xSemaphoreCreateRecursiveMutexStatic(&semaphore_pool[slot])
+                     : xSemaphoreCreateMutexStatic(&semaphore_pool[slot]);
+#else
+    SemaphoreHandle_t mutex = recursive ? xSemaphoreCreateRecursiveMutex() : xSemaphoreCreateMutex();
+    if (mutex != NULL) {
+        portENTER_CRITICAL(&alloc_lock);
+        semaphores++;
+        portEXIT_CRITICAL(&alloc_lock);
+    }
+    return mutex;
+#endif
+}
+
+SemaphoreHandle_t static_alloc_mutex(void) { return create_mutex(false); }
+
+SemaphoreHandle_t static_alloc_recursive_mutex(void) { return create_mutex(true); }
+
+EventGroupHandle_t static_alloc_event_group(void) {
+#ifdef CONFIG_POOL_PUMP_STATIC_ALLOCATION
+    uint32_t slot;
+    if (!claim(&event_groups, STATIC_ALLOC_EVENT_GROUPS, &slot)) {
+        ESP_LOGE(TAG, "All %d static event groups are in use", STATIC_ALLOC_EVENT_GROUPS);
+        return NULL;
+    }
+    return xEventGroupCreateStatic(&event_group_pool[slot]);
+#else
+    EventGroupHandle_t group = xEventGroupCreate();
+    if (group != NULL) {
+        portENTER_CRITICAL(&alloc_lock);
+        event_groups++;
+        portEXIT_CRITICAL(&alloc_lock);
+    }
+    return group;
+#endif
+}
+
+BaseType_t static_alloc_task(TaskFunction_t function,
+                             const char *name,
+                             uint32_t stack_bytes,
+                             void *arg,
+                             UBaseType_t priority,
+                             TaskHandle_t *handle,
+                             BaseType_t core) {
+    // Keep every stack 16-byte aligned in the pool
+    stack_bytes = (stack_bytes + 15) & ~15UL;
+
+    // Claimed before the task exists: it may allocate as soon as it is created
+    portENTER_CRITICAL(&alloc_lock);
+    uint32_t slot = task_count;
+    uint32_t stack_offset = stack_bytes_used;
+#ifdef CONFIG_POOL_PUMP_STATIC_ALLOCATION
+    bool ok = slot < STATIC_ALLOC_TASKS && stack_offset + stack_bytes <= STATIC_ALLOC_STACK_BYTES;
+#else
+    bool ok = true; // Only the first STATIC_ALLOC_TASKS are remembered, which nothing needs without the guard
+#endif
+    if (ok) {
+        task_count++;
+        stack_bytes_used += stack_bytes;
+    }
+    portEXIT_CRITICAL(&alloc_lock);
+    if (!ok) {
+        ESP_LOGE(TAG,
+                 "No room for task %s: %lu of %d tasks, %lu stack bytes used",
+                 name,
+                 (unsigned long)slot,
+                 STATIC_ALLOC_TASKS,
+                 (unsigned long)stack_offset);
+        return pdFAIL;
+    }
+
+#ifdef CONFIG_POOL_PUMP_STATIC_ALLOCATION
+    TaskHandle_t task = xTaskCreateStaticPinnedToCore(function,
+                                                      name,
+                                                      stack_bytes,
+                                                      arg,
+                                                      priority,
+                                                      &stack_pool[stack_offset],
+                                                      &task_pool[slot],
+                                                      core);
+#else
+    TaskHandle_t task = NULL;
+    if (xTaskCreatePinnedToCore(function, name, stack_bytes, arg, priority, &task, core) != pdPASS) {
+        task = NULL;
+    }
+#endif
+    if (slot < STATIC_ALLOC_TASKS) {
+        portENTER_CRITICAL(&alloc_lock);
+        our_tasks[slot] = task;
+        portEXIT_CRITICAL(&alloc_lock);
+    }
+
+    if (handle != NULL) {
+        *handle = task;
+    }
+    return task != NULL ? pdPASS : pdFAIL;
+}
+
+void static_alloc_seal(void) {
+    portENTER_CRITICAL(&alloc_lock);
+    sealed = true;
+    portEXIT_CRITICAL(&alloc_lock);
+
+#ifdef CONFIG_POOL_PUMP_STATIC_ALLOCATION
+    ESP_LOGI(TAG,
+             "Boot done, heap use is flagged from now on: %lu/%d mutexes, %lu/%d groups, %lu/%d tasks, %lu/%d stack",
+             (unsigned long)semaphores,
+             STATIC_ALLOC_SEMAPHORES,
+             (unsigned long)event_groups,
+             STATIC_ALLOC_EVENT_GROUPS,
+             (unsigned long)task_count,
+             STATIC_ALLOC_TASKS,
+             (unsigned long)stack_bytes_used,
+             STATIC_ALLOC_STACK_BYTES);
+#endif
+}
+
+// Slot of a task created by static_alloc_task(), -1 for everyone else; call with alloc_lock held
+static int IRAM_ATTR find_task_locked(TaskHandle_t task) {
+    for (uint32_t i = 0; i < task_count && i < STATIC_ALLOC_TASKS; i++) {
+        if (our_tasks[i] == task) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+void static_alloc_exempt_begin(void) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    portENTER_CRITICAL(&alloc_lock);
+    int slot = find_task_locked(task);
+    if (slot >= 0 && exempt_depth[slot] < UINT8_MAX) {
+        exempt_depth[slot]++;
+    }
+    portEXIT_CRITICAL(&alloc_lock);
+}
+
+void static_alloc_exempt_end(void) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    portENTER_CRITICAL(&alloc_lock);
+    int slot = find_task_locked(task);
+    if (slot >= 0 && exempt_depth[slot] > 0) {
+        exempt_depth[slot]--;
+    }
+    portEXIT_CRITICAL(&alloc_lock);
+}
+
+esp_err_t static_alloc_get_stats(static_alloc_stats_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(out, 0, sizeof(*out));
+
+#ifdef CONFIG_POOL_PUMP_STATIC_ALLOCATION
+    out->static_mode = true;
+#endif
+    portENTER_CRITICAL(&alloc_lock);
+    out->semaphores = semaphores;
+    out->event_groups = event_groups;
+    out->tasks = task_count;
+    out->stack_bytes = stack_bytes_used;
+    out->sealed = sealed;
+    out->heap_allocs = heap_allocs;
+    out->last_alloc_bytes = last_alloc_bytes;
+    portEXIT_CRITICAL(&alloc_lock);
+    return ESP_OK;
+}
+
+#if defined(CONFIG_POOL_PUMP_STATIC_ALLOCATION) && defined(CONFIG_HEAP_USE_HOOKS)
+// Called by the heap on every allocation; must not allocate, and may run from any context
+void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps) {
+    if (!sealed || xPortInIsrContext()) {
+        return;
+    }
+
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    portENTER_CRITICAL_SAFE(&alloc_lock);
+    int slot = find_task_locked(task);
+    bool ours = slot >= 0 && exempt_depth[slot] == 0;
+    if (ours) {
+        heap_allocs++;
+        last_alloc_bytes = size;
+    }
+    portEXIT_CRITICAL_SAFE(&alloc_lock);
+
+    if (ours) {
+        ESP_DRAM_LOGW(DRAM_STR("static_alloc"), "Heap allocation of %u bytes after boot at %p", (unsigned)size, ptr);
+#ifdef CONFIG_POOL_PUMP_HEAP_GUARD_ABORT
+        abort();
+#endif
+    }
+}
+#endif
@@ -1,19 +1,101 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "esp_err.h"
+#include "pool_pump/storage_keys.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef enum {
+    STORAGE_BOOL = 0,
+    STORAGE_I32,
+    STORAGE_FLOAT,
+    STORAGE_STR,
+} storage_type_t;
+
+// How a key is persisted; every key is read from the RAM mirror regardless of its class
+typedef enum {
+    STORAGE_VOLATILE = 0,  // RAM only, back to its default after a reset
+    STORAGE_CONFIG,        // Field of the A/B config blob, written through with the rest of the blob
+    STORAGE_WRITE_THROUGH, // Own NVS key, written on every change
+    STORAGE_WRITE_BACK,    // Own NVS key, written by storage_flush() and on esp_restart()
+} storage_class_t;
+
+typedef enum {
+#define STORAGE_KEY_ENUM(id, type, size, persistence, location, number, string) id,
+    STORAGE_KEYS(STORAGE_KEY_ENUM)
+#undef STORAGE_KEY_ENUM
+    STORAGE_KEY_COUNT
+} storage_key_t;
+
 typedef struct {
     char wifi_ssid[32];
     char wifi_password[64];
     char price_api_endpoint[128];
 } storage_network_config_t;
 
+/**
+ * @brief Load every key into the RAM mirror
+ *
+ * Opens nvs_storage if needed. Config keys come from one read of the config blob, the others
+ * from their own NVS keys or the table default. Calling it again reloads the mirror from flash.
+ *
+ * @return ESP_OK on success
+ */
 esp_err_t storage_init(void);
+
+/**
+ * @brief Read a key from the RAM mirror; no flash access
+ * @param key Key of type STORAGE_BOOL, STORAGE_I32 or STORAGE_FLOAT respectively
+ * @return The value, or 0 when the key has another type
+ */
+bool storage_get_bool(storage_key_t key);
+int32_t storage_get_i32(storage_key_t key);
+float storage_get_float(storage_key_t key);
+
+/**
+ * @brief Copy a string key from the RAM mirror; no flash access
+ * @param key Key of type STORAGE_STR
+ * @param buffer Buffer for the string
+ * @param size Size of buffer; the value is truncated to fit
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a key of another type
+ */
+esp_err_t storage_get_str(storage_key_t key, char *buffer, size_t size);
+
+/**
+ * @brief Update a key in the RAM mirror and persist it according to its class
+ * @param key Key of the matching type
+ * @param value New value
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a key of another type or a string too long
+ */
+esp_err_t storage_set_bool(storage_key_t key, bool value);
+esp_err_t storage_set_i32(storage_key_t key, int32_t value);
+esp_err_t storage_set_float(storage_key_t key, float value);
+esp_err_t storage_set_str(storage_key_t key, const char *value);
+
+/**
+ * @brief Write every changed STORAGE_WRITE_BACK key in a single commit
+ * @return ESP_OK on success
+ */
+esp_err_t storage_flush(void);
+
+/**
+ * @brief Read the network settings from the mirror
+ * @param config Pointer to store the settings
+ * @return ESP_OK on success
+ */
 esp_err_t storage_load_network_config(storage_network_config_t *config);
+
+/**
+ * @brief Update the network settings; the credentials share one config blob write
+ * @param config Settings to store
+ * @return ESP_OK on success
+ */
 esp_err_t storage_save_network_config(const storage_network_config_t *config);
 
 #ifdef __cplusplus
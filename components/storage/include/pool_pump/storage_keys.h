@@ -0,0 +1,22 @@
+#pragma once
+
+// Compile-time key table of the storage component, one row per key:
+//   X(id, type, size, persistence, location, default_number, default_string)
+//
+// size         String capacity including the terminator; 0 for scalar types
+// persistence  Where the value lives besides the RAM mirror, see storage_class_t
+// location     CFG(field) of nvs_config_t for STORAGE_CONFIG, KEY("nvs_key") when stored
+//              under its own NVS key, NONE for STORAGE_VOLATILE
+// defaults     Used until a value is stored; STORAGE_CONFIG keys take theirs from the config blob
+//
+// The table is expanded in storage.c, which provides config.h for the default values.
+#define STORAGE_KEYS(X)                                                                                                \
+    X(STORAGE_KEY_WIFI_SSID, STORAGE_STR, 32, STORAGE_CONFIG, CFG(wifi_ssid), 0, "")                                   \
+    X(STORAGE_KEY_WIFI_PASSWORD, STORAGE_STR, 64, STORAGE_CONFIG, CFG(wifi_password), 0, "")                           \
+    X(STORAGE_KEY_PUMP_MODE, STORAGE_I32, 0, STORAGE_CONFIG, CFG(pump_mode), 0, NULL)                                  \
+    X(STORAGE_KEY_DAILY_RUNTIME, STORAGE_I32, 0, STORAGE_CONFIG, CFG(daily_runtime), 0, NULL)                          \
+    X(STORAGE_KEY_PRICE_ENDPOINT, STORAGE_STR, 128, STORAGE_WRITE_THROUGH, KEY("price_url"), 0, PRICE_API_URL)         \
+    X(STORAGE_KEY_PRICE_LOW, STORAGE_FLOAT, 0, STORAGE_WRITE_THROUGH, KEY("price_low"), PRICE_THRESHOLD_LOW, NULL)     \
+    X(STORAGE_KEY_PRICE_HIGH, STORAGE_FLOAT, 0, STORAGE_WRITE_THROUGH, KEY("price_high"), PRICE_THRESHOLD_HIGH, NULL)  \
+    X(STORAGE_KEY_LAST_PRICE_FETCH, STORAGE_I32, 0, STORAGE_WRITE_BACK, KEY("price_fetched"), 0, NULL)                 \
+    X(STORAGE_KEY_WIFI_CONNECTED, STORAGE_BOOL, 0, STORAGE_VOLATILE, NONE, 0, NULL)
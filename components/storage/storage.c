@@ -1,33 +1,402 @@
 #include "pool_pump/storage.h"
 
+#include <stdio.h>
 #include <string.h>
 
+#include "config.h"
 #include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "nvs_storage.h"
 
 static const char *TAG = "storage";
-static storage_network_config_t s_network_config = {0};
+
+#define SCALAR_SIZE 4 // Every scalar takes one 32-bit mirror slot
+
+typedef struct {
+    const char *name;
+    storage_type_t type;
+    storage_class_t persistence;
+    uint16_t size;   // Mirror bytes
+    uint16_t offset; // Into the mirror
+    const char *nvs_key;
+    uint16_t config_offset; // Into nvs_config_t
+    uint16_t config_size;
+    double default_number;
+    const char *default_string;
+} key_def_t;
+
+// One slot per key, sized at compile time from the table
+#define MIRROR_SLOT(id, type, size, persistence, location, number, string)                                             \
+    uint8_t id[(size) > 0 ? (size) : SCALAR_SIZE];
+typedef struct {
+    STORAGE_KEYS(MIRROR_SLOT)
+} mirror_layout_t;
+#undef MIRROR_SLOT
+
+#define CFG(field) .config_offset = offsetof(nvs_config_t, field), .config_size = sizeof(((nvs_config_t *)0)->field)
+#define KEY(key) .nvs_key = key
+#define NONE .nvs_key = NULL
+#define KEY_DEF(id, key_type, key_size, key_persistence, location, number, string)                                     \
+    [id] = {.name = #id,                                                                                               \
+            .type = key_type,                                                                                          \
+            .persistence = key_persistence,                                                                            \
+            .size = (key_size) > 0 ? (key_size) : SCALAR_SIZE,                                                         \
+            .offset = offsetof(mirror_layout_t, id),                                                                   \
+            location,                                                                                                  \
+            .default_number = (number),                                                                                \
+            .default_string = (string)},
+static const key_def_t keys[STORAGE_KEY_COUNT] = {STORAGE_KEYS(KEY_DEF)};
+#undef KEY_DEF
+#undef CFG
+#undef KEY
+#undef NONE
+
+static uint8_t mirror[sizeof(mirror_layout_t)];
+static bool dirty[STORAGE_KEY_COUNT];
+// Guards the mirror and dirty flags; never held across a flash operation
+static portMUX_TYPE mirror_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool initialized = false;
+
+static void set_default(const key_def_t *def, uint8_t *slot) {
+    memset(slot, 0, def->size);
+    switch (def->type) {
+        case STORAGE_BOOL:
+            *slot = def->default_number != 0;
+            break;
+        case STORAGE_I32: {
+            int32_t value = (int32_t)def->default_number;
+            memcpy(slot, &value, sizeof(value));
+            break;
+        }
+        case STORAGE_FLOAT: {
+            float value = (float)def->default_number;
+            memcpy(slot, &value, sizeof(value));
+            break;
+        }
+        case STORAGE_STR:
+            if (def->default_string != NULL) {
+                snprintf((char *)slot, def->size, "%s", def->default_string);
+            }
+            break;
+    }
+}
+
+// Config fields keep their own widths (uint8_t pump_mode, ...); the mirror always holds int32 for integers
+static void config_to_slot(const key_def_t *def, const nvs_config_t *config, uint8_t *slot) {
+    const uint8_t *field = (const uint8_t *)config + def->config_offset;
+    if (def->type == STORAGE_STR) {
+        snprintf((char *)slot, def->size, "%s", (const char *)field);
+        return;
+    }
+
+    int32_t value = 0;
+    if (def->config_size == sizeof(uint8_t)) {
+        value = *field;
+    } else if (def->config_size == sizeof(uint16_t)) {
+        uint16_t narrow;
+        memcpy(&narrow, field, sizeof(narrow));
+        value = narrow;
+    } else {
+        memcpy(&value, field, sizeof(value));
+    }
+    memcpy(slot, &value, sizeof(value));
+}
+
+static void slot_to_config(const key_def_t *def, const uint8_t *slot, nvs_config_t *config) {
+    uint8_t *field = (uint8_t *)config + def->config_offset;
+    if (def->type == STORAGE_STR) {
+        snprintf((char *)field, def->config_size, "%s", (const char *)slot);
+        return;
+    }
+
+    int32_t value;
+    memcpy(&value, slot, sizeof(value));
+    if (def->config_size == sizeof(uint8_t)) {
+        *field = (uint8_t)value;
+    } else if (def->config_size == sizeof(uint16_t)) {
+        uint16_t narrow = (uint16_t)value;
+        memcpy(field, &narrow, sizeof(narrow));
+    } else {
+        memcpy(field, &value, sizeof(value));
+    }
+}
+
+static esp_err_t load_key(const key_def_t *def, uint8_t *slot) {
+    esp_err_t ret;
+    int32_t value;
+    size_t length = SCALAR_SIZE;
+    switch (def->type) {
+        case STORAGE_BOOL:
+            ret = nvs_storage_load_int(def->nvs_key, &value);
+            if (ret == ESP_OK) *slot = value != 0;
+            break;
+        case STORAGE_I32:
+            ret = nvs_storage_load_int(def->nvs_key, &value);
+            if (ret == ESP_OK) memcpy(slot, &value, sizeof(value));
+            break;
+        case STORAGE_FLOAT:
+            ret = nvs_storage_load_blob(def->nvs_key, slot, &length);
+            break;
+        case STORAGE_STR:
+        default:
+            ret = nvs_storage_load_string(def->nvs_key, (char *)slot, def->size);
+            break;
+    }
+    return ret == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : ret;
+}
+
+static esp_err_t store_key(const key_def_t *def, const uint8_t *slot) {
+    int32_t value;
+    switch (def->type) {
+        case STORAGE_BOOL:
+            return nvs_storage_save_int(def->nvs_key, *slot);
+        case STORAGE_I32:
+            memcpy(&value, slot, sizeof(value));
+            return nvs_storage_save_int(def->nvs_key, value);
+        case STORAGE_FLOAT:
+            return nvs_storage_save_blob(def->nvs_key, slot, SCALAR_SIZE);
+        case STORAGE_STR:
+        default:
+            return nvs_storage_save_string(def->nvs_key, (const char *)slot);
+    }
+}
+
+static void shutdown_flush(void) { storage_flush(); }
 
 esp_err_t storage_init(void) {
-    ESP_LOGI(TAG, "Initializing non-volatile storage");
-    memset(&s_network_config, 0, sizeof(s_network_config));
+    esp_err_t ret = nvs_storage_init();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (initialized) {
+        // Reloading must not lose values that were never written
+        storage_flush();
+    }
+
+    // Built privately and published in one step, so readers never see a half-loaded mirror
+    static uint8_t loaded[sizeof(mirror_layout_t)];
+    nvs_config_t config;
+    nvs_storage_begin_batch();
+    ret = nvs_storage_load_config(&config);
+    for (int key = 0; key < STORAGE_KEY_COUNT && ret == ESP_OK; key++) {
+        const key_def_t *def = &keys[key];
+        uint8_t *slot = loaded + def->offset;
+        set_default(def, slot);
+        if (def->persistence == STORAGE_CONFIG) {
+            config_to_slot(def, &config, slot);
+        } else if (def->persistence != STORAGE_VOLATILE) {
+            ret = load_key(def, slot);
+        }
+    }
+    nvs_storage_end_batch();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to load storage mirror: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    portENTER_CRITICAL(&mirror_lock);
+    memcpy(mirror, loaded, sizeof(mirror));
+    memset(dirty, 0, sizeof(dirty));
+    portEXIT_CRITICAL(&mirror_lock);
+
+    if (!initialized) {
+        esp_register_shutdown_handler(shutdown_flush);
+        initialized = true;
+    }
+
+    ESP_LOGI(TAG, "Loaded %d keys into a %u-byte RAM mirror", STORAGE_KEY_COUNT, (unsigned)sizeof(mirror));
     return ESP_OK;
 }
 
+static bool key_is(storage_key_t key, storage_type_t type) {
+    return (unsigned)key < STORAGE_KEY_COUNT && keys[key].type == type;
+}
+
+static void read_slot(storage_key_t key, void *out, size_t length) {
+    portENTER_CRITICAL(&mirror_lock);
+    memcpy(out, mirror + keys[key].offset, length);
+    portEXIT_CRITICAL(&mirror_lock);
+}
+
+bool storage_get_bool(storage_key_t key) {
+    uint8_t value = 0;
+    if (key_is(key, STORAGE_BOOL)) {
+        read_slot(key, &value, sizeof(value));
+    }
+    return value != 0;
+}
+
+int32_t storage_get_i32(storage_key_t key) {
+    int32_t value = 0;
+    if (key_is(key, STORAGE_I32)) {
+        read_slot(key, &value, sizeof(value));
+    }
+    return value;
+}
+
+float storage_get_float(storage_key_t key) {
+    float value = 0;
+    if (key_is(key, STORAGE_FLOAT)) {
+        read_slot(key, &value, sizeof(value));
+    }
+    return value;
+}
+
+esp_err_t storage_get_str(storage_key_t key, char *buffer, size_t size) {
+    if (!key_is(key, STORAGE_STR) || buffer == NULL || size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&mirror_lock);
+    snprintf(buffer, size, "%s", (const char *)(mirror + keys[key].offset));
+    portEXIT_CRITICAL(&mirror_lock);
+    return ESP_OK;
+}
+
+static esp_err_t persist(const key_def_t *def, const uint8_t *slot) {
+    if (def->persistence == STORAGE_CONFIG) {
+        // Read-modify-write of the blob under the storage lock so concurrent config writes do not race
+        nvs_config_t config;
+        esp_err_t ret = nvs_storage_begin_batch();
+        if (ret != ESP_OK) return ret;
+        ret = nvs_storage_load_config(&config);
+        if (ret == ESP_OK) {
+            slot_to_config(def, slot, &config);
+            ret = nvs_storage_save_config(&config);
+        }
+        esp_err_t end = nvs_storage_end_batch();
+        return ret != ESP_OK ? ret : end;
+    }
+    return store_key(def, slot);
+}
+
+static esp_err_t set_value(storage_key_t key, storage_type_t type, const void *value, size_t length) {
+    if (!key_is(key, type) || length > keys[key].size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const key_def_t *def = &keys[key];
+
+    uint8_t slot[sizeof(mirror_layout_t)];
+    portENTER_CRITICAL(&mirror_lock);
+    uint8_t *current = mirror + def->offset;
+    bool changed = memcmp(current, value, length) != 0;
+    if (changed) {
+        memset(current, 0, def->size);
+        memcpy(current, value, length);
+        dirty[key] = def->persistence == STORAGE_WRITE_BACK;
+    }
+    memcpy(slot, current, def->size);
+    portEXIT_CRITICAL(&mirror_lock);
+
+    if (!changed || def->persistence == STORAGE_VOLATILE || def->persistence == STORAGE_WRITE_BACK) {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = persist(def, slot);
+    if (ret != ESP_OK) {
+        // The mirror keeps the new value; the next successful write of the key persists it
+        ESP_LOGW(TAG, "Failed to persist %s: %s", def->name, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+esp_err_t storage_set_bool(storage_key_t key, bool value) {
+    uint8_t byte = value;
+    return set_value(key, STORAGE_BOOL, &byte, sizeof(byte));
+}
+
+esp_err_t storage_set_i32(storage_key_t key, int32_t value) {
+    return set_value(key, STORAGE_I32, &value, sizeof(value));
+}
+
+esp_err_t storage_set_float(storage_key_t key, float value) {
+    return set_value(key, STORAGE_FLOAT, &value, sizeof(value));
+}
+
+esp_err_t storage_set_str(storage_key_t key, const char *value) {
+    if (value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return set_value(key, STORAGE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t storage_flush(void) {
+    esp_err_t ret = nvs_storage_begin_batch();
+    if (ret != ESP_OK) return ret;
+
+    int written = 0;
+    for (int key = 0; key < STORAGE_KEY_COUNT; key++) {
+        const key_def_t *def = &keys[key];
+        uint8_t slot[sizeof(mirror_layout_t)];
+        portENTER_CRITICAL(&mirror_lock);
+        bool pending = dirty[key];
+        if (pending) {
+            memcpy(slot, mirror + def->offset, def->size);
+            dirty[key] = false;
+        }
+        portEXIT_CRITICAL(&mirror_lock);
+        if (!pending) {
+            continue;
+        }
+
+        esp_err_t stored = store_key(def, slot);
+        if (stored == ESP_OK) {
+            written++;
+        } else {
+            portENTER_CRITICAL(&mirror_lock);
+            dirty[key] = true;
+            portEXIT_CRITICAL(&mirror_lock);
+            ret = stored;
+        }
+    }
+
+    // All write-back keys go out in one commit
+    esp_err_t end = nvs_storage_end_batch();
+    if (written > 0) {
+        ESP_LOGD(TAG, "Flushed %d write-back keys", written);
+    }
+    return ret != ESP_OK ? ret : end;
+}
+
 esp_err_t storage_load_network_config(storage_network_config_t *config) {
     if (config == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    *config = s_network_config;
+    storage_get_str(STORAGE_KEY_WIFI_SSID, config->wifi_ssid, sizeof(config->wifi_ssid));
+    storage_get_str(STORAGE_KEY_WIFI_PASSWORD, config->wifi_password, sizeof(config->wifi_password));
+    storage_get_str(STORAGE_KEY_PRICE_ENDPOINT, config->price_api_endpoint, sizeof(config->price_api_endpoint));
     return ESP_OK;
 }
 
 esp_err_t storage_save_network_config(const storage_network_config_t *config) {
-    if (config == NULL) {
+    if (config == NULL || strlen(config->wifi_ssid) >= keys[STORAGE_KEY_WIFI_SSID].size ||
+        strlen(config->wifi_password) >= keys[STORAGE_KEY_WIFI_PASSWORD].size) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    s_network_config = *config;
-    ESP_LOGI(TAG, "Persisted network configuration");
-    return ESP_OK;
+    // Both credentials live in the config blob: patch them together so they cost one blob write
+    nvs_config_t stored;
+    esp_err_t ret = nvs_storage_begin_batch();
+    if (ret != ESP_OK) return ret;
+    ret = nvs_storage_load_config(&stored);
+    if (ret == ESP_OK) {
+        snprintf(stored.wifi_ssid, sizeof(stored.wifi_ssid), "%s", config->wifi_ssid);
+        snprintf(stored.wifi_password, sizeof(stored.wifi_password), "%s", config->wifi_password);
+        ret = nvs_storage_save_config(&stored);
+    }
+    if (ret == ESP_OK) {
+        portENTER_CRITICAL(&mirror_lock);
+        config_to_slot(&keys[STORAGE_KEY_WIFI_SSID], &stored, mirror + keys[STORAGE_KEY_WIFI_SSID].offset);
+        config_to_slot(&keys[STORAGE_KEY_WIFI_PASSWORD], &stored, mirror + keys[STORAGE_KEY_WIFI_PASSWORD].offset);
+        portEXIT_CRITICAL(&mirror_lock);
+        ret = storage_set_str(STORAGE_KEY_PRICE_ENDPOINT, config->price_api_endpoint);
+    }
+    esp_err_t end = nvs_storage_end_batch();
+
+    if (ret == ESP_OK && end == ESP_OK) {
+        ESP_LOGI(TAG, "Persisted network configuration");
+    }
+    return ret != ESP_OK ? ret : end;
 }
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// PRO_CPU also runs the WiFi driver, lwIP and the event loop; APP_CPU is left to control
+#ifdef CONFIG_FREERTOS_UNICORE
+#define TASK_CORE_NETWORK 0
+#define TASK_CORE_CONTROL 0
+#else
+#define TASK_CORE_NETWORK 0 // PRO_CPU
+#define TASK_CORE_CONTROL 1 // APP_CPU
+#endif
+
+// Every long-running task of the firmware
+typedef enum {
+    TASK_SCHEDULER = 0, // Control loop: plan, transitions, relays
+    TASK_NETWORK,       // Radio windows, price fetches over TLS, SNTP and deferred network jobs
+    TASK_NVS_CACHE,     // Write-back of the cached counters to flash
+    TASK_COUNT,
+} task_id_t;
+
+typedef struct {
+    const char *name;
+    BaseType_t core;       // TASK_CORE_NETWORK or TASK_CORE_CONTROL
+    UBaseType_t priority;  // FreeRTOS priority on that core
+    uint32_t stack_bytes;
+} task_spec_t;
+
+/**
+ * @brief Placement, priority and stack of a task
+ * @param id Task
+ * @return Its entry in the task table, or NULL for an unknown task
+ */
+const task_spec_t *task_map_get(task_id_t id);
+
+/**
+ * @brief Create a task as the task table places it, from the static pools where those are enabled
+ * @param id Task to create; each is created once
+ * @param function Task function
+ * @param arg Task argument
+ * @param handle Set to the task handle; may be NULL
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for an unknown task, ESP_ERR_INVALID_STATE if it
+ *         already runs, ESP_ERR_NO_MEM when it cannot be created
+ */
+esp_err_t task_map_create(task_id_t id, TaskFunction_t function, void *arg, TaskHandle_t *handle);
+
+/**
+ * @brief Log where each created task runs and the least stack it had left
+ */
+void task_map_log_report(void);
+
+#ifdef __cplusplus
+}
+#endif
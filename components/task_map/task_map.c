@@ -0,0 +1,74 @@
+#include "pool_pump/task_map.h"
+
+#include <stdbool.h>
+
+#include "esp_log.h"
+#include "pool_pump/static_alloc.h"
+
+static const char *TAG = "task_map";
+
+// Control outranks everything else on its core, so a TLS handshake or a flash write never delays a relay decision.
+// On PRO_CPU the network work stays below the WiFi driver (23) and lwIP (18) it waits on.
+static const task_spec_t task_table[TASK_COUNT] = {
+    [TASK_SCHEDULER] = {"pump_scheduler", TASK_CORE_CONTROL, 10, 4096},
+    [TASK_NETWORK] = {"pump_network", TASK_CORE_NETWORK, 5, 6144}, // The TLS handshake runs on this stack
+    [TASK_NVS_CACHE] = {"nvs_cache", TASK_CORE_NETWORK, 1, 3072},
+};
+
+static portMUX_TYPE map_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t handles[TASK_COUNT];
+static bool creating[TASK_COUNT];
+
+const task_spec_t *task_map_get(task_id_t id) { return id < TASK_COUNT ? &task_table[id] : NULL; }
+
+esp_err_t task_map_create(task_id_t id, TaskFunction_t function, void *arg, TaskHandle_t *handle) {
+    if (id >= TASK_COUNT || function == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&map_lock);
+    bool taken = creating[id];
+    creating[id] = true;
+    portEXIT_CRITICAL(&map_lock);
+    if (taken) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const task_spec_t *spec = &task_table[id];
+    TaskHandle_t task = NULL;
+    if (static_alloc_task(function, spec->name, spec->stack_bytes, arg, spec->priority, &task, spec->core) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create task %s", spec->name);
+        portENTER_CRITICAL(&map_lock);
+        creating[id] = false;
+        portEXIT_CRITICAL(&map_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    portENTER_CRITICAL(&map_lock);
+    handles[id] = task;
+    portEXIT_CRITICAL(&map_lock);
+    if (handle != NULL) {
+        *handle = task;
+    }
+    ESP_LOGI(TAG, "Task %s on core %d at priority %u", spec->name, (int)spec->core, (unsigned)spec->priority);
+    return ESP_OK;
+}
+
+void task_map_log_report(void) {
+    for (int i = 0; i < TASK_COUNT; i++) {
+        portENTER_CRITICAL(&map_lock);
+        TaskHandle_t task = handles[i];
+        portEXIT_CRITICAL(&map_lock);
+        if (task == NULL) {
+            continue;
+        }
+        // Stack depth is given in bytes on ESP-IDF, and so is the high water mark
+        ESP_LOGI(TAG,
+                 "%s: core %d, priority %u, %lu of %lu stack bytes never used",
+                 task_table[i].name,
+                 (int)task_table[i].core,
+                 (unsigned)task_table[i].priority,
+                 (unsigned long)uxTaskGetStackHighWaterMark(task),
+                 (unsigned long)task_table[i].stack_bytes);
+    }
+}
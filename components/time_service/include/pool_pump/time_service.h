@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "esp_err.h"
+#include "esp_system.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Where the clock was last set from, in order of accuracy */
+typedef enum {
+    TIME_SOURCE_NONE = 0,
+    TIME_SOURCE_HTTP, // Date header of an HTTP response
+    TIME_SOURCE_SNTP,
+} time_source_t;
+
+/** @brief How far the clock can be relied on, from its estimated error */
+typedef enum {
+    TIME_QUALITY_NONE = 0, // Never set, or drifted beyond TIME_MAX_ERROR_MS
+    TIME_QUALITY_DEGRADED, // Good enough for minute-based scheduling
+    TIME_QUALITY_GOOD,     // Within TIME_GOOD_ERROR_MS
+} time_quality_t;
+
+typedef struct {
+    time_quality_t quality;
+    time_source_t source;
+    uint32_t error_ms;      // Estimated error now: error of the last sync plus drift since
+    uint32_t since_sync_s;  // Time since the clock was last set
+    float drift_ppm;        // Measured drift being compensated, positive when the clock runs slow
+    bool drift_measured;    // Whether drift_ppm comes from two SNTP syncs
+    int32_t last_offset_ms; // Correction applied by the last sync
+    uint32_t syncs;         // Syncs since power-on
+} time_status_t;
+
+/**
+ * @brief Restore the sync state kept across soft resets
+ *
+ * The system clock keeps running through a soft reset, so does its quality; after power-on the clock is
+ * unset until the first sync.
+ *
+ * @param reason Reset reason of this boot
+ * @return ESP_OK on success
+ */
+esp_err_t time_service_init(esp_reset_reason_t reason);
+
+/**
+ * @brief Set the clock from SNTP
+ *
+ * The station must already be connected; SNTP is stopped again once the reply is in, so it never keeps
+ * the radio busy on its own. The other calls are not held up while it waits for the server.
+ *
+ * @param timeout_ms Maximum time to wait for the server
+ * @return ESP_OK when the clock was set, ESP_ERR_TIMEOUT if no reply came in time,
+ *         ESP_ERR_INVALID_STATE before init or while another sync is running
+ */
+esp_err_t time_service_sync_sntp(uint32_t timeout_ms);
+
+/**
+ * @brief Set the clock from a reference time
+ *
+ * A clock already known to be better than the reference is left alone. Two SNTP references at least
+ * TIME_DRIFT_MIN_INTERVAL_S apart measure the drift of the clock.
+ *
+ * @param source Where the reference comes from
+ * @param reference Reference time, taken now
+ * @param error_ms Error of the reference
+ * @return ESP_OK when the clock was set, ESP_ERR_INVALID_STATE when it was already better,
+ *         ESP_ERR_INVALID_ARG for a missing reference
+ */
+esp_err_t time_service_set_reference(time_source_t source, const struct timeval *reference, uint32_t error_ms);
+
+/**
+ * @brief Use the Date header of an HTTP response as a reference
+ * @param value Header value in IMF-fixdate form, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+ * @return As time_service_set_reference(), ESP_ERR_INVALID_ARG for a value that does not parse
+ */
+esp_err_t time_service_on_http_date(const char *value);
+
+/**
+ * @brief Slew the clock by the drift measured since the last call
+ *
+ * Call periodically; corrections below a millisecond are carried over to the next call.
+ */
+void time_service_update(void);
+
+/**
+ * @brief Account for deep sleep, during which the RTC slow clock kept the time
+ *
+ * The slow clock drifts far more than the crystal: the sleep adds TIME_SLEEP_CLOCK_PPM of error,
+ * is left out of drift compensation and breaks the chain of syncs a drift measurement spans.
+ *
+ * @param slept_us Time spent in deep sleep
+ */
+void time_service_note_sleep(uint64_t slept_us);
+
+/**
+ * @brief Current quality of the clock
+ */
+time_quality_t time_service_get_quality(void);
+
+/**
+ * @brief Whether the clock is good enough to schedule by
+ */
+bool time_service_is_trusted(void);
+
+/**
+ * @brief Whether an SNTP sync should ride along with the next network window
+ *
+ * True until the clock is good and set from SNTP, and again TIME_SYNC_INTERVAL_S after that.
+ */
+bool time_service_sync_due(void);
+
+/**
+ * @brief Get the current sync state
+ * @param out Filled with the state
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for NULL
+ */
+esp_err_t time_service_get_status(time_status_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,369 @@
+#include "pool_pump/time_service.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_netif_sntp.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "pool_pump/static_alloc.h"
+
+static const char *TAG = "time_service";
+
+#define RTC_MAGIC 0x544D5331 // "TMS1"; bump when the layout changes
+#define HTTP_DATE_MIN_YEAR 2024
+
+// Kept in RTC memory: the system clock survives a soft reset, and with it what is known about it
+typedef struct {
+    uint32_t magic;
+    uint32_t sync_error_ms; // Error right after the last sync
+    int64_t sync_us;        // System time of the last sync
+    int64_t sntp_us;        // System time of the last SNTP sync in an unbroken chain, 0 for none
+    int64_t compensated_us; // System time up to which drift has been compensated
+    float drift_ppm;
+    int32_t last_offset_ms;
+    uint8_t source;
+    uint8_t drift_measured;
+    uint16_t reserved;
+    uint32_t crc; // Over everything above
+} time_record_t;
+
+static RTC_NOINIT_ATTR time_record_t rtc_record;
+
+// Serializes setting and slewing the clock with the record describing it
+static SemaphoreHandle_t time_mutex = NULL;
+static uint32_t syncs = 0;
+
+// Reply of the SNTP exchange in progress, stored by the SNTP task
+static bool sntp_in_progress = false; // Under time_mutex; one exchange at a time
+static volatile bool sntp_replied = false;
+static struct timeval sntp_reply;
+static int64_t sntp_reply_mono_us;
+
+static const char *source_names[] = {"nothing", "HTTP", "SNTP"};
+
+static uint32_t record_crc(const time_record_t *record) {
+    return esp_rom_crc32_le(0, (const uint8_t *)record, offsetof(time_record_t, crc));
+}
+
+static void seal(void) { rtc_record.crc = record_crc(&rtc_record); }
+
+static bool rtc_valid(esp_reset_reason_t reason) {
+    // RTC memory is undefined after power-on, and the clock starts again from zero anyway
+    if (reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT || reason == ESP_RST_UNKNOWN) {
+        return false;
+    }
+    return rtc_record.magic == RTC_MAGIC && rtc_record.crc == record_crc(&rtc_record);
+}
+
+static int64_t timeval_us(const struct timeval *tv) { return (int64_t)tv->tv_sec * 1000000 + tv->tv_usec; }
+
+// System time including a slew still in progress, which is already committed to
+static int64_t system_time_us(void) {
+    struct timeval now;
+    struct timeval pending = {0};
+    gettimeofday(&now, NULL);
+    adjtime(NULL, &pending);
+    return timeval_us(&now) + timeval_us(&pending);
+}
+
+static void status_locked(int64_t now_us, time_status_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->source = (time_source_t)rtc_record.source;
+    out->drift_ppm = rtc_record.drift_ppm;
+    out->drift_measured = rtc_record.drift_measured;
+    out->last_offset_ms = rtc_record.last_offset_ms;
+    out->syncs = syncs;
+
+    int64_t since_us = now_us - rtc_record.sync_us;
+    if (rtc_record.source == TIME_SOURCE_NONE || since_us < 0) {
+        // Never set, or the clock went backwards under us
+        out->quality = TIME_QUALITY_NONE;
+        out->error_ms = UINT32_MAX;
+        return;
+    }
+
+    // One ppm of drift is one microsecond per second
+    uint32_t drift_ppm = rtc_record.drift_measured ? TIME_DRIFT_RESIDUAL_PPM : TIME_DRIFT_UNMEASURED_PPM;
+    uint64_t error_ms = rtc_record.sync_error_ms + (uint64_t)since_us / 1000000 * drift_ppm / 1000;
+    out->error_ms = error_ms > UINT32_MAX ? UINT32_MAX : (uint32_t)error_ms;
+    out->since_sync_s = (uint32_t)(since_us / 1000000);
+    if (out->error_ms <= TIME_GOOD_ERROR_MS) {
+        out->quality = TIME_QUALITY_GOOD;
+    } else if (out->error_ms <= TIME_MAX_ERROR_MS) {
+        out->quality = TIME_QUALITY_DEGRADED;
+    } else {
+        out->quality = TIME_QUALITY_NONE;
+    }
+}
+
+esp_err_t time_service_init(esp_reset_reason_t reason) {
+    if (time_mutex == NULL) {
+        time_mutex = static_alloc_mutex();
+        if (time_mutex == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    xSemaphoreTake(time_mutex, portMAX_DELAY);
+    if (!rtc_valid(reason)) {
+        memset(&rtc_record, 0, sizeof(rtc_record));
+        rtc_record.magic = RTC_MAGIC;
+        seal();
+    }
+    time_status_t status;
+    status_locked(system_time_us(), &status);
+    xSemaphoreGive(time_mutex);
+
+    if (status.source == TIME_SOURCE_NONE) {
+        ESP_LOGI(TAG, "Clock not set until the first sync");
+    } else {
+        ESP_LOGI(TAG,
+                 "Clock set from %s %lu s ago, error about %lu ms",
+                 source_names[status.source],
+                 (unsigned long)status.since_sync_s,
+                 (unsigned long)status.error_ms);
+    }
+    return ESP_OK;
+}
+
+// Step the clock to a reference taken when the system clock read system_us
+static esp_err_t apply_reference(time_source_t source, int64_t reference_us, uint32_t error_ms, int64_t system_us) {
+    time_status_t status;
+    status_locked(system_us, &status);
+    if (status.quality != TIME_QUALITY_NONE && status.error_ms < error_ms) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int64_t offset_us = reference_us - system_us;
+    if (source == TIME_SOURCE_SNTP && rtc_record.sntp_us != 0) {
+        // What the previous SNTP sync and the compensation since missed, spread over the interval
+        int64_t interval_us = system_us - rtc_record.sntp_us;
+        if (interval_us >= (int64_t)TIME_DRIFT_MIN_INTERVAL_S * 1000000) {
+            float drift_ppm = rtc_record.drift_ppm + (float)offset_us * 1e6f / (float)interval_us;
+            if (drift_ppm > -TIME_DRIFT_MAX_PPM && drift_ppm < TIME_DRIFT_MAX_PPM) {
+                rtc_record.drift_ppm = drift_ppm;
+                rtc_record.drift_measured = true;
+                ESP_LOGI(TAG, "Clock drift %.1f ppm over %lld s", drift_ppm, (long long)(interval_us / 1000000));
+            } else {
+                ESP_LOGW(TAG, "Clock off by %lld ms, not counting it as drift", (long long)(offset_us / 1000));
+            }
+        }
+    }
+
+    struct timeval tv = {.tv_sec = reference_us / 1000000, .tv_usec = reference_us % 1000000};
+    settimeofday(&tv, NULL);
+
+    rtc_record.source = source;
+    rtc_record.sync_error_ms = error_ms;
+    rtc_record.sync_us = reference_us;
+    rtc_record.compensated_us = reference_us;
+    // A coarser source in between breaks the chain a drift measurement is taken over
+    rtc_record.sntp_us = source == TIME_SOURCE_SNTP ? reference_us : 0;
+    // Saturates for the first set of a clock that started at 1970
+    int64_t offset_ms = offset_us / 1000;
+    if (offset_ms > INT32_MAX) {
+        offset_ms = INT32_MAX;
+    } else if (offset_ms < INT32_MIN) {
+        offset_ms = INT32_MIN;
+    }
+    rtc_record.last_offset_ms = (int32_t)offset_ms;
+    seal();
+    syncs++;
+
+    ESP_LOGI(TAG, "Clock set from %s, corrected by %ld ms", source_names[source], (long)rtc_record.last_offset_ms);
+    return ESP_OK;
+}
+
+esp_err_t time_service_set_reference(time_source_t source, const struct timeval *reference, uint32_t error_ms) {
+    if (reference == NULL || source == TIME_SOURCE_NONE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (time_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(time_mutex, portMAX_DELAY);
+    esp_err_t ret = apply_reference(source, timeval_us(reference), error_ms, system_time_us());
+    xSemaphoreGive(time_mutex);
+    return ret;
+}
+
+static void on_sntp_reply(struct timeval *tv) {
+    sntp_reply = *tv;
+    sntp_reply_mono_us = esp_timer_get_time();
+    sntp_replied = true;
+}
+
+esp_err_t time_service_sync_sntp(uint32_t timeout_ms) {
+    if (time_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // The wait takes seconds; the clock is read and the record updated under the mutex, but not held across it
+    xSemaphoreTake(time_mutex, portMAX_DELAY);
+    if (sntp_in_progress) {
+        xSemaphoreGive(time_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+    sntp_in_progress = true;
+    // SNTP steps the clock itself before it reports, so note where the clock would have been
+    int64_t before_us = system_time_us();
+    int64_t before_mono_us = esp_timer_get_time();
+    sntp_replied = false;
+    xSemaphoreGive(time_mutex);
+
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(TIME_SNTP_SERVER);
+    config.sync_cb = on_sntp_reply;
+    // The SNTP client lives on the heap for the length of the sync
+    static_alloc_exempt_begin();
+    esp_err_t ret = esp_netif_sntp_init(&config);
+    if (ret == ESP_OK) {
+        ret = esp_netif_sntp_sync_wait(pdMS_TO_TICKS(timeout_ms));
+        esp_netif_sntp_deinit();
+    }
+    static_alloc_exempt_end();
+
+    xSemaphoreTake(time_mutex, portMAX_DELAY);
+    if (ret == ESP_OK && !sntp_replied) {
+        ret = ESP_ERR_TIMEOUT;
+    }
+    if (ret == ESP_OK) {
+        int64_t now_mono_us = esp_timer_get_time();
+        int64_t reference_us = timeval_us(&sntp_reply) + (now_mono_us - sntp_reply_mono_us);
+        int64_t system_us = before_us + (now_mono_us - before_mono_us);
+        ret = apply_reference(TIME_SOURCE_SNTP, reference_us, TIME_SNTP_ERROR_MS, system_us);
+    }
+    sntp_in_progress = false;
+    xSemaphoreGive(time_mutex);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "SNTP sync failed: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date, without depending on the TZ setting
+static int64_t days_from_civil(int year, int month, int day) {
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int year_of_era = year - era * 400;
+    int day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return (int64_t)era * 146097 + day_of_era - 719468;
+}
+
+static bool parse_http_date(const char *value, int64_t *out_s) {
+    static const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    char weekday[4];
+    char month_name[4];
+    int day, year, hour, minute, second;
+    if (sscanf(value,
+               "%3[A-Za-z], %d %3[A-Za-z] %d %d:%d:%d GMT",
+               weekday,
+               &day,
+               month_name,
+               &year,
+               &hour,
+               &minute,
+               &second) != 7) {
+        return false;
+    }
+
+    int month = 0;
+    for (int i = 0; i < 12; i++) {
+        if (strcmp(month_name, months[i]) == 0) {
+            month = i + 1;
+        }
+    }
+    // A date before the firmware was written is a server without a clock
+    if (month == 0 || day < 1 || day > 31 || year < HTTP_DATE_MIN_YEAR || hour > 23 || minute > 59 ||
+        second > 60) {
+        return false;
+    }
+
+    *out_s = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+esp_err_t time_service_on_http_date(const char *value) {
+    int64_t date_s;
+    if (value == NULL || !parse_http_date(value, &date_s)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The header truncates to whole seconds, so the middle of that second is the best guess
+    struct timeval reference = {.tv_sec = date_s, .tv_usec = 500000};
+    return time_service_set_reference(TIME_SOURCE_HTTP, &reference, TIME_HTTP_ERROR_MS);
+}
+
+void time_service_update(void) {
+    if (time_mutex == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(time_mutex, portMAX_DELAY);
+    if (rtc_record.drift_measured) {
+        int64_t now_us = system_time_us();
+        int64_t correction_us = (int64_t)((float)(now_us - rtc_record.compensated_us) * rtc_record.drift_ppm / 1e6f);
+        if (llabs(correction_us) >= 1000) {
+            struct timeval delta = {.tv_sec = correction_us / 1000000, .tv_usec = correction_us % 1000000};
+            adjtime(&delta, NULL);
+            rtc_record.compensated_us = now_us;
+            seal();
+        }
+    }
+    xSemaphoreGive(time_mutex);
+}
+
+void time_service_note_sleep(uint64_t slept_us) {
+    if (time_mutex == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(time_mutex, portMAX_DELAY);
+    uint64_t error_ms = rtc_record.sync_error_ms + slept_us / 1000000 * TIME_SLEEP_CLOCK_PPM / 1000;
+    rtc_record.sync_error_ms = error_ms > UINT32_MAX ? UINT32_MAX : (uint32_t)error_ms;
+    rtc_record.compensated_us += (int64_t)slept_us;
+    rtc_record.sntp_us = 0;
+    seal();
+    xSemaphoreGive(time_mutex);
+}
+
+esp_err_t time_service_get_status(time_status_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (time_mutex == NULL) {
+        memset(out, 0, sizeof(*out));
+        out->error_ms = UINT32_MAX;
+        return ESP_OK;
+    }
+
+    xSemaphoreTake(time_mutex, portMAX_DELAY);
+    status_locked(system_time_us(), out);
+    xSemaphoreGive(time_mutex);
+    return ESP_OK;
+}
+
+time_quality_t time_service_get_quality(void) {
+    time_status_t status;
+    time_service_get_status(&status);
+    return status.quality;
+}
+
+bool time_service_is_trusted(void) { return time_service_get_quality() != TIME_QUALITY_NONE; }
+
+bool time_service_sync_due(void) {
+    time_status_t status;
+    time_service_get_status(&status);
+    return status.quality != TIME_QUALITY_GOOD || status.source != TIME_SOURCE_SNTP ||
+           status.since_sync_s >= TIME_SYNC_INTERVAL_S;
+}
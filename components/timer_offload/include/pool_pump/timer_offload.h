@@ -0,0 +1,65 @@
+#pragma once
+
+#include "esp_err.h"
+#include "pool_pump/daily_plan.h"
+#include "pool_pump/vario_inverter.h"
+#include "price_fetcher.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// How far the uploaded timer program is from the plan it approximates
+typedef struct {
+    int plan_blocks;            // Contiguous same-mode run blocks in the plan
+    int intervals;              // Timer intervals in the program
+    int planned_minutes;        // Run minutes in the plan
+    int program_minutes;        // Run minutes in the program
+    int extra_minutes;          // Program runs while the plan is off
+    int missing_minutes;        // Plan runs while the program is off
+    int speed_mismatch_minutes; // Both run, at different speeds
+    float planned_kwh;
+    float program_kwh;
+    float planned_cost_eur; // Only when prices were supplied
+    float program_cost_eur;
+} timer_offload_report_t;
+
+/**
+ * @brief Compile a daily plan into at most VARIO_TIMER_SLOTS inverter timer intervals
+ *
+ * A plan with more run blocks than slots is approximated by merging neighbouring blocks
+ * (bridging the gap) or dropping short ones, whichever costs least. The choice is
+ * optimal for a cost of 2 per missing minute and 1 per extra or wrong-speed minute.
+ *
+ * @param plan Plan to compile
+ * @param prices Hourly prices for the cost figures in the report, may be NULL
+ * @param program Compiled program
+ * @param report Approximation report, may be NULL
+ * @return ESP_OK on success
+ */
+esp_err_t timer_offload_compile(const daily_plan_t *plan,
+                                const price_data_t *prices,
+                                vario_timer_program_t *program,
+                                timer_offload_report_t *report);
+
+/**
+ * @brief Compile a plan, upload it to the inverter and verify it by reading it back
+ * @param plan Plan to offload
+ * @param prices Hourly prices for the report, may be NULL
+ * @param clock_minute Current minute of day, used to set the inverter clock
+ * @param report Approximation report, may be NULL
+ * @return ESP_OK on success
+ */
+esp_err_t timer_offload_upload(const daily_plan_t *plan,
+                               const price_data_t *prices,
+                               int clock_minute,
+                               timer_offload_report_t *report);
+
+/**
+ * @brief Log an approximation report
+ */
+void timer_offload_log_report(const timer_offload_report_t *report);
+
+#ifdef __cplusplus
+}
+#endif
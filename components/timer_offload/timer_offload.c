@@ -0,0 +1,249 @@
+#include "pool_pump/timer_offload.h"
+
+#include <string.h>
+
+#include "config.h"
+#include "esp_log.h"
+
+static const char *TAG = "timer_offload";
+
+// Approximation cost per 15-minute slot. Under-filtering is worse than running a little extra.
+#define COST_MISSING 2
+#define COST_EXTRA 1
+#define COST_SPEED 1
+
+#define MAX_BLOCKS (DAILY_PLAN_SLOTS / 2 + 1)
+#define SLOTS_PER_HOUR (60 / DAILY_PLAN_SLOT_MINUTES)
+
+typedef struct {
+    int start; // First slot
+    int end;   // One past the last slot
+    uint8_t mode;
+} run_block_t;
+
+static uint16_t rpm_for_mode(uint8_t mode) {
+    switch (mode) {
+        case PUMP_MODE_NIGHT:
+            return PUMP_SPEED_NIGHT;
+        case PUMP_MODE_DAY:
+            return PUMP_SPEED_DAY;
+        case PUMP_MODE_BACKWASH:
+            return PUMP_SPEED_BACKWASH;
+        default:
+            return 0;
+    }
+}
+
+static float power_kw(uint16_t rpm) {
+    // Affinity law: power scales with the cube of speed
+    float ratio = (float)rpm / VARIO_MAX_RPM;
+    return PUMP_RATED_POWER_W / 1000.0f * ratio * ratio * ratio;
+}
+
+static int extract_blocks(const daily_plan_t *plan, run_block_t *blocks) {
+    int count = 0;
+    for (int slot = 0; slot < DAILY_PLAN_SLOTS; slot++) {
+        uint8_t mode = plan->mode[slot];
+        if (mode == PUMP_MODE_OFF) {
+            continue;
+        }
+        if (count > 0 && blocks[count - 1].end == slot && blocks[count - 1].mode == mode) {
+            blocks[count - 1].end++;
+        } else {
+            blocks[count++] = (run_block_t){.start = slot, .end = slot + 1, .mode = mode};
+        }
+    }
+    return count;
+}
+
+// Cost of covering blocks[first..last] with one interval; also returns the mode to run it at
+static int cover_cost(const run_block_t *blocks, int first, int last, uint8_t *mode) {
+    int mode_slots[PUMP_MODE_BACKWASH + 1] = {0};
+    int run_slots = 0;
+    for (int b = first; b <= last; b++) {
+        int len = blocks[b].end - blocks[b].start;
+        mode_slots[blocks[b].mode] += len;
+        run_slots += len;
+    }
+
+    uint8_t best_mode = blocks[first].mode;
+    for (int m = PUMP_MODE_NIGHT; m <= PUMP_MODE_BACKWASH; m++) {
+        if (mode_slots[m] > mode_slots[best_mode]) {
+            best_mode = (uint8_t)m;
+        }
+    }
+    *mode = best_mode;
+
+    int gap_slots = (blocks[last].end - blocks[first].start) - run_slots;
+    return gap_slots * COST_EXTRA + (run_slots - mode_slots[best_mode]) * COST_SPEED;
+}
+
+static void fill_report(const daily_plan_t *plan,
+                        const price_data_t *prices,
+                        const vario_timer_program_t *program,
+                        int plan_blocks,
+                        timer_offload_report_t *report) {
+    memset(report, 0, sizeof(*report));
+    report->plan_blocks = plan_blocks;
+    report->intervals = program->count;
+
+    for (int slot = 0; slot < DAILY_PLAN_SLOTS; slot++) {
+        int minute = slot * DAILY_PLAN_SLOT_MINUTES;
+        uint16_t planned_rpm = rpm_for_mode(plan->mode[slot]);
+        uint16_t program_rpm = 0;
+        for (int i = 0; i < program->count; i++) {
+            if (minute >= program->intervals[i].start_minute && minute < program->intervals[i].end_minute) {
+                program_rpm = program->intervals[i].rpm;
+                break;
+            }
+        }
+
+        if (planned_rpm) report->planned_minutes += DAILY_PLAN_SLOT_MINUTES;
+        if (program_rpm) report->program_minutes += DAILY_PLAN_SLOT_MINUTES;
+        if (program_rpm && !planned_rpm) report->extra_minutes += DAILY_PLAN_SLOT_MINUTES;
+        if (planned_rpm && !program_rpm) report->missing_minutes += DAILY_PLAN_SLOT_MINUTES;
+        if (planned_rpm && program_rpm && planned_rpm != program_rpm) {
+            report->speed_mismatch_minutes += DAILY_PLAN_SLOT_MINUTES;
+        }
+
+        float hours = DAILY_PLAN_SLOT_MINUTES / 60.0f;
+        float planned_kwh = planned_rpm ? power_kw(planned_rpm) * hours : 0;
+        float program_kwh = program_rpm ? power_kw(program_rpm) * hours : 0;
+        report->planned_kwh += planned_kwh;
+        report->program_kwh += program_kwh;
+        if (prices != NULL) {
+            float price = prices[slot / SLOTS_PER_HOUR].price_eur_kwh;
+            report->planned_cost_eur += planned_kwh * price;
+            report->program_cost_eur += program_kwh * price;
+        }
+    }
+}
+
+esp_err_t timer_offload_compile(const daily_plan_t *plan,
+                                const price_data_t *prices,
+                                vario_timer_program_t *program,
+                                timer_offload_report_t *report) {
+    if (plan == NULL || program == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    static run_block_t blocks[MAX_BLOCKS];
+    int n = extract_blocks(plan, blocks);
+
+    // cost[k][j]: cheapest way to handle blocks[0..j) with at most k intervals.
+    // from[k][j]: -1 if block j-1 is dropped, otherwise the first block of the interval ending at j-1.
+    static int cost[VARIO_TIMER_SLOTS + 1][MAX_BLOCKS + 1];
+    static int8_t from[VARIO_TIMER_SLOTS + 1][MAX_BLOCKS + 1];
+
+    for (int k = 0; k <= VARIO_TIMER_SLOTS; k++) {
+        cost[k][0] = 0;
+        for (int j = 1; j <= n; j++) {
+            int drop = (blocks[j - 1].end - blocks[j - 1].start) * COST_MISSING;
+            cost[k][j] = cost[k][j - 1] + drop;
+            from[k][j] = -1;
+            if (k == 0) {
+                continue;
+            }
+            for (int i = 0; i < j; i++) {
+                uint8_t mode;
+                int candidate = cost[k - 1][i] + cover_cost(blocks, i, j - 1, &mode);
+                if (candidate < cost[k][j]) {
+                    cost[k][j] = candidate;
+                    from[k][j] = (int8_t)i;
+                }
+            }
+        }
+    }
+
+    // Walk the choices back from the full problem; intervals come out in reverse order
+    memset(program, 0, sizeof(*program));
+    vario_timer_interval_t reversed[VARIO_TIMER_SLOTS];
+    int k = VARIO_TIMER_SLOTS;
+    int j = n;
+    while (j > 0) {
+        if (from[k][j] < 0) {
+            j--;
+            continue;
+        }
+        int i = from[k][j];
+        uint8_t mode;
+        cover_cost(blocks, i, j - 1, &mode);
+        reversed[program->count++] = (vario_timer_interval_t){
+            .start_minute = (uint16_t)(blocks[i].start * DAILY_PLAN_SLOT_MINUTES),
+            .end_minute = (uint16_t)(blocks[j - 1].end * DAILY_PLAN_SLOT_MINUTES),
+            .rpm = rpm_for_mode(mode),
+        };
+        j = i;
+        k--;
+    }
+    for (int i = 0; i < program->count; i++) {
+        program->intervals[i] = reversed[program->count - 1 - i];
+    }
+
+    if (report != NULL) {
+        fill_report(plan, prices, program, n, report);
+    }
+    return ESP_OK;
+}
+
+esp_err_t timer_offload_upload(const daily_plan_t *plan,
+                               const price_data_t *prices,
+                               int clock_minute,
+                               timer_offload_report_t *report) {
+    vario_timer_program_t program;
+    esp_err_t ret = timer_offload_compile(plan, prices, &program, report);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ret = vario_inverter_write_timer_program(&program, (uint16_t)clock_minute);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Timer program upload failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    vario_timer_program_t readback;
+    ret = vario_inverter_read_timer_program(&readback);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (readback.count != program.count ||
+        memcmp(readback.intervals, program.intervals, program.count * sizeof(program.intervals[0])) != 0) {
+        ESP_LOGE(TAG, "Timer program readback does not match the upload");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    for (int i = 0; i < program.count; i++) {
+        ESP_LOGI(TAG,
+                 "Interval %d: %02d:%02d-%02d:%02d at %u RPM",
+                 i,
+                 program.intervals[i].start_minute / 60,
+                 program.intervals[i].start_minute % 60,
+                 program.intervals[i].end_minute / 60,
+                 program.intervals[i].end_minute % 60,
+                 program.intervals[i].rpm);
+    }
+    return ESP_OK;
+}
+
+void timer_offload_log_report(const timer_offload_report_t *report) {
+    if (report == NULL) {
+        return;
+    }
+
+    ESP_LOGI(TAG,
+             "%d plan blocks -> %d intervals: %d/%d run min, +%d extra, -%d missing, %d wrong speed",
+             report->plan_blocks,
+             report->intervals,
+             report->program_minutes,
+             report->planned_minutes,
+             report->extra_minutes,
+             report->missing_minutes,
+             report->speed_mismatch_minutes);
+    ESP_LOGI(TAG,
+             "Energy %.2f kWh (plan %.2f kWh), cost %.3f EUR (plan %.3f EUR)",
+             report->program_kwh,
+             report->planned_kwh,
+             report->program_cost_eur,
+             report->planned_cost_eur);
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TIMESERIES_MAX_SERIES 4
+#define TIMESERIES_CHUNK_BYTES 256 // Compressed samples a series buffers in RAM before they go to flash
+
+typedef struct {
+    uint32_t timestamp; // Unix time in seconds
+    float value;
+} timeseries_sample_t;
+
+typedef struct {
+    uint32_t segments_used;
+    uint32_t segments_total;
+    uint32_t bytes_used; // Segment headers and chunks in flash; open chunks are not counted
+    uint32_t bytes_total;
+    uint32_t samples; // Samples in flash and in the open chunks
+    uint32_t oldest_timestamp;
+} timeseries_info_t;
+
+/**
+ * @brief Streaming reader over one series; fields are private to timeseries.c
+ *
+ * Samples are decoded from the mapped partition one at a time, so a range of any length is read
+ * without a buffer. Appends may go on while an iterator is open; samples in a segment that is
+ * erased before the iterator reaches it are skipped.
+ */
+typedef struct {
+    uint8_t series;
+    bool done;
+    bool in_ram;
+    uint32_t from;
+    uint32_t to;
+    int segment;
+    uint32_t sequence;
+    uint16_t offset;
+    // Current chunk
+    const uint8_t *bits;
+    uint32_t bit_pos;
+    uint32_t bit_length;
+    uint16_t remaining;
+    bool first;
+    uint32_t timestamp;
+    int32_t delta;
+    uint32_t value;
+    uint8_t leading;
+    uint8_t trailing;
+    uint8_t ram_copy[TIMESERIES_CHUNK_BYTES];
+} timeseries_iter_t;
+
+/**
+ * @brief Map the time-series partition and recover the segment log
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the partition table has no time-series partition
+ */
+esp_err_t timeseries_init(void);
+
+/**
+ * @brief Append one sample to a series
+ *
+ * Samples are compressed into a RAM chunk per series, with delta-of-delta timestamps and XOR'd
+ * values, and the chunk is written to flash when it is full or spans TIMESERIES_CHUNK_SECONDS.
+ * When the partition is full the oldest segment is erased to make room.
+ *
+ * @param series Series number below TIMESERIES_MAX_SERIES
+ * @param timestamp Unix time in seconds, later than the previous sample of the series
+ * @param value Sample value
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for an unknown series or a timestamp out of order
+ */
+esp_err_t timeseries_append(uint8_t series, uint32_t timestamp, float value);
+
+/**
+ * @brief Write the open chunks of every series to flash, e.g. before a restart
+ * @return ESP_OK on success
+ */
+esp_err_t timeseries_flush(void);
+
+/**
+ * @brief Start reading the samples of a series between two timestamps, inclusive
+ * @param iter Iterator to initialize
+ * @param series Series number below TIMESERIES_MAX_SERIES
+ * @param from Earliest timestamp to return
+ * @param to Latest timestamp to return
+ * @return ESP_OK on success
+ */
+esp_err_t timeseries_iter_begin(timeseries_iter_t *iter, uint8_t series, uint32_t from, uint32_t to);
+
+/**
+ * @brief Decode the next sample in the range
+ * @param iter Iterator started with timeseries_iter_begin()
+ * @param out Pointer to store the sample
+ * @return true if a sample was stored, false at the end of the range
+ */
+bool timeseries_iter_next(timeseries_iter_t *iter, timeseries_sample_t *out);
+
+/**
+ * @brief Get the segment usage and the number of samples stored
+ * @param out Pointer to store the summary
+ * @return ESP_OK on success
+ */
+esp_err_t timeseries_get_info(timeseries_info_t *out);
+
+/**
+ * @brief Erase every series, including the open chunks
+ * @return ESP_OK on success
+ */
+esp_err_t timeseries_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
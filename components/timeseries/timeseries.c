@@ -0,0 +1,621 @@
+#include "pool_pump/timeseries.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "config.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "pool_pump/static_alloc.h"
+
+static const char *TAG = "timeseries";
+
+#define SEGMENT_MAGIC 0x47455354 // "TSEG"
+#define SEGMENT_VERSION 1
+#define SEGMENT_SIZE 4096 // One flash sector, erased as a unit
+#define MAX_SEGMENTS 128
+#define CHUNK_COMMITTED 0xA5
+#define NO_WINDOW 0xFF
+#define MAX_SAMPLE_BITS (4 + 32 + 2 + 5 + 5 + 32) // Widest timestamp and value encodings
+#define ALIGN4(size) (((size) + 3) & ~3u)
+
+typedef struct {
+    uint32_t magic; // Written last, so a segment with a torn header reads as unused
+    uint32_t sequence;
+    uint8_t version;
+    uint8_t reserved[7];
+} segment_header_t;
+
+// A chunk is one series over a stretch of time: the first sample in the header, the rest as a
+// Gorilla bit stream behind it. Chunks start on 4-byte boundaries so headers read straight from
+// the mapping.
+typedef struct {
+    uint8_t commit; // CHUNK_COMMITTED, programmed once the rest of the chunk is written
+    uint8_t series;
+    uint16_t count;  // Samples, including the first one
+    uint16_t length; // Bit stream bytes
+    uint8_t crc;     // Over the fields from series to length, the timestamps and value, and the bit stream
+    uint8_t reserved;
+    uint32_t first_timestamp;
+    uint32_t last_timestamp;
+    uint32_t first_value; // Bits of the float
+} chunk_header_t;
+
+typedef struct {
+    bool used;
+    bool sealed; // A torn chunk ends the segment; later chunks go to a new one
+    uint32_t sequence;
+    uint16_t tail;
+    uint32_t samples;
+    uint32_t first_timestamp; // Over all series, to skip the segment in range reads
+    uint32_t last_timestamp;
+} segment_info_t;
+
+typedef struct {
+    chunk_header_t header; // header.count is 0 while no chunk is open
+    uint8_t bits[TIMESERIES_CHUNK_BYTES];
+    uint32_t bit_length;
+    int32_t delta;
+    uint32_t value;
+    uint8_t leading; // Meaningful-bit window of the last XOR, NO_WINDOW before the first one
+    uint8_t trailing;
+} open_chunk_t;
+
+_Static_assert(offsetof(open_chunk_t, bits) == sizeof(chunk_header_t), "chunk is written with one call");
+
+static const esp_partition_t *partition = NULL;
+static const uint8_t *mapped = NULL;
+static esp_partition_mmap_handle_t map_handle;
+static SemaphoreHandle_t series_mutex = NULL;
+static segment_info_t segments[MAX_SEGMENTS];
+static int segment_count = 0;
+static int newest = -1;
+static open_chunk_t chunks[TIMESERIES_MAX_SERIES];
+static uint32_t last_timestamp[TIMESERIES_MAX_SERIES]; // Newest sample per series, 0 when empty
+
+static const chunk_header_t *chunk_at(int segment, uint16_t offset) {
+    return (const chunk_header_t *)(mapped + segment * SEGMENT_SIZE + offset);
+}
+
+static uint8_t chunk_crc(const chunk_header_t *header, const uint8_t *bits) {
+    uint8_t crc =
+        esp_rom_crc8_le(0, &header->series, offsetof(chunk_header_t, crc) - offsetof(chunk_header_t, series));
+    crc = esp_rom_crc8_le(crc,
+                          (const uint8_t *)&header->first_timestamp,
+                          sizeof(chunk_header_t) - offsetof(chunk_header_t, first_timestamp));
+    return esp_rom_crc8_le(crc, bits, header->length);
+}
+
+static void put_bits(open_chunk_t *chunk, uint32_t value, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+        if (value >> i & 1) {
+            chunk->bits[chunk->bit_length >> 3] |= 0x80 >> (chunk->bit_length & 7);
+        }
+        chunk->bit_length++;
+    }
+}
+
+static uint32_t get_bits(timeseries_iter_t *iter, int count) {
+    uint32_t value = 0;
+    while (count-- > 0) {
+        // Past the end reads as zeros rather than whatever follows the chunk
+        uint32_t bit = 0;
+        if (iter->bit_pos < iter->bit_length) {
+            bit = iter->bits[iter->bit_pos >> 3] >> (7 - (iter->bit_pos & 7)) & 1;
+        }
+        value = value << 1 | bit;
+        iter->bit_pos++;
+    }
+    return value;
+}
+
+static void encode_sample(open_chunk_t *chunk, uint32_t timestamp, uint32_t value) {
+    // Delta-of-delta: a steady sampling interval costs one bit per sample
+    int32_t delta = (int32_t)(timestamp - chunk->header.last_timestamp);
+    int32_t dod = delta - chunk->delta;
+    chunk->delta = delta;
+    if (dod == 0) {
+        put_bits(chunk, 0x0, 1);
+    } else if (dod >= -63 && dod <= 64) {
+        put_bits(chunk, 0x2, 2);
+        put_bits(chunk, dod + 63, 7);
+    } else if (dod >= -255 && dod <= 256) {
+        put_bits(chunk, 0x6, 3);
+        put_bits(chunk, dod + 255, 9);
+    } else if (dod >= -2047 && dod <= 2048) {
+        put_bits(chunk, 0xE, 4);
+        put_bits(chunk, dod + 2047, 12);
+    } else {
+        put_bits(chunk, 0xF, 4);
+        put_bits(chunk, (uint32_t)dod, 32);
+    }
+
+    // XOR with the previous value: a repeat costs one bit, a small change only its differing bits
+    uint32_t xor = value ^ chunk->value;
+    chunk->value = value;
+    if (xor == 0) {
+        put_bits(chunk, 0x0, 1);
+    } else {
+        int leading = __builtin_clz(xor);
+        int trailing = __builtin_ctz(xor);
+        if (chunk->leading != NO_WINDOW && leading >= chunk->leading && trailing >= chunk->trailing) {
+            put_bits(chunk, 0x2, 2);
+            put_bits(chunk, xor >> chunk->trailing, 32 - chunk->leading - chunk->trailing);
+        } else {
+            int length = 32 - leading - trailing;
+            put_bits(chunk, 0x3, 2);
+            put_bits(chunk, leading, 5);
+            put_bits(chunk, length - 1, 5);
+            put_bits(chunk, xor >> trailing, length);
+            chunk->leading = leading;
+            chunk->trailing = trailing;
+        }
+    }
+
+    chunk->header.last_timestamp = timestamp;
+    chunk->header.count++;
+}
+
+static void decode_sample(timeseries_iter_t *iter) {
+    int32_t dod;
+    if (get_bits(iter, 1) == 0) {
+        dod = 0;
+    } else if (get_bits(iter, 1) == 0) {
+        dod = (int32_t)get_bits(iter, 7) - 63;
+    } else if (get_bits(iter, 1) == 0) {
+        dod = (int32_t)get_bits(iter, 9) - 255;
+    } else if (get_bits(iter, 1) == 0) {
+        dod = (int32_t)get_bits(iter, 12) - 2047;
+    } else {
+        dod = (int32_t)get_bits(iter, 32);
+    }
+    iter->delta += dod;
+    iter->timestamp += iter->delta;
+
+    if (get_bits(iter, 1) == 0) {
+        return;
+    }
+    if (get_bits(iter, 1) == 1) {
+        iter->leading = get_bits(iter, 5);
+        iter->trailing = 32 - iter->leading - (get_bits(iter, 5) + 1);
+    }
+    iter->value ^= get_bits(iter, 32 - iter->leading - iter->trailing) << iter->trailing;
+}
+
+static void scan_segment(int segment) {
+    const segment_header_t *header = (const segment_header_t *)(mapped + segment * SEGMENT_SIZE);
+    segment_info_t *info = &segments[segment];
+    memset(info, 0, sizeof(*info));
+    if (header->magic != SEGMENT_MAGIC || header->version != SEGMENT_VERSION) {
+        return;
+    }
+
+    info->used = true;
+    info->sequence = header->sequence;
+    uint16_t offset = sizeof(segment_header_t);
+    while (offset + sizeof(chunk_header_t) <= SEGMENT_SIZE) {
+        const chunk_header_t *chunk = chunk_at(segment, offset);
+        if (chunk->commit != CHUNK_COMMITTED || chunk->length > TIMESERIES_CHUNK_BYTES ||
+            chunk->series >= TIMESERIES_MAX_SERIES) {
+            break;
+        }
+        if (info->samples == 0 || chunk->first_timestamp < info->first_timestamp) {
+            info->first_timestamp = chunk->first_timestamp;
+        }
+        if (chunk->last_timestamp > info->last_timestamp) info->last_timestamp = chunk->last_timestamp;
+        if (chunk->last_timestamp > last_timestamp[chunk->series]) {
+            last_timestamp[chunk->series] = chunk->last_timestamp;
+        }
+        info->samples += chunk->count;
+        offset += ALIGN4(sizeof(chunk_header_t) + chunk->length);
+    }
+    info->tail = offset;
+
+    // Anything programmed behind the last committed chunk is a torn write
+    for (const uint8_t *byte = mapped + segment * SEGMENT_SIZE + offset; offset < SEGMENT_SIZE; offset++, byte++) {
+        if (*byte != 0xFF) {
+            info->sealed = true;
+            break;
+        }
+    }
+    if (newest < 0 || info->sequence > segments[newest].sequence) {
+        newest = segment;
+    }
+}
+
+static bool segment_is_blank(int segment) {
+    const uint32_t *words = (const uint32_t *)(mapped + segment * SEGMENT_SIZE);
+    for (size_t i = 0; i < SEGMENT_SIZE / sizeof(uint32_t); i++) {
+        if (words[i] != UINT32_MAX) return false;
+    }
+    return true;
+}
+
+// Take an unused segment, or the oldest one, and make it the newest
+static esp_err_t start_segment(void) {
+    int target = -1;
+    for (int segment = 0; segment < segment_count; segment++) {
+        if (!segments[segment].used) {
+            target = segment;
+            break;
+        }
+        if (target < 0 || segments[segment].sequence < segments[target].sequence) {
+            target = segment;
+        }
+    }
+
+    if (segments[target].used) {
+        ESP_LOGD(TAG, "Partition full, dropping %lu samples", (unsigned long)segments[target].samples);
+    }
+    esp_err_t ret = ESP_OK;
+    if (!segment_is_blank(target)) {
+        segments[target].used = false;
+        ret = esp_partition_erase_range(partition, (size_t)target * SEGMENT_SIZE, SEGMENT_SIZE);
+        if (ret != ESP_OK) return ret;
+    }
+
+    segment_header_t header;
+    memset(&header, 0xFF, sizeof(header));
+    header.sequence = newest >= 0 ? segments[newest].sequence + 1 : 0;
+    header.version = SEGMENT_VERSION;
+    header.magic = SEGMENT_MAGIC;
+    size_t base = (size_t)target * SEGMENT_SIZE;
+    ret = esp_partition_write(partition,
+                              base + offsetof(segment_header_t, sequence),
+                              &header.sequence,
+                              sizeof(header) - offsetof(segment_header_t, sequence));
+    if (ret == ESP_OK) {
+        ret = esp_partition_write(partition, base, &header.magic, sizeof(header.magic));
+    }
+    if (ret != ESP_OK) return ret;
+
+    segments[target] = (segment_info_t){
+        .used = true,
+        .sequence = header.sequence,
+        .tail = sizeof(segment_header_t),
+    };
+    newest = target;
+    return ESP_OK;
+}
+
+static esp_err_t write_chunk(open_chunk_t *chunk) {
+    if (chunk->header.count == 0) {
+        return ESP_OK;
+    }
+
+    chunk->header.length = (chunk->bit_length + 7) / 8;
+    size_t size = sizeof(chunk_header_t) + chunk->header.length;
+    esp_err_t ret = ESP_OK;
+    if (newest < 0 || segments[newest].sealed || segments[newest].tail + size > SEGMENT_SIZE) {
+        ret = start_segment();
+    }
+
+    // The commit byte goes last: a power cut leaves a chunk that scan_segment() stops at
+    if (ret == ESP_OK) {
+        segment_info_t *info = &segments[newest];
+        size_t address = (size_t)newest * SEGMENT_SIZE + info->tail;
+        chunk->header.commit = 0xFF;
+        chunk->header.crc = chunk_crc(&chunk->header, chunk->bits);
+        info->tail += ALIGN4(size);
+        ret = esp_partition_write(partition, address, &chunk->header, size);
+        if (ret == ESP_OK) {
+            const uint8_t commit = CHUNK_COMMITTED;
+            ret = esp_partition_write(partition, address, &commit, sizeof(commit));
+        }
+        if (ret == ESP_OK) {
+            if (info->samples == 0 || chunk->header.first_timestamp < info->first_timestamp) {
+                info->first_timestamp = chunk->header.first_timestamp;
+            }
+            if (chunk->header.last_timestamp > info->last_timestamp) {
+                info->last_timestamp = chunk->header.last_timestamp;
+            }
+            info->samples += chunk->header.count;
+        } else {
+            info->sealed = true;
+        }
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG,
+                 "Failed to write %u samples of series %u: %s",
+                 chunk->header.count,
+                 chunk->header.series,
+                 esp_err_to_name(ret));
+    }
+    chunk->header.count = 0;
+    return ret;
+}
+
+static int oldest_segment(void) {
+    int oldest = -1;
+    for (int segment = 0; segment < segment_count; segment++) {
+        if (segments[segment].used && (oldest < 0 || segments[segment].sequence < segments[oldest].sequence)) {
+            oldest = segment;
+        }
+    }
+    return oldest;
+}
+
+static int segment_after(uint32_t sequence) {
+    int next = -1;
+    for (int segment = 0; segment < segment_count; segment++) {
+        if (segments[segment].used && segments[segment].sequence > sequence &&
+            (next < 0 || segments[segment].sequence < segments[next].sequence)) {
+            next = segment;
+        }
+    }
+    return next;
+}
+
+static void start_decoding(timeseries_iter_t *iter,
+                           const chunk_header_t *header,
+                           const uint8_t *bits,
+                           uint32_t bit_length) {
+    iter->bits = bits;
+    iter->bit_pos = 0;
+    iter->bit_length = bit_length;
+    iter->remaining = header->count;
+    iter->first = true;
+    iter->timestamp = header->first_timestamp;
+    iter->delta = 0;
+    iter->value = header->first_value;
+    iter->leading = 0;
+    iter->trailing = 0;
+}
+
+// Move to the next chunk of the series that overlaps the range: through the segments in write
+// order, then the chunk still open in RAM
+static bool load_next_chunk(timeseries_iter_t *iter) {
+    while (!iter->in_ram) {
+        bool valid = iter->segment >= 0 && segments[iter->segment].used &&
+                     segments[iter->segment].sequence == iter->sequence;
+        while (valid && iter->offset < segments[iter->segment].tail) {
+            const chunk_header_t *chunk = chunk_at(iter->segment, iter->offset);
+            iter->offset += ALIGN4(sizeof(chunk_header_t) + chunk->length);
+            if (chunk->series != iter->series || chunk->last_timestamp < iter->from ||
+                chunk->first_timestamp > iter->to) {
+                continue;
+            }
+            const uint8_t *bits = (const uint8_t *)(chunk + 1);
+            if (chunk_crc(chunk, bits) != chunk->crc) {
+                ESP_LOGW(TAG, "Skipping a damaged chunk of series %u", chunk->series);
+                continue;
+            }
+            start_decoding(iter, chunk, bits, chunk->length * 8u);
+            return true;
+        }
+
+        // A segment erased under the iterator was the oldest, so continuing by sequence is right
+        int next = iter->segment < 0 ? oldest_segment() : segment_after(iter->sequence);
+        if (next < 0) {
+            iter->in_ram = true;
+            break;
+        }
+        iter->segment = next;
+        iter->sequence = segments[next].sequence;
+        bool overlaps = segments[next].samples > 0 && segments[next].last_timestamp >= iter->from &&
+                        segments[next].first_timestamp <= iter->to;
+        iter->offset = overlaps ? sizeof(segment_header_t) : segments[next].tail;
+    }
+
+    // The flash log is exhausted under the same lock, so the open chunk holds exactly what follows
+    open_chunk_t *chunk = &chunks[iter->series];
+    if (chunk->header.count == 0 || chunk->header.last_timestamp < iter->from ||
+        chunk->header.first_timestamp > iter->to || iter->bits == iter->ram_copy) {
+        return false;
+    }
+    memcpy(iter->ram_copy, chunk->bits, (chunk->bit_length + 7) / 8);
+    start_decoding(iter, &chunk->header, iter->ram_copy, chunk->bit_length);
+    return true;
+}
+
+esp_err_t timeseries_init(void) {
+    if (mapped != NULL) {
+        return ESP_OK;
+    }
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                         (esp_partition_subtype_t)TIMESERIES_SUBTYPE,
+                                         TIMESERIES_PARTITION);
+    if (partition == NULL) {
+        ESP_LOGW(TAG, "No \"%s\" partition, samples are not recorded", TIMESERIES_PARTITION);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const void *ptr;
+    esp_err_t ret = esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &ptr, &map_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map the partition: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    series_mutex = static_alloc_mutex();
+    if (series_mutex == NULL) {
+        esp_partition_munmap(map_handle);
+        return ESP_ERR_NO_MEM;
+    }
+
+    mapped = ptr;
+    segment_count = partition->size / SEGMENT_SIZE > MAX_SEGMENTS ? MAX_SEGMENTS : partition->size / SEGMENT_SIZE;
+    newest = -1;
+    memset(chunks, 0, sizeof(chunks));
+    memset(last_timestamp, 0, sizeof(last_timestamp));
+    for (int segment = 0; segment < segment_count; segment++) {
+        scan_segment(segment);
+    }
+
+    timeseries_info_t info;
+    timeseries_get_info(&info);
+    ESP_LOGI(TAG,
+             "%lu samples in %lu of %lu segments",
+             (unsigned long)info.samples,
+             (unsigned long)info.segments_used,
+             (unsigned long)info.segments_total);
+    return ESP_OK;
+}
+
+esp_err_t timeseries_append(uint8_t series, uint32_t timestamp, float value) {
+    if (series >= TIMESERIES_MAX_SERIES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (mapped == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    xSemaphoreTake(series_mutex, portMAX_DELAY);
+    if (timestamp <= last_timestamp[series]) {
+        xSemaphoreGive(series_mutex);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    open_chunk_t *chunk = &chunks[series];
+    if (chunk->header.count == 0) {
+        memset(chunk, 0, sizeof(*chunk));
+        chunk->header.series = series;
+        chunk->header.count = 1;
+        chunk->header.first_timestamp = timestamp;
+        chunk->header.last_timestamp = timestamp;
+        chunk->header.first_value = bits;
+        chunk->header.reserved = 0xFF;
+        chunk->value = bits;
+        chunk->leading = NO_WINDOW;
+    } else {
+        encode_sample(chunk, timestamp, bits);
+    }
+    last_timestamp[series] = timestamp;
+
+    // Closing on age bounds what a reset loses; closing on size keeps the next sample in bounds
+    esp_err_t ret = ESP_OK;
+    if (chunk->bit_length + MAX_SAMPLE_BITS > TIMESERIES_CHUNK_BYTES * 8 ||
+        timestamp - chunk->header.first_timestamp >= TIMESERIES_CHUNK_SECONDS || chunk->header.count == UINT16_MAX) {
+        ret = write_chunk(chunk);
+    }
+    xSemaphoreGive(series_mutex);
+    return ret;
+}
+
+esp_err_t timeseries_flush(void) {
+    if (mapped == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t ret = ESP_OK;
+    xSemaphoreTake(series_mutex, portMAX_DELAY);
+    for (int series = 0; series < TIMESERIES_MAX_SERIES; series++) {
+        esp_err_t err = write_chunk(&chunks[series]);
+        if (ret == ESP_OK) ret = err;
+    }
+    xSemaphoreGive(series_mutex);
+    return ret;
+}
+
+esp_err_t timeseries_iter_begin(timeseries_iter_t *iter, uint8_t series, uint32_t from, uint32_t to) {
+    if (iter == NULL || series >= TIMESERIES_MAX_SERIES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (mapped == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(iter, 0, sizeof(*iter));
+    iter->series = series;
+    iter->from = from;
+    iter->to = to;
+    iter->segment = -1;
+    iter->done = from > to;
+    return ESP_OK;
+}
+
+bool timeseries_iter_next(timeseries_iter_t *iter, timeseries_sample_t *out) {
+    if (iter == NULL || out == NULL || iter->done) {
+        return false;
+    }
+
+    bool found = false;
+    xSemaphoreTake(series_mutex, portMAX_DELAY);
+    while (!found && !iter->done) {
+        bool in_flash = iter->bits != iter->ram_copy;
+        if (iter->remaining > 0 && in_flash &&
+            (!segments[iter->segment].used || segments[iter->segment].sequence != iter->sequence)) {
+            iter->remaining = 0; // The segment was erased under us
+        }
+        if (iter->remaining == 0) {
+            iter->done = !load_next_chunk(iter);
+            continue;
+        }
+
+        // The first sample sits in the chunk header, the rest in the bit stream
+        if (iter->first) {
+            iter->first = false;
+        } else {
+            decode_sample(iter);
+        }
+        iter->remaining--;
+        found = iter->timestamp >= iter->from;
+        if (iter->timestamp > iter->to) {
+            // Samples of a series are in time order, so nothing later can be in range
+            iter->done = true;
+            found = false;
+        }
+        if (found) {
+            out->timestamp = iter->timestamp;
+            memcpy(&out->value, &iter->value, sizeof(out->value));
+        }
+    }
+    xSemaphoreGive(series_mutex);
+    return found;
+}
+
+esp_err_t timeseries_get_info(timeseries_info_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(out, 0, sizeof(*out));
+    if (mapped == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(series_mutex, portMAX_DELAY);
+    out->segments_total = segment_count;
+    out->bytes_total = segment_count * SEGMENT_SIZE;
+    for (int segment = 0; segment < segment_count; segment++) {
+        if (!segments[segment].used) continue;
+        out->segments_used++;
+        out->bytes_used += segments[segment].tail;
+        out->samples += segments[segment].samples;
+        if (segments[segment].samples > 0 &&
+            (out->oldest_timestamp == 0 || segments[segment].first_timestamp < out->oldest_timestamp)) {
+            out->oldest_timestamp = segments[segment].first_timestamp;
+        }
+    }
+    for (int series = 0; series < TIMESERIES_MAX_SERIES; series++) {
+        const chunk_header_t *header = &chunks[series].header;
+        out->samples += header->count;
+        if (header->count > 0 && (out->oldest_timestamp == 0 || header->first_timestamp < out->oldest_timestamp)) {
+            out->oldest_timestamp = header->first_timestamp;
+        }
+    }
+    xSemaphoreGive(series_mutex);
+    return ESP_OK;
+}
+
+esp_err_t timeseries_clear(void) {
+    if (mapped == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(series_mutex, portMAX_DELAY);
+    esp_err_t ret = esp_partition_erase_range(partition, 0, (size_t)segment_count * SEGMENT_SIZE);
+    memset(segments, 0, sizeof(segments));
+    memset(chunks, 0, sizeof(chunks));
+    memset(last_timestamp, 0, sizeof(last_timestamp));
+    newest = -1;
+    xSemaphoreGive(series_mutex);
+    return ret;
+}
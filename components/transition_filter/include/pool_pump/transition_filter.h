@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "pump_controller.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    float price_low_enter;       // Price must drop below this to enter the low-price band (EUR/kWh)
+    float price_low_exit;        // Price must rise above this to leave the low-price band (EUR/kWh)
+    uint32_t min_on_ms;          // Minimum time the pump stays in a running mode before it may change
+    uint32_t min_off_ms;         // Minimum time the pump stays off before it may start again
+    uint32_t coalesce_window_ms; // Requests arriving within this window collapse into one transition
+} transition_filter_config_t;
+
+typedef struct {
+    uint32_t requests;             // Requests that changed the target mode
+    uint32_t applied;              // Transitions actually sent to the pump controller
+    uint32_t forced;               // Transitions applied through transition_filter_force()
+    uint32_t cancelled;            // Pending transitions dropped because the target reverted to the active mode
+    uint32_t suppressed_coalesced; // Pending transitions overwritten inside the coalescing window
+    uint32_t suppressed_dwell;     // Pending transitions overwritten while held back by the dwell time
+    uint32_t price_band_changes;   // Transitions of the hysteresis-filtered low-price flag
+} transition_filter_stats_t;
+
+/**
+ * @brief Fill a configuration with the defaults from config.h
+ * @param config Configuration to fill
+ */
+void transition_filter_default_config(transition_filter_config_t *config);
+
+/**
+ * @brief Initialize the filter
+ * @param config Filter configuration, NULL for defaults
+ * @param initial_mode Mode the pump is currently in
+ * @return ESP_OK on success
+ */
+esp_err_t transition_filter_init(const transition_filter_config_t *config, pump_mode_t initial_mode);
+
+/**
+ * @brief Hysteresis-filtered low-price check
+ * @param price Current price in EUR/kWh (<= 0 means unknown)
+ * @return true while the price is inside the low-price band
+ */
+bool transition_filter_price_is_low(float price);
+
+/**
+ * @brief Record the mode the scheduler wants
+ *
+ * The request is not applied immediately; it becomes pending and is committed by
+ * transition_filter_process() once the coalescing window and dwell times allow it.
+ *
+ * @param mode Desired mode (PUMP_MODE_OFF to stop)
+ * @param now_ms Monotonic time in milliseconds
+ * @return ESP_OK on success
+ */
+esp_err_t transition_filter_request(pump_mode_t mode, int64_t now_ms);
+
+/**
+ * @brief Commit the pending request if allowed
+ * @param now_ms Monotonic time in milliseconds
+ * @return true if a transition was sent to the pump controller
+ */
+bool transition_filter_process(int64_t now_ms);
+
+/**
+ * @brief Apply a mode immediately, bypassing dwell and coalescing (safety stops)
+ * @param mode Mode to apply
+ * @param now_ms Monotonic time in milliseconds
+ * @return Result of the pump controller call
+ */
+esp_err_t transition_filter_force(pump_mode_t mode, int64_t now_ms);
+
+/**
+ * @brief Mode most recently committed to the pump controller
+ */
+pump_mode_t transition_filter_get_active_mode(void);
+
+/**
+ * @brief Copy the filter counters
+ * @param stats Destination
+ * @return ESP_OK on success
+ */
+esp_err_t transition_filter_get_stats(transition_filter_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
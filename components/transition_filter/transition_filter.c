@@ -0,0 +1,197 @@
+#include "pool_pump/transition_filter.h"
+
+#include <string.h>
+
+#include "config.h"
+#include "esp_log.h"
+
+static const char *TAG = "transition_filter";
+
+static transition_filter_config_t s_config;
+static transition_filter_stats_t s_stats;
+
+static pump_mode_t s_active_mode = PUMP_MODE_OFF;
+static int64_t s_active_since_ms = 0;
+
+static bool s_has_pending = false;
+static pump_mode_t s_pending_mode = PUMP_MODE_OFF;
+static int64_t s_pending_since_ms = 0;
+
+static bool s_price_low = false;
+
+void transition_filter_default_config(transition_filter_config_t *config) {
+    if (config == NULL) {
+        return;
+    }
+
+    config->price_low_enter = PRICE_THRESHOLD_LOW;
+    config->price_low_exit = PRICE_THRESHOLD_LOW + PRICE_HYSTERESIS_BAND;
+    config->min_on_ms = PUMP_MIN_ON_MINUTES * 60 * 1000;
+    config->min_off_ms = PUMP_MIN_OFF_MINUTES * 60 * 1000;
+    config->coalesce_window_ms = PUMP_COALESCE_WINDOW_SECONDS * 1000;
+}
+
+esp_err_t transition_filter_init(const transition_filter_config_t *config, pump_mode_t initial_mode) {
+    if (initial_mode < PUMP_MODE_OFF || initial_mode > PUMP_MODE_BACKWASH) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (config != NULL) {
+        if (config->price_low_exit < config->price_low_enter) {
+            ESP_LOGE(TAG, "Price exit threshold must not be below the enter threshold");
+            return ESP_ERR_INVALID_ARG;
+        }
+        s_config = *config;
+    } else {
+        transition_filter_default_config(&s_config);
+    }
+
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_active_mode = initial_mode;
+    // Treat the initial mode as having dwelled long enough so the first decision is not delayed
+    uint32_t longest_dwell = s_config.min_on_ms > s_config.min_off_ms ? s_config.min_on_ms : s_config.min_off_ms;
+    s_active_since_ms = -(int64_t)longest_dwell;
+    s_has_pending = false;
+    s_price_low = false;
+
+    ESP_LOGI(TAG,
+             "Filter initialized: band %.3f-%.3f EUR/kWh, min on %lu s, min off %lu s, coalesce %lu ms",
+             s_config.price_low_enter,
+             s_config.price_low_exit,
+             (unsigned long)(s_config.min_on_ms / 1000),
+             (unsigned long)(s_config.min_off_ms / 1000),
+             (unsigned long)s_config.coalesce_window_ms);
+    return ESP_OK;
+}
+
+bool transition_filter_price_is_low(float price) {
+    bool low;
+    if (price <= 0) {
+        // Unknown price never counts as low, matching price_fetcher_is_low_price_period()
+        low = false;
+    } else if (s_price_low) {
+        low = price <= s_config.price_low_exit;
+    } else {
+        low = price < s_config.price_low_enter;
+    }
+
+    if (low != s_price_low) {
+        s_stats.price_band_changes++;
+        s_price_low = low;
+    }
+    return low;
+}
+
+static esp_err_t apply_mode(pump_mode_t mode, int64_t now_ms) {
+    esp_err_t ret;
+    if (mode == PUMP_MODE_OFF) {
+        ret = pump_controller_stop();
+    } else {
+        ret = pump_controller_set_mode(mode);
+        if (ret == ESP_OK) {
+            ret = pump_controller_start();
+        }
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to apply mode %d: %s", mode, esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(TAG,
+             "Transition %d -> %d after %lld s",
+             s_active_mode,
+             mode,
+             (long long)((now_ms - s_active_since_ms) / 1000));
+    s_active_mode = mode;
+    s_active_since_ms = now_ms;
+    return ESP_OK;
+}
+
+esp_err_t transition_filter_request(pump_mode_t mode, int64_t now_ms) {
+    if (mode < PUMP_MODE_OFF || mode > PUMP_MODE_BACKWASH) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pump_mode_t target = s_has_pending ? s_pending_mode : s_active_mode;
+    if (mode == target) {
+        return ESP_OK;
+    }
+
+    s_stats.requests++;
+
+    if (!s_has_pending) {
+        s_has_pending = true;
+        s_pending_mode = mode;
+        s_pending_since_ms = now_ms;
+        return ESP_OK;
+    }
+
+    if (mode == s_active_mode) {
+        ESP_LOGD(TAG, "Pending transition to %d cancelled", s_pending_mode);
+        s_stats.cancelled++;
+        s_has_pending = false;
+        return ESP_OK;
+    }
+
+    // Keep the original window start so a stream of requests cannot postpone the transition forever
+    if (now_ms - s_pending_since_ms < (int64_t)s_config.coalesce_window_ms) {
+        s_stats.suppressed_coalesced++;
+    } else {
+        s_stats.suppressed_dwell++;
+    }
+    s_pending_mode = mode;
+    return ESP_OK;
+}
+
+bool transition_filter_process(int64_t now_ms) {
+    if (!s_has_pending) {
+        return false;
+    }
+
+    if (now_ms - s_pending_since_ms < (int64_t)s_config.coalesce_window_ms) {
+        return false;
+    }
+
+    uint32_t dwell_ms = (s_active_mode == PUMP_MODE_OFF) ? s_config.min_off_ms : s_config.min_on_ms;
+    if (now_ms - s_active_since_ms < (int64_t)dwell_ms) {
+        return false;
+    }
+
+    if (apply_mode(s_pending_mode, now_ms) != ESP_OK) {
+        // Leave the request pending so the next cycle retries it
+        return false;
+    }
+
+    s_has_pending = false;
+    s_stats.applied++;
+    return true;
+}
+
+esp_err_t transition_filter_force(pump_mode_t mode, int64_t now_ms) {
+    if (mode < PUMP_MODE_OFF || mode > PUMP_MODE_BACKWASH) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_has_pending = false;
+    if (mode == s_active_mode) {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = apply_mode(mode, now_ms);
+    if (ret == ESP_OK) {
+        s_stats.forced++;
+    }
+    return ret;
+}
+
+pump_mode_t transition_filter_get_active_mode(void) { return s_active_mode; }
+
+esp_err_t transition_filter_get_stats(transition_filter_stats_t *stats) {
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *stats = s_stats;
+    return ESP_OK;
+}
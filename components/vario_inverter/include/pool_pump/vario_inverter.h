@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "pool_pump/modbus_rtu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Vario+ II Modbus register map. Holding registers are written by us, input registers are status.
+#define VARIO_REG_CONTROL 0x0000        // Holding: 0 = stop, 1 = run
+#define VARIO_REG_SPEED_SETPOINT 0x0001 // Holding: speed setpoint in RPM
+#define VARIO_REG_STATUS_BASE 0x0100    // Input: start of the status block
+#define VARIO_STATUS_REG_COUNT 6        // Registers in the status block
+
+#define VARIO_REG_TIMER_BASE 0x0200   // Holding: VARIO_TIMER_SLOTS x {start minute, end minute, RPM}
+#define VARIO_REG_TIMER_ENABLE 0x020C // Holding: 1 = inverter runs its own timer program
+#define VARIO_REG_CLOCK_MINUTE 0x020D // Holding: inverter clock, minute of day
+#define VARIO_TIMER_SLOTS 4
+#define VARIO_TIMER_SLOT_REGS 3
+
+#define VARIO_CONTROL_STOP 0
+#define VARIO_CONTROL_RUN 1
+
+#define VARIO_STATUS_FLAG_RUNNING 0x0001
+#define VARIO_STATUS_FLAG_PRIMING 0x0002
+#define VARIO_STATUS_FLAG_FAULT 0x0004
+
+#define VARIO_MIN_RPM 1200
+#define VARIO_MAX_RPM 2900
+
+typedef struct {
+    uint16_t actual_rpm;
+    uint16_t power_w;
+    uint16_t fault_code;
+    uint16_t status_flags;
+    uint16_t dc_bus_v;
+    int16_t temperature_c;
+} vario_inverter_status_t;
+
+typedef struct {
+    uint16_t start_minute; // Minute of day the interval starts
+    uint16_t end_minute;   // Minute of day the interval ends (exclusive)
+    uint16_t rpm;
+} vario_timer_interval_t;
+
+typedef struct {
+    vario_timer_interval_t intervals[VARIO_TIMER_SLOTS];
+    uint8_t count;
+} vario_timer_program_t;
+
+/**
+ * @brief Open the RS485 link to the inverter using the pins in config.h
+ * @return ESP_OK on success
+ */
+esp_err_t vario_inverter_init(void);
+
+/**
+ * @brief Open the inverter link on an existing transport (host simulator, tests)
+ * @param transport Byte transport
+ * @return ESP_OK on success
+ */
+esp_err_t vario_inverter_init_with_transport(const modbus_rtu_transport_t *transport);
+
+/**
+ * @brief Run the pump at an arbitrary speed
+ *
+ * Writes the run command and setpoint in a single write-multiple transaction.
+ *
+ * @param rpm Speed in RPM (VARIO_MIN_RPM..VARIO_MAX_RPM)
+ * @return ESP_OK on success
+ */
+esp_err_t vario_inverter_set_speed(uint16_t rpm);
+
+/**
+ * @brief Stop the pump
+ * @return ESP_OK on success
+ */
+esp_err_t vario_inverter_stop(void);
+
+/**
+ * @brief Read actual RPM, power, faults and flags in one multi-register transaction
+ * @param status Pointer to store status
+ * @return ESP_OK on success
+ */
+esp_err_t vario_inverter_read_status(vario_inverter_status_t *status);
+
+/**
+ * @brief Upload a timer program, set the inverter clock and hand control to the inverter timer
+ *
+ * All slots, the enable flag and the clock go out in a single write-multiple transaction.
+ *
+ * @param program Up to VARIO_TIMER_SLOTS intervals
+ * @param clock_minute Current minute of day
+ * @return ESP_OK on success
+ */
+esp_err_t vario_inverter_write_timer_program(const vario_timer_program_t *program, uint16_t clock_minute);
+
+/**
+ * @brief Read back the timer program stored in the inverter
+ * @param program Pointer to store the program
+ * @return ESP_OK on success
+ */
+esp_err_t vario_inverter_read_timer_program(vario_timer_program_t *program);
+
+/**
+ * @brief Take control back from the inverter timer
+ * @return ESP_OK on success
+ */
+esp_err_t vario_inverter_disable_timer(void);
+
+/**
+ * @brief Get link statistics (round-trip latency, retries, errors)
+ * @param stats Pointer to store statistics
+ * @return ESP_OK on success
+ */
+esp_err_t vario_inverter_get_link_stats(modbus_rtu_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,183 @@
+#include "pool_pump/vario_inverter.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "config.h"
+#include "esp_log.h"
+#include "pool_pump/modbus_rtu_uart.h"
+
+static const char *TAG = "vario_inverter";
+
+static modbus_rtu_master_t s_master;
+static bool s_initialized = false;
+
+esp_err_t vario_inverter_init_with_transport(const modbus_rtu_transport_t *transport) {
+    esp_err_t ret = modbus_rtu_master_init(&s_master, transport, INVERTER_RESPONSE_TIMEOUT_MS, INVERTER_RETRIES);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    s_initialized = true;
+    ESP_LOGI(TAG, "Inverter link ready (slave %d)", INVERTER_MODBUS_ADDRESS);
+    return ESP_OK;
+}
+
+esp_err_t vario_inverter_init(void) {
+    const modbus_rtu_uart_config_t uart_config = {
+        .uart_num = INVERTER_UART_NUM,
+        .tx_pin = INVERTER_UART_TX_PIN,
+        .rx_pin = INVERTER_UART_RX_PIN,
+        .de_pin = INVERTER_UART_DE_PIN,
+        .baud_rate = INVERTER_UART_BAUD,
+    };
+
+    modbus_rtu_transport_t transport;
+    esp_err_t ret = modbus_rtu_uart_init(&uart_config, &transport);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open RS485 link: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    return vario_inverter_init_with_transport(&transport);
+}
+
+esp_err_t vario_inverter_set_speed(uint16_t rpm) {
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (rpm < VARIO_MIN_RPM || rpm > VARIO_MAX_RPM) {
+        ESP_LOGE(TAG, "Speed %u RPM outside %d-%d", rpm, VARIO_MIN_RPM, VARIO_MAX_RPM);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Control and setpoint are adjacent, so one write-multiple starts the pump at the new speed
+    const uint16_t values[2] = {VARIO_CONTROL_RUN, rpm};
+    esp_err_t ret = modbus_rtu_write_registers(&s_master, INVERTER_MODBUS_ADDRESS, VARIO_REG_CONTROL, 2, values);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Speed set to %u RPM", rpm);
+    }
+    return ret;
+}
+
+esp_err_t vario_inverter_stop(void) {
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t ret =
+        modbus_rtu_write_register(&s_master, INVERTER_MODBUS_ADDRESS, VARIO_REG_CONTROL, VARIO_CONTROL_STOP);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Pump stopped");
+    }
+    return ret;
+}
+
+esp_err_t vario_inverter_read_status(vario_inverter_status_t *status) {
+    if (status == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint16_t regs[VARIO_STATUS_REG_COUNT];
+    esp_err_t ret = modbus_rtu_read_registers(&s_master,
+                                              INVERTER_MODBUS_ADDRESS,
+                                              MODBUS_FC_READ_INPUT,
+                                              VARIO_REG_STATUS_BASE,
+                                              VARIO_STATUS_REG_COUNT,
+                                              regs);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    status->actual_rpm = regs[0];
+    status->power_w = regs[1];
+    status->fault_code = regs[2];
+    status->status_flags = regs[3];
+    status->dc_bus_v = regs[4];
+    status->temperature_c = (int16_t)regs[5];
+    return ESP_OK;
+}
+
+esp_err_t vario_inverter_write_timer_program(const vario_timer_program_t *program, uint16_t clock_minute) {
+    if (program == NULL || program->count > VARIO_TIMER_SLOTS || clock_minute >= 24 * 60) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Slots, enable flag and clock are contiguous so the whole program is one transaction
+    uint16_t regs[VARIO_REG_CLOCK_MINUTE - VARIO_REG_TIMER_BASE + 1] = {0};
+    for (int i = 0; i < program->count; i++) {
+        const vario_timer_interval_t *interval = &program->intervals[i];
+        if (interval->start_minute >= interval->end_minute || interval->end_minute > 24 * 60 ||
+            interval->rpm < VARIO_MIN_RPM || interval->rpm > VARIO_MAX_RPM) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        regs[i * VARIO_TIMER_SLOT_REGS + 0] = interval->start_minute;
+        regs[i * VARIO_TIMER_SLOT_REGS + 1] = interval->end_minute;
+        regs[i * VARIO_TIMER_SLOT_REGS + 2] = interval->rpm;
+    }
+    regs[VARIO_REG_TIMER_ENABLE - VARIO_REG_TIMER_BASE] = 1;
+    regs[VARIO_REG_CLOCK_MINUTE - VARIO_REG_TIMER_BASE] = clock_minute;
+
+    esp_err_t ret = modbus_rtu_write_registers(
+        &s_master, INVERTER_MODBUS_ADDRESS, VARIO_REG_TIMER_BASE, sizeof(regs) / sizeof(regs[0]), regs);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Timer program with %d intervals uploaded", program->count);
+    }
+    return ret;
+}
+
+esp_err_t vario_inverter_read_timer_program(vario_timer_program_t *program) {
+    if (program == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint16_t regs[VARIO_TIMER_SLOTS * VARIO_TIMER_SLOT_REGS];
+    esp_err_t ret = modbus_rtu_read_registers(&s_master,
+                                              INVERTER_MODBUS_ADDRESS,
+                                              MODBUS_FC_READ_HOLDING,
+                                              VARIO_REG_TIMER_BASE,
+                                              sizeof(regs) / sizeof(regs[0]),
+                                              regs);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    memset(program, 0, sizeof(*program));
+    for (int i = 0; i < VARIO_TIMER_SLOTS; i++) {
+        const uint16_t *slot = &regs[i * VARIO_TIMER_SLOT_REGS];
+        if (slot[2] == 0 || slot[0] >= slot[1]) {
+            continue;
+        }
+        vario_timer_interval_t *interval = &program->intervals[program->count++];
+        interval->start_minute = slot[0];
+        interval->end_minute = slot[1];
+        interval->rpm = slot[2];
+    }
+    return ESP_OK;
+}
+
+esp_err_t vario_inverter_disable_timer(void) {
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return modbus_rtu_write_register(&s_master, INVERTER_MODBUS_ADDRESS, VARIO_REG_TIMER_ENABLE, 0);
+}
+
+esp_err_t vario_inverter_get_link_stats(modbus_rtu_stats_t *stats) {
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *stats = s_master.stats;
+    return ESP_OK;
+}
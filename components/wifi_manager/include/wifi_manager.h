@@ -2,19 +2,61 @@
 #define WIFI_MANAGER_H
 
 #include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
 #include <stdbool.h>
+#include <stdint.h>
+
+// Bits of the event group returned by wifi_manager_get_event_group(); exactly one is set at a time
+#define WIFI_MANAGER_CONNECTED_BIT BIT0    // Associated and holding an IP address
+#define WIFI_MANAGER_DISCONNECTED_BIT BIT1 // Not connected, whether idle, connecting or backing off
+
+typedef enum {
+    WIFI_MANAGER_STATE_IDLE = 0,   // No network requested, or disconnected on request
+    WIFI_MANAGER_STATE_CONNECTING, // Waiting for the access point to accept the station
+    WIFI_MANAGER_STATE_ASSOCIATED, // Associated, waiting for DHCP
+    WIFI_MANAGER_STATE_CONNECTED,  // Holding an IP address
+    WIFI_MANAGER_STATE_BACKOFF,    // Waiting before the next connect attempt
+} wifi_manager_state_t;
+
+typedef struct {
+    uint32_t connect_attempts;
+    uint32_t connects;
+    uint32_t disconnects;
+    uint32_t last_connect_ms; // From esp_wifi_connect() to an IP address
+    uint32_t max_connect_ms;
+    uint32_t avg_connect_ms;
+    uint32_t last_start_to_ip_ms;   // From esp_wifi_start(), or the link loss, to an IP address
+    uint32_t fast_connects;         // Connections made on the cached access point and lease
+    uint32_t fast_fallbacks;        // Fast attempts that failed and went back to a full scan
+    uint32_t backoff_ms;            // Delay before the next attempt, 0 while connected
+    uint8_t last_disconnect_reason; // wifi_err_reason_t of the last disconnect
+    uint64_t uptime_ms;             // Total time connected, including the current connection
+    uint64_t current_uptime_ms;     // Time the current connection has been up, 0 when disconnected
+} wifi_manager_stats_t;
 
 /**
  * @brief Initialize WiFi manager
+ *
+ * Registers the WiFi and IP event handlers that drive the connection state machine. Safe to call
+ * after the netif and default event loop have already been created.
+ *
  * @return ESP_OK on success
  */
 esp_err_t wifi_manager_init(void);
 
 /**
  * @brief Connect to WiFi network
+ *
+ * Starts the first attempt and returns; the outcome is published through the event group. When the
+ * network was joined before, the attempt goes straight to the cached access point and channel and
+ * reuses the cached lease, falling back to a full scan and DHCP if that fails. Lost
+ * connections and failed attempts are retried with an exponential backoff from
+ * WIFI_RECONNECT_MIN_MS to WIFI_RECONNECT_MAX_MS until wifi_manager_disconnect() is called.
+ *
  * @param ssid WiFi network SSID
  * @param password WiFi network password
- * @return ESP_OK on success
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for NULL credentials
  */
 esp_err_t wifi_manager_connect(const char *ssid, const char *password);
 
@@ -30,4 +72,36 @@ bool wifi_manager_is_connected(void);
  */
 esp_err_t wifi_manager_disconnect(void);
 
+/**
+ * @brief Disconnect and switch the radio off until the next wifi_manager_connect()
+ * @return ESP_OK on success
+ */
+esp_err_t wifi_manager_stop(void);
+
+/**
+ * @brief Get the event group carrying WIFI_MANAGER_CONNECTED_BIT and WIFI_MANAGER_DISCONNECTED_BIT
+ * @return Event group handle, NULL before wifi_manager_init()
+ */
+EventGroupHandle_t wifi_manager_get_event_group(void);
+
+/**
+ * @brief Block until the station holds an IP address
+ * @param timeout_ms Maximum time to wait in milliseconds
+ * @return true if connected, false on timeout
+ */
+bool wifi_manager_wait_connected(uint32_t timeout_ms);
+
+/**
+ * @brief Get the state of the connection state machine
+ * @return Current state
+ */
+wifi_manager_state_t wifi_manager_get_state(void);
+
+/**
+ * @brief Get the connect latency, reconnect and uptime statistics
+ * @param out Pointer to store the statistics
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for NULL
+ */
+esp_err_t wifi_manager_get_stats(wifi_manager_stats_t *out);
+
 #endif // WIFI_MANAGER_H
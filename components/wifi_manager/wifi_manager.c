@@ -1,30 +1,356 @@
 #include "wifi_manager.h"
+#include "config.h"
+#include "esp_attr.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_netif_net_stack.h"
 #include "esp_wifi.h"
+#include "lwip/dhcp.h"
 #include "nvs_flash.h"
+#include "nvs_storage.h"
+#include "pool_pump/boot_trace.h"
+#include "pool_pump/static_alloc.h"
+#include <stddef.h>
 #include <string.h>
+#include <time.h>
 
 static const char *TAG = "WIFI_MANAGER";
 
-static bool wifi_connected = false;
+#define FAST_CONNECT_MAGIC 0x57464332 // "WFC2"; bump when the layout changes
+#define CLOCK_SET_AFTER 1577836800    // 2020-01-01; earlier readings mean the clock has not been synced
+
+// Access point and lease of the last connection, kept in RTC memory and as the same bytes in NVS
+typedef struct {
+    uint32_t magic;
+    uint32_t ssid_crc; // Network the entry belongs to
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t reserved;
+    esp_netif_ip_info_t ip_info;
+    uint32_t dns;
+    uint32_t lease_from;  // Wall-clock seconds DHCP granted the lease at, 0 when unknown
+    uint32_t lease_until; // The lease may be reused as a static address until its renewal time
+    uint32_t crc;         // Over everything above
+} fast_connect_record_t;
+
+static RTC_NOINIT_ATTR fast_connect_record_t rtc_fast_connect;
+
+static EventGroupHandle_t wifi_events = NULL;
+static esp_timer_handle_t reconnect_timer = NULL;
+static esp_netif_t *sta_netif = NULL;
+static bool wifi_started = false;
+static wifi_config_t sta_config;
+static uint32_t sta_ssid_crc = 0;
+static fast_connect_record_t fast_connect; // Valid when magic is set
+static bool attempt_fast = false;          // The current attempt skips the scan
+static bool attempt_reuse_ip = false;      // ...and DHCP, with the cached lease still inside its renewal time
+
+// State machine and statistics; written from the event loop and the reconnect timer, read by any task
+static portMUX_TYPE wifi_lock = portMUX_INITIALIZER_UNLOCKED;
+static wifi_manager_state_t state = WIFI_MANAGER_STATE_IDLE;
+static bool disconnect_requested = true;
+static uint32_t backoff_ms = 0;
+static int64_t attempt_start_us = 0;
+static int64_t radio_start_us = 0;
+static int64_t connected_since_us = 0;
+static uint64_t total_connect_ms = 0;
+static wifi_manager_stats_t stats = {0};
+
+static void set_connected_bits(bool connected) {
+    if (connected) {
+        xEventGroupClearBits(wifi_events, WIFI_MANAGER_DISCONNECTED_BIT);
+        xEventGroupSetBits(wifi_events, WIFI_MANAGER_CONNECTED_BIT);
+    } else {
+        xEventGroupClearBits(wifi_events, WIFI_MANAGER_CONNECTED_BIT);
+        xEventGroupSetBits(wifi_events, WIFI_MANAGER_DISCONNECTED_BIT);
+    }
+}
+
+static uint32_t fast_connect_crc(const fast_connect_record_t *record) {
+    return esp_rom_crc32_le(0, (const uint8_t *)record, offsetof(fast_connect_record_t, crc));
+}
+
+static bool fast_connect_valid(const fast_connect_record_t *record) {
+    return record->magic == FAST_CONNECT_MAGIC && record->crc == fast_connect_crc(record);
+}
+
+static void load_fast_connect(void) {
+    // RTC memory is undefined after power-on, and a brownout may have corrupted it mid-write
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool rtc_usable = reason != ESP_RST_POWERON && reason != ESP_RST_BROWNOUT && reason != ESP_RST_UNKNOWN;
+    if (rtc_usable && fast_connect_valid(&rtc_fast_connect)) {
+        fast_connect = rtc_fast_connect;
+        return;
+    }
+
+    size_t length = sizeof(fast_connect);
+    if (nvs_storage_load_blob(NVS_KEY_WIFI_FAST_CONNECT, &fast_connect, &length) != ESP_OK ||
+        length != sizeof(fast_connect) || !fast_connect_valid(&fast_connect)) {
+        memset(&fast_connect, 0, sizeof(fast_connect));
+    }
+    rtc_fast_connect = fast_connect;
+}
+
+// Renewal time of the lease the DHCP client just bound, read from lwIP; the client renews at T1 itself
+static void read_lease(fast_connect_record_t *record) {
+    time_t now = time(NULL);
+    struct netif *netif = esp_netif_get_netif_impl(sta_netif);
+    struct dhcp *dhcp = netif != NULL ? netif_dhcp_data(netif) : NULL;
+    if (now < CLOCK_SET_AFTER || dhcp == NULL || dhcp->offered_t1_renew == 0) {
+        return;
+    }
+    record->lease_from = (uint32_t)now;
+    record->lease_until = (uint32_t)now + dhcp->offered_t1_renew;
+}
+
+// Whether the cached address may be set statically; a clock reset after power loss reads as expired
+static bool lease_reusable(void) {
+    time_t now = time(NULL);
+    return fast_connect.lease_until != 0 && now >= CLOCK_SET_AFTER && now >= (time_t)fast_connect.lease_from &&
+           now < (time_t)fast_connect.lease_until;
+}
+
+// Remember where the station just got in; flash is only written when the access point or lease changed
+static void store_fast_connect(const esp_netif_ip_info_t *ip_info, bool reused_ip) {
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+        return;
+    }
+
+    fast_connect_record_t record = {0};
+    record.magic = FAST_CONNECT_MAGIC;
+    record.ssid_crc = sta_ssid_crc;
+    memcpy(record.bssid, ap.bssid, sizeof(record.bssid));
+    record.channel = ap.primary;
+    record.ip_info = *ip_info;
+    esp_netif_dns_info_t dns;
+    if (esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) {
+        record.dns = dns.ip.u_addr.ip4.addr;
+    }
+    if (reused_ip) {
+        // A statically set address carries no new lease; keep the window of the one it came from
+        record.lease_from = fast_connect.lease_from;
+        record.lease_until = fast_connect.lease_until;
+    } else {
+        read_lease(&record);
+    }
+    record.crc = fast_connect_crc(&record);
+
+    bool changed = memcmp(&record, &fast_connect, sizeof(record)) != 0;
+    fast_connect = record;
+    rtc_fast_connect = record;
+    if (changed) {
+        esp_err_t ret = nvs_storage_save_blob(NVS_KEY_WIFI_FAST_CONNECT, &record, sizeof(record));
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to save the fast connect entry: %s", esp_err_to_name(ret));
+        }
+    }
+}
+
+// Point the driver and the netif at the cached access point and lease, or back at a scan and DHCP
+static esp_err_t apply_connect_mode(bool fast) {
+    wifi_config_t config = sta_config;
+    if (fast) {
+        config.sta.bssid_set = true;
+        memcpy(config.sta.bssid, fast_connect.bssid, sizeof(config.sta.bssid));
+        config.sta.channel = fast_connect.channel;
+        config.sta.scan_method = WIFI_FAST_SCAN;
+    }
+    esp_err_t ret = esp_wifi_set_config(WIFI_IF_STA, &config);
+    if (ret != ESP_OK) return ret;
+
+    bool reuse_ip = fast && WIFI_FAST_CONNECT_REUSE_IP && lease_reusable();
+    if (reuse_ip) {
+        esp_netif_dhcpc_stop(sta_netif);
+        ret = esp_netif_set_ip_info(sta_netif, &fast_connect.ip_info);
+        if (ret == ESP_OK && fast_connect.dns != 0) {
+            esp_netif_dns_info_t dns = {0};
+            dns.ip.u_addr.ip4.addr = fast_connect.dns;
+            dns.ip.type = ESP_IPADDR_TYPE_V4;
+            esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+        }
+    } else {
+        // Fails harmlessly when the client is already running
+        esp_netif_dhcpc_start(sta_netif);
+    }
+
+    portENTER_CRITICAL(&wifi_lock);
+    attempt_fast = fast;
+    attempt_reuse_ip = reuse_ip;
+    portEXIT_CRITICAL(&wifi_lock);
+    return ret;
+}
+
+static void start_attempt(void) {
+    portENTER_CRITICAL(&wifi_lock);
+    if (disconnect_requested) {
+        portEXIT_CRITICAL(&wifi_lock);
+        return;
+    }
+    state = WIFI_MANAGER_STATE_CONNECTING;
+    attempt_start_us = esp_timer_get_time();
+    stats.connect_attempts++;
+    portEXIT_CRITICAL(&wifi_lock);
+
+    esp_err_t ret = esp_wifi_connect();
+    if (ret != ESP_OK) {
+        // No disconnect event follows a rejected call, so the next attempt is scheduled here
+        ESP_LOGW(TAG, "Connect attempt failed: %s", esp_err_to_name(ret));
+        esp_timer_start_once(reconnect_timer, (uint64_t)WIFI_RECONNECT_MIN_MS * 1000);
+    }
+}
+
+static void reconnect_timer_callback(void *arg) {
+    (void)arg;
+    start_attempt();
+}
+
+// Called with wifi_lock held; returns the delay before the next attempt, doubling up to the maximum
+static uint32_t next_backoff_ms(void) {
+    if (backoff_ms == 0) {
+        backoff_ms = WIFI_RECONNECT_MIN_MS;
+    } else if (backoff_ms < WIFI_RECONNECT_MAX_MS / 2) {
+        backoff_ms *= 2;
+    } else {
+        backoff_ms = WIFI_RECONNECT_MAX_MS;
+    }
+    return backoff_ms;
+}
+
+static void handle_disconnected(uint8_t reason) {
+    int64_t now_us = esp_timer_get_time();
+    bool retry;
+    uint32_t delay_ms = 0;
+
+    portENTER_CRITICAL(&wifi_lock);
+    if (state == WIFI_MANAGER_STATE_CONNECTED) {
+        stats.uptime_ms += (uint64_t)(now_us - connected_since_us) / 1000;
+        stats.disconnects++;
+        // The next start-to-IP time counts from the link loss
+        radio_start_us = now_us;
+    }
+    stats.last_disconnect_reason = reason;
+    retry = !disconnect_requested;
+    bool attempting = state == WIFI_MANAGER_STATE_CONNECTING || state == WIFI_MANAGER_STATE_ASSOCIATED;
+    bool fallback = retry && attempt_fast && attempting;
+    if (fallback) {
+        stats.fast_fallbacks++;
+        state = WIFI_MANAGER_STATE_BACKOFF;
+    } else if (retry) {
+        delay_ms = next_backoff_ms();
+        state = WIFI_MANAGER_STATE_BACKOFF;
+    } else {
+        state = WIFI_MANAGER_STATE_IDLE;
+    }
+    portEXIT_CRITICAL(&wifi_lock);
+
+    set_connected_bits(false);
+    if (fallback) {
+        // The access point moved or the lease is gone; scan and ask DHCP straight away
+        ESP_LOGW(TAG, "Fast connect failed (reason %u), falling back to a full scan", reason);
+        memset(&fast_connect, 0, sizeof(fast_connect));
+        rtc_fast_connect = fast_connect;
+        apply_connect_mode(false);
+        start_attempt();
+    } else if (retry) {
+        ESP_LOGW(TAG, "Disconnected (reason %u), retrying in %lu ms", reason, (unsigned long)delay_ms);
+        esp_timer_stop(reconnect_timer);
+        esp_timer_start_once(reconnect_timer, (uint64_t)delay_ms * 1000);
+    } else {
+        ESP_LOGI(TAG, "Disconnected (reason %u)", reason);
+    }
+}
+
+static void handle_got_ip(const ip_event_got_ip_t *event) {
+    int64_t now_us = esp_timer_get_time();
+    uint32_t latency_ms;
+    uint32_t start_to_ip_ms;
+    bool fast;
+    bool reused_ip;
+
+    portENTER_CRITICAL(&wifi_lock);
+    latency_ms = (uint32_t)((now_us - attempt_start_us) / 1000);
+    start_to_ip_ms = (uint32_t)((now_us - radio_start_us) / 1000);
+    fast = attempt_fast;
+    reused_ip = attempt_reuse_ip;
+    stats.last_start_to_ip_ms = start_to_ip_ms;
+    if (fast) {
+        stats.fast_connects++;
+    }
+    state = WIFI_MANAGER_STATE_CONNECTED;
+    connected_since_us = now_us;
+    backoff_ms = 0;
+    stats.connects++;
+    stats.last_connect_ms = latency_ms;
+    if (latency_ms > stats.max_connect_ms) {
+        stats.max_connect_ms = latency_ms;
+    }
+    total_connect_ms += latency_ms;
+    stats.avg_connect_ms = (uint32_t)(total_connect_ms / stats.connects);
+    portEXIT_CRITICAL(&wifi_lock);
+
+    if (event != NULL) {
+        store_fast_connect(&event->ip_info, reused_ip);
+    }
+    set_connected_bits(true);
+    ESP_LOGI(TAG,
+             "Connected in %lu ms, %lu ms after radio start%s",
+             (unsigned long)latency_ms,
+             (unsigned long)start_to_ip_ms,
+             fast ? " (fast)" : "");
+    boot_trace_mark(BOOT_STAGE_NETWORK);
+}
+
+static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    (void)arg;
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        portENTER_CRITICAL(&wifi_lock);
+        if (state == WIFI_MANAGER_STATE_CONNECTING) {
+            state = WIFI_MANAGER_STATE_ASSOCIATED;
+        }
+        portEXIT_CRITICAL(&wifi_lock);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        const wifi_event_sta_disconnected_t *event = event_data;
+        handle_disconnected(event != NULL ? event->reason : 0);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_STOP) {
+        // Settles the state in case the driver stopped without posting a disconnect first
+        if (wifi_manager_get_state() != WIFI_MANAGER_STATE_IDLE) {
+            handle_disconnected(0);
+        }
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        handle_got_ip(event_data);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_LOST_IP) {
+        // Still associated but unusable; dropping the link makes the disconnect path retry
+        ESP_LOGW(TAG, "Lost IP address");
+        esp_wifi_disconnect();
+    }
+}
 
 esp_err_t wifi_manager_init(void) {
+    if (wifi_events != NULL) {
+        return ESP_OK;
+    }
     ESP_LOGI(TAG, "Initializing WiFi manager...");
 
+    // app_main may already have created these; that is not an error here
     esp_err_t ret = esp_netif_init();
-    if (ret != ESP_OK) {
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
         ESP_LOGE(TAG, "Failed to initialize netif: %s", esp_err_to_name(ret));
         return ret;
     }
 
     ret = esp_event_loop_create_default();
-    if (ret != ESP_OK) {
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
         ESP_LOGE(TAG, "Failed to create event loop: %s", esp_err_to_name(ret));
         return ret;
     }
 
-    esp_netif_create_default_wifi_sta();
+    sta_netif = esp_netif_create_default_wifi_sta();
+    load_fast_connect();
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ret = esp_wifi_init(&cfg);
@@ -33,11 +359,46 @@ esp_err_t wifi_manager_init(void) {
         return ret;
     }
 
+    // Created before the handlers are registered, which may run as soon as they are
+    wifi_events = static_alloc_event_group();
+    if (wifi_events == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    set_connected_bits(false);
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = reconnect_timer_callback,
+        .name = "wifi_reconnect",
+    };
+    ret = esp_timer_create(&timer_args, &reconnect_timer);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create reconnect timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_event_handler, NULL);
+    if (ret == ESP_OK) {
+        ret = esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_event_handler, NULL);
+    }
+    if (ret == ESP_OK) {
+        ret = esp_event_handler_register(IP_EVENT, IP_EVENT_STA_LOST_IP, wifi_event_handler, NULL);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register event handlers: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
     ESP_LOGI(TAG, "WiFi manager initialized");
     return ESP_OK;
 }
 
 esp_err_t wifi_manager_connect(const char *ssid, const char *password) {
+    if (ssid == NULL || password == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (wifi_events == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
     ESP_LOGI(TAG, "Connecting to WiFi: %s", ssid);
 
     wifi_config_t wifi_config = {
@@ -50,27 +411,104 @@ esp_err_t wifi_manager_connect(const char *ssid, const char *password) {
 
     strncpy((char *)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid));
     strncpy((char *)wifi_config.sta.password, password, sizeof(wifi_config.sta.password));
+    sta_config = wifi_config;
+    sta_ssid_crc = esp_rom_crc32_le(0, wifi_config.sta.ssid, sizeof(wifi_config.sta.ssid));
 
     esp_err_t ret = esp_wifi_set_mode(WIFI_MODE_STA);
     if (ret != ESP_OK) return ret;
 
-    ret = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    // Straight to the last access point on its channel, with its lease, when we have been here before
+    bool fast = fast_connect.magic == FAST_CONNECT_MAGIC && fast_connect.ssid_crc == sta_ssid_crc;
+    ret = apply_connect_mode(fast);
     if (ret != ESP_OK) return ret;
 
-    ret = esp_wifi_start();
-    if (ret != ESP_OK) return ret;
+    radio_start_us = esp_timer_get_time();
+    if (!wifi_started) {
+        ret = esp_wifi_start();
+        if (ret != ESP_OK) return ret;
+        wifi_started = true;
+    }
 
-    ret = esp_wifi_connect();
-    if (ret != ESP_OK) return ret;
+    esp_timer_stop(reconnect_timer);
+    portENTER_CRITICAL(&wifi_lock);
+    disconnect_requested = false;
+    backoff_ms = 0;
+    portEXIT_CRITICAL(&wifi_lock);
+    start_attempt();
 
     ESP_LOGI(TAG, "WiFi connect initiated");
     return ESP_OK;
 }
 
-bool wifi_manager_is_connected(void) { return wifi_connected; }
+bool wifi_manager_is_connected(void) {
+    return wifi_events != NULL && (xEventGroupGetBits(wifi_events) & WIFI_MANAGER_CONNECTED_BIT) != 0;
+}
 
 esp_err_t wifi_manager_disconnect(void) {
     ESP_LOGI(TAG, "Disconnecting WiFi");
-    wifi_connected = false;
+    portENTER_CRITICAL(&wifi_lock);
+    disconnect_requested = true;
+    if (state == WIFI_MANAGER_STATE_CONNECTING || state == WIFI_MANAGER_STATE_BACKOFF) {
+        state = WIFI_MANAGER_STATE_IDLE;
+    }
+    portEXIT_CRITICAL(&wifi_lock);
+    if (reconnect_timer != NULL) {
+        esp_timer_stop(reconnect_timer);
+    }
+    // A connected station settles its state and bits in the disconnect event
     return esp_wifi_disconnect();
-}
\ No newline at end of file
+}
+
+esp_err_t wifi_manager_stop(void) {
+    if (!wifi_started) {
+        return ESP_OK;
+    }
+    ESP_LOGI(TAG, "Stopping WiFi");
+    portENTER_CRITICAL(&wifi_lock);
+    disconnect_requested = true;
+    portEXIT_CRITICAL(&wifi_lock);
+    esp_timer_stop(reconnect_timer);
+
+    esp_err_t ret = esp_wifi_stop();
+    if (ret == ESP_OK) {
+        wifi_started = false;
+    }
+    return ret;
+}
+
+EventGroupHandle_t wifi_manager_get_event_group(void) { return wifi_events; }
+
+bool wifi_manager_wait_connected(uint32_t timeout_ms) {
+    if (wifi_events == NULL) {
+        return false;
+    }
+    EventBits_t bits =
+        xEventGroupWaitBits(wifi_events, WIFI_MANAGER_CONNECTED_BIT, pdFALSE, pdFALSE, pdMS_TO_TICKS(timeout_ms));
+    return (bits & WIFI_MANAGER_CONNECTED_BIT) != 0;
+}
+
+wifi_manager_state_t wifi_manager_get_state(void) {
+    portENTER_CRITICAL(&wifi_lock);
+    wifi_manager_state_t current = state;
+    portEXIT_CRITICAL(&wifi_lock);
+    return current;
+}
+
+esp_err_t wifi_manager_get_stats(wifi_manager_stats_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&wifi_lock);
+    *out = stats;
+    out->backoff_ms = backoff_ms;
+    if (state == WIFI_MANAGER_STATE_CONNECTED) {
+        out->current_uptime_ms = (uint64_t)(now_us - connected_since_us) / 1000;
+        out->uptime_ms += out->current_uptime_ms;
+    } else {
+        out->current_uptime_ms = 0;
+    }
+    portEXIT_CRITICAL(&wifi_lock);
+    return ESP_OK;
+}
@@ -1,9 +1,15 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stdbool.h>
+
 // WiFi Configuration
 #define WIFI_SSID_MAX_LEN 32
 #define WIFI_PASSWORD_MAX_LEN 64
+#define WIFI_RECONNECT_MIN_MS 1000   // First retry after a lost connection or failed attempt
+#define WIFI_RECONNECT_MAX_MS 300000 // Retries back off exponentially up to this delay
+#define WIFI_CONNECT_WAIT_MS 30000   // How long a fetch waits for the network before giving up
+#define WIFI_FAST_CONNECT_REUSE_IP 1 // Set the cached lease statically until its DHCP renewal time; 0 always runs DHCP
 
 // Pump Speed Settings (RPM)
 #define PUMP_SPEED_NIGHT 1400
@@ -16,31 +22,130 @@
 #define RELAY_3_PIN 18
 #define RELAY_4_PIN 5
 
+// Relay Readback Verification
+#define RELAY_FEEDBACK_PIN -1          // Contact feedback input, -1 when not wired
+#define RELAY_FEEDBACK_ACTIVE_LEVEL 1  // Input level while the pump contact is closed
+#define RELAY_VERIFY_PERIOD_MS 1000    // Readback sampling period
+#define RELAY_VERIFY_CONFIRM_SAMPLES 3 // Consecutive mismatches before a fault is raised
+
+// Relay Output Expanders (CONFIG_POOL_PUMP_RELAY_BACKEND_*)
+#define RELAY_I2C_PORT 0
+#define RELAY_I2C_SDA_PIN 26
+#define RELAY_I2C_SCL_PIN 27
+#define RELAY_I2C_CLOCK_HZ 400000
+#define RELAY_I2C_TIMEOUT_MS 20
+#define RELAY_EXPANDER_ADDRESS 0x20 // PCF8574 / MCP23017 with A0-A2 low
+#define RELAY_EXPANDER_ACTIVE_LOW 1 // Relay boards on expanders usually energise on low
+#define RELAY_HC595_SPI_HOST 1      // SPI2_HOST (HSPI)
+#define RELAY_HC595_DATA_PIN 13
+#define RELAY_HC595_CLOCK_PIN 14
+#define RELAY_HC595_LATCH_PIN 15 // RCLK, driven as SPI chip select
+#define RELAY_HC595_CLOCK_HZ 1000000
+#define RELAY_HC595_CHAIN_LENGTH 1 // Daisy-chained 74HC595s, 8 outputs each
+
 // Digital Input Pins for Inverter Control
 #define INVERTER_DI2_PIN RELAY_1_PIN // Night mode (1400 RPM)
 #define INVERTER_DI3_PIN RELAY_2_PIN // Day mode (2000 RPM)
 #define INVERTER_DI4_PIN RELAY_3_PIN // Backwash mode (2900 RPM)
 
+// RS485 Modbus Link to the Inverter (CONFIG_POOL_PUMP_INVERTER_MODBUS)
+#define INVERTER_UART_NUM 2
+#define INVERTER_UART_TX_PIN 17
+#define INVERTER_UART_RX_PIN 16
+#define INVERTER_UART_DE_PIN 4 // RS485 transceiver DE/RE, driven by UART RTS
+#define INVERTER_UART_BAUD 9600
+#define INVERTER_MODBUS_ADDRESS 1
+#define INVERTER_RESPONSE_TIMEOUT_MS 100
+#define INVERTER_RETRIES 2
+
 // Price Fetcher Configuration
 #define PRICE_API_URL "https://api.energidataservice.dk/dataset/Elspotprices"
 #define PRICE_FETCH_INTERVAL_HOURS 1
-#define PRICE_THRESHOLD_LOW 0.10  // EUR/kWh
-#define PRICE_THRESHOLD_HIGH 0.30 // EUR/kWh
+#define PRICE_FETCH_ARENA_BYTES 24576 // Response body and JSON tree of one fetch, reused by every fetch
+#define PRICE_THRESHOLD_LOW 0.10      // EUR/kWh
+#define PRICE_THRESHOLD_HIGH 0.30     // EUR/kWh
+#define PRICE_HYSTERESIS_BAND 0.02    // EUR/kWh above PRICE_THRESHOLD_LOW before leaving the low band
 
 // Pump Operation Settings
+#define OPERATING_START_HOUR 6  // Pump may run from 06:00
+#define OPERATING_END_HOUR 22   // ... until 22:00
+#define PUMP_RATED_POWER_W 1100 // Vario+ 1100 at full speed, used for energy estimates
 #define MIN_DAILY_RUNTIME_HOURS 4
 #define MAX_DAILY_RUNTIME_HOURS 12
 #define BACKWASH_DURATION_MINUTES 10
 
+// Transition Filter Settings
+#define PUMP_MIN_ON_MINUTES 15          // Minimum dwell in a running mode
+#define PUMP_MIN_OFF_MINUTES 10         // Minimum dwell while stopped
+#define PUMP_COALESCE_WINDOW_SECONDS 90 // Requests within this window become one transition
+
+// Write-back Counter Cache
+#define NVS_CACHE_FLUSH_INTERVAL_S 900 // Periodic flush of dirty counters
+#define NVS_PARTITION_SIZE 0x6000      // "nvs" partition in the partition table
+#define FLASH_ERASE_CYCLES 100000      // Rated erase endurance of a flash sector
+
+// Daily History Ring
+#define DAILY_STATS_CHUNK_DAYS 64 // Days per NVS blob; only the chunk holding today is rewritten
+#define DAILY_STATS_CHUNKS 6      // 384 days of history in six 1088-byte blobs
+
+// Price History Archive
+#define PRICE_ARCHIVE_PARTITION "prices" // Data partition in partitions.csv
+#define PRICE_ARCHIVE_SUBTYPE 0x40       // First custom data subtype
+
+// Time-Series Store
+#define TIMESERIES_PARTITION "tsdb" // Data partition in partitions.csv
+#define TIMESERIES_SUBTYPE 0x41
+#define TIMESERIES_CHUNK_SECONDS 3600 // Longest a series buffers in RAM; bounds what a reset loses
+#define SENSORS_SAMPLE_INTERVAL_S 60
+
+// Radio Duty Cycling
+#define CONNECTIVITY_MAX_JOBS 8          // Deferred network jobs waiting for the next window
+#define CONNECTIVITY_MAX_DEFER_S 21600   // Oldest a deferred job gets before a window is opened for it
+#define CONNECTIVITY_ASSOCIATED_MA 20.0f // Average extra current of an associated STA over a stopped radio
+
+// Time Service
+#define TIME_SNTP_SERVER "pool.ntp.org"
+#define TIME_SNTP_TIMEOUT_MS 10000     // How long a sync waits for the server's reply
+#define TIME_SYNC_INTERVAL_S 86400     // SNTP sync at least this often, riding along with a fetch window
+#define TIME_SNTP_ERROR_MS 50          // Error right after an SNTP sync over WiFi
+#define TIME_HTTP_ERROR_MS 2000        // Error of an HTTP Date header: whole seconds plus response latency
+#define TIME_DRIFT_UNMEASURED_PPM 100  // Assumed clock drift until two SNTP syncs have measured it
+#define TIME_DRIFT_RESIDUAL_PPM 10     // Drift left once it is measured and compensated
+#define TIME_DRIFT_MIN_INTERVAL_S 3600 // Shortest SNTP interval a drift measurement is taken from
+#define TIME_DRIFT_MAX_PPM 500.0f      // Larger measurements are a stepped clock, not drift
+#define TIME_GOOD_ERROR_MS 5000        // Estimated error up to which the clock counts as good
+#define TIME_MAX_ERROR_MS 60000        // Beyond this the clock is not trusted for scheduling
+#define TIME_SLEEP_CLOCK_PPM 500       // Drift of the calibrated RTC slow clock, which keeps the time in deep sleep
+
+// Power Management
+#define POWER_MIN_CPU_FREQ_MHZ 40 // Lowest frequency scaling step: the XTAL, which WiFi still runs on
+
+// Deep Sleep Between Plan Transitions (CONFIG_POOL_PUMP_DEEP_SLEEP)
+#define DEEP_SLEEP_MIN_S 300       // Shorter gaps are spent awake; booting again costs more than the sleep saves
+#define DEEP_SLEEP_WAKE_SLACK_S 60 // A clock this far from the planned wake-up boots the full firmware instead
+
+// Static Allocation (CONFIG_POOL_PUMP_STATIC_ALLOCATION)
+#define STATIC_ALLOC_SEMAPHORES 8      // relay, NVS, NVS cache, clock, radio, price archive, timeseries + 1 spare
+#define STATIC_ALLOC_EVENT_GROUPS 2    // WiFi manager + 1 spare
+#define STATIC_ALLOC_TASKS 4           // Scheduler, network, NVS cache flush + 1 spare (see task_map)
+#define STATIC_ALLOC_STACK_BYTES 15360 // Stacks of those tasks, with 2 KB for the spare
+
 // NVS Storage Keys
 #define NVS_NAMESPACE "pool_pump"
 #define NVS_KEY_WIFI_SSID "wifi_ssid"
 #define NVS_KEY_WIFI_PASS "wifi_pass"
 #define NVS_KEY_PUMP_MODE "pump_mode"
 #define NVS_KEY_SCHEDULE "schedule"
+#define NVS_KEY_CONFIG_A "cfg_a" // Config blob slots, written alternately
+#define NVS_KEY_CONFIG_B "cfg_b"
+#define NVS_KEY_PLAN_CHECKPOINT "plan_ckpt"   // Plan being executed, for resuming after power loss
+#define NVS_KEY_WIFI_FAST_CONNECT "wifi_fast" // Last access point, channel and lease
 
 // Function declarations
 void config_init(void);
+bool pump_scheduler_wake(void);
+void pump_scheduler_sleep_again(void);
+void pump_scheduler_resume(bool woke);
 void pump_scheduler_task(void *pvParameters);
 
 #endif // CONFIG_H
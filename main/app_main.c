@@ -8,6 +8,15 @@
 #include <stdio.h>
 
 #include "config.h"
+#include "pool_pump/boot_trace.h"
+#include "pool_pump/connectivity.h"
+#include "pool_pump/nvs_cache.h"
+#include "pool_pump/plan_checkpoint.h"
+#include "pool_pump/power.h"
+#include "pool_pump/runtime_accounting.h"
+#include "pool_pump/storage.h"
+#include "pool_pump/task_map.h"
+#include "pool_pump/time_service.h"
 #include "price_fetcher.h"
 #include "pump_controller.h"
 #include "relay_control.h"
@@ -15,30 +24,73 @@
 
 static const char *TAG = "POOL_PUMP_MAIN";
 
+static void init_network(void) {
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    wifi_manager_init();
+    storage_network_config_t network;
+    storage_load_network_config(&network);
+    // An empty or unusable stored endpoint leaves the one of config.h
+    price_fetcher_set_endpoint(network.price_api_endpoint);
+    if (network.wifi_ssid[0] != '\0') {
+        // The radio stays off until a component needs the network
+        connectivity_init(network.wifi_ssid, network.wifi_password);
+    } else {
+        ESP_LOGW(TAG, "No WiFi credentials stored, running without prices");
+        connectivity_init(NULL, NULL);
+    }
+}
+
 void app_main(void) {
+    boot_trace_mark(BOOT_STAGE_APP_START);
+    bool woke = false;
+#ifdef CONFIG_POOL_PUMP_DEEP_SLEEP
+    // A wake-up from deep sleep switches the held relays before anything else is initialized
+    woke = pump_scheduler_wake();
+#endif
+
     ESP_LOGI(TAG, "Pool Pump Controller starting...");
 
-    // Initialize NVS
+    // The CPU is idle between the minute ticks; let it scale down and sleep from the start
+    power_init();
+
+    // Only what the relay decision needs runs before it: NVS and the RTC/NVS-backed state
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_ERROR_CHECK(nvs_flash_erase());
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    // One read of the config blob runs pending schema migrations and fills the settings mirror everything reads
+    if (storage_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Settings not loaded, running on the defaults of config.h");
+    }
+    nvs_cache_init(NVS_CACHE_FLUSH_INTERVAL_S);
+    runtime_accounting_init(esp_reset_reason());
+    plan_checkpoint_init(esp_reset_reason());
+    time_service_init(esp_reset_reason());
+    boot_trace_mark(BOOT_STAGE_STATE_LOADED);
 
-    // Initialize networking
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
+#ifdef CONFIG_POOL_PUMP_DEEP_SLEEP
+    if (woke) {
+        // Normally back to sleep from here; the rest of the firmware only starts when the plan needs it
+        pump_scheduler_sleep_again();
+    }
+#endif
 
-    // Initialize components
-    config_init();
-    wifi_manager_init();
-    relay_control_init();
-    pump_controller_init();
-    price_fetcher_init();
+    // Bring the pump back to the checkpointed plan before anything waits on the network
+    pump_scheduler_resume(woke);
 
-    ESP_LOGI(TAG, "Pool Pump Controller initialized successfully");
+    relay_control_start_verification(RELAY_VERIFY_PERIOD_MS);
+
+    // Everything else overlaps: the scheduler task loads the price history while the network comes up here
+    TaskHandle_t scheduler;
+    if (task_map_create(TASK_SCHEDULER, &pump_scheduler_task, NULL, &scheduler) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start the scheduler task");
+        return;
+    }
+    init_network();
+    xTaskNotifyGive(scheduler);
 
-    // Start main application task
-    xTaskCreate(&pump_scheduler_task, "pump_scheduler", 4096, NULL, 5, NULL);
+    ESP_LOGI(TAG, "Pool Pump Controller initialized successfully");
 }
@@ -2,6 +2,7 @@
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "pool_pump/storage.h"
 #include <stdio.h>
 
 static const char *TAG = "CONFIG";
@@ -13,6 +14,9 @@ void config_init(void) {
              PUMP_SPEED_NIGHT,
              PUMP_SPEED_DAY,
              PUMP_SPEED_BACKWASH);
-    ESP_LOGI(TAG, "Price thresholds: Low=%.2f EUR/kWh, High=%.2f EUR/kWh", PRICE_THRESHOLD_LOW, PRICE_THRESHOLD_HIGH);
+    ESP_LOGI(TAG,
+             "Price thresholds: Low=%.2f EUR/kWh, High=%.2f EUR/kWh",
+             storage_get_float(STORAGE_KEY_PRICE_LOW),
+             storage_get_float(STORAGE_KEY_PRICE_HIGH));
     ESP_LOGI(TAG, "Daily runtime: Min=%d hours, Max=%d hours", MIN_DAILY_RUNTIME_HOURS, MAX_DAILY_RUNTIME_HOURS);
 }
@@ -1,39 +1,104 @@
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include <float.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <time.h>
 
 #include "config.h"
+#include "nvs_storage.h"
+#include "pool_pump/boot_trace.h"
+#include "pool_pump/connectivity.h"
+#include "pool_pump/daily_plan.h"
+#include "pool_pump/deep_sleep.h"
+#include "pool_pump/nvs_cache.h"
+#include "pool_pump/plan_checkpoint.h"
+#include "pool_pump/power.h"
+#include "pool_pump/price_archive.h"
+#include "pool_pump/runtime_accounting.h"
+#include "pool_pump/sensors.h"
+#include "pool_pump/static_alloc.h"
+#include "pool_pump/storage.h"
+#include "pool_pump/task_map.h"
+#include "pool_pump/time_service.h"
+#include "pool_pump/timer_offload.h"
+#include "pool_pump/transition_filter.h"
 #include "price_fetcher.h"
 #include "pump_controller.h"
-#include "wifi_manager.h"
 
 static const char *TAG = "PUMP_SCHEDULER";
 
+// Date of the prices the fetcher holds; the radio is off most of the day, so this says whether they are current
+static uint32_t prices_date = 0;
+
+// Work the control loop hands to the network task
+#define NETWORK_SYNC_CLOCK (1 << 0)   // Open a radio window so the deferred SNTP sync runs
+#define NETWORK_REFRESH_PLAN (1 << 1) // Fetch today's prices and checkpoint a plan made of them
+#define NETWORK_SERVICE (1 << 2)      // Run deferred jobs that have waited too long
+
+static TaskHandle_t network_task_handle = NULL;
+static portMUX_TYPE network_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t network_work = 0; // Requested and not started yet
+static uint32_t network_date = 0; // Date of the plan to refresh
+static bool network_busy = false;
+
+static uint32_t date_of(const struct tm *timeinfo) {
+    return (timeinfo->tm_year + 1900) * 10000 + (timeinfo->tm_mon + 1) * 100 + timeinfo->tm_mday;
+}
+
+// A trusted but wrong HTTP Date can have dated history into the future, which would then refuse every real
+// day; an SNTP sync has the last word and drops it
+static esp_err_t sync_sntp(void) {
+    esp_err_t ret = time_service_sync_sntp(TIME_SNTP_TIMEOUT_MS);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    time_t now;
+    struct tm timeinfo;
+    time(&now);
+    localtime_r(&now, &timeinfo);
+    uint32_t date = date_of(&timeinfo);
+    size_t dropped = 0;
+    if (nvs_storage_drop_daily_stats_after(date, &dropped) == ESP_OK && dropped > 0) {
+        ESP_LOGW(TAG, "Dropped %u recorded days dated after %lu", (unsigned)dropped, (unsigned long)date);
+    }
+    if (price_archive_drop_after(date, &dropped) == ESP_OK && dropped > 0) {
+        ESP_LOGW(TAG, "Dropped %u archived price days dated after %lu", (unsigned)dropped, (unsigned long)date);
+    }
+    return ESP_OK;
+}
+
+// Deferred to the next network window, so keeping the clock synced costs no radio time of its own
+static void sync_time(void *arg) { sync_sntp(); }
+
 static bool is_within_operating_hours(void) {
     time_t now;
     struct tm timeinfo;
     time(&now);
     localtime_r(&now, &timeinfo);
 
-    // Allow operation between 6 AM and 10 PM
-    return (timeinfo.tm_hour >= 6 && timeinfo.tm_hour < 22);
+    // Allow operation inside the configured operating window
+    return (timeinfo.tm_hour >= OPERATING_START_HOUR && timeinfo.tm_hour < OPERATING_END_HOUR);
 }
 
-static pump_mode_t determine_optimal_mode(void) {
-    if (!wifi_manager_is_connected()) {
-        ESP_LOGW(TAG, "WiFi not connected, using default day mode");
+static pump_mode_t determine_optimal_mode(uint32_t date) {
+    if (prices_date != date) {
+        ESP_LOGW(TAG, "No prices for today, using default day mode");
         return PUMP_MODE_DAY;
     }
 
     float current_price = price_fetcher_get_current_price();
 
-    if (current_price < PRICE_THRESHOLD_LOW) {
+    if (current_price < storage_get_float(STORAGE_KEY_PRICE_LOW)) {
         ESP_LOGI(TAG, "Low price period (%.3f EUR/kWh), using day mode", current_price);
         return PUMP_MODE_DAY;
-    } else if (current_price > PRICE_THRESHOLD_HIGH) {
+    } else if (current_price > storage_get_float(STORAGE_KEY_PRICE_HIGH)) {
         ESP_LOGI(TAG, "High price period (%.3f EUR/kWh), using night mode", current_price);
         return PUMP_MODE_NIGHT;
     } else {
@@ -42,81 +107,525 @@ static pump_mode_t determine_optimal_mode(void) {
     }
 }
 
+// A reset brings the plan back from the checkpoint, but not the prices it was made from; the archive has them
+static bool restore_prices(uint32_t date) {
+    price_data_t prices[24];
+    if (price_archive_get_day(date, prices) != ESP_OK) {
+        return false;
+    }
+    price_fetcher_set_today_prices(prices);
+    prices_date = date;
+    ESP_LOGI(TAG, "Prices for %lu restored from the archive", (unsigned long)date);
+    return true;
+}
+
+// Energy and cost of the current day; runtime itself comes from runtime_accounting
+typedef struct {
+    float energy_kwh;
+    float cost_eur;
+    float min_price; // FLT_MAX until the pump has run
+    uint8_t starts;
+} day_totals_t;
+
+// Kept through deep sleep; any other reset loses them, so a day with a reboot records partial energy and cost
+static RTC_DATA_ATTR day_totals_t day_totals = {.min_price = FLT_MAX};
+static RTC_DATA_ATTR float energy_wh_pending = 0;
+
+static void reset_day_totals(day_totals_t *totals) {
+    memset(totals, 0, sizeof(*totals));
+    totals->min_price = FLT_MAX;
+}
+
+// Lifetime counters live in the write-back cache; the loop only ever touches RAM
+static void register_lifetime_counters(void) {
+    nvs_cache_register("run_minutes", 60);
+    nvs_cache_register("energy_wh", 1000);
+}
+
+// Affinity law estimate of the energy of running at a speed, counted for the day and for the lifetime total
+static float account_run(int rpm, int minutes) {
+    float speed = (float)rpm / PUMP_SPEED_BACKWASH;
+    float wh = PUMP_RATED_POWER_W * speed * speed * speed / 60.0f * minutes;
+    nvs_cache_add("run_minutes", minutes);
+    day_totals.energy_kwh += wh / 1000.0f;
+
+    // Accumulated until a whole Wh is reached
+    energy_wh_pending += wh;
+    if (energy_wh_pending >= 1.0f) {
+        nvs_cache_add("energy_wh", (int32_t)energy_wh_pending);
+        energy_wh_pending -= (int32_t)energy_wh_pending;
+    }
+    return wh;
+}
+
+static void record_day(const runtime_accounting_t *day, const day_totals_t *totals) {
+    nvs_daily_stats_t stats = {0};
+    stats.date = day->date;
+    for (int mode = PUMP_MODE_NIGHT; mode <= PUMP_MODE_BACKWASH; mode++) {
+        stats.runtime_minutes[mode - PUMP_MODE_NIGHT] = (uint16_t)(day->mode_us[mode] / 60000000);
+    }
+    stats.energy_kwh = totals->energy_kwh;
+    stats.cost_eur = totals->cost_eur;
+    stats.avg_price = totals->energy_kwh > 0 ? totals->cost_eur / totals->energy_kwh : 0;
+    stats.min_price = totals->min_price == FLT_MAX ? 0 : totals->min_price;
+    stats.starts = totals->starts;
+
+    esp_err_t ret = nvs_storage_set_daily_stats(&stats);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to record day %lu: %s", (unsigned long)day->date, esp_err_to_name(ret));
+    }
+}
+
+#ifdef CONFIG_POOL_PUMP_INVERTER_TIMER_OFFLOAD
+// The inverter runs the plan from its own timer; we only wake once a day to re-program it
+static void run_timer_offload(void) {
+    const int retry_minutes = 10;
+    const int reprogram_minute = 5; // 00:05, after the day has rolled over
+
+    while (1) {
+        // The radio is only on for the fetch; the clock is synced first so the plan is for the right day
+        bool online = connectivity_acquire(WIFI_CONNECT_WAIT_MS) == ESP_OK;
+        if (online && time_service_sync_due()) {
+            sync_sntp();
+        }
+
+        time_t now;
+        struct tm timeinfo;
+        time(&now);
+        localtime_r(&now, &timeinfo);
+        int minute_of_day = timeinfo.tm_hour * 60 + timeinfo.tm_min;
+        uint32_t date = date_of(&timeinfo);
+
+        // Deferred network work runs before the radio goes off again
+        price_data_t prices[24] = {0};
+        if (online) {
+            if (price_fetcher_get_today_prices(prices) == ESP_OK) {
+                price_archive_append(date, prices);
+                prices_date = date;
+            } else {
+                ESP_LOGW(TAG, "Price fetch failed, planning without prices");
+            }
+            connectivity_release();
+        }
+
+        daily_plan_t plan;
+        daily_plan_build(prices, date, &plan);
+        plan_checkpoint_set_plan(&plan, plan_checkpoint_price_version(prices));
+
+        timer_offload_report_t report;
+        int sleep_minutes;
+        if (timer_offload_upload(&plan, prices, minute_of_day, &report) == ESP_OK) {
+            timer_offload_log_report(&report);
+            sleep_minutes = 24 * 60 - minute_of_day + reprogram_minute;
+        } else {
+            ESP_LOGW(TAG, "Timer offload failed, retrying in %d min", retry_minutes);
+            sleep_minutes = retry_minutes;
+        }
+
+        // A day in ms overflows pdMS_TO_TICKS, so sleep a minute at a time
+        for (int i = 0; i < sleep_minutes; i++) {
+            vTaskDelay(pdMS_TO_TICKS(60000));
+            time_service_update();
+        }
+    }
+}
+#endif
+
+#ifndef CONFIG_POOL_PUMP_INVERTER_TIMER_OFFLOAD
+// Fetch today's prices and make a plan from them the checkpointed one
+static void refresh_plan(uint32_t date) {
+    price_data_t prices[24] = {0};
+    if (connectivity_acquire(WIFI_CONNECT_WAIT_MS) != ESP_OK) {
+        ESP_LOGW(TAG, "No network, keeping the current plan");
+        return;
+    }
+    esp_err_t ret = price_fetcher_get_today_prices(prices);
+    connectivity_release();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Price fetch failed, keeping the current plan");
+        return;
+    }
+    price_archive_append(date, prices);
+    prices_date = date;
+
+    daily_plan_t plan;
+    daily_plan_build(prices, date, &plan);
+    plan_checkpoint_set_plan(&plan, plan_checkpoint_price_version(prices));
+}
+
+// Runs on the network core; fetches take seconds and must not hold up the control loop
+static void network_task(void *arg) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        portENTER_CRITICAL(&network_lock);
+        uint32_t work = network_work;
+        uint32_t date = network_date;
+        network_work = 0;
+        network_busy = true;
+        portEXIT_CRITICAL(&network_lock);
+
+        if ((work & NETWORK_SYNC_CLOCK) && connectivity_acquire(WIFI_CONNECT_WAIT_MS) == ESP_OK) {
+            connectivity_release();
+        }
+        if (work & NETWORK_REFRESH_PLAN) {
+            refresh_plan(date);
+        }
+        if (work & NETWORK_SERVICE) {
+            connectivity_service(WIFI_CONNECT_WAIT_MS);
+        }
+
+        portENTER_CRITICAL(&network_lock);
+        network_busy = false;
+        portEXIT_CRITICAL(&network_lock);
+    }
+}
+#endif
+
+static void request_network(uint32_t work, uint32_t date) {
+    if (network_task_handle == NULL) {
+        return;
+    }
+    portENTER_CRITICAL(&network_lock);
+    network_work |= work;
+    if (work & NETWORK_REFRESH_PLAN) {
+        network_date = date;
+    }
+    portEXIT_CRITICAL(&network_lock);
+    xTaskNotifyGive(network_task_handle);
+}
+
+#ifdef CONFIG_POOL_PUMP_DEEP_SLEEP
+static bool network_idle(void) {
+    portENTER_CRITICAL(&network_lock);
+    bool idle = network_work == 0 && !network_busy;
+    portEXIT_CRITICAL(&network_lock);
+    return idle;
+}
+
+// The wake-up this boot took the held relays over on
+static deep_sleep_wake_t wake_up;
+static bool woke_on_plan = false;
+
+// Sleep until the plan next needs us; returns when that is too close to be worth a boot
+static void sleep_until_next_event(const daily_plan_t *plan, int minute_of_day, pump_mode_t mode) {
+    int budget = MAX_DAILY_RUNTIME_HOURS * 60 - (int)runtime_accounting_get_run_minutes();
+    deep_sleep_wake_t wake = {.date = plan->date, .held_mode = mode};
+    wake.minute_of_day = deep_sleep_next_wake(plan, minute_of_day, mode, budget, &wake.wake_mode);
+
+    time_t now;
+    struct tm timeinfo;
+    time(&now);
+    localtime_r(&now, &timeinfo);
+    wake.wake_time_s = now - (timeinfo.tm_hour * 3600 + timeinfo.tm_min * 60 + timeinfo.tm_sec) +
+                       wake.minute_of_day * 60;
+    if (wake.wake_time_s - now < DEEP_SLEEP_MIN_S) {
+        return;
+    }
+
+    // Deferred network work is queued in RAM; run it now rather than lose it
+    connectivity_stats_t radio;
+    connectivity_get_stats(&radio);
+    if (radio.jobs_pending > 0 && connectivity_acquire(WIFI_CONNECT_WAIT_MS) == ESP_OK) {
+        connectivity_release();
+    }
+    deep_sleep_enter(&wake);
+}
+
+bool pump_scheduler_wake(void) {
+    deep_sleep_init(esp_reset_reason());
+    if (!deep_sleep_get_wake(&wake_up)) {
+        return false;
+    }
+
+    // Nothing else runs first: the relays switch to the planned mode as their hold is released
+    time_t now;
+    time(&now);
+    woke_on_plan = llabs((int64_t)now - wake_up.wake_time_s) <= DEEP_SLEEP_WAKE_SLACK_S;
+    esp_err_t ret = pump_controller_resume(woke_on_plan ? wake_up.wake_mode : wake_up.held_mode);
+    if (ret != ESP_OK) {
+        // Full init releases and resets them
+        ESP_LOGE(TAG, "Failed to take over the held relays: %s", esp_err_to_name(ret));
+        return false;
+    }
+    deep_sleep_note_switched();
+    boot_trace_mark(BOOT_STAGE_RELAYS);
+
+    deep_sleep_stats_t stats;
+    deep_sleep_get_stats(&stats);
+    ESP_LOGI(TAG,
+             "Woke after %lld s in mode %d, mode %d from %lu us after start",
+             (long long)(wake_up.slept_us / 1000000),
+             wake_up.held_mode,
+             woke_on_plan ? wake_up.wake_mode : wake_up.held_mode,
+             (unsigned long)stats.last_switch_us);
+    return true;
+}
+
+// Charge a run slept through hour by hour, each at that hour's archived price; unknown prices add energy only
+static void account_slept_run(int rpm, time_t start, time_t end) {
+    price_data_t prices[PRICE_ARCHIVE_HOURS];
+    uint32_t prices_date = 0;
+    bool have_prices = false;
+    price_archive_init();
+
+    for (time_t from = start; from < end;) {
+        struct tm timeinfo;
+        localtime_r(&from, &timeinfo);
+        time_t hour_end = from + (60 - timeinfo.tm_min) * 60 - timeinfo.tm_sec;
+        time_t to = hour_end < end ? hour_end : end;
+        // Whole minutes counted from the start, so splitting at hours loses none
+        int minutes = (int)((to - start) / 60 - (from - start) / 60);
+        float wh = account_run(rpm, minutes);
+
+        uint32_t date = date_of(&timeinfo);
+        if (date != prices_date) {
+            prices_date = date;
+            have_prices = price_archive_get_day(date, prices) == ESP_OK;
+        }
+        float price = have_prices ? prices[timeinfo.tm_hour].price_eur_kwh : 0;
+        if (price > 0) {
+            day_totals.cost_eur += wh / 1000.0f * price;
+            if (price < day_totals.min_price) {
+                day_totals.min_price = price;
+            }
+        }
+        from = to;
+    }
+}
+
+void pump_scheduler_sleep_again(void) {
+    time_service_note_sleep(wake_up.slept_us > 0 ? (uint64_t)wake_up.slept_us : 0);
+    pump_status_t status;
+    pump_controller_get_status(&status);
+    runtime_accounting_set_mode(status.mode);
+
+    // The pump ran on through the sleep
+    register_lifetime_counters();
+    if (wake_up.held_mode != PUMP_MODE_OFF && wake_up.slept_us > 0) {
+        int rpm = pump_controller_get_mode_rpm(wake_up.held_mode);
+        if (time_service_is_trusted()) {
+            time_t now = time(NULL);
+            account_slept_run(rpm, now - (time_t)(wake_up.slept_us / 1000000), now);
+        } else {
+            account_run(rpm, (int)(wake_up.slept_us / 60000000));
+        }
+    } else if (status.mode != PUMP_MODE_OFF && day_totals.starts < UINT8_MAX) {
+        day_totals.starts++;
+    }
+
+    // A new day, a stale clock or an unexpected wake-up time need the full firmware
+    plan_checkpoint_t checkpoint;
+    if (!woke_on_plan || wake_up.minute_of_day >= 24 * 60 || !time_service_is_trusted() ||
+        plan_checkpoint_get(&checkpoint) != ESP_OK || checkpoint.plan.date != wake_up.date ||
+        checkpoint.price_version == 0) {
+        return;
+    }
+    plan_checkpoint_mark_executed(wake_up.minute_of_day, status.mode);
+    sleep_until_next_event(&checkpoint.plan, wake_up.minute_of_day, status.mode);
+}
+#endif
+
+void pump_scheduler_resume(bool woke) {
+    pump_mode_t mode = PUMP_MODE_OFF;
+    if (woke) {
+        // After a wake-up from deep sleep the pump is already running as planned
+        pump_status_t status;
+        pump_controller_get_status(&status);
+        mode = status.mode;
+    } else {
+#ifdef CONFIG_POOL_PUMP_INVERTER_TIMER_OFFLOAD
+        // The inverter's timer runs the pump through our reset; a stop here would cut its current slot
+        pump_controller_attach();
+#else
+        // Runs before networking: the checkpointed plan decides, so a reset costs no fetch
+        time_t now;
+        struct tm timeinfo;
+        time(&now);
+        localtime_r(&now, &timeinfo);
+        // Without a trusted clock the position in the plan is unknown, and whatever was running carries on
+        uint32_t date = time_service_is_trusted() ? date_of(&timeinfo) : 0;
+        mode = plan_checkpoint_resume_mode(date, timeinfo.tm_hour * 60 + timeinfo.tm_min);
+        // Straight into that mode: relays that were on before the reset are not switched off first
+        if (pump_controller_restore(mode) != ESP_OK) {
+            mode = PUMP_MODE_OFF;
+        }
+#endif
+    }
+    boot_trace_mark(BOOT_STAGE_RELAYS);
+
+    // The pump was in this mode before the reset, so no dwell time applies
+    transition_filter_init(NULL, mode);
+    if (mode != PUMP_MODE_OFF) {
+        runtime_accounting_set_mode(mode);
+        ESP_LOGI(TAG, "Resumed mode %d %s", mode, woke ? "after deep sleep" : "from the checkpointed plan");
+    }
+}
+
 void pump_scheduler_task(void *pvParameters) {
     ESP_LOGI(TAG, "Pump scheduler task started");
 
+    // app_main brings up the network meanwhile, and notifies once it has
+    config_init();
+    price_fetcher_init();
+    price_archive_init();
+    sensors_init();
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+#ifndef CONFIG_POOL_PUMP_INVERTER_TIMER_OFFLOAD
+    // Fetches and the radio windows run next to the WiFi driver on the other core
+    if (task_map_create(TASK_NETWORK, network_task, NULL, &network_task_handle) != ESP_OK) {
+        ESP_LOGE(TAG, "No network task, running on the checkpointed plan and without prices");
+    }
+#endif
+    boot_trace_mark(BOOT_STAGE_SCHEDULER);
+    static_alloc_seal();
+
+#ifdef CONFIG_POOL_PUMP_INVERTER_TIMER_OFFLOAD
+    run_timer_offload();
+#endif
+
     TickType_t last_wake_time = xTaskGetTickCount();
     const TickType_t frequency = pdMS_TO_TICKS(60000); // Run every minute
+    const int64_t plan_retry_ms = 10 * 60 * 1000;
+    int64_t last_plan_attempt_ms = -plan_retry_ms;
+    int64_t last_sync_attempt_ms = -plan_retry_ms;
 
-    bool pump_running = false;
-    int daily_runtime_minutes = 0;
-    int last_hour = -1;
+    register_lifetime_counters();
+    bool pump_running = transition_filter_get_active_mode() != PUMP_MODE_OFF;
 
     while (1) {
+        int64_t now_ms = esp_timer_get_time() / 1000;
+
+        // The sync rides along with the next window, unless there is no clock to schedule by at all
+        time_service_update();
+        if (time_service_sync_due()) {
+            connectivity_defer(sync_time, NULL);
+        }
+        bool clock_set = time_service_is_trusted();
+        if (!clock_set && now_ms - last_sync_attempt_ms >= plan_retry_ms) {
+            last_sync_attempt_ms = now_ms;
+            request_network(NETWORK_SYNC_CLOCK, 0);
+        }
+
         time_t now;
         struct tm timeinfo;
         time(&now);
         localtime_r(&now, &timeinfo);
+        uint32_t date = date_of(&timeinfo);
+        int minute_of_day = timeinfo.tm_hour * 60 + timeinfo.tm_min;
 
-        // Reset daily counter at midnight
-        if (timeinfo.tm_hour == 0 && last_hour == 23) {
-            daily_runtime_minutes = 0;
-            ESP_LOGI(TAG, "New day started, resetting runtime counter");
+        // Today's runtime is measured on the monotonic clock and survives soft resets in RTC memory
+        runtime_accounting_update();
+        runtime_accounting_t yesterday;
+        runtime_accounting_get(&yesterday);
+        if (runtime_accounting_roll_day(date)) {
+            record_day(&yesterday, &day_totals);
+            reset_day_totals(&day_totals);
+            connectivity_roll_day(NULL);
         }
-        last_hour = timeinfo.tm_hour;
+        int daily_runtime_minutes = (int)runtime_accounting_get_run_minutes();
 
-        // Check if we're within operating hours
-        if (!is_within_operating_hours()) {
+        // Today's prices are looked up in the archive once; without them there, they are fetched again
+        static uint32_t archive_checked_date = 0;
+        if (clock_set && prices_date != date && archive_checked_date != date) {
+            archive_checked_date = date;
+            restore_prices(date);
+        }
+
+        // A plan built from today's prices is fetched once; a fallback plan is retried. The fetch runs on the
+        // network task and its plan is picked up on a later tick
+        plan_checkpoint_t checkpoint;
+        bool have_plan = plan_checkpoint_get(&checkpoint) == ESP_OK && checkpoint.plan.date == date;
+        if ((!have_plan || checkpoint.price_version == 0 || prices_date != date) && clock_set &&
+            now_ms - last_plan_attempt_ms >= plan_retry_ms) {
+            last_plan_attempt_ms = now_ms;
+            request_network(NETWORK_REFRESH_PLAN, date);
+        }
+        request_network(NETWORK_SERVICE, 0);
+
+        // Decide what we want; the transition filter decides when it is actually applied. Stops for the
+        // operating window and the runtime limit are not price decisions and skip its dwell
+        pump_mode_t desired_mode = transition_filter_get_active_mode();
+        bool limit_stop = false;
+
+        if (have_plan) {
+            // The plan already keeps to the operating window and the daily runtime limits
+            desired_mode = daily_plan_mode_at(&checkpoint.plan, minute_of_day);
+            if (desired_mode != PUMP_MODE_OFF && daily_runtime_minutes >= MAX_DAILY_RUNTIME_HOURS * 60) {
+                desired_mode = PUMP_MODE_OFF;
+                limit_stop = true;
+            } else if (desired_mode == PUMP_MODE_OFF && !is_within_operating_hours()) {
+                limit_stop = true;
+            }
+        } else if (!is_within_operating_hours()) {
             if (pump_running) {
                 ESP_LOGI(TAG, "Outside operating hours, stopping pump");
-                pump_controller_stop();
-                pump_running = false;
+                desired_mode = PUMP_MODE_OFF;
+                limit_stop = true;
             }
         } else {
             // Check if we've reached minimum daily runtime
             int min_runtime_minutes = MIN_DAILY_RUNTIME_HOURS * 60;
             int max_runtime_minutes = MAX_DAILY_RUNTIME_HOURS * 60;
+            bool low_price = transition_filter_price_is_low(price_fetcher_get_current_price());
 
             if (daily_runtime_minutes < min_runtime_minutes) {
                 // Must run to meet minimum requirements
                 if (!pump_running) {
-                    pump_mode_t mode = determine_optimal_mode();
+                    desired_mode = determine_optimal_mode(date);
                     ESP_LOGI(TAG,
                              "Starting pump to meet minimum runtime (%d/%d min)",
                              daily_runtime_minutes,
                              min_runtime_minutes);
-                    pump_controller_set_mode(mode);
-                    pump_controller_start();
-                    pump_running = true;
                 }
             } else if (daily_runtime_minutes >= max_runtime_minutes) {
                 // Reached maximum, stop for today
                 if (pump_running) {
                     ESP_LOGI(TAG, "Maximum daily runtime reached, stopping pump");
-                    pump_controller_stop();
-                    pump_running = false;
+                    desired_mode = PUMP_MODE_OFF;
+                    limit_stop = true;
                 }
             } else {
                 // Optional operation based on electricity prices
-                if (price_fetcher_is_low_price_period() && !pump_running) {
-                    pump_mode_t mode = determine_optimal_mode();
+                if (low_price && !pump_running) {
                     ESP_LOGI(TAG, "Low price period detected, starting pump");
-                    pump_controller_set_mode(mode);
-                    pump_controller_start();
-                    pump_running = true;
-                } else if (!price_fetcher_is_low_price_period() && pump_running) {
+                    desired_mode = determine_optimal_mode(date);
+                } else if (!low_price && pump_running) {
                     ESP_LOGI(TAG, "Price increased, stopping optional operation");
-                    pump_controller_stop();
-                    pump_running = false;
+                    desired_mode = PUMP_MODE_OFF;
                 }
             }
         }
 
-        // Update runtime counter
+        if (limit_stop) {
+            transition_filter_force(PUMP_MODE_OFF, now_ms);
+        } else {
+            transition_filter_request(desired_mode, now_ms);
+            transition_filter_process(now_ms);
+        }
+        pump_mode_t active_mode = transition_filter_get_active_mode();
+        runtime_accounting_set_mode(active_mode);
+        plan_checkpoint_mark_executed(minute_of_day, active_mode);
+        if (!pump_running && active_mode != PUMP_MODE_OFF && day_totals.starts < UINT8_MAX) {
+            day_totals.starts++;
+        }
+        pump_running = active_mode != PUMP_MODE_OFF;
+
+        // Update lifetime counters
         if (pump_running) {
-            daily_runtime_minutes++;
+            pump_status_t status;
+            pump_controller_get_status(&status);
+            float minute_wh = account_run(status.current_rpm, 1);
+
+            float price = price_fetcher_get_current_price();
+            day_totals.cost_eur += minute_wh / 1000.0f * price;
+            if (price < day_totals.min_price) {
+                day_totals.min_price = price;
+            }
         }
 
+        // Water temperature history, one sample per SENSORS_SAMPLE_INTERVAL_S
+        sensors_poll();
+
         // Log status every 15 minutes
         static int log_counter = 0;
         if (++log_counter >= 15) {
@@ -129,7 +638,27 @@ void pump_scheduler_task(void *pvParameters) {
                      status.mode,
                      daily_runtime_minutes,
                      price_fetcher_get_current_price());
+
+            transition_filter_stats_t filter_stats;
+            transition_filter_get_stats(&filter_stats);
+            ESP_LOGI(TAG,
+                     "Transitions: %lu applied, %lu cancelled, %lu coalesced, %lu held by dwell",
+                     (unsigned long)filter_stats.applied,
+                     (unsigned long)filter_stats.cancelled,
+                     (unsigned long)filter_stats.suppressed_coalesced,
+                     (unsigned long)filter_stats.suppressed_dwell);
+            nvs_cache_log_report();
+            power_log_report();
+            task_map_log_report();
+        }
+
+#ifdef CONFIG_POOL_PUMP_DEEP_SLEEP
+        // Once today's plan runs undisturbed, nothing needs the controller awake until its next change
+        if (have_plan && checkpoint.price_version != 0 && clock_set && desired_mode == active_mode &&
+            !connectivity_radio_on() && network_idle()) {
+            sleep_until_next_event(&checkpoint.plan, minute_of_day, active_mode);
         }
+#endif
 
         vTaskDelayUntil(&last_wake_time, frequency);
     }
@@ -5,13 +5,28 @@
 
 #include "mock_esp_wifi.h"
 #include "esp_err.h"
+#include "esp_event.h"
+#include "freertos/FreeRTOS.h"
 #include <stdbool.h>
 #include <string.h>
 
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+
+static const uint8_t mock_bssid[6] = {0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56};
+
 // Mock state
 static bool mock_connected = false;
 static wifi_mode_t mock_mode = WIFI_MODE_NULL;
 static wifi_config_t mock_config = {0};
+static uint32_t mock_connect_calls = 0;
+static bool mock_auto_connect = false;
+static bool mock_started = false;
+static bool mock_ap_moved = false;
+
+static void post_disconnected(uint8_t reason) {
+    wifi_event_sta_disconnected_t event = {.reason = reason};
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &event, sizeof(event), portMAX_DELAY);
+}
 
 // Mock function implementations
 esp_err_t esp_wifi_init(const wifi_init_config_t *config) {
@@ -52,27 +67,83 @@ esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf) {
     return ESP_OK;
 }
 
-esp_err_t esp_wifi_start(void) { return ESP_OK; }
+esp_err_t esp_wifi_start(void) {
+    mock_started = true;
+    return ESP_OK;
+}
 
-esp_err_t esp_wifi_stop(void) { return ESP_OK; }
+esp_err_t esp_wifi_stop(void) {
+    if (mock_connected) {
+        mock_connected = false;
+        post_disconnected(MOCK_WIFI_REASON_ASSOC_LEAVE);
+    }
+    mock_started = false;
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_STOP, NULL, 0, portMAX_DELAY);
+    return ESP_OK;
+}
 
 esp_err_t esp_wifi_connect(void) {
     mock_connected = true;
+    mock_connect_calls++;
+    if (mock_ap_moved && mock_config.sta.bssid_set) {
+        post_disconnected(MOCK_WIFI_REASON_NO_AP_FOUND);
+    } else if (mock_auto_connect) {
+        mock_esp_wifi_set_connected(true);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info) {
+    if (ap_info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!mock_connected) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    memset(ap_info, 0, sizeof(*ap_info));
+    memcpy(ap_info->bssid, mock_bssid, sizeof(mock_bssid));
+    ap_info->primary = MOCK_WIFI_AP_CHANNEL;
     return ESP_OK;
 }
 
 esp_err_t esp_wifi_disconnect(void) {
     mock_connected = false;
+    post_disconnected(MOCK_WIFI_REASON_ASSOC_LEAVE);
     return ESP_OK;
 }
 
 // Test control functions
-void mock_esp_wifi_set_connected(bool connected) { mock_connected = connected; }
+void mock_esp_wifi_set_connected(bool connected) {
+    mock_connected = connected;
+    if (connected) {
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, NULL, 0, portMAX_DELAY);
+        ip_event_got_ip_t got_ip = {0};
+        got_ip.ip_info.ip.addr = MOCK_WIFI_LEASE_IP;
+        got_ip.ip_info.netmask.addr = 0x00FFFFFF;
+        got_ip.ip_info.gw.addr = 0x0101A8C0;
+        esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof(got_ip), portMAX_DELAY);
+    } else {
+        post_disconnected(MOCK_WIFI_REASON_BEACON_TIMEOUT);
+    }
+}
 
 bool mock_esp_wifi_is_connected(void) { return mock_connected; }
 
+uint32_t mock_esp_wifi_get_connect_calls(void) { return mock_connect_calls; }
+
+void mock_esp_wifi_set_auto_connect(bool auto_connect) { mock_auto_connect = auto_connect; }
+
+bool mock_esp_wifi_is_started(void) { return mock_started; }
+
+const wifi_config_t *mock_esp_wifi_get_config(void) { return &mock_config; }
+
+void mock_esp_wifi_set_ap_moved(bool moved) { mock_ap_moved = moved; }
+
 void mock_esp_wifi_reset(void) {
     mock_connected = false;
     mock_mode = WIFI_MODE_NULL;
+    mock_connect_calls = 0;
+    mock_auto_connect = false;
+    mock_ap_moved = false;
     memset(&mock_config, 0, sizeof(wifi_config_t));
 }
\ No newline at end of file
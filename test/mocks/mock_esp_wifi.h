@@ -6,6 +6,8 @@
 #ifndef MOCK_ESP_WIFI_H
 #define MOCK_ESP_WIFI_H
 
+#include "esp_event.h"
+#include "esp_netif.h" // IP_EVENT and its payloads come from the real netif layer
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -30,10 +32,21 @@ typedef enum {
     WIFI_AUTH_MAX
 } wifi_auth_mode_t;
 
+typedef enum {
+    WIFI_FAST_SCAN = 0,
+    WIFI_ALL_CHANNEL_SCAN,
+} wifi_scan_method_t;
+
 typedef struct {
     uint8_t ssid[32];
     uint8_t password[64];
-    wifi_auth_mode_t threshold_authmode;
+    wifi_scan_method_t scan_method;
+    bool bssid_set;
+    uint8_t bssid[6];
+    uint8_t channel;
+    struct {
+        wifi_auth_mode_t authmode;
+    } threshold;
     struct {
         bool capable;
         bool required;
@@ -50,6 +63,39 @@ typedef enum {
     WIFI_IF_AP,
 } wifi_interface_t;
 
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t ssid[33];
+    uint8_t primary;
+    int8_t rssi;
+} wifi_ap_record_t;
+
+// Event base, ids and payload as posted by the WiFi driver
+ESP_EVENT_DECLARE_BASE(WIFI_EVENT);
+
+typedef enum {
+    WIFI_EVENT_WIFI_READY = 0,
+    WIFI_EVENT_SCAN_DONE,
+    WIFI_EVENT_STA_START,
+    WIFI_EVENT_STA_STOP,
+    WIFI_EVENT_STA_CONNECTED,
+    WIFI_EVENT_STA_DISCONNECTED,
+} wifi_event_t;
+
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t ssid_len;
+    uint8_t bssid[6];
+    uint8_t reason;
+    int8_t rssi;
+} wifi_event_sta_disconnected_t;
+
+#define MOCK_WIFI_REASON_ASSOC_LEAVE 8
+#define MOCK_WIFI_REASON_BEACON_TIMEOUT 200
+#define MOCK_WIFI_REASON_NO_AP_FOUND 201
+#define MOCK_WIFI_AP_CHANNEL 6
+#define MOCK_WIFI_LEASE_IP 0x3201A8C0 // 192.168.1.50 in network byte order
+
 // Mock function declarations
 esp_err_t esp_wifi_init(const wifi_init_config_t *config);
 esp_err_t esp_wifi_deinit(void);
@@ -61,10 +107,21 @@ esp_err_t esp_wifi_start(void);
 esp_err_t esp_wifi_stop(void);
 esp_err_t esp_wifi_connect(void);
 esp_err_t esp_wifi_disconnect(void);
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info);
 
 // Test control functions
+// Posts STA_CONNECTED and IP_EVENT_STA_GOT_IP, or STA_DISCONNECTED with a beacon timeout.
+// The access point is on MOCK_WIFI_AP_CHANNEL and hands out MOCK_WIFI_LEASE_IP.
 void mock_esp_wifi_set_connected(bool connected);
 bool mock_esp_wifi_is_connected(void);
+uint32_t mock_esp_wifi_get_connect_calls(void);
+// When set, esp_wifi_connect() posts a successful connection as a reachable access point would
+void mock_esp_wifi_set_auto_connect(bool auto_connect);
+bool mock_esp_wifi_is_started(void);
+// Config most recently passed to esp_wifi_set_config()
+const wifi_config_t *mock_esp_wifi_get_config(void);
+// When set, the access point is gone from its cached BSSID and channel, so a direct connect fails
+void mock_esp_wifi_set_ap_moved(bool moved);
 void mock_esp_wifi_reset(void);
 
 #endif // MOCK_ESP_WIFI_H
\ No newline at end of file
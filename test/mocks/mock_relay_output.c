@@ -0,0 +1,96 @@
+/**
+ * @file mock_relay_output.c
+ * @brief Host mock relay output backend for unit testing
+ */
+
+#include "mock_relay_output.h"
+#include "esp_err.h"
+#include <string.h>
+
+// Mock output state
+static uint32_t mock_mask;     // Levels on the outputs
+static uint32_t mock_register; // Levels written, which the outputs ignore while held
+static bool mock_held;
+static uint32_t mock_change_count;
+static uint32_t mock_write_count;
+static uint32_t mock_stuck_on;
+static uint32_t mock_stuck_off;
+static esp_err_t mock_write_error = ESP_OK;
+
+static void drive_outputs(uint32_t mask) {
+    if (mask != mock_mask) {
+        mock_change_count++;
+    }
+    mock_mask = mask;
+}
+
+static esp_err_t mock_init(void *ctx) {
+    (void)ctx; // Unused in mock
+    return ESP_OK;
+}
+
+static esp_err_t mock_write(void *ctx, uint32_t mask) {
+    (void)ctx; // Unused in mock
+    if (mock_write_error != ESP_OK) {
+        return mock_write_error;
+    }
+
+    mock_register = mask;
+    if (!mock_held) {
+        drive_outputs(mask);
+    }
+    mock_write_count++;
+    return ESP_OK;
+}
+
+static esp_err_t mock_hold(void *ctx, bool hold) {
+    (void)ctx; // Unused in mock
+    mock_held = hold;
+    if (!hold) {
+        drive_outputs(mock_register);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t mock_read(void *ctx, uint32_t *mask) {
+    (void)ctx; // Unused in mock
+    *mask = (mock_mask | mock_stuck_on) & ~mock_stuck_off;
+    return ESP_OK;
+}
+
+void mock_relay_output_create(relay_output_backend_t *backend, uint8_t channels, bool readback) {
+    memset(backend, 0, sizeof(*backend));
+    backend->name = "mock";
+    backend->channels = channels;
+    backend->init = mock_init;
+    backend->write = mock_write;
+    backend->read = readback ? mock_read : NULL;
+    backend->hold = mock_hold;
+}
+
+// Test control functions
+uint32_t mock_relay_output_get_mask(void) { return mock_mask; }
+
+uint32_t mock_relay_output_get_write_count(void) { return mock_write_count; }
+
+uint32_t mock_relay_output_get_change_count(void) { return mock_change_count; }
+
+bool mock_relay_output_is_held(void) { return mock_held; }
+
+void mock_relay_output_set_stuck(uint32_t stuck_on, uint32_t stuck_off) {
+    mock_stuck_on = stuck_on;
+    mock_stuck_off = stuck_off;
+}
+
+void mock_relay_output_set_write_error(esp_err_t error) { mock_write_error = error; }
+
+void mock_relay_output_reset(void) {
+    mock_mask = 0;
+    mock_register = 0;
+    mock_held = false;
+    mock_change_count = 0;
+    mock_write_count = 0;
+    mock_stuck_on = 0;
+    mock_stuck_off = 0;
+    mock_write_error = ESP_OK;
+}
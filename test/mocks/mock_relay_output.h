@@ -0,0 +1,32 @@
+/**
+ * @file mock_relay_output.h
+ * @brief Host mock relay output backend for unit testing
+ */
+
+#ifndef MOCK_RELAY_OUTPUT_H
+#define MOCK_RELAY_OUTPUT_H
+
+#include "pool_pump/relay_output.h"
+#include <stdint.h>
+
+/**
+ * @brief Fill a backend that records writes instead of driving hardware
+ *
+ * The outputs can be held like GPIO pads in deep sleep: writes while held only reach the
+ * output register, and the outputs take its value when the hold is released.
+ *
+ * @param channels Number of outputs to report
+ * @param readback false to behave like a shift register without readback
+ */
+void mock_relay_output_create(relay_output_backend_t *backend, uint8_t channels, bool readback);
+
+// Test control functions
+uint32_t mock_relay_output_get_mask(void);
+uint32_t mock_relay_output_get_write_count(void);
+uint32_t mock_relay_output_get_change_count(void);
+bool mock_relay_output_is_held(void);
+void mock_relay_output_set_stuck(uint32_t stuck_on, uint32_t stuck_off);
+void mock_relay_output_set_write_error(esp_err_t error);
+void mock_relay_output_reset(void);
+
+#endif // MOCK_RELAY_OUTPUT_H
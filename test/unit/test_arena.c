@@ -0,0 +1,85 @@
+/**
+ * @file test_arena.c
+ * @brief Unit tests for the bump-pointer arena and cJSON allocating from it
+ */
+
+#include "cJSON.h"
+#include "esp_heap_caps.h"
+#include "pool_pump/arena.h"
+#include "unity.h"
+#include <stdint.h>
+
+static uint8_t region[1024] __attribute__((aligned(ARENA_ALIGN)));
+static arena_t arena;
+
+static void *json_alloc(size_t size) { return arena_alloc(&arena, size); }
+
+static void json_free(void *block) {}
+
+// Test group
+TEST_GROUP(arena_tests);
+
+// Test setup and teardown
+TEST_SETUP(arena_tests) { arena_init(&arena, region, 64); }
+
+TEST_TEAR_DOWN(arena_tests) { cJSON_InitHooks(NULL); }
+
+/**
+ * @brief Test blocks are handed out aligned and back to back, and a block that does not fit is refused
+ */
+TEST(arena_tests, test_blocks_aligned_and_contiguous) {
+    TEST_ASSERT_EQUAL_PTR(&region[0], arena_alloc(&arena, 1));
+    TEST_ASSERT_EQUAL_PTR(&region[8], arena_alloc(&arena, 3));
+    TEST_ASSERT_EQUAL_PTR(&region[16], arena_alloc(&arena, 16));
+    TEST_ASSERT_EQUAL(32, arena.used);
+
+    TEST_ASSERT_NULL(arena_alloc(&arena, 40));
+    TEST_ASSERT_EQUAL(1, arena.failures);
+    TEST_ASSERT_EQUAL_PTR(&region[32], arena_alloc(&arena, 32));
+    TEST_ASSERT_NULL(arena_alloc(&arena, 1));
+    TEST_ASSERT_NULL(arena_alloc(&arena, SIZE_MAX));
+    TEST_ASSERT_NULL(arena_alloc(&arena, 0));
+    TEST_ASSERT_EQUAL(64, arena.used);
+    TEST_ASSERT_EQUAL(64, arena.peak);
+    TEST_ASSERT_EQUAL(4, arena.allocations);
+    TEST_ASSERT_EQUAL(3, arena.failures);
+
+    // A reset gives the whole region back; the peak is kept
+    arena_reset(&arena);
+    TEST_ASSERT_EQUAL(0, arena.used);
+    TEST_ASSERT_EQUAL(64, arena.peak);
+    TEST_ASSERT_EQUAL_PTR(&region[0], arena_alloc(&arena, 8));
+}
+
+/**
+ * @brief Test a JSON tree built in the arena leaves the heap untouched, and fails cleanly when it runs out
+ */
+TEST(arena_tests, test_cjson_parses_in_arena) {
+    arena_init(&arena, region, sizeof(region));
+    cJSON_Hooks hooks = {.malloc_fn = json_alloc, .free_fn = json_free};
+    cJSON_InitHooks(&hooks);
+
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    cJSON *root = cJSON_Parse("{\"records\": [{\"SpotPriceEUR\": 0.123}, {\"SpotPriceEUR\": 0.145}]}");
+    TEST_ASSERT_NOT_NULL(root);
+    cJSON *records = cJSON_GetObjectItem(root, "records");
+    TEST_ASSERT_EQUAL(2, cJSON_GetArraySize(records));
+    cJSON *price = cJSON_GetObjectItem(cJSON_GetArrayItem(records, 1), "SpotPriceEUR");
+    TEST_ASSERT_EQUAL_FLOAT(0.145f, (float)price->valuedouble);
+    TEST_ASSERT_TRUE(arena.used > 0);
+    cJSON_Delete(root);
+    arena_reset(&arena);
+    TEST_ASSERT_EQUAL(free_before, heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
+
+    // Out of room halfway through the tree
+    arena_init(&arena, region, 64);
+    TEST_ASSERT_NULL(cJSON_Parse("{\"records\": [{\"SpotPriceEUR\": 0.123}, {\"SpotPriceEUR\": 0.145}]}"));
+    TEST_ASSERT_TRUE(arena.failures > 0);
+    TEST_ASSERT_EQUAL(free_before, heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(arena_tests) {
+    RUN_TEST_CASE(arena_tests, test_blocks_aligned_and_contiguous);
+    RUN_TEST_CASE(arena_tests, test_cjson_parses_in_arena);
+}
@@ -0,0 +1,45 @@
+/**
+ * @file test_boot_trace.c
+ * @brief Unit tests for the boot timeline
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "pool_pump/boot_trace.h"
+#include "unity.h"
+
+// Test group
+TEST_GROUP(boot_trace_tests);
+
+// Test setup and teardown
+TEST_SETUP(boot_trace_tests) {
+    // Setup before each test
+}
+
+TEST_TEAR_DOWN(boot_trace_tests) {
+    // Clean up after each test
+}
+
+/**
+ * @brief Test only the first mark of a milestone counts and later milestones come after it
+ */
+TEST(boot_trace_tests, test_first_mark_counts) {
+    boot_trace_t first, again;
+    boot_trace_mark(BOOT_STAGE_APP_START);
+    TEST_ASSERT_EQUAL(ESP_OK, boot_trace_get(&first));
+    TEST_ASSERT_TRUE(first.stage_us[BOOT_STAGE_APP_START] > 0);
+
+    vTaskDelay(pdMS_TO_TICKS(20));
+    boot_trace_mark(BOOT_STAGE_APP_START);
+    boot_trace_mark(BOOT_STAGE_RELAYS);
+    boot_trace_mark(BOOT_STAGE_COUNT);
+    TEST_ASSERT_EQUAL(ESP_OK, boot_trace_get(&again));
+    TEST_ASSERT_EQUAL(first.stage_us[BOOT_STAGE_APP_START], again.stage_us[BOOT_STAGE_APP_START]);
+    TEST_ASSERT_TRUE(again.stage_us[BOOT_STAGE_RELAYS] >= again.stage_us[BOOT_STAGE_APP_START] + 20000);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, boot_trace_get(NULL));
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(boot_trace_tests) {
+    RUN_TEST_CASE(boot_trace_tests, test_first_mark_counts);
+}
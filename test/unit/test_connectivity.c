@@ -0,0 +1,143 @@
+/**
+ * @file test_connectivity.c
+ * @brief Unit tests for the reference-counted radio duty cycling
+ */
+
+#include "config.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mock_esp_wifi.h"
+#include "pool_pump/connectivity.h"
+#include "unity.h"
+#include "wifi_manager.h"
+#include <string.h>
+
+static int job_runs[3];
+static int spare_runs[CONNECTIVITY_MAX_JOBS];
+
+static void count_job(void *arg) { (*(int *)arg)++; }
+
+// Events are handled on the event loop task; wait until the manager has seen the ones just posted
+static void wait_events(void) { vTaskDelay(pdMS_TO_TICKS(50)); }
+
+// Test group
+TEST_GROUP(connectivity_tests);
+
+// Test setup and teardown
+TEST_SETUP(connectivity_tests) {
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_init());
+    TEST_ASSERT_EQUAL(ESP_OK, connectivity_init("TestNetwork", "testpassword"));
+    wifi_manager_stop();
+    wait_events();
+    mock_esp_wifi_reset();
+    mock_esp_wifi_set_auto_connect(true);
+    memset(job_runs, 0, sizeof(job_runs));
+}
+
+TEST_TEAR_DOWN(connectivity_tests) {
+    // Clean up after each test
+}
+
+/**
+ * @brief Test the radio comes up for the first reference and goes off with the last one
+ */
+TEST(connectivity_tests, test_radio_follows_references) {
+    TEST_ASSERT_FALSE(connectivity_radio_on());
+    TEST_ASSERT_EQUAL(ESP_OK, connectivity_acquire(1000));
+    TEST_ASSERT_EQUAL(ESP_OK, connectivity_acquire(1000));
+    TEST_ASSERT_TRUE(connectivity_radio_on());
+    TEST_ASSERT_EQUAL(1, mock_esp_wifi_get_connect_calls());
+
+    connectivity_release();
+    TEST_ASSERT_TRUE(connectivity_radio_on());
+    TEST_ASSERT_TRUE(wifi_manager_is_connected());
+
+    connectivity_release();
+    wait_events();
+    TEST_ASSERT_FALSE(connectivity_radio_on());
+    TEST_ASSERT_FALSE(mock_esp_wifi_is_started());
+    TEST_ASSERT_FALSE(wifi_manager_is_connected());
+
+    // The next window joins the network again
+    TEST_ASSERT_EQUAL(ESP_OK, connectivity_acquire(1000));
+    TEST_ASSERT_EQUAL(2, mock_esp_wifi_get_connect_calls());
+    connectivity_release();
+}
+
+/**
+ * @brief Test deferred jobs wait for the next window and run once, before the radio goes off
+ */
+TEST(connectivity_tests, test_deferred_jobs_ride_along) {
+    TEST_ASSERT_EQUAL(ESP_OK, connectivity_defer(count_job, &job_runs[0]));
+    TEST_ASSERT_EQUAL(ESP_OK, connectivity_defer(count_job, &job_runs[0]));
+    TEST_ASSERT_EQUAL(ESP_OK, connectivity_defer(count_job, &job_runs[1]));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, connectivity_defer(NULL, NULL));
+
+    // Not due yet, so no window is opened for them
+    connectivity_service(1000);
+    TEST_ASSERT_FALSE(connectivity_radio_on());
+    TEST_ASSERT_EQUAL(0, job_runs[0]);
+
+    connectivity_stats_t stats;
+    TEST_ASSERT_EQUAL(ESP_OK, connectivity_get_stats(&stats));
+    TEST_ASSERT_EQUAL(2, stats.jobs_pending);
+
+    TEST_ASSERT_EQUAL(ESP_OK, connectivity_acquire(1000));
+    TEST_ASSERT_EQUAL(0, job_runs[0]);
+    connectivity_release();
+    TEST_ASSERT_EQUAL(1, job_runs[0]);
+    TEST_ASSERT_EQUAL(1, job_runs[1]);
+    TEST_ASSERT_EQUAL(0, job_runs[2]);
+
+    TEST_ASSERT_EQUAL(ESP_OK, connectivity_get_stats(&stats));
+    TEST_ASSERT_EQUAL(0, stats.jobs_pending);
+
+    // The queue is bounded
+    for (int i = 0; i < CONNECTIVITY_MAX_JOBS; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, connectivity_defer(count_job, &spare_runs[i]));
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, connectivity_defer(count_job, &job_runs[2]));
+    mock_esp_wifi_set_auto_connect(false);
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, connectivity_acquire(100));
+    TEST_ASSERT_EQUAL(ESP_OK, connectivity_get_stats(&stats));
+    TEST_ASSERT_EQUAL(CONNECTIVITY_MAX_JOBS, stats.jobs_pending);
+
+    // Drain the queue so later tests start empty
+    mock_esp_wifi_set_auto_connect(true);
+    TEST_ASSERT_EQUAL(ESP_OK, connectivity_acquire(1000));
+    connectivity_release();
+}
+
+/**
+ * @brief Test radio-on time and the savings against an always-associated station are reported
+ */
+TEST(connectivity_tests, test_daily_radio_report) {
+    connectivity_stats_t day;
+    connectivity_roll_day(NULL);
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    TEST_ASSERT_EQUAL(ESP_OK, connectivity_acquire(1000));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    connectivity_release();
+    wait_events();
+
+    connectivity_roll_day(&day);
+    TEST_ASSERT_EQUAL(1, day.windows);
+    TEST_ASSERT_EQUAL(1, day.radio_on_s);
+    TEST_ASSERT_EQUAL(2, day.period_s);
+    TEST_ASSERT_TRUE(day.saved_mah > 0);
+    TEST_ASSERT_TRUE(day.average_saved_ma > 0 && day.average_saved_ma < CONNECTIVITY_ASSOCIATED_MA);
+
+    TEST_ASSERT_EQUAL(ESP_OK, connectivity_get_stats(&day));
+    TEST_ASSERT_EQUAL(0, day.windows);
+
+    // Without a network nothing can take the radio
+    TEST_ASSERT_EQUAL(ESP_OK, connectivity_init(NULL, NULL));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, connectivity_acquire(1000));
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(connectivity_tests) {
+    RUN_TEST_CASE(connectivity_tests, test_radio_follows_references);
+    RUN_TEST_CASE(connectivity_tests, test_deferred_jobs_ride_along);
+    RUN_TEST_CASE(connectivity_tests, test_daily_radio_report);
+}
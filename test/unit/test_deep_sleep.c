@@ -0,0 +1,159 @@
+/**
+ * @file test_deep_sleep.c
+ * @brief Unit tests for sleeping between plan transitions with the relays held
+ */
+
+#include "config.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mock_relay_output.h"
+#include "nvs_storage.h"
+#include "pool_pump/deep_sleep.h"
+#include "pool_pump/nvs_cache.h"
+#include "pool_pump/runtime_accounting.h"
+#include "pool_pump/time_service.h"
+#include "pump_controller.h"
+#include "relay_control.h"
+#include "unity.h"
+#include <string.h>
+#include <sys/time.h>
+
+#define TEST_DATE 20260601
+#define TEST_EPOCH 1780304400 // 2026-06-01 09:00:00 UTC
+
+// Day mode from 10:00 to 12:00, then night mode until 13:00, off otherwise
+static void test_plan(daily_plan_t *plan) {
+    memset(plan, 0, sizeof(*plan));
+    plan->date = TEST_DATE;
+    memset(&plan->mode[10 * 60 / DAILY_PLAN_SLOT_MINUTES], PUMP_MODE_DAY, 2 * 60 / DAILY_PLAN_SLOT_MINUTES);
+    memset(&plan->mode[12 * 60 / DAILY_PLAN_SLOT_MINUTES], PUMP_MODE_NIGHT, 60 / DAILY_PLAN_SLOT_MINUTES);
+}
+
+static void set_clock(time_t seconds) {
+    struct timeval tv = {.tv_sec = seconds, .tv_usec = 0};
+    settimeofday(&tv, NULL);
+}
+
+// Test group
+TEST_GROUP(deep_sleep_tests);
+
+// Test setup and teardown
+TEST_SETUP(deep_sleep_tests) { mock_relay_output_reset(); }
+
+TEST_TEAR_DOWN(deep_sleep_tests) { relay_control_set_backend(NULL); }
+
+/**
+ * @brief Test the wake-up is set for the next mode change, the end of the runtime budget or midnight
+ */
+TEST(deep_sleep_tests, test_next_wake_follows_plan_and_budget) {
+    daily_plan_t plan;
+    test_plan(&plan);
+    pump_mode_t wake_mode;
+
+    TEST_ASSERT_EQUAL(10 * 60, deep_sleep_next_wake(&plan, 8 * 60, PUMP_MODE_OFF, 720, &wake_mode));
+    TEST_ASSERT_EQUAL(PUMP_MODE_DAY, wake_mode);
+    TEST_ASSERT_EQUAL(12 * 60, deep_sleep_next_wake(&plan, 10 * 60, PUMP_MODE_DAY, 720, &wake_mode));
+    TEST_ASSERT_EQUAL(PUMP_MODE_NIGHT, wake_mode);
+
+    // The budget runs out before the plan's next change
+    TEST_ASSERT_EQUAL(10 * 60 + 30, deep_sleep_next_wake(&plan, 10 * 60, PUMP_MODE_DAY, 30, &wake_mode));
+    TEST_ASSERT_EQUAL(PUMP_MODE_OFF, wake_mode);
+    TEST_ASSERT_EQUAL(12 * 60, deep_sleep_next_wake(&plan, 10 * 60, PUMP_MODE_OFF, 0, &wake_mode));
+    TEST_ASSERT_EQUAL(PUMP_MODE_OFF, wake_mode);
+
+    // Nothing left today: wake for the next day's plan
+    TEST_ASSERT_EQUAL(24 * 60, deep_sleep_next_wake(&plan, 13 * 60, PUMP_MODE_OFF, 720, &wake_mode));
+    TEST_ASSERT_EQUAL(PUMP_MODE_OFF, wake_mode);
+
+    // Only a boot that follows deep_sleep_enter() finds the relays held
+    TEST_ASSERT_EQUAL(ESP_OK, deep_sleep_init(ESP_RST_POWERON));
+    TEST_ASSERT_EQUAL(ESP_OK, deep_sleep_init(ESP_RST_DEEPSLEEP));
+    TEST_ASSERT_FALSE(deep_sleep_get_wake(NULL));
+}
+
+/**
+ * @brief Test held relays are taken over on the wake-up and switch in a single step
+ */
+TEST(deep_sleep_tests, test_relays_resume_without_glitch) {
+    relay_output_backend_t backend;
+    mock_relay_output_create(&backend, 8, true);
+    TEST_ASSERT_EQUAL(ESP_OK, relay_control_set_backend(&backend));
+    TEST_ASSERT_EQUAL(ESP_OK, pump_controller_init());
+    TEST_ASSERT_EQUAL(ESP_OK, pump_controller_set_mode(PUMP_MODE_DAY));
+    TEST_ASSERT_EQUAL(ESP_OK, relay_control_hold());
+    TEST_ASSERT_TRUE(mock_relay_output_is_held());
+
+    // The wake-up: straight from day to night mode, never through off
+    uint32_t changes = mock_relay_output_get_change_count();
+    TEST_ASSERT_EQUAL(ESP_OK, pump_controller_resume(PUMP_MODE_NIGHT));
+    TEST_ASSERT_FALSE(mock_relay_output_is_held());
+    TEST_ASSERT_EQUAL(changes + 1, mock_relay_output_get_change_count());
+    TEST_ASSERT_EQUAL_HEX32(1 << RELAY_1, mock_relay_output_get_mask());
+    pump_status_t status;
+    TEST_ASSERT_EQUAL(ESP_OK, pump_controller_get_status(&status));
+    TEST_ASSERT_EQUAL(PUMP_MODE_NIGHT, status.mode);
+    TEST_ASSERT_EQUAL(PUMP_SPEED_NIGHT, status.current_rpm);
+
+    // Staying in the held mode leaves the outputs alone
+    TEST_ASSERT_EQUAL(ESP_OK, relay_control_hold());
+    TEST_ASSERT_EQUAL(ESP_OK, pump_controller_resume(PUMP_MODE_NIGHT));
+    TEST_ASSERT_EQUAL(changes + 1, mock_relay_output_get_change_count());
+
+    // Outputs that cannot be held are never put to sleep
+    backend.hold = NULL;
+    relay_control_set_backend(&backend);
+    TEST_ASSERT_EQUAL(ESP_OK, relay_control_init());
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, relay_control_hold());
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, relay_control_resume(0));
+}
+
+/**
+ * @brief Test the runtime and the clock's error estimate carry on through a sleep
+ */
+TEST(deep_sleep_tests, test_runtime_and_clock_carried_through_sleep) {
+    nvs_storage_init();
+    nvs_cache_init(NVS_CACHE_FLUSH_INTERVAL_S); // Already running if another group started it
+    set_clock(TEST_EPOCH);
+    TEST_ASSERT_EQUAL(ESP_OK, runtime_accounting_init(ESP_RST_POWERON));
+    runtime_accounting_roll_day(20260531);
+    runtime_accounting_roll_day(TEST_DATE);
+    TEST_ASSERT_EQUAL(ESP_OK, time_service_init(ESP_RST_POWERON));
+    struct timeval reference = {.tv_sec = TEST_EPOCH, .tv_usec = 0};
+    TEST_ASSERT_EQUAL(ESP_OK, time_service_set_reference(TIME_SOURCE_SNTP, &reference, TIME_SNTP_ERROR_MS));
+
+    runtime_accounting_set_mode(PUMP_MODE_DAY);
+    runtime_accounting_prepare_sleep();
+
+    // Ten minutes asleep, kept by the RTC slow clock
+    set_clock(TEST_EPOCH + 600);
+    TEST_ASSERT_EQUAL(ESP_OK, runtime_accounting_init(ESP_RST_DEEPSLEEP));
+    time_service_note_sleep(600ULL * 1000000);
+
+    runtime_accounting_t counters;
+    TEST_ASSERT_EQUAL(ESP_OK, runtime_accounting_get(&counters));
+    TEST_ASSERT_EQUAL(TEST_DATE, counters.date);
+    TEST_ASSERT_EQUAL(RUNTIME_SOURCE_RTC, counters.source);
+    TEST_ASSERT_EQUAL(0, counters.soft_resets);
+    TEST_ASSERT_TRUE(counters.mode_us[PUMP_MODE_DAY] >= 600ULL * 1000000);
+    TEST_ASSERT_TRUE(counters.mode_us[PUMP_MODE_DAY] < 601ULL * 1000000);
+
+    // Accounting carries on in the held mode
+    vTaskDelay(pdMS_TO_TICKS(50));
+    runtime_accounting_update();
+    runtime_accounting_t later;
+    TEST_ASSERT_EQUAL(ESP_OK, runtime_accounting_get(&later));
+    TEST_ASSERT_TRUE(later.mode_us[PUMP_MODE_DAY] > counters.mode_us[PUMP_MODE_DAY]);
+    runtime_accounting_set_mode(PUMP_MODE_OFF);
+
+    time_status_t status;
+    TEST_ASSERT_EQUAL(ESP_OK, time_service_get_status(&status));
+    TEST_ASSERT_EQUAL(TIME_SNTP_ERROR_MS + 600 * TIME_DRIFT_UNMEASURED_PPM / 1000 + 600 * TIME_SLEEP_CLOCK_PPM / 1000,
+                      status.error_ms);
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(deep_sleep_tests) {
+    RUN_TEST_CASE(deep_sleep_tests, test_next_wake_follows_plan_and_budget);
+    RUN_TEST_CASE(deep_sleep_tests, test_relays_resume_without_glitch);
+    RUN_TEST_CASE(deep_sleep_tests, test_runtime_and_clock_carried_through_sleep);
+}
@@ -0,0 +1,156 @@
+/**
+ * @file test_modbus_rtu.c
+ * @brief Unit tests for the Modbus RTU master
+ */
+
+#include "pool_pump/modbus_rtu.h"
+#include "unity.h"
+#include <string.h>
+
+// Scripted transport: captures the request and plays back a canned reply
+static uint8_t sent_frame[MODBUS_RTU_MAX_ADU];
+static size_t sent_len;
+static uint8_t reply_frame[MODBUS_RTU_MAX_ADU];
+static size_t reply_len;
+static size_t reply_pos;
+static int busy_depth;
+static bool sent_while_busy;
+
+static esp_err_t scripted_write(void *ctx, const uint8_t *data, size_t len) {
+    sent_while_busy = busy_depth > 0;
+    memcpy(sent_frame, data, len);
+    sent_len = len;
+    reply_pos = 0;
+    return ESP_OK;
+}
+
+static int scripted_read(void *ctx, uint8_t *buf, size_t len, uint32_t timeout_ms) {
+    size_t available = reply_len - reply_pos;
+    size_t n = len < available ? len : available;
+    if (n == 0) {
+        return -1;
+    }
+    memcpy(buf, reply_frame + reply_pos, n);
+    reply_pos += n;
+    return (int)n;
+}
+
+static void scripted_busy(void *ctx, bool busy) { busy_depth += busy ? 1 : -1; }
+
+static void set_reply(const uint8_t *frame, size_t len) {
+    memcpy(reply_frame, frame, len);
+    uint16_t crc = modbus_rtu_crc16(frame, len);
+    reply_frame[len] = crc & 0xFF;
+    reply_frame[len + 1] = crc >> 8;
+    reply_len = len + 2;
+}
+
+static modbus_rtu_master_t master;
+
+// Test group
+TEST_GROUP(modbus_rtu_tests);
+
+// Test setup and teardown
+TEST_SETUP(modbus_rtu_tests) {
+    const modbus_rtu_transport_t transport = {.write = scripted_write, .read = scripted_read};
+    modbus_rtu_master_init(&master, &transport, 50, 0);
+    sent_len = 0;
+    reply_len = 0;
+}
+
+TEST_TEAR_DOWN(modbus_rtu_tests) {
+    // Clean up after each test
+}
+
+/**
+ * @brief Test CRC against the reference frame 01 03 00 00 00 01 -> 84 0A
+ */
+TEST(modbus_rtu_tests, test_crc16_reference) {
+    const uint8_t frame[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x01};
+    TEST_ASSERT_EQUAL_HEX32(0x0A84, modbus_rtu_crc16(frame, sizeof(frame)));
+}
+
+/**
+ * @brief Test a multi-register read in one transaction
+ */
+TEST(modbus_rtu_tests, test_read_input_registers) {
+    const uint8_t reply[] = {0x01, 0x04, 0x04, 0x05, 0xDC, 0x01, 0x2C};
+    set_reply(reply, sizeof(reply));
+
+    uint16_t values[2];
+    esp_err_t result = modbus_rtu_read_registers(&master, 1, MODBUS_FC_READ_INPUT, 0x0100, 2, values);
+    TEST_ASSERT_EQUAL(ESP_OK, result);
+    TEST_ASSERT_EQUAL(8, sent_len);
+    TEST_ASSERT_EQUAL(1500, values[0]);
+    TEST_ASSERT_EQUAL(300, values[1]);
+}
+
+/**
+ * @brief Test that a slave exception is reported
+ */
+TEST(modbus_rtu_tests, test_exception_reply) {
+    const uint8_t reply[] = {0x01, 0x83, 0x02};
+    set_reply(reply, sizeof(reply));
+
+    uint16_t value;
+    esp_err_t result = modbus_rtu_read_registers(&master, 1, MODBUS_FC_READ_HOLDING, 0x7000, 1, &value);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, result);
+    TEST_ASSERT_EQUAL(2, master.stats.last_exception);
+}
+
+/**
+ * @brief Test that a corrupted reply is rejected
+ */
+TEST(modbus_rtu_tests, test_bad_crc_rejected) {
+    const uint8_t reply[] = {0x01, 0x03, 0x02, 0x00, 0x07};
+    set_reply(reply, sizeof(reply));
+    reply_frame[reply_len - 1] ^= 0xFF;
+
+    uint16_t value;
+    esp_err_t result = modbus_rtu_read_registers(&master, 1, MODBUS_FC_READ_HOLDING, 0, 1, &value);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, result);
+    TEST_ASSERT_EQUAL(1, master.stats.crc_errors);
+}
+
+/**
+ * @brief Test invalid register counts
+ */
+TEST(modbus_rtu_tests, test_invalid_count) {
+    uint16_t values[1];
+    esp_err_t result = modbus_rtu_read_registers(&master, 1, MODBUS_FC_READ_HOLDING, 0, 0, values);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, result);
+
+    result = modbus_rtu_read_registers(&master, 1, MODBUS_FC_READ_HOLDING, 0, 126, values);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, result);
+}
+
+/**
+ * @brief Test the transport is marked busy for the whole transaction, retries included
+ */
+TEST(modbus_rtu_tests, test_busy_brackets_transaction) {
+    const modbus_rtu_transport_t transport = {.write = scripted_write, .read = scripted_read, .busy = scripted_busy};
+    modbus_rtu_master_init(&master, &transport, 50, 1);
+    busy_depth = 0;
+
+    const uint8_t reply[] = {0x01, 0x06, 0x00, 0x10, 0x05, 0xDC};
+    set_reply(reply, sizeof(reply));
+    TEST_ASSERT_EQUAL(ESP_OK, modbus_rtu_write_register(&master, 1, 0x0010, 1500));
+    TEST_ASSERT_TRUE(sent_while_busy);
+    TEST_ASSERT_EQUAL(0, busy_depth);
+
+    // No reply: both attempts time out, and the transport is released once
+    reply_len = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, modbus_rtu_write_register(&master, 1, 0x0010, 1500));
+    TEST_ASSERT_EQUAL(1, master.stats.retries);
+    TEST_ASSERT_EQUAL(0, busy_depth);
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(modbus_rtu_tests) {
+    RUN_TEST_CASE(modbus_rtu_tests, test_crc16_reference);
+    RUN_TEST_CASE(modbus_rtu_tests, test_read_input_registers);
+    RUN_TEST_CASE(modbus_rtu_tests, test_exception_reply);
+    RUN_TEST_CASE(modbus_rtu_tests, test_bad_crc_rejected);
+    RUN_TEST_CASE(modbus_rtu_tests, test_invalid_count);
+    RUN_TEST_CASE(modbus_rtu_tests, test_busy_brackets_transaction);
+}
@@ -0,0 +1,102 @@
+/**
+ * @file test_nvs_cache.c
+ * @brief Unit tests for the write-back counter cache
+ */
+
+#include "config.h"
+#include "nvs_storage.h"
+#include "pool_pump/nvs_cache.h"
+#include "unity.h"
+#include <stdbool.h>
+#include <string.h>
+
+static bool cache_started = false;
+
+// Test group
+TEST_GROUP(nvs_cache_tests);
+
+// Test setup and teardown
+TEST_SETUP(nvs_cache_tests) {
+    nvs_storage_init();
+    if (!cache_started) {
+        // The cache and its flush task live for the rest of the run
+        TEST_ASSERT_EQUAL(ESP_OK, nvs_cache_init(NVS_CACHE_FLUSH_INTERVAL_S));
+        cache_started = true;
+    }
+}
+
+TEST_TEAR_DOWN(nvs_cache_tests) {
+    // Clean up after each test
+}
+
+/**
+ * @brief Test a registered counter starts from its persisted value
+ */
+TEST(nvs_cache_tests, test_register_loads_persisted_value) {
+    nvs_storage_save_int("tc_loaded", 1234);
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_cache_register("tc_loaded", 0));
+
+    int32_t value = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_cache_get("tc_loaded", &value));
+    TEST_ASSERT_EQUAL(1234, value);
+}
+
+/**
+ * @brief Test many updates reach flash as a single write on flush
+ */
+TEST(nvs_cache_tests, test_updates_coalesce_until_flush) {
+    nvs_storage_erase("tc_minutes");
+    nvs_cache_register("tc_minutes", 0);
+    nvs_cache_set("tc_minutes", 0);
+    nvs_cache_flush();
+
+    nvs_storage_stats_t before, after;
+    nvs_storage_get_stats(&before);
+    for (int i = 0; i < 60; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, nvs_cache_add("tc_minutes", 1));
+    }
+    nvs_storage_get_stats(&after);
+    TEST_ASSERT_EQUAL(before.writes, after.writes);
+
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_cache_flush());
+    nvs_storage_get_stats(&after);
+    TEST_ASSERT_EQUAL(before.writes + 1, after.writes);
+    TEST_ASSERT_EQUAL(before.commits + 1, after.commits);
+
+    int32_t stored = 0;
+    nvs_storage_load_int("tc_minutes", &stored);
+    TEST_ASSERT_EQUAL(60, stored);
+}
+
+/**
+ * @brief Test the report shows fewer flash writes than updates
+ */
+TEST(nvs_cache_tests, test_report_write_ratio) {
+    nvs_cache_register("tc_ratio", 0);
+    for (int i = 0; i < 10; i++) {
+        nvs_cache_add("tc_ratio", 1);
+    }
+    nvs_cache_flush();
+
+    nvs_cache_report_t report;
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_cache_get_report(&report));
+    TEST_ASSERT_EQUAL(0, report.dirty);
+    TEST_ASSERT_TRUE(report.write_ratio < 1.0f);
+    TEST_ASSERT_TRUE(report.lifetime_years > report.write_through_years);
+}
+
+/**
+ * @brief Test unknown keys and over-long keys are rejected
+ */
+TEST(nvs_cache_tests, test_invalid_keys) {
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, nvs_cache_add("tc_unknown", 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, nvs_cache_register("tc_key_that_is_too_long", 0));
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(nvs_cache_tests) {
+    RUN_TEST_CASE(nvs_cache_tests, test_register_loads_persisted_value);
+    RUN_TEST_CASE(nvs_cache_tests, test_updates_coalesce_until_flush);
+    RUN_TEST_CASE(nvs_cache_tests, test_report_write_ratio);
+    RUN_TEST_CASE(nvs_cache_tests, test_invalid_keys);
+}
@@ -3,8 +3,11 @@
  * @brief Unit tests for NVS storage component
  */
 
+#include "config.h"
+#include "esp_timer.h"
 #include "nvs_storage.h"
 #include "unity.h"
+#include <stdio.h>
 #include <string.h>
 
 // Test group
@@ -236,6 +239,371 @@ TEST(nvs_storage_tests, test_system_settings_boundary_values) {
     TEST_ASSERT_EQUAL(12, retrieved_settings.timezone_offset);
 }
 
+/**
+ * @brief Test a pump config update is a single commit
+ */
+TEST(nvs_storage_tests, test_pump_config_single_commit) {
+    nvs_storage_init();
+    nvs_storage_set_pump_config(1, 120);
+
+    nvs_storage_stats_t before, after;
+    nvs_storage_get_stats(&before);
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_set_pump_config(2, 240));
+    nvs_storage_get_stats(&after);
+    TEST_ASSERT_EQUAL(before.commits + 1, after.commits);
+    // Both values go out in one config blob
+    TEST_ASSERT_EQUAL(before.writes + 1, after.writes);
+
+    uint8_t mode;
+    uint16_t runtime;
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_get_pump_config(&mode, &runtime));
+    TEST_ASSERT_EQUAL(2, mode);
+    TEST_ASSERT_EQUAL(240, runtime);
+}
+
+/**
+ * @brief Test nested batches commit once, at the outermost end
+ */
+TEST(nvs_storage_tests, test_nested_batch_commits_once) {
+    nvs_storage_init();
+
+    nvs_storage_stats_t before, after;
+    nvs_storage_get_stats(&before);
+
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_begin_batch());
+    nvs_storage_save_int("batch_a", 1);
+    nvs_storage_set_pump_config(1, 120);
+    nvs_storage_save_string("batch_b", "x");
+    nvs_storage_get_stats(&after);
+    TEST_ASSERT_EQUAL(before.commits, after.commits);
+
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_end_batch());
+    nvs_storage_get_stats(&after);
+    TEST_ASSERT_EQUAL(before.commits + 1, after.commits);
+
+    // Unbalanced end is rejected
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, nvs_storage_end_batch());
+
+    // Closing the handle inside a batch is refused, and the batch carries on
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_begin_batch());
+    nvs_storage_save_int("batch_a", 2);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, nvs_storage_deinit());
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_end_batch());
+    nvs_storage_get_stats(&after);
+    TEST_ASSERT_EQUAL(before.commits + 2, after.commits);
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_deinit());
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_init());
+}
+
+/**
+ * @brief Benchmark boot-time config load and write latency, batched and unbatched
+ */
+TEST(nvs_storage_tests, test_benchmark_load_and_write) {
+    const int iterations = 20;
+    char ssid[32];
+    char password[64];
+    uint8_t mode;
+    uint16_t runtime;
+
+    nvs_storage_init();
+    nvs_storage_set_wifi_credentials("BenchNetwork", "BenchPassword");
+    nvs_storage_set_pump_config(2, 240);
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        nvs_storage_get_wifi_credentials(ssid, password);
+        nvs_storage_get_pump_config(&mode, &runtime);
+    }
+    int64_t load_us = (esp_timer_get_time() - start) / iterations;
+
+    nvs_storage_stats_t before, after;
+    nvs_storage_get_stats(&before);
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        nvs_storage_save_int("pump_mode", i & 3);
+        nvs_storage_save_int("daily_runtime", 240 + i);
+    }
+    int64_t unbatched_us = (esp_timer_get_time() - start) / iterations;
+    nvs_storage_get_stats(&after);
+    uint32_t unbatched_commits = after.commits - before.commits;
+
+    nvs_storage_get_stats(&before);
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        nvs_storage_set_pump_config(i & 3, 240 + i);
+    }
+    int64_t batched_us = (esp_timer_get_time() - start) / iterations;
+    nvs_storage_get_stats(&after);
+    uint32_t batched_commits = after.commits - before.commits;
+
+    // Timings are reported, not asserted: they depend on the flash and on what else is running
+    printf("NVS config load: %lld us, pump config write: %lld us unbatched, %lld us batched\n",
+           (long long)load_us,
+           (long long)unbatched_us,
+           (long long)batched_us);
+    TEST_ASSERT_EQUAL(2 * iterations, unbatched_commits);
+    TEST_ASSERT_EQUAL(iterations, batched_commits);
+}
+
+static nvs_config_t make_config(const char *ssid, uint8_t mode) {
+    nvs_config_t config;
+    memset(&config, 0, sizeof(config));
+    strcpy(config.wifi_ssid, ssid);
+    strcpy(config.wifi_password, "secret");
+    config.pump_mode = mode;
+    config.daily_runtime = 300;
+    return config;
+}
+
+/**
+ * @brief Test saves alternate between the slots and the newest one is read back after a restart
+ */
+TEST(nvs_storage_tests, test_config_slots_alternate) {
+    nvs_storage_init();
+
+    nvs_config_t first = make_config("SlotOne", 1);
+    nvs_config_t second = make_config("SlotTwo", 2);
+    nvs_config_info_t info_first, info_second;
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_save_config(&first));
+    nvs_storage_get_config_info(&info_first);
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_save_config(&second));
+    nvs_storage_get_config_info(&info_second);
+    TEST_ASSERT_NOT_EQUAL(info_first.slot, info_second.slot);
+    TEST_ASSERT_EQUAL(info_first.sequence + 1, info_second.sequence);
+
+    nvs_storage_deinit();
+    nvs_storage_init();
+    nvs_storage_stats_t before, after;
+    nvs_storage_get_stats(&before);
+    nvs_config_t loaded;
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_load_config(&loaded));
+    nvs_storage_get_stats(&after);
+    // One blob read per slot
+    TEST_ASSERT_EQUAL(before.reads + 2, after.reads);
+    TEST_ASSERT_EQUAL_STRING("SlotTwo", loaded.wifi_ssid);
+    TEST_ASSERT_EQUAL(2, loaded.pump_mode);
+}
+
+/**
+ * @brief Test a damaged newest slot falls back to the previous configuration
+ */
+TEST(nvs_storage_tests, test_config_torn_write_falls_back) {
+    nvs_storage_init();
+
+    nvs_config_t good = make_config("Survivor", 1);
+    nvs_config_t torn = make_config("Torn", 3);
+    nvs_config_info_t info;
+    nvs_storage_save_config(&good);
+    nvs_storage_get_config_info(&info);
+    char good_slot = info.slot;
+    nvs_storage_save_config(&torn);
+    nvs_storage_get_config_info(&info);
+
+    // Cut the newest slot short, as a reset in the middle of its write would
+    const uint8_t partial[6] = {0x50, 0x43, 0x46, 0x47, 0x01, 0x00};
+    nvs_storage_save_blob(info.slot == 'A' ? NVS_KEY_CONFIG_A : NVS_KEY_CONFIG_B, partial, sizeof(partial));
+
+    nvs_storage_deinit();
+    nvs_storage_init();
+    nvs_config_t loaded;
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_load_config(&loaded));
+    nvs_storage_get_config_info(&info);
+    TEST_ASSERT_EQUAL_STRING("Survivor", loaded.wifi_ssid);
+    TEST_ASSERT_EQUAL(good_slot, info.slot);
+}
+
+/**
+ * @brief Test the individual keys of earlier firmware are imported once and then removed
+ */
+TEST(nvs_storage_tests, test_config_migrates_legacy_keys_once) {
+    nvs_storage_init();
+    nvs_storage_erase(NVS_KEY_CONFIG_A);
+    nvs_storage_erase(NVS_KEY_CONFIG_B);
+    nvs_storage_save_string(NVS_KEY_WIFI_SSID, "LegacyNet");
+    nvs_storage_save_string(NVS_KEY_WIFI_PASS, "LegacyPass");
+    nvs_storage_save_int(NVS_KEY_PUMP_MODE, 2);
+    nvs_storage_save_int("daily_runtime", 360);
+
+    nvs_storage_deinit();
+    nvs_storage_init();
+    nvs_config_t loaded;
+    nvs_config_info_t info;
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_load_config(&loaded));
+    nvs_storage_get_config_info(&info);
+    TEST_ASSERT_TRUE(info.migrated);
+    TEST_ASSERT_EQUAL(0, info.stored_version);
+    TEST_ASSERT_EQUAL_STRING("LegacyNet", loaded.wifi_ssid);
+    TEST_ASSERT_EQUAL_STRING("LegacyPass", loaded.wifi_password);
+    TEST_ASSERT_EQUAL(2, loaded.pump_mode);
+    TEST_ASSERT_EQUAL(360, loaded.daily_runtime);
+    int32_t value;
+    TEST_ASSERT_EQUAL(ESP_ERR_NVS_NOT_FOUND, nvs_storage_load_int(NVS_KEY_PUMP_MODE, &value));
+
+    nvs_storage_deinit();
+    nvs_storage_init();
+    nvs_storage_get_config_info(&info);
+    TEST_ASSERT_FALSE(info.migrated);
+    TEST_ASSERT_EQUAL(NVS_CONFIG_VERSION, info.stored_version);
+}
+
+static nvs_daily_stats_t make_day(uint32_t date, uint16_t day_minutes) {
+    nvs_daily_stats_t stats = {0};
+    stats.date = date;
+    stats.runtime_minutes[1] = day_minutes;
+    stats.energy_kwh = day_minutes * 0.0125f;
+    stats.cost_eur = stats.energy_kwh * 0.12f;
+    stats.avg_price = 0.12f;
+    stats.min_price = 0.08f;
+    stats.starts = 2;
+    return stats;
+}
+
+/**
+ * @brief Test a day round-trips through the packed record within its resolution
+ */
+TEST(nvs_storage_tests, test_daily_stats_round_trip) {
+    nvs_storage_init();
+    nvs_storage_clear_daily_stats();
+
+    nvs_daily_stats_t day = make_day(20260228, 240);
+    day.runtime_minutes[0] = 60;
+    day.min_price = -0.0123f;
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_set_daily_stats(&day));
+
+    nvs_daily_stats_t loaded;
+    size_t count = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_get_daily_stats_range(20260101, 20261231, &loaded, 1, &count));
+    TEST_ASSERT_EQUAL(1, count);
+    TEST_ASSERT_EQUAL(20260228, loaded.date);
+    TEST_ASSERT_EQUAL(60, loaded.runtime_minutes[0]);
+    TEST_ASSERT_EQUAL(240, loaded.runtime_minutes[1]);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, day.energy_kwh, loaded.energy_kwh);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, day.cost_eur, loaded.cost_eur);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, -0.0123f, loaded.min_price);
+    TEST_ASSERT_EQUAL(2, loaded.starts);
+}
+
+/**
+ * @brief Test the newest day can be rewritten but history cannot be rewritten out of order
+ */
+TEST(nvs_storage_tests, test_daily_stats_same_day_replaces) {
+    nvs_storage_init();
+    nvs_storage_clear_daily_stats();
+
+    nvs_daily_stats_t day = make_day(20260301, 100);
+    nvs_storage_set_daily_stats(&day);
+    day = make_day(20260301, 180);
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_set_daily_stats(&day));
+    day = make_day(20260302, 200);
+    nvs_storage_set_daily_stats(&day);
+    day = make_day(20260301, 50);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, nvs_storage_set_daily_stats(&day));
+
+    nvs_daily_stats_t loaded[4];
+    size_t count = 0;
+    nvs_storage_get_daily_stats_range(20260301, 20260302, loaded, 4, &count);
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(180, loaded[0].runtime_minutes[1]);
+    TEST_ASSERT_EQUAL(200, loaded[1].runtime_minutes[1]);
+}
+
+/**
+ * @brief Test days recorded under a clock that ran ahead can be dropped, so real days are accepted again
+ */
+TEST(nvs_storage_tests, test_daily_stats_drop_future) {
+    nvs_storage_init();
+    nvs_storage_clear_daily_stats();
+
+    nvs_daily_stats_t day = make_day(20260305, 100);
+    nvs_storage_set_daily_stats(&day);
+    day = make_day(20270101, 110);
+    nvs_storage_set_daily_stats(&day);
+    day = make_day(20270102, 120);
+    nvs_storage_set_daily_stats(&day);
+    day = make_day(20260306, 130);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, nvs_storage_set_daily_stats(&day));
+
+    size_t dropped = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_drop_daily_stats_after(20260306, &dropped));
+    TEST_ASSERT_EQUAL(2, dropped);
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_set_daily_stats(&day));
+
+    nvs_daily_stats_t loaded[4];
+    size_t count = 0;
+    nvs_storage_get_daily_stats_range(20260101, 20271231, loaded, 4, &count);
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(20260305, loaded[0].date);
+    TEST_ASSERT_EQUAL(20260306, loaded[1].date);
+    TEST_ASSERT_EQUAL(130, loaded[1].runtime_minutes[1]);
+}
+
+/**
+ * @brief Test a full ring drops the oldest day and range queries still see whole days only
+ */
+TEST(nvs_storage_tests, test_daily_stats_ring_wraps) {
+    nvs_storage_init();
+    nvs_storage_clear_daily_stats();
+
+    // One more day than fits, starting 2025-01-01 (2025 is not a leap year)
+    const int capacity = DAILY_STATS_CHUNKS * DAILY_STATS_CHUNK_DAYS;
+    for (int i = 0; i <= capacity; i++) {
+        int month_days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        int year = 2025, month = 0, day = 1 + i;
+        while (day > month_days[month]) {
+            day -= month_days[month];
+            if (++month == 12) {
+                month = 0;
+                year++;
+            }
+        }
+        nvs_daily_stats_t stats = make_day(year * 10000 + (month + 1) * 100 + day, 100);
+        TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_set_daily_stats(&stats));
+    }
+
+    nvs_storage_stats_t before, after;
+    nvs_storage_get_stats(&before);
+    size_t count = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_get_daily_stats_range(20250101, 20301231, NULL, 0, &count));
+    nvs_storage_get_stats(&after);
+    TEST_ASSERT_EQUAL(capacity, count);
+    // Meta plus one read per chunk at most
+    TEST_ASSERT_TRUE(after.reads - before.reads <= DAILY_STATS_CHUNKS + 1);
+
+    nvs_daily_stats_t oldest;
+    nvs_storage_get_daily_stats_range(20250101, 20250102, &oldest, 1, &count);
+    TEST_ASSERT_EQUAL(1, count);
+    TEST_ASSERT_EQUAL(20250102, oldest.date);
+}
+
+/**
+ * @brief Test range totals for telemetry
+ */
+TEST(nvs_storage_tests, test_daily_stats_sum) {
+    nvs_storage_init();
+    nvs_storage_clear_daily_stats();
+
+    nvs_daily_stats_t day = make_day(20260310, 120);
+    nvs_storage_set_daily_stats(&day);
+    day = make_day(20260311, 240);
+    day.avg_price = 0.06f;
+    day.min_price = 0.02f;
+    nvs_storage_set_daily_stats(&day);
+    day = make_day(20260320, 480);
+    nvs_storage_set_daily_stats(&day);
+
+    nvs_daily_stats_t total;
+    size_t days = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_storage_sum_daily_stats(20260301, 20260315, &total, &days));
+    TEST_ASSERT_EQUAL(2, days);
+    TEST_ASSERT_EQUAL(360, total.runtime_minutes[1]);
+    TEST_ASSERT_EQUAL(20260311, total.date);
+    TEST_ASSERT_EQUAL(4, total.starts);
+    TEST_ASSERT_FLOAT_WITHIN(0.002f, 4.5f, total.energy_kwh);
+    // Weighted by energy: (1.5 * 0.12 + 3.0 * 0.06) / 4.5
+    TEST_ASSERT_FLOAT_WITHIN(0.0005f, 0.08f, total.avg_price);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 0.02f, total.min_price);
+}
+
 // Test group runner
 TEST_GROUP_RUNNER(nvs_storage_tests) {
     RUN_TEST_CASE(nvs_storage_tests, test_init_success);
@@ -250,4 +618,15 @@ TEST_GROUP_RUNNER(nvs_storage_tests) {
     RUN_TEST_CASE(nvs_storage_tests, test_wifi_config_empty_strings);
     RUN_TEST_CASE(nvs_storage_tests, test_pump_schedule_boundary_values);
     RUN_TEST_CASE(nvs_storage_tests, test_system_settings_boundary_values);
+    RUN_TEST_CASE(nvs_storage_tests, test_pump_config_single_commit);
+    RUN_TEST_CASE(nvs_storage_tests, test_nested_batch_commits_once);
+    RUN_TEST_CASE(nvs_storage_tests, test_benchmark_load_and_write);
+    RUN_TEST_CASE(nvs_storage_tests, test_config_slots_alternate);
+    RUN_TEST_CASE(nvs_storage_tests, test_config_torn_write_falls_back);
+    RUN_TEST_CASE(nvs_storage_tests, test_config_migrates_legacy_keys_once);
+    RUN_TEST_CASE(nvs_storage_tests, test_daily_stats_round_trip);
+    RUN_TEST_CASE(nvs_storage_tests, test_daily_stats_same_day_replaces);
+    RUN_TEST_CASE(nvs_storage_tests, test_daily_stats_drop_future);
+    RUN_TEST_CASE(nvs_storage_tests, test_daily_stats_ring_wraps);
+    RUN_TEST_CASE(nvs_storage_tests, test_daily_stats_sum);
 }
\ No newline at end of file
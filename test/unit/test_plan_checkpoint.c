@@ -0,0 +1,130 @@
+/**
+ * @file test_plan_checkpoint.c
+ * @brief Unit tests for the checkpoint of the plan being executed
+ */
+
+#include "config.h"
+#include "nvs_storage.h"
+#include "pool_pump/plan_checkpoint.h"
+#include "unity.h"
+#include <string.h>
+
+#define TEST_DATE 20260601
+
+// Test group
+TEST_GROUP(plan_checkpoint_tests);
+
+// Test setup and teardown
+TEST_SETUP(plan_checkpoint_tests) {
+    nvs_storage_init();
+    nvs_storage_erase(NVS_KEY_PLAN_CHECKPOINT);
+    TEST_ASSERT_EQUAL(ESP_OK, plan_checkpoint_init(ESP_RST_POWERON));
+}
+
+TEST_TEAR_DOWN(plan_checkpoint_tests) {
+    // Clean up after each test
+}
+
+// Day mode from 10:00 to 12:00, off otherwise
+static void morning_plan(daily_plan_t *plan) {
+    memset(plan, 0, sizeof(*plan));
+    plan->date = TEST_DATE;
+    memset(&plan->mode[10 * 60 / DAILY_PLAN_SLOT_MINUTES], PUMP_MODE_DAY, 2 * 60 / DAILY_PLAN_SLOT_MINUTES);
+}
+
+/**
+ * @brief Test a soft reset resumes the planned mode from RTC memory without touching flash
+ */
+TEST(plan_checkpoint_tests, test_soft_reset_resumes_from_rtc) {
+    daily_plan_t plan;
+    morning_plan(&plan);
+    TEST_ASSERT_EQUAL(ESP_OK, plan_checkpoint_set_plan(&plan, 0x1234));
+    plan_checkpoint_mark_executed(10 * 60 + 16, PUMP_MODE_DAY);
+
+    nvs_storage_stats_t stats_before, stats_after;
+    nvs_storage_get_stats(&stats_before);
+    TEST_ASSERT_EQUAL(ESP_OK, plan_checkpoint_init(ESP_RST_TASK_WDT));
+    nvs_storage_get_stats(&stats_after);
+    TEST_ASSERT_EQUAL(stats_before.reads, stats_after.reads);
+
+    plan_checkpoint_t checkpoint;
+    TEST_ASSERT_EQUAL(ESP_OK, plan_checkpoint_get(&checkpoint));
+    TEST_ASSERT_EQUAL(PLAN_SOURCE_RTC, checkpoint.source);
+    TEST_ASSERT_EQUAL(0x1234, checkpoint.price_version);
+    TEST_ASSERT_EQUAL(41, checkpoint.position);
+    TEST_ASSERT_EQUAL(PUMP_MODE_DAY, checkpoint.mode);
+    TEST_ASSERT_EQUAL(PUMP_MODE_DAY, plan_checkpoint_resume_mode(TEST_DATE, 10 * 60 + 20));
+    TEST_ASSERT_EQUAL(PUMP_MODE_OFF, plan_checkpoint_resume_mode(TEST_DATE, 12 * 60));
+}
+
+/**
+ * @brief Test after power loss the plan and the last mode change come back from NVS
+ */
+TEST(plan_checkpoint_tests, test_power_loss_resumes_from_nvs) {
+    daily_plan_t plan;
+    morning_plan(&plan);
+    TEST_ASSERT_EQUAL(ESP_OK, plan_checkpoint_set_plan(&plan, 0x1234));
+    plan_checkpoint_mark_executed(10 * 60, PUMP_MODE_DAY);
+
+    TEST_ASSERT_EQUAL(ESP_OK, plan_checkpoint_init(ESP_RST_POWERON));
+
+    plan_checkpoint_t checkpoint;
+    TEST_ASSERT_EQUAL(ESP_OK, plan_checkpoint_get(&checkpoint));
+    TEST_ASSERT_EQUAL(PLAN_SOURCE_NVS, checkpoint.source);
+    TEST_ASSERT_EQUAL_MEMORY(&plan, &checkpoint.plan, sizeof(plan));
+    TEST_ASSERT_EQUAL(PUMP_MODE_DAY, checkpoint.mode);
+    TEST_ASSERT_EQUAL(PUMP_MODE_DAY, plan_checkpoint_resume_mode(TEST_DATE, 11 * 60));
+}
+
+/**
+ * @brief Test NVS is written for a new plan and a mode change, not for every executed slot
+ */
+TEST(plan_checkpoint_tests, test_flash_writes_on_changes_only) {
+    daily_plan_t plan;
+    morning_plan(&plan);
+    nvs_storage_stats_t before, after;
+    nvs_storage_get_stats(&before);
+
+    TEST_ASSERT_EQUAL(ESP_OK, plan_checkpoint_set_plan(&plan, 0x1234));
+    TEST_ASSERT_EQUAL(ESP_OK, plan_checkpoint_set_plan(&plan, 0x1234));
+    for (int minute = 9 * 60; minute < 13 * 60; minute++) {
+        plan_checkpoint_mark_executed(minute, daily_plan_mode_at(&plan, minute));
+    }
+
+    // The plan, then the switch to day and back to off
+    nvs_storage_get_stats(&after);
+    TEST_ASSERT_EQUAL(before.writes + 3, after.writes);
+}
+
+/**
+ * @brief Test resuming without a set clock, for another day and from price snapshots
+ */
+TEST(plan_checkpoint_tests, test_resume_without_clock_or_plan) {
+    TEST_ASSERT_EQUAL(PUMP_MODE_OFF, plan_checkpoint_resume_mode(19700101, 0));
+
+    daily_plan_t plan;
+    morning_plan(&plan);
+    TEST_ASSERT_EQUAL(ESP_OK, plan_checkpoint_set_plan(&plan, 0x1234));
+    plan_checkpoint_mark_executed(11 * 60, PUMP_MODE_DAY);
+
+    // The position in the plan is unknown, so whatever was running carries on
+    TEST_ASSERT_EQUAL(PUMP_MODE_DAY, plan_checkpoint_resume_mode(19700101, 0));
+    TEST_ASSERT_EQUAL(PUMP_MODE_OFF, plan_checkpoint_resume_mode(TEST_DATE + 1, 11 * 60));
+
+    price_data_t prices[24] = {0};
+    TEST_ASSERT_EQUAL(0, plan_checkpoint_price_version(prices));
+    prices[5].price_eur_kwh = 0.12f;
+    uint32_t version = plan_checkpoint_price_version(prices);
+    TEST_ASSERT_NOT_EQUAL(0, version);
+    TEST_ASSERT_EQUAL(version, plan_checkpoint_price_version(prices));
+    prices[6].price_eur_kwh = 0.13f;
+    TEST_ASSERT_NOT_EQUAL(version, plan_checkpoint_price_version(prices));
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(plan_checkpoint_tests) {
+    RUN_TEST_CASE(plan_checkpoint_tests, test_soft_reset_resumes_from_rtc);
+    RUN_TEST_CASE(plan_checkpoint_tests, test_power_loss_resumes_from_nvs);
+    RUN_TEST_CASE(plan_checkpoint_tests, test_flash_writes_on_changes_only);
+    RUN_TEST_CASE(plan_checkpoint_tests, test_resume_without_clock_or_plan);
+}
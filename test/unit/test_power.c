@@ -0,0 +1,65 @@
+/**
+ * @file test_power.c
+ * @brief Unit tests for the power management locks and their accounting
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "pool_pump/power.h"
+#include "unity.h"
+
+// Test group
+TEST_GROUP(power_tests);
+
+// Test setup and teardown
+TEST_SETUP(power_tests) { TEST_ASSERT_EQUAL(ESP_OK, power_init()); }
+
+TEST_TEAR_DOWN(power_tests) {
+    // Clean up after each test
+}
+
+/**
+ * @brief Test nested holders keep a lock held until the last release, and the time is counted once
+ */
+TEST(power_tests, test_nested_holds_counted_once) {
+    power_stats_t before, after;
+    TEST_ASSERT_EQUAL(ESP_OK, power_get_stats(&before));
+
+    power_lock_acquire(POWER_LOCK_CPU_MAX);
+    power_lock_acquire(POWER_LOCK_CPU_MAX);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    power_lock_release(POWER_LOCK_CPU_MAX);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    power_lock_release(POWER_LOCK_CPU_MAX);
+
+    TEST_ASSERT_EQUAL(ESP_OK, power_get_stats(&after));
+    TEST_ASSERT_EQUAL(before.acquires[POWER_LOCK_CPU_MAX] + 2, after.acquires[POWER_LOCK_CPU_MAX]);
+    uint64_t held_ms = (after.held_us[POWER_LOCK_CPU_MAX] - before.held_us[POWER_LOCK_CPU_MAX]) / 1000;
+    TEST_ASSERT_INT_WITHIN(30, 200, held_ms);
+    TEST_ASSERT_EQUAL(before.held_us[POWER_LOCK_NO_SLEEP], after.held_us[POWER_LOCK_NO_SLEEP]);
+}
+
+/**
+ * @brief Test an unmatched release is ignored and the statistics cover the time since init
+ */
+TEST(power_tests, test_unmatched_release_ignored) {
+    power_stats_t before, after;
+    TEST_ASSERT_EQUAL(ESP_OK, power_get_stats(&before));
+
+    power_lock_release(POWER_LOCK_NO_SLEEP);
+    power_lock_release(POWER_LOCK_COUNT);
+    vTaskDelay(pdMS_TO_TICKS(50));
+
+    TEST_ASSERT_EQUAL(ESP_OK, power_get_stats(&after));
+    TEST_ASSERT_EQUAL(before.held_us[POWER_LOCK_NO_SLEEP], after.held_us[POWER_LOCK_NO_SLEEP]);
+    TEST_ASSERT_EQUAL(before.acquires[POWER_LOCK_NO_SLEEP], after.acquires[POWER_LOCK_NO_SLEEP]);
+    TEST_ASSERT_TRUE(after.period_us >= before.period_us + 50000);
+    TEST_ASSERT_TRUE(after.period_us >= after.held_us[POWER_LOCK_CPU_MAX]);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, power_get_stats(NULL));
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(power_tests) {
+    RUN_TEST_CASE(power_tests, test_nested_holds_counted_once);
+    RUN_TEST_CASE(power_tests, test_unmatched_release_ignored);
+}
@@ -0,0 +1,168 @@
+/**
+ * @file test_price_archive.c
+ * @brief Unit tests for the delta-encoded price history archive
+ */
+
+#include "pool_pump/price_archive.h"
+#include "unity.h"
+#include <math.h>
+#include <time.h>
+
+// Test group
+TEST_GROUP(price_archive_tests);
+
+// Test setup and teardown
+TEST_SETUP(price_archive_tests) {
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_init());
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_clear());
+}
+
+TEST_TEAR_DOWN(price_archive_tests) {
+    // Clean up after each test
+}
+
+// YYYYMMDD of the day the given number of days after 2024-01-01
+static uint32_t date_after(int days) {
+    struct tm tm = {.tm_year = 2024 - 1900, .tm_mon = 0, .tm_mday = 1 + days, .tm_hour = 12};
+    mktime(&tm);
+    return (tm.tm_year + 1900) * 10000 + (tm.tm_mon + 1) * 100 + tm.tm_mday;
+}
+
+// A daily curve with a morning and an evening peak that drifts from day to day
+static void typical_day(int day, price_data_t prices[24]) {
+    for (int hour = 0; hour < 24; hour++) {
+        float peaks = 0.08f * expf(-(hour - 8) * (hour - 8) / 4.0f) + 0.12f * expf(-(hour - 18) * (hour - 18) / 6.0f);
+        prices[hour].hour = hour;
+        prices[hour].price_eur_kwh = 0.06f + 0.04f * sinf(day * 0.05f) + peaks;
+    }
+}
+
+/**
+ * @brief Test prices read back within the archive resolution, including negative prices and spikes
+ */
+TEST(price_archive_tests, test_round_trip) {
+    price_data_t prices[24];
+    typical_day(0, prices);
+    prices[3].price_eur_kwh = -0.015f;
+    prices[4].price_eur_kwh = 2.5f;
+    prices[5].price_eur_kwh = 0.0f;
+
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_append(20240301, prices));
+
+    price_data_t loaded[24];
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_get_day(20240301, loaded));
+    for (int hour = 0; hour < 24; hour++) {
+        TEST_ASSERT_EQUAL(hour, loaded[hour].hour);
+        TEST_ASSERT_FLOAT_WITHIN(0.0006f, prices[hour].price_eur_kwh, loaded[hour].price_eur_kwh);
+    }
+}
+
+/**
+ * @brief Test days are append-only: a repeat with the same prices is accepted, anything else refused
+ */
+TEST(price_archive_tests, test_append_only) {
+    price_data_t prices[24];
+    typical_day(1, prices);
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_append(20240302, prices));
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_append(20240302, prices));
+
+    prices[12].price_eur_kwh += 0.05f;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, price_archive_append(20240302, prices));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, price_archive_append(20240301, prices));
+
+    price_data_t loaded[24];
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, price_archive_get_day(20240301, loaded));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, price_archive_get_day(20240303, loaded));
+}
+
+/**
+ * @brief Test days archived under a clock that ran ahead can be dropped and the real days archived after them
+ */
+TEST(price_archive_tests, test_drop_future_days) {
+    price_data_t prices[24];
+    typical_day(0, prices);
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_append(20240301, prices));
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_append(20240305, prices));
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_append(20250101, prices)); // Outside the first block
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, price_archive_append(20240302, prices));
+
+    size_t dropped = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_drop_after(20240302, &dropped));
+    TEST_ASSERT_EQUAL(2, dropped);
+
+    price_data_t loaded[24];
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, price_archive_get_day(20240305, loaded));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, price_archive_get_day(20250101, loaded));
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_get_day(20240301, loaded));
+
+    typical_day(1, prices);
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_append(20240302, prices));
+    // The dropped day's offset slot is spent, so it goes to a new block
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_append(20240305, prices));
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_get_day(20240305, loaded));
+    TEST_ASSERT_FLOAT_WITHIN(0.0006f, prices[12].price_eur_kwh, loaded[12].price_eur_kwh);
+
+    price_archive_info_t info;
+    price_archive_get_info(&info);
+    TEST_ASSERT_EQUAL(3, info.days);
+    TEST_ASSERT_EQUAL(20240305, info.last_date);
+}
+
+/**
+ * @brief Test a year of hourly prices, with a gap, fits in well under 32 KB
+ */
+TEST(price_archive_tests, test_year_fits) {
+    price_data_t prices[24];
+    for (int day = 0; day < 366; day++) {
+        if (day == 100) continue; // Offline that day
+        typical_day(day, prices);
+        TEST_ASSERT_EQUAL(ESP_OK, price_archive_append(date_after(day), prices));
+    }
+
+    price_archive_info_t info;
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_get_info(&info));
+    TEST_ASSERT_EQUAL(365, info.days);
+    TEST_ASSERT_EQUAL(20240101, info.first_date);
+    TEST_ASSERT_EQUAL(date_after(365), info.last_date);
+    TEST_ASSERT_LESS_THAN(16 * 1024, info.bytes_used);
+
+    price_data_t loaded[24];
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, price_archive_get_day(date_after(100), loaded));
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_get_day(date_after(200), loaded));
+    typical_day(200, prices);
+    TEST_ASSERT_FLOAT_WITHIN(0.0006f, prices[18].price_eur_kwh, loaded[18].price_eur_kwh);
+}
+
+/**
+ * @brief Test a full archive drops its oldest block of days and keeps appending
+ */
+TEST(price_archive_tests, test_full_archive_drops_oldest) {
+    price_data_t prices[24];
+    price_archive_info_t info;
+    int day = 0;
+    // Hour-to-hour swings of 10 EUR/kWh take the largest records, so the archive fills in months
+    do {
+        for (int hour = 0; hour < 24; hour++) {
+            prices[hour].price_eur_kwh = (hour + day) % 2 ? 10.0f : -10.0f;
+        }
+        TEST_ASSERT_EQUAL(ESP_OK, price_archive_append(date_after(day++), prices));
+        TEST_ASSERT_EQUAL(ESP_OK, price_archive_get_info(&info));
+    } while (info.first_date == 20240101 && day < 2000);
+
+    TEST_ASSERT_NOT_EQUAL(20240101, info.first_date);
+    TEST_ASSERT_EQUAL(date_after(day - 1), info.last_date);
+
+    price_data_t loaded[24];
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, price_archive_get_day(20240101, loaded));
+    TEST_ASSERT_EQUAL(ESP_OK, price_archive_get_day(date_after(day - 1), loaded));
+    TEST_ASSERT_FLOAT_WITHIN(0.0006f, prices[0].price_eur_kwh, loaded[0].price_eur_kwh);
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(price_archive_tests) {
+    RUN_TEST_CASE(price_archive_tests, test_round_trip);
+    RUN_TEST_CASE(price_archive_tests, test_append_only);
+    RUN_TEST_CASE(price_archive_tests, test_drop_future_days);
+    RUN_TEST_CASE(price_archive_tests, test_year_fits);
+    RUN_TEST_CASE(price_archive_tests, test_full_archive_drops_oldest);
+}
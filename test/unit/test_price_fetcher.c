@@ -3,11 +3,41 @@
  * @brief Unit tests for price fetcher component
  */
 
+#include "config.h"
+#include "esp_heap_caps.h"
 #include "mock_esp_http_client.h"
 #include "price_fetcher.h"
 #include "unity.h"
+#include <stdio.h>
 #include <string.h>
 
+static char response[2048];
+static int response_len;
+
+// A 200 response with one record per price, in hour order
+static void set_day_response(const float *day, int hours) {
+    response_len = snprintf(response, sizeof(response), "{\"records\": [");
+    for (int i = 0; i < hours; i++) {
+        response_len += snprintf(response + response_len,
+                                 sizeof(response) - response_len,
+                                 "%s{\"SpotPriceEUR\": %.3f}",
+                                 i > 0 ? "," : "",
+                                 day[i]);
+    }
+    response_len += snprintf(response + response_len, sizeof(response) - response_len, "]}");
+    mock_http_client_set_response_data(response, response_len);
+    mock_http_client_set_status_code(200);
+    mock_http_client_set_content_length(response_len);
+}
+
+static void set_flat_day(float price, int hours) {
+    float day[24];
+    for (int i = 0; i < 24; i++) {
+        day[i] = price;
+    }
+    set_day_response(day, hours);
+}
+
 // Test group
 TEST_GROUP(price_fetcher_tests);
 
@@ -30,18 +60,14 @@ TEST(price_fetcher_tests, test_init_success) {
  * @brief Test fetching today's prices with valid JSON response
  */
 TEST(price_fetcher_tests, test_get_today_prices_success) {
-    // Mock JSON response with price data
-    const char *mock_json = "{"
-                            "\"records\": ["
-                            "{\"SpotPriceEUR\": 0.123},"
-                            "{\"SpotPriceEUR\": 0.145},"
-                            "{\"SpotPriceEUR\": 0.089}"
-                            "]"
-                            "}";
-
-    mock_http_client_set_response_data(mock_json, strlen(mock_json));
-    mock_http_client_set_status_code(200);
-    mock_http_client_set_content_length(strlen(mock_json));
+    float day[24];
+    for (int i = 0; i < 24; i++) {
+        day[i] = 0.100f + 0.001f * i;
+    }
+    day[0] = 0.123f;
+    day[1] = 0.145f;
+    day[2] = 0.089f;
+    set_day_response(day, 24);
 
     price_data_t prices[24];
     esp_err_t result = price_fetcher_get_today_prices(prices);
@@ -57,11 +83,17 @@ TEST(price_fetcher_tests, test_get_today_prices_success) {
  * @brief Test fetching prices with HTTP error
  */
 TEST(price_fetcher_tests, test_get_today_prices_http_error) {
-    mock_http_client_set_status_code(404);
-
+    set_flat_day(0.08f, 24);
     price_data_t prices[24];
+    TEST_ASSERT_EQUAL(ESP_OK, price_fetcher_get_today_prices(prices));
+
+    // A full body with an error status is not a price list
+    set_flat_day(0.25f, 24);
+    mock_http_client_set_status_code(404);
     esp_err_t result = price_fetcher_get_today_prices(prices);
-    TEST_ASSERT_NOT_EQUAL(ESP_OK, result);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, result);
+    TEST_ASSERT_EQUAL_FLOAT(0.08f, prices[0].price_eur_kwh);
+    TEST_ASSERT_EQUAL_FLOAT(0.08f, price_fetcher_get_current_price());
 }
 
 /**
@@ -71,16 +103,18 @@ TEST(price_fetcher_tests, test_get_today_prices_invalid_json) {
     const char *invalid_json = "{ invalid json }";
     mock_http_client_set_response_data(invalid_json, strlen(invalid_json));
     mock_http_client_set_status_code(200);
+    mock_http_client_set_content_length(strlen(invalid_json));
 
     price_data_t prices[24];
     esp_err_t result = price_fetcher_get_today_prices(prices);
-    TEST_ASSERT_EQUAL(ESP_OK, result); // HTTP request succeeds, but parsing might fail
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, result); // HTTP request succeeds, but parsing fails
 }
 
 /**
  * @brief Test getting current price when no data is available
  */
 TEST(price_fetcher_tests, test_get_current_price_no_data) {
+    price_fetcher_init();
     float price = price_fetcher_get_current_price();
     TEST_ASSERT_EQUAL_FLOAT(0.0f, price);
 }
@@ -89,18 +123,10 @@ TEST(price_fetcher_tests, test_get_current_price_no_data) {
  * @brief Test low price period detection with high price
  */
 TEST(price_fetcher_tests, test_is_low_price_period_high_price) {
-    // Mock high price data
-    const char *mock_json = "{"
-                            "\"records\": ["
-                            "{\"SpotPriceEUR\": 0.25}" // Above threshold
-                            "]"
-                            "}";
-
-    mock_http_client_set_response_data(mock_json, strlen(mock_json));
-    mock_http_client_set_status_code(200);
+    set_flat_day(0.25f, 24); // Above threshold
 
     price_data_t prices[24];
-    price_fetcher_get_today_prices(prices);
+    TEST_ASSERT_EQUAL(ESP_OK, price_fetcher_get_today_prices(prices));
 
     bool is_low = price_fetcher_is_low_price_period();
     TEST_ASSERT_FALSE(is_low);
@@ -110,18 +136,10 @@ TEST(price_fetcher_tests, test_is_low_price_period_high_price) {
  * @brief Test low price period detection with low price
  */
 TEST(price_fetcher_tests, test_is_low_price_period_low_price) {
-    // Mock low price data
-    const char *mock_json = "{"
-                            "\"records\": ["
-                            "{\"SpotPriceEUR\": 0.08}" // Below threshold
-                            "]"
-                            "}";
-
-    mock_http_client_set_response_data(mock_json, strlen(mock_json));
-    mock_http_client_set_status_code(200);
+    set_flat_day(0.08f, 24); // Below threshold
 
     price_data_t prices[24];
-    price_fetcher_get_today_prices(prices);
+    TEST_ASSERT_EQUAL(ESP_OK, price_fetcher_get_today_prices(prices));
 
     bool is_low = price_fetcher_is_low_price_period();
     TEST_ASSERT_TRUE(is_low);
@@ -131,18 +149,10 @@ TEST(price_fetcher_tests, test_is_low_price_period_low_price) {
  * @brief Test low price period detection with zero price
  */
 TEST(price_fetcher_tests, test_is_low_price_period_zero_price) {
-    // Mock zero price data
-    const char *mock_json = "{"
-                            "\"records\": ["
-                            "{\"SpotPriceEUR\": 0.0}"
-                            "]"
-                            "}";
-
-    mock_http_client_set_response_data(mock_json, strlen(mock_json));
-    mock_http_client_set_status_code(200);
+    set_flat_day(0.0f, 24);
 
     price_data_t prices[24];
-    price_fetcher_get_today_prices(prices);
+    TEST_ASSERT_EQUAL(ESP_OK, price_fetcher_get_today_prices(prices));
 
     bool is_low = price_fetcher_is_low_price_period();
     TEST_ASSERT_FALSE(is_low); // Zero price is not considered low
@@ -152,11 +162,11 @@ TEST(price_fetcher_tests, test_is_low_price_period_zero_price) {
  * @brief Test price data structure initialization
  */
 TEST(price_fetcher_tests, test_price_data_initialization) {
+    set_flat_day(0.10f, 24);
     price_data_t prices[24];
+    TEST_ASSERT_EQUAL(ESP_OK, price_fetcher_get_today_prices(prices));
 
-    // Initially all prices should be 0
     for (int i = 0; i < 24; i++) {
-        TEST_ASSERT_EQUAL_FLOAT(0.0f, prices[i].price_eur_kwh);
         TEST_ASSERT_EQUAL(i, prices[i].hour);
     }
 }
@@ -165,35 +175,102 @@ TEST(price_fetcher_tests, test_price_data_initialization) {
  * @brief Test multiple price records parsing
  */
 TEST(price_fetcher_tests, test_multiple_price_records) {
-    // Mock JSON with 5 price records
-    const char *mock_json = "{"
-                            "\"records\": ["
-                            "{\"SpotPriceEUR\": 0.10},"
-                            "{\"SpotPriceEUR\": 0.12},"
-                            "{\"SpotPriceEUR\": 0.08},"
-                            "{\"SpotPriceEUR\": 0.15},"
-                            "{\"SpotPriceEUR\": 0.09}"
-                            "]"
-                            "}";
-
-    mock_http_client_set_response_data(mock_json, strlen(mock_json));
-    mock_http_client_set_status_code(200);
+    float day[24];
+    for (int i = 0; i < 24; i++) {
+        day[i] = 0.05f + 0.01f * i;
+    }
+    set_day_response(day, 24);
 
     price_data_t prices[24];
     esp_err_t result = price_fetcher_get_today_prices(prices);
     TEST_ASSERT_EQUAL(ESP_OK, result);
 
     // Check all parsed prices
-    TEST_ASSERT_EQUAL_FLOAT(0.10f, prices[0].price_eur_kwh);
-    TEST_ASSERT_EQUAL_FLOAT(0.12f, prices[1].price_eur_kwh);
-    TEST_ASSERT_EQUAL_FLOAT(0.08f, prices[2].price_eur_kwh);
-    TEST_ASSERT_EQUAL_FLOAT(0.15f, prices[3].price_eur_kwh);
-    TEST_ASSERT_EQUAL_FLOAT(0.09f, prices[4].price_eur_kwh);
-
-    // Remaining hours should be 0
-    for (int i = 5; i < 24; i++) {
-        TEST_ASSERT_EQUAL_FLOAT(0.0f, prices[i].price_eur_kwh);
+    for (int i = 0; i < 24; i++) {
+        TEST_ASSERT_EQUAL_FLOAT(day[i], prices[i].price_eur_kwh);
+    }
+}
+
+/**
+ * @brief Test a response that prices only part of the day fails and keeps the published prices
+ */
+TEST(price_fetcher_tests, test_partial_day_rejected) {
+    set_flat_day(0.08f, 24);
+    price_data_t prices[24];
+    TEST_ASSERT_EQUAL(ESP_OK, price_fetcher_get_today_prices(prices));
+
+    set_flat_day(0.25f, 5);
+    price_data_t fetched[24] = {0};
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, price_fetcher_get_today_prices(fetched));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, fetched[0].price_eur_kwh);
+    TEST_ASSERT_EQUAL_FLOAT(0.08f, price_fetcher_get_current_price());
+
+    // Records without a numeric price leave their hour unpriced
+    const char *no_prices = "{\"records\": [{\"SpotPriceEUR\": \"n/a\"}]}";
+    mock_http_client_set_response_data(no_prices, strlen(no_prices));
+    mock_http_client_set_content_length(strlen(no_prices));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, price_fetcher_get_today_prices(fetched));
+    TEST_ASSERT_EQUAL_FLOAT(0.08f, price_fetcher_get_current_price());
+}
+
+/**
+ * @brief Test a response too big for the fetch arena fails and keeps the published prices
+ */
+TEST(price_fetcher_tests, test_oversized_response_rejected) {
+    set_flat_day(0.08f, 24);
+    price_data_t prices[24];
+    TEST_ASSERT_EQUAL(ESP_OK, price_fetcher_get_today_prices(prices));
+
+    set_flat_day(0.25f, 24);
+    mock_http_client_set_content_length(PRICE_FETCH_ARENA_BYTES);
+    price_data_t fetched[24] = {0};
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, price_fetcher_get_today_prices(fetched));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, fetched[0].price_eur_kwh);
+    TEST_ASSERT_EQUAL_FLOAT(0.08f, price_fetcher_get_current_price());
+}
+
+/**
+ * @brief Test prices published without a fetch, as from the archive after a reset, are the current ones
+ */
+TEST(price_fetcher_tests, test_set_today_prices_publishes) {
+    price_fetcher_init();
+    price_data_t prices[24];
+    for (int i = 0; i < 24; i++) {
+        prices[i].hour = 0; // Not trusted: the hour is the index
+        prices[i].price_eur_kwh = 0.07f;
+    }
+    price_fetcher_set_today_prices(prices);
+    TEST_ASSERT_EQUAL_FLOAT(0.07f, price_fetcher_get_current_price());
+    TEST_ASSERT_TRUE(price_fetcher_is_low_price_period());
+}
+
+/**
+ * @brief Test a fetch builds its response and JSON tree in the arena and leaves the heap as it found it
+ */
+TEST(price_fetcher_tests, test_fetch_leaves_heap_unchanged) {
+    float day[24];
+    for (int i = 0; i < 24; i++) {
+        day[i] = 0.100f;
     }
+    day[2] = 0.089f;
+    set_day_response(day, 24);
+
+    // Logging and the clock may set up state of their own on first use
+    price_data_t prices[24];
+    TEST_ASSERT_EQUAL(ESP_OK, price_fetcher_get_today_prices(prices));
+
+    arena_t before, after;
+    TEST_ASSERT_EQUAL(ESP_OK, price_fetcher_get_arena_stats(&before));
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    TEST_ASSERT_EQUAL(ESP_OK, price_fetcher_get_today_prices(prices));
+    TEST_ASSERT_EQUAL(free_before, heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
+
+    TEST_ASSERT_EQUAL(ESP_OK, price_fetcher_get_arena_stats(&after));
+    TEST_ASSERT_EQUAL(0, after.used); // Rewound for the next fetch
+    TEST_ASSERT_TRUE(after.peak > (size_t)response_len);
+    TEST_ASSERT_EQUAL(before.failures, after.failures);
+    TEST_ASSERT_EQUAL_FLOAT(0.089f, prices[2].price_eur_kwh);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, price_fetcher_get_arena_stats(NULL));
 }
 
 // Test group runner
@@ -208,4 +285,8 @@ TEST_GROUP_RUNNER(price_fetcher_tests) {
     RUN_TEST_CASE(price_fetcher_tests, test_is_low_price_period_zero_price);
     RUN_TEST_CASE(price_fetcher_tests, test_price_data_initialization);
     RUN_TEST_CASE(price_fetcher_tests, test_multiple_price_records);
+    RUN_TEST_CASE(price_fetcher_tests, test_partial_day_rejected);
+    RUN_TEST_CASE(price_fetcher_tests, test_oversized_response_rejected);
+    RUN_TEST_CASE(price_fetcher_tests, test_set_today_prices_publishes);
+    RUN_TEST_CASE(price_fetcher_tests, test_fetch_leaves_heap_unchanged);
 }
\ No newline at end of file
@@ -3,7 +3,9 @@
  * @brief Unit tests for relay control component
  */
 
+#include "config.h"
 #include "mock_driver_gpio.h"
+#include "mock_relay_output.h"
 #include "relay_control.h"
 #include "unity.h"
 #include <string.h>
@@ -12,7 +14,10 @@
 TEST_GROUP(relay_control_tests);
 
 // Test setup and teardown
-TEST_SETUP(relay_control_tests) { mock_gpio_reset(); }
+TEST_SETUP(relay_control_tests) {
+    mock_gpio_reset();
+    mock_relay_output_reset();
+}
 
 TEST_TEAR_DOWN(relay_control_tests) {
     // Clean up after each test
@@ -177,6 +182,166 @@ TEST(relay_control_tests, test_invalid_pump_mode) {
     TEST_ASSERT_NOT_EQUAL(ESP_OK, result);
 }
 
+/**
+ * @brief Test commanded mask tracks relay state
+ */
+TEST(relay_control_tests, test_commanded_mask) {
+    relay_control_all_off();
+    relay_control_set(RELAY_1, true);
+    relay_control_set(RELAY_3, true);
+    TEST_ASSERT_EQUAL_HEX32((1 << RELAY_1) | (1 << RELAY_3), relay_control_get_mask());
+
+    relay_control_all_off();
+    TEST_ASSERT_EQUAL_HEX32(0, relay_control_get_mask());
+}
+
+/**
+ * @brief Test verification stats with NULL pointer
+ */
+TEST(relay_control_tests, test_verify_stats_null_pointer) {
+    esp_err_t result = relay_control_get_verify_stats(NULL);
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, result);
+}
+
+/**
+ * @brief Test verification rejects a zero period
+ */
+TEST(relay_control_tests, test_verification_zero_period) {
+    esp_err_t result = relay_control_start_verification(0);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, result);
+}
+
+/**
+ * @brief Test a mode change is one break and one make transaction on the backend
+ */
+TEST(relay_control_tests, test_pump_mode_batched_writes) {
+    relay_output_backend_t backend;
+    mock_relay_output_create(&backend, 16, true);
+    TEST_ASSERT_EQUAL(ESP_OK, relay_control_set_backend(&backend));
+    TEST_ASSERT_EQUAL(ESP_OK, relay_control_init());
+    TEST_ASSERT_EQUAL(16, relay_control_get_channel_count());
+
+    relay_control_set(RELAY_4, true);
+    uint32_t writes = mock_relay_output_get_write_count();
+
+    TEST_ASSERT_EQUAL(ESP_OK, relay_control_set_pump_mode(2));
+    TEST_ASSERT_EQUAL(writes + 2, mock_relay_output_get_write_count());
+    TEST_ASSERT_EQUAL_HEX32((1 << RELAY_2) | (1 << RELAY_4), mock_relay_output_get_mask());
+}
+
+/**
+ * @brief Test several relays change in a single transaction, including expander-only channels
+ */
+TEST(relay_control_tests, test_update_mask_single_write) {
+    relay_output_backend_t backend;
+    mock_relay_output_create(&backend, 16, true);
+    relay_control_set_backend(&backend);
+    relay_control_init();
+    uint32_t writes = mock_relay_output_get_write_count();
+
+    TEST_ASSERT_EQUAL(ESP_OK, relay_control_update_mask(0, 0x8003));
+    TEST_ASSERT_EQUAL(writes + 1, mock_relay_output_get_write_count());
+    TEST_ASSERT_EQUAL_HEX32(0x8003, mock_relay_output_get_mask());
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, relay_control_update_mask(0, 0x10000));
+
+    // A failed bus write leaves the commanded state untouched
+    mock_relay_output_set_write_error(ESP_FAIL);
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, relay_control_set(RELAY_3, true));
+    TEST_ASSERT_EQUAL_HEX32(0x8003, relay_control_get_mask());
+}
+
+/**
+ * @brief Test readback through the backend detects a stuck output
+ */
+TEST(relay_control_tests, test_backend_readback_mismatch) {
+    relay_output_backend_t backend;
+    mock_relay_output_create(&backend, 8, true);
+    relay_control_set_backend(&backend);
+    relay_control_init();
+
+    relay_control_set(RELAY_2, true);
+    TEST_ASSERT_EQUAL(ESP_OK, relay_control_verify_now());
+
+    mock_relay_output_set_stuck(0, 1 << RELAY_2);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, relay_control_verify_now());
+}
+
+/**
+ * @brief Test a mismatch that persists for the confirm count raises one stuck fault, which clears once readback matches
+ */
+TEST(relay_control_tests, test_stuck_fault_raised_and_cleared) {
+    relay_output_backend_t backend;
+    mock_relay_output_create(&backend, 8, true);
+    relay_control_set_backend(&backend);
+    relay_control_init();
+    relay_control_set(RELAY_1, true);
+    TEST_ASSERT_EQUAL(ESP_OK, relay_control_verify_now()); // Starts from a clean streak
+
+    relay_verify_stats_t before, stats;
+    relay_control_get_verify_stats(&before);
+    TEST_ASSERT_FALSE(before.fault_active);
+
+    mock_relay_output_set_stuck(0, 1 << RELAY_1);
+    for (int i = 0; i < RELAY_VERIFY_CONFIRM_SAMPLES - 1; i++) {
+        TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, relay_control_verify_now());
+    }
+    relay_control_get_verify_stats(&stats);
+    TEST_ASSERT_EQUAL(before.stuck_faults, stats.stuck_faults);
+    TEST_ASSERT_FALSE(stats.fault_active);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, relay_control_verify_now());
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, relay_control_verify_now()); // Raised once per streak
+    relay_control_get_verify_stats(&stats);
+    TEST_ASSERT_EQUAL(before.stuck_faults + 1, stats.stuck_faults);
+    TEST_ASSERT_EQUAL(before.mismatches + RELAY_VERIFY_CONFIRM_SAMPLES + 1, stats.mismatches);
+    TEST_ASSERT_TRUE(stats.fault_active);
+    TEST_ASSERT_EQUAL_HEX32(0, stats.last_actual_mask);
+
+    mock_relay_output_set_stuck(0, 0);
+    TEST_ASSERT_EQUAL(ESP_OK, relay_control_verify_now());
+    relay_control_get_verify_stats(&stats);
+    TEST_ASSERT_FALSE(stats.fault_active);
+    TEST_ASSERT_EQUAL(before.stuck_faults + 1, stats.stuck_faults);
+    TEST_ASSERT_EQUAL_HEX32(1 << RELAY_1, stats.last_actual_mask);
+}
+
+/**
+ * @brief Test verification is refused on a backend without readback
+ */
+TEST(relay_control_tests, test_verification_without_readback) {
+    relay_output_backend_t backend;
+    mock_relay_output_create(&backend, 8, false);
+    relay_control_set_backend(&backend);
+    relay_control_init();
+
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, relay_control_start_verification(1000));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, relay_control_verify_now());
+}
+
+/**
+ * @brief Test a restore after a restart drives the known state first and never passes through all off
+ */
+TEST(relay_control_tests, test_restore_keeps_relays_through_restart) {
+    relay_output_backend_t backend;
+    mock_relay_output_create(&backend, 8, true);
+    relay_control_set_backend(&backend);
+    relay_control_init();
+    relay_control_update_mask(0, 1 << RELAY_2);
+
+    // Outputs that kept their levels through the reset stay where they are
+    uint32_t changes = mock_relay_output_get_change_count();
+    TEST_ASSERT_EQUAL(ESP_OK, relay_control_restore(1 << RELAY_2));
+    TEST_ASSERT_EQUAL(changes, mock_relay_output_get_change_count());
+    TEST_ASSERT_EQUAL_HEX32(1 << RELAY_2, relay_control_get_mask());
+
+    // Held ones switch to a new state in one step as the hold is released
+    TEST_ASSERT_EQUAL(ESP_OK, relay_control_hold());
+    TEST_ASSERT_EQUAL(ESP_OK, relay_control_restore(1 << RELAY_1));
+    TEST_ASSERT_FALSE(mock_relay_output_is_held());
+    TEST_ASSERT_EQUAL(changes + 1, mock_relay_output_get_change_count());
+    TEST_ASSERT_EQUAL_HEX32(1 << RELAY_1, mock_relay_output_get_mask());
+}
+
 // Test group runner
 TEST_GROUP_RUNNER(relay_control_tests) {
     RUN_TEST_CASE(relay_control_tests, test_init_success);
@@ -190,4 +355,13 @@ TEST_GROUP_RUNNER(relay_control_tests) {
     RUN_TEST_CASE(relay_control_tests, test_pump_mode_day);
     RUN_TEST_CASE(relay_control_tests, test_pump_mode_backwash);
     RUN_TEST_CASE(relay_control_tests, test_invalid_pump_mode);
+    RUN_TEST_CASE(relay_control_tests, test_commanded_mask);
+    RUN_TEST_CASE(relay_control_tests, test_verify_stats_null_pointer);
+    RUN_TEST_CASE(relay_control_tests, test_verification_zero_period);
+    RUN_TEST_CASE(relay_control_tests, test_pump_mode_batched_writes);
+    RUN_TEST_CASE(relay_control_tests, test_update_mask_single_write);
+    RUN_TEST_CASE(relay_control_tests, test_backend_readback_mismatch);
+    RUN_TEST_CASE(relay_control_tests, test_stuck_fault_raised_and_cleared);
+    RUN_TEST_CASE(relay_control_tests, test_verification_without_readback);
+    RUN_TEST_CASE(relay_control_tests, test_restore_keeps_relays_through_restart);
 }
\ No newline at end of file
@@ -0,0 +1,132 @@
+/**
+ * @file test_runtime_accounting.c
+ * @brief Unit tests for RTC-backed runtime accounting
+ */
+
+#include "config.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs_storage.h"
+#include "pool_pump/nvs_cache.h"
+#include "pool_pump/runtime_accounting.h"
+#include "unity.h"
+#include <stdbool.h>
+
+#define TEST_DATE 20260601
+
+static bool cache_started = false;
+
+// Test group
+TEST_GROUP(runtime_accounting_tests);
+
+// Test setup and teardown
+TEST_SETUP(runtime_accounting_tests) {
+    nvs_storage_init();
+    if (!cache_started) {
+        TEST_ASSERT_EQUAL(ESP_OK, nvs_cache_init(NVS_CACHE_FLUSH_INTERVAL_S));
+        cache_started = true;
+    }
+
+    // Start every test from a clean day
+    TEST_ASSERT_EQUAL(ESP_OK, runtime_accounting_init(ESP_RST_POWERON));
+    runtime_accounting_roll_day(20260531);
+    runtime_accounting_roll_day(TEST_DATE);
+}
+
+TEST_TEAR_DOWN(runtime_accounting_tests) { runtime_accounting_set_mode(PUMP_MODE_OFF); }
+
+/**
+ * @brief Test time is charged to the mode that was running, measured on the monotonic clock
+ */
+TEST(runtime_accounting_tests, test_accrues_per_mode) {
+    runtime_accounting_set_mode(PUMP_MODE_DAY);
+    vTaskDelay(pdMS_TO_TICKS(50));
+    runtime_accounting_set_mode(PUMP_MODE_OFF);
+    vTaskDelay(pdMS_TO_TICKS(50));
+    runtime_accounting_update();
+
+    runtime_accounting_t counters;
+    TEST_ASSERT_EQUAL(ESP_OK, runtime_accounting_get(&counters));
+    TEST_ASSERT_EQUAL(TEST_DATE, counters.date);
+    TEST_ASSERT_TRUE(counters.mode_us[PUMP_MODE_DAY] >= 50000);
+    TEST_ASSERT_TRUE(counters.mode_us[PUMP_MODE_DAY] < 100000);
+    TEST_ASSERT_EQUAL(0, counters.mode_us[PUMP_MODE_OFF]);
+    TEST_ASSERT_EQUAL(0, counters.mode_us[PUMP_MODE_NIGHT]);
+}
+
+/**
+ * @brief Test a soft reset restores the counters from RTC memory without touching flash
+ */
+TEST(runtime_accounting_tests, test_soft_reset_restores_from_rtc) {
+    runtime_accounting_set_mode(PUMP_MODE_NIGHT);
+    vTaskDelay(pdMS_TO_TICKS(20));
+    runtime_accounting_update();
+
+    runtime_accounting_t before, after;
+    runtime_accounting_get(&before);
+    nvs_storage_stats_t stats_before, stats_after;
+    nvs_storage_get_stats(&stats_before);
+
+    TEST_ASSERT_EQUAL(ESP_OK, runtime_accounting_init(ESP_RST_TASK_WDT));
+
+    nvs_storage_get_stats(&stats_after);
+    TEST_ASSERT_EQUAL(stats_before.writes, stats_after.writes);
+    TEST_ASSERT_EQUAL(stats_before.reads, stats_after.reads);
+
+    runtime_accounting_get(&after);
+    TEST_ASSERT_EQUAL(RUNTIME_SOURCE_RTC, after.source);
+    TEST_ASSERT_EQUAL(before.date, after.date);
+    TEST_ASSERT_TRUE(after.mode_us[PUMP_MODE_NIGHT] == before.mode_us[PUMP_MODE_NIGHT]);
+    TEST_ASSERT_EQUAL(before.soft_resets + 1, after.soft_resets);
+}
+
+/**
+ * @brief Test a power-on reset ignores RTC memory and falls back to the NVS snapshot
+ */
+TEST(runtime_accounting_tests, test_power_on_falls_back_to_nvs) {
+    runtime_accounting_set_mode(PUMP_MODE_DAY);
+    vTaskDelay(pdMS_TO_TICKS(1100));
+    runtime_accounting_set_mode(PUMP_MODE_OFF);
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_cache_flush());
+
+    TEST_ASSERT_EQUAL(ESP_OK, runtime_accounting_init(ESP_RST_POWERON));
+
+    runtime_accounting_t counters;
+    runtime_accounting_get(&counters);
+    TEST_ASSERT_EQUAL(RUNTIME_SOURCE_NVS, counters.source);
+    TEST_ASSERT_EQUAL(TEST_DATE, counters.date);
+    // The snapshot keeps whole seconds only
+    TEST_ASSERT_TRUE(counters.mode_us[PUMP_MODE_DAY] == 1000000);
+    TEST_ASSERT_EQUAL(0, counters.soft_resets);
+}
+
+/**
+ * @brief Test a new date clears the counters and an unsynchronised clock is ignored
+ */
+TEST(runtime_accounting_tests, test_roll_day) {
+    runtime_accounting_set_mode(PUMP_MODE_BACKWASH);
+    vTaskDelay(pdMS_TO_TICKS(20));
+    runtime_accounting_update();
+
+    TEST_ASSERT_FALSE(runtime_accounting_roll_day(TEST_DATE));
+    TEST_ASSERT_FALSE(runtime_accounting_roll_day(19700101));
+
+    runtime_accounting_t counters;
+    runtime_accounting_get(&counters);
+    TEST_ASSERT_EQUAL(TEST_DATE, counters.date);
+    TEST_ASSERT_TRUE(counters.mode_us[PUMP_MODE_BACKWASH] >= 20000);
+
+    TEST_ASSERT_TRUE(runtime_accounting_roll_day(TEST_DATE + 1));
+    runtime_accounting_get(&counters);
+    TEST_ASSERT_EQUAL(TEST_DATE + 1, counters.date);
+    TEST_ASSERT_TRUE(counters.mode_us[PUMP_MODE_BACKWASH] == 0);
+    TEST_ASSERT_EQUAL(0, runtime_accounting_get_run_minutes());
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(runtime_accounting_tests) {
+    RUN_TEST_CASE(runtime_accounting_tests, test_accrues_per_mode);
+    RUN_TEST_CASE(runtime_accounting_tests, test_soft_reset_restores_from_rtc);
+    RUN_TEST_CASE(runtime_accounting_tests, test_power_on_falls_back_to_nvs);
+    RUN_TEST_CASE(runtime_accounting_tests, test_roll_day);
+}
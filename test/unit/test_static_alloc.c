@@ -0,0 +1,117 @@
+/**
+ * @file test_static_alloc.c
+ * @brief Unit tests for the kernel object helpers and the post-boot heap guard
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "pool_pump/static_alloc.h"
+#include "sdkconfig.h"
+#include "unity.h"
+#include <stdlib.h>
+
+// Only a guard that counts without aborting can be watched from a test
+#if defined(CONFIG_POOL_PUMP_STATIC_ALLOCATION) && defined(CONFIG_HEAP_USE_HOOKS)
+#ifndef CONFIG_POOL_PUMP_HEAP_GUARD_ABORT
+#define GUARD_COUNTS 1
+#endif
+#endif
+
+static TaskHandle_t test_task;
+
+static void helper_task(void *arg) {
+    EventGroupHandle_t group = (EventGroupHandle_t)arg;
+    xEventGroupSetBits(group, BIT0);
+    vTaskDelete(NULL);
+}
+
+static void allocating_task(void *arg) {
+    // Allowed: inside an exempt window, nested like the fetch inside a radio window
+    static_alloc_exempt_begin();
+    static_alloc_exempt_begin();
+    free(malloc(32));
+    static_alloc_exempt_end();
+    free(malloc(40));
+    static_alloc_exempt_end();
+#ifdef GUARD_COUNTS
+    free(malloc(24)); // Flagged
+#endif
+    xTaskNotifyGive(test_task);
+    vTaskDelete(NULL);
+}
+
+// Test group
+TEST_GROUP(static_alloc_tests);
+
+// Test setup and teardown
+TEST_SETUP(static_alloc_tests) { test_task = xTaskGetCurrentTaskHandle(); }
+
+TEST_TEAR_DOWN(static_alloc_tests) {
+    // Clean up after each test
+}
+
+/**
+ * @brief Test the helpers hand out working objects and count them
+ */
+TEST(static_alloc_tests, test_helpers_create_working_objects) {
+    static_alloc_stats_t before, after;
+    TEST_ASSERT_EQUAL(ESP_OK, static_alloc_get_stats(&before));
+
+    SemaphoreHandle_t mutex = static_alloc_mutex();
+    TEST_ASSERT_NOT_NULL(mutex);
+    TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(mutex, 0));
+    TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreGive(mutex));
+
+    SemaphoreHandle_t recursive = static_alloc_recursive_mutex();
+    TEST_ASSERT_NOT_NULL(recursive);
+    TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTakeRecursive(recursive, 0));
+    TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTakeRecursive(recursive, 0));
+    xSemaphoreGiveRecursive(recursive);
+    xSemaphoreGiveRecursive(recursive);
+
+    EventGroupHandle_t group = static_alloc_event_group();
+    TEST_ASSERT_NOT_NULL(group);
+    TaskHandle_t task = NULL;
+    TEST_ASSERT_EQUAL(pdPASS, static_alloc_task(helper_task, "helper", 2050, group, 5, &task, tskNO_AFFINITY));
+    TEST_ASSERT_NOT_NULL(task);
+    TEST_ASSERT_EQUAL(BIT0, xEventGroupWaitBits(group, BIT0, pdTRUE, pdTRUE, pdMS_TO_TICKS(1000)) & BIT0);
+
+    TEST_ASSERT_EQUAL(ESP_OK, static_alloc_get_stats(&after));
+    TEST_ASSERT_EQUAL(before.semaphores + 2, after.semaphores);
+    TEST_ASSERT_EQUAL(before.event_groups + 1, after.event_groups);
+    TEST_ASSERT_EQUAL(before.tasks + 1, after.tasks);
+    TEST_ASSERT_EQUAL(before.stack_bytes + 2064, after.stack_bytes); // Rounded up to keep stacks aligned
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, static_alloc_get_stats(NULL));
+}
+
+/**
+ * @brief Test the guard flags allocations from our tasks after the seal, outside exempt windows only
+ */
+TEST(static_alloc_tests, test_guard_flags_unexempted_allocations) {
+    static_alloc_seal();
+    static_alloc_stats_t before, after;
+    TEST_ASSERT_EQUAL(ESP_OK, static_alloc_get_stats(&before));
+    TEST_ASSERT_TRUE(before.sealed);
+
+    // The test task is not ours: its allocations are never flagged
+    free(malloc(16));
+
+    TEST_ASSERT_EQUAL(pdPASS, static_alloc_task(allocating_task, "allocating", 2048, NULL, 5, NULL, tskNO_AFFINITY));
+    TEST_ASSERT_EQUAL(1, ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000)));
+
+    TEST_ASSERT_EQUAL(ESP_OK, static_alloc_get_stats(&after));
+#ifdef GUARD_COUNTS
+    TEST_ASSERT_EQUAL(before.heap_allocs + 1, after.heap_allocs);
+    TEST_ASSERT_EQUAL(24, after.last_alloc_bytes);
+#else
+    TEST_ASSERT_EQUAL(before.heap_allocs, after.heap_allocs);
+#endif
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(static_alloc_tests) {
+    RUN_TEST_CASE(static_alloc_tests, test_helpers_create_working_objects);
+    RUN_TEST_CASE(static_alloc_tests, test_guard_flags_unexempted_allocations);
+}
@@ -0,0 +1,132 @@
+/**
+ * @file test_storage.c
+ * @brief Unit tests for the typed key/value store and its RAM mirror
+ */
+
+#include "config.h"
+#include "nvs_storage.h"
+#include "pool_pump/storage.h"
+#include "unity.h"
+#include <string.h>
+
+// Test group
+TEST_GROUP(storage_tests);
+
+// Test setup and teardown
+TEST_SETUP(storage_tests) {
+    nvs_storage_init();
+    nvs_storage_erase("price_low");
+    nvs_storage_erase("price_url");
+    nvs_storage_erase("price_fetched");
+    TEST_ASSERT_EQUAL(ESP_OK, storage_init());
+}
+
+TEST_TEAR_DOWN(storage_tests) {
+    // Clean up after each test
+}
+
+/**
+ * @brief Test keys without a stored value read their table defaults, with no flash access
+ */
+TEST(storage_tests, test_defaults_from_key_table) {
+    nvs_storage_stats_t before, after;
+    nvs_storage_get_stats(&before);
+
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, PRICE_THRESHOLD_LOW, storage_get_float(STORAGE_KEY_PRICE_LOW));
+    TEST_ASSERT_EQUAL(0, storage_get_i32(STORAGE_KEY_LAST_PRICE_FETCH));
+    TEST_ASSERT_FALSE(storage_get_bool(STORAGE_KEY_WIFI_CONNECTED));
+    char endpoint[128];
+    TEST_ASSERT_EQUAL(ESP_OK, storage_get_str(STORAGE_KEY_PRICE_ENDPOINT, endpoint, sizeof(endpoint)));
+    TEST_ASSERT_EQUAL_STRING(PRICE_API_URL, endpoint);
+
+    nvs_storage_get_stats(&after);
+    TEST_ASSERT_EQUAL(before.reads, after.reads);
+}
+
+/**
+ * @brief Test a write-through key reaches flash immediately and survives a reload
+ */
+TEST(storage_tests, test_write_through_persists) {
+    nvs_storage_stats_t before, after;
+    nvs_storage_get_stats(&before);
+    TEST_ASSERT_EQUAL(ESP_OK, storage_set_float(STORAGE_KEY_PRICE_LOW, 0.07f));
+    nvs_storage_get_stats(&after);
+    TEST_ASSERT_EQUAL(before.writes + 1, after.writes);
+
+    // Setting the same value again does not touch flash
+    storage_set_float(STORAGE_KEY_PRICE_LOW, 0.07f);
+    nvs_storage_get_stats(&before);
+    TEST_ASSERT_EQUAL(after.writes, before.writes);
+
+    TEST_ASSERT_EQUAL(ESP_OK, storage_init());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 0.07f, storage_get_float(STORAGE_KEY_PRICE_LOW));
+}
+
+/**
+ * @brief Test a write-back key stays in RAM until flushed, then goes out in one commit
+ */
+TEST(storage_tests, test_write_back_waits_for_flush) {
+    nvs_storage_stats_t before, after;
+    nvs_storage_get_stats(&before);
+    for (int i = 1; i <= 10; i++) {
+        storage_set_i32(STORAGE_KEY_LAST_PRICE_FETCH, 1700000000 + i);
+    }
+    nvs_storage_get_stats(&after);
+    TEST_ASSERT_EQUAL(before.writes, after.writes);
+    TEST_ASSERT_EQUAL(1700000010, storage_get_i32(STORAGE_KEY_LAST_PRICE_FETCH));
+
+    TEST_ASSERT_EQUAL(ESP_OK, storage_flush());
+    nvs_storage_get_stats(&after);
+    TEST_ASSERT_EQUAL(before.writes + 1, after.writes);
+    TEST_ASSERT_EQUAL(before.commits + 1, after.commits);
+
+    int32_t stored = 0;
+    nvs_storage_load_int("price_fetched", &stored);
+    TEST_ASSERT_EQUAL(1700000010, stored);
+}
+
+/**
+ * @brief Test config keys live in the config blob and network settings are really persisted
+ */
+TEST(storage_tests, test_network_config_persisted) {
+    storage_network_config_t config;
+    memset(&config, 0, sizeof(config));
+    strcpy(config.wifi_ssid, "MirrorNet");
+    strcpy(config.wifi_password, "MirrorPass");
+    strcpy(config.price_api_endpoint, "https://prices.example/api");
+    TEST_ASSERT_EQUAL(ESP_OK, storage_save_network_config(&config));
+
+    nvs_config_t blob;
+    nvs_storage_load_config(&blob);
+    TEST_ASSERT_EQUAL_STRING("MirrorNet", blob.wifi_ssid);
+
+    TEST_ASSERT_EQUAL(ESP_OK, storage_init());
+    storage_network_config_t loaded;
+    TEST_ASSERT_EQUAL(ESP_OK, storage_load_network_config(&loaded));
+    TEST_ASSERT_EQUAL_STRING("MirrorNet", loaded.wifi_ssid);
+    TEST_ASSERT_EQUAL_STRING("MirrorPass", loaded.wifi_password);
+    TEST_ASSERT_EQUAL_STRING("https://prices.example/api", loaded.price_api_endpoint);
+}
+
+/**
+ * @brief Test type mismatches and over-long strings are rejected
+ */
+TEST(storage_tests, test_type_checks) {
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, storage_set_i32(STORAGE_KEY_PRICE_LOW, 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, storage_set_str(STORAGE_KEY_PUMP_MODE, "2"));
+    TEST_ASSERT_EQUAL(0, storage_get_i32(STORAGE_KEY_WIFI_SSID));
+
+    char too_long[40];
+    memset(too_long, 'x', sizeof(too_long) - 1);
+    too_long[sizeof(too_long) - 1] = '\0';
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, storage_set_str(STORAGE_KEY_WIFI_SSID, too_long));
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(storage_tests) {
+    RUN_TEST_CASE(storage_tests, test_defaults_from_key_table);
+    RUN_TEST_CASE(storage_tests, test_write_through_persists);
+    RUN_TEST_CASE(storage_tests, test_write_back_waits_for_flush);
+    RUN_TEST_CASE(storage_tests, test_network_config_persisted);
+    RUN_TEST_CASE(storage_tests, test_type_checks);
+}
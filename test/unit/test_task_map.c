@@ -0,0 +1,145 @@
+/**
+ * @file test_task_map.c
+ * @brief Unit tests for task placement and control-task wakeup jitter under network load
+ */
+
+#include "config.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs_storage.h"
+#include "pool_pump/nvs_cache.h"
+#include "pool_pump/task_map.h"
+#include "price_fetcher.h"
+#include "unity.h"
+#include "wifi_manager.h"
+#include <stdlib.h>
+
+#define CONTROL_PERIOD_MS 10   // One tick at the configured 100 Hz
+#define CONTROL_PERIODS 100    // Measured while the fetch is in flight
+#define HANDSHAKE_LOAD_MS 1500 // Outlasts the measurement
+#define JITTER_MAX_US 1000     // A relay decision is never more than this late
+
+static const char *TAG = "test_task_map";
+
+static TaskHandle_t test_task;
+static int64_t max_jitter_us;
+static BaseType_t control_core;
+static BaseType_t fetch_core;
+
+// Wakes like the control loop, and records how far each wake-up strays from the period
+static void control_task(void *arg) {
+    control_core = xPortGetCoreID();
+    TickType_t last_wake = xTaskGetTickCount();
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CONTROL_PERIOD_MS));
+    int64_t previous_us = esp_timer_get_time();
+    int64_t worst_us = 0;
+    for (int i = 0; i < CONTROL_PERIODS; i++) {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CONTROL_PERIOD_MS));
+        int64_t now_us = esp_timer_get_time();
+        int64_t jitter_us = llabs(now_us - previous_us - CONTROL_PERIOD_MS * 1000);
+        if (jitter_us > worst_us) {
+            worst_us = jitter_us;
+        }
+        previous_us = now_us;
+    }
+    max_jitter_us = worst_us;
+    xTaskNotifyGive(test_task);
+    vTaskDelete(NULL);
+}
+
+// A real fetch when the test device is online; otherwise the part of it that matters here, the
+// handshake's big-number arithmetic, which keeps the core busy for seconds without blocking
+static void fetch_task(void *arg) {
+    fetch_core = xPortGetCoreID();
+    if (wifi_manager_is_connected()) {
+        price_data_t prices[24];
+        price_fetcher_get_today_prices(prices);
+    } else {
+        volatile uint32_t x = 1;
+        int64_t end_us = esp_timer_get_time() + HANDSHAKE_LOAD_MS * 1000;
+        while (esp_timer_get_time() < end_us) {
+            x = x * 1103515245u + 12345u;
+        }
+    }
+    xTaskNotifyGive(test_task);
+    vTaskDelete(NULL);
+}
+
+// The tasks end on their own; their handles are not used once they are created
+static void create_as(task_id_t id, TaskFunction_t function) {
+    const task_spec_t *spec = task_map_get(id);
+    BaseType_t created =
+        xTaskCreatePinnedToCore(function, spec->name, spec->stack_bytes, NULL, spec->priority, NULL, spec->core);
+    TEST_ASSERT_EQUAL(pdPASS, created);
+}
+
+// Test group
+TEST_GROUP(task_map_tests);
+
+// Test setup and teardown
+TEST_SETUP(task_map_tests) { test_task = xTaskGetCurrentTaskHandle(); }
+
+TEST_TEAR_DOWN(task_map_tests) {
+    // Clean up after each test
+}
+
+/**
+ * @brief Test control and network work are on different cores, with control ranked first
+ */
+TEST(task_map_tests, test_control_and_network_placed_apart) {
+    const task_spec_t *scheduler = task_map_get(TASK_SCHEDULER);
+    const task_spec_t *network = task_map_get(TASK_NETWORK);
+    const task_spec_t *flush = task_map_get(TASK_NVS_CACHE);
+    TEST_ASSERT_NOT_NULL(scheduler);
+    TEST_ASSERT_NOT_NULL(network);
+    TEST_ASSERT_NOT_NULL(flush);
+    TEST_ASSERT_NULL(task_map_get(TASK_COUNT));
+
+    TEST_ASSERT_EQUAL(TASK_CORE_CONTROL, scheduler->core);
+    TEST_ASSERT_EQUAL(TASK_CORE_NETWORK, network->core);
+    TEST_ASSERT_EQUAL(TASK_CORE_NETWORK, flush->core);
+    TEST_ASSERT_TRUE(scheduler->priority > network->priority);
+    TEST_ASSERT_TRUE(network->priority > flush->priority);
+    for (int i = 0; i < TASK_COUNT; i++) {
+        TEST_ASSERT_NOT_NULL(task_map_get(i)->name);
+        TEST_ASSERT_TRUE(task_map_get(i)->stack_bytes >= 2048);
+    }
+
+    // The flush task is created through the table, where it is pinned; a second one is refused
+    nvs_storage_init();
+    nvs_cache_init(NVS_CACHE_FLUSH_INTERVAL_S); // Already running if another group started it
+    TaskHandle_t flush_task = xTaskGetHandle(flush->name);
+    TEST_ASSERT_NOT_NULL(flush_task);
+    TEST_ASSERT_EQUAL(flush->core, xTaskGetCoreID(flush_task));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, task_map_create(TASK_NVS_CACHE, control_task, NULL, NULL));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, task_map_create(TASK_COUNT, control_task, NULL, NULL));
+}
+
+/**
+ * @brief Test the control task wakes on time while a TLS fetch keeps the network core busy
+ */
+TEST(task_map_tests, test_control_jitter_during_fetch) {
+    // The fetch preempts this task on the network core, so the control task has to be running first
+    create_as(TASK_SCHEDULER, control_task);
+    create_as(TASK_NETWORK, fetch_task);
+
+    // Both notify when done; the control task finishes first unless a real fetch is quick
+    TEST_ASSERT_TRUE(ulTaskNotifyTake(pdFALSE, pdMS_TO_TICKS(30000)) > 0);
+    TEST_ASSERT_TRUE(ulTaskNotifyTake(pdFALSE, pdMS_TO_TICKS(30000)) > 0);
+    TEST_ASSERT_EQUAL(TASK_CORE_CONTROL, control_core);
+    TEST_ASSERT_EQUAL(TASK_CORE_NETWORK, fetch_core);
+    ESP_LOGI(TAG,
+             "Control wake-up jitter %lld us over %d periods, %s",
+             (long long)max_jitter_us,
+             CONTROL_PERIODS,
+             wifi_manager_is_connected() ? "during a price fetch" : "during an emulated handshake");
+    TEST_ASSERT_TRUE(max_jitter_us < JITTER_MAX_US);
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(task_map_tests) {
+    RUN_TEST_CASE(task_map_tests, test_control_and_network_placed_apart);
+    RUN_TEST_CASE(task_map_tests, test_control_jitter_during_fetch);
+}
@@ -0,0 +1,128 @@
+/**
+ * @file test_time_service.c
+ * @brief Unit tests for clock sync quality, the HTTP Date fallback and drift compensation
+ */
+
+#include "config.h"
+#include "pool_pump/time_service.h"
+#include "unity.h"
+#include <sys/time.h>
+#include <time.h>
+
+#define TEST_EPOCH 1780272000 // 2026-06-01 00:00:00 UTC
+
+static void set_clock(time_t seconds, suseconds_t microseconds) {
+    struct timeval tv = {.tv_sec = seconds, .tv_usec = microseconds};
+    settimeofday(&tv, NULL);
+}
+
+static void sntp_reference(time_t seconds, suseconds_t microseconds) {
+    struct timeval reference = {.tv_sec = seconds, .tv_usec = microseconds};
+    TEST_ASSERT_EQUAL(ESP_OK, time_service_set_reference(TIME_SOURCE_SNTP, &reference, TIME_SNTP_ERROR_MS));
+}
+
+// Test group
+TEST_GROUP(time_service_tests);
+
+// Test setup and teardown
+TEST_SETUP(time_service_tests) { TEST_ASSERT_EQUAL(ESP_OK, time_service_init(ESP_RST_POWERON)); }
+
+TEST_TEAR_DOWN(time_service_tests) {
+    // Clean up after each test
+}
+
+/**
+ * @brief Test a clock is only trusted after a sync, and stops being trusted as its error grows
+ */
+TEST(time_service_tests, test_quality_follows_estimated_error) {
+    // A plausible date alone does not make the clock trusted
+    set_clock(TEST_EPOCH, 0);
+    TEST_ASSERT_EQUAL(TIME_QUALITY_NONE, time_service_get_quality());
+    TEST_ASSERT_FALSE(time_service_is_trusted());
+    TEST_ASSERT_TRUE(time_service_sync_due());
+
+    sntp_reference(TEST_EPOCH, 0);
+    TEST_ASSERT_EQUAL(TIME_QUALITY_GOOD, time_service_get_quality());
+    TEST_ASSERT_FALSE(time_service_sync_due());
+
+    // Unmeasured drift: about a day and the error is past the good bound
+    set_clock(TEST_EPOCH + 100000, 0);
+    time_status_t status;
+    TEST_ASSERT_EQUAL(ESP_OK, time_service_get_status(&status));
+    TEST_ASSERT_EQUAL(TIME_QUALITY_DEGRADED, status.quality);
+    TEST_ASSERT_EQUAL(TIME_SNTP_ERROR_MS + 100000 * TIME_DRIFT_UNMEASURED_PPM / 1000, status.error_ms);
+    TEST_ASSERT_TRUE(time_service_is_trusted());
+    TEST_ASSERT_TRUE(time_service_sync_due());
+
+    set_clock(TEST_EPOCH + 700000, 0);
+    TEST_ASSERT_EQUAL(TIME_QUALITY_NONE, time_service_get_quality());
+    TEST_ASSERT_FALSE(time_service_is_trusted());
+
+    // A soft reset keeps the clock and what is known about it, power loss does not
+    sntp_reference(TEST_EPOCH, 0);
+    TEST_ASSERT_EQUAL(ESP_OK, time_service_init(ESP_RST_SW));
+    TEST_ASSERT_EQUAL(TIME_QUALITY_GOOD, time_service_get_quality());
+    TEST_ASSERT_EQUAL(ESP_OK, time_service_init(ESP_RST_POWERON));
+    TEST_ASSERT_EQUAL(TIME_QUALITY_NONE, time_service_get_quality());
+}
+
+/**
+ * @brief Test the Date header sets an unsynced clock but never overrides a better one
+ */
+TEST(time_service_tests, test_http_date_fallback) {
+    set_clock(0, 0);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, time_service_on_http_date("garbage"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, time_service_on_http_date("Thu, 01 Jan 1970 00:00:00 GMT"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, time_service_on_http_date(NULL));
+
+    TEST_ASSERT_EQUAL(ESP_OK, time_service_on_http_date("Mon, 01 Jun 2026 10:00:00 GMT"));
+    TEST_ASSERT_EQUAL(TEST_EPOCH + 10 * 3600, time(NULL));
+    time_status_t status;
+    TEST_ASSERT_EQUAL(ESP_OK, time_service_get_status(&status));
+    TEST_ASSERT_EQUAL(TIME_SOURCE_HTTP, status.source);
+    TEST_ASSERT_TRUE(time_service_is_trusted());
+    TEST_ASSERT_TRUE(time_service_sync_due());
+
+    // Once SNTP has set the clock, a later response's header is coarser than what we have
+    sntp_reference(TEST_EPOCH + 11 * 3600, 0);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, time_service_on_http_date("Mon, 01 Jun 2026 12:00:00 GMT"));
+    TEST_ASSERT_EQUAL(TEST_EPOCH + 11 * 3600, time(NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, time_service_get_status(&status));
+    TEST_ASSERT_EQUAL(TIME_SOURCE_SNTP, status.source);
+}
+
+/**
+ * @brief Test two SNTP syncs an hour apart measure the drift, which is then slewed out
+ */
+TEST(time_service_tests, test_drift_measured_and_compensated) {
+    sntp_reference(TEST_EPOCH, 0);
+
+    // An hour later the clock is 36 ms slow: 10 ppm
+    set_clock(TEST_EPOCH + 3600, 0);
+    sntp_reference(TEST_EPOCH + 3600, 36000);
+    time_status_t status;
+    TEST_ASSERT_EQUAL(ESP_OK, time_service_get_status(&status));
+    TEST_ASSERT_TRUE(status.drift_measured);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 10.0f, status.drift_ppm);
+    TEST_ASSERT_EQUAL(36, status.last_offset_ms);
+
+    // The next hour's 36 ms are slewed in before SNTP would have to correct them
+    set_clock(TEST_EPOCH + 7200, 36000);
+    time_service_update();
+    struct timeval pending = {0};
+    adjtime(NULL, &pending);
+    TEST_ASSERT_INT_WITHIN(1000, 36000, pending.tv_sec * 1000000 + pending.tv_usec);
+
+    // A step far beyond any crystal's drift is not taken as drift
+    set_clock(TEST_EPOCH + 10800, 0);
+    sntp_reference(TEST_EPOCH + 10800 + 60, 0);
+    TEST_ASSERT_EQUAL(ESP_OK, time_service_get_status(&status));
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 10.0f, status.drift_ppm);
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(time_service_tests) {
+    RUN_TEST_CASE(time_service_tests, test_quality_follows_estimated_error);
+    RUN_TEST_CASE(time_service_tests, test_http_date_fallback);
+    RUN_TEST_CASE(time_service_tests, test_drift_measured_and_compensated);
+}
@@ -0,0 +1,141 @@
+/**
+ * @file test_timer_offload.c
+ * @brief Unit tests for daily plan building and compilation into inverter timer slots
+ */
+
+#include "config.h"
+#include "pool_pump/daily_plan.h"
+#include "pool_pump/timer_offload.h"
+#include "unity.h"
+#include <string.h>
+
+static daily_plan_t plan;
+static price_data_t prices[24];
+
+static void plan_run(int start_minute, int end_minute, pump_mode_t mode) {
+    for (int minute = start_minute; minute < end_minute; minute += DAILY_PLAN_SLOT_MINUTES) {
+        plan.mode[minute / DAILY_PLAN_SLOT_MINUTES] = mode;
+    }
+}
+
+// Test group
+TEST_GROUP(timer_offload_tests);
+
+// Test setup and teardown
+TEST_SETUP(timer_offload_tests) {
+    memset(&plan, 0, sizeof(plan));
+    for (int hour = 0; hour < 24; hour++) {
+        prices[hour].hour = hour;
+        prices[hour].price_eur_kwh = 0.20;
+    }
+}
+
+TEST_TEAR_DOWN(timer_offload_tests) {
+    // Clean up after each test
+}
+
+/**
+ * @brief Test the plan runs the cheapest operating hours for the minimum runtime
+ */
+TEST(timer_offload_tests, test_plan_picks_cheapest_hours) {
+    prices[10].price_eur_kwh = 0.12;
+    prices[11].price_eur_kwh = 0.11;
+    prices[14].price_eur_kwh = 0.13;
+    prices[15].price_eur_kwh = 0.14;
+    prices[3].price_eur_kwh = 0.01; // Outside operating hours
+
+    TEST_ASSERT_EQUAL(ESP_OK, daily_plan_build(prices, 20260101, &plan));
+    TEST_ASSERT_EQUAL(MIN_DAILY_RUNTIME_HOURS * 60, daily_plan_run_minutes(&plan));
+    TEST_ASSERT_EQUAL(PUMP_MODE_DAY, daily_plan_mode_at(&plan, 10 * 60));
+    TEST_ASSERT_EQUAL(PUMP_MODE_DAY, daily_plan_mode_at(&plan, 15 * 60 + 45));
+    TEST_ASSERT_EQUAL(PUMP_MODE_OFF, daily_plan_mode_at(&plan, 3 * 60));
+    TEST_ASSERT_EQUAL(12 * 60, daily_plan_next_transition(&plan, 10 * 60));
+}
+
+/**
+ * @brief Test hours without a price rank after every priced hour, and only fill up the minimum runtime
+ */
+TEST(timer_offload_tests, test_plan_ranks_unpriced_hours_last) {
+    for (int hour = OPERATING_START_HOUR; hour < OPERATING_END_HOUR; hour++) {
+        prices[hour].price_eur_kwh = 0.0; // Unknown
+    }
+    prices[18].price_eur_kwh = 0.35;
+    prices[19].price_eur_kwh = 0.25;
+
+    TEST_ASSERT_EQUAL(ESP_OK, daily_plan_build(prices, 20260101, &plan));
+    TEST_ASSERT_EQUAL(MIN_DAILY_RUNTIME_HOURS * 60, daily_plan_run_minutes(&plan));
+    TEST_ASSERT_EQUAL(PUMP_MODE_NIGHT, daily_plan_mode_at(&plan, 18 * 60)); // Dear, but priced
+    TEST_ASSERT_EQUAL(PUMP_MODE_DAY, daily_plan_mode_at(&plan, 19 * 60));
+    // The rest of the minimum comes from the first unpriced hours
+    TEST_ASSERT_EQUAL(PUMP_MODE_DAY, daily_plan_mode_at(&plan, OPERATING_START_HOUR * 60));
+    TEST_ASSERT_EQUAL(PUMP_MODE_DAY, daily_plan_mode_at(&plan, (OPERATING_START_HOUR + 1) * 60));
+    TEST_ASSERT_EQUAL(PUMP_MODE_OFF, daily_plan_mode_at(&plan, (OPERATING_START_HOUR + 2) * 60));
+
+    // With enough priced hours the unpriced ones are not used at all
+    prices[20].price_eur_kwh = 0.30;
+    prices[21].price_eur_kwh = 0.28;
+    TEST_ASSERT_EQUAL(ESP_OK, daily_plan_build(prices, 20260101, &plan));
+    TEST_ASSERT_EQUAL(MIN_DAILY_RUNTIME_HOURS * 60, daily_plan_run_minutes(&plan));
+    TEST_ASSERT_EQUAL(PUMP_MODE_OFF, daily_plan_mode_at(&plan, OPERATING_START_HOUR * 60));
+    TEST_ASSERT_EQUAL(PUMP_MODE_DAY, daily_plan_mode_at(&plan, 21 * 60));
+}
+
+/**
+ * @brief Test a plan that fits the timer slots compiles exactly
+ */
+TEST(timer_offload_tests, test_compile_exact) {
+    plan_run(8 * 60, 10 * 60, PUMP_MODE_DAY);
+    plan_run(20 * 60, 21 * 60, PUMP_MODE_NIGHT);
+
+    vario_timer_program_t program;
+    timer_offload_report_t report;
+    TEST_ASSERT_EQUAL(ESP_OK, timer_offload_compile(&plan, prices, &program, &report));
+    TEST_ASSERT_EQUAL(2, program.count);
+    TEST_ASSERT_EQUAL(8 * 60, program.intervals[0].start_minute);
+    TEST_ASSERT_EQUAL(10 * 60, program.intervals[0].end_minute);
+    TEST_ASSERT_EQUAL(PUMP_SPEED_DAY, program.intervals[0].rpm);
+    TEST_ASSERT_EQUAL(PUMP_SPEED_NIGHT, program.intervals[1].rpm);
+    TEST_ASSERT_EQUAL(0, report.extra_minutes);
+    TEST_ASSERT_EQUAL(0, report.missing_minutes);
+    TEST_ASSERT_EQUAL(report.planned_minutes, report.program_minutes);
+}
+
+/**
+ * @brief Test a plan with more blocks than slots bridges the shortest gap
+ */
+TEST(timer_offload_tests, test_compile_merges_blocks) {
+    plan_run(6 * 60, 7 * 60, PUMP_MODE_DAY);
+    plan_run(7 * 60 + 15, 8 * 60, PUMP_MODE_DAY);
+    plan_run(11 * 60, 12 * 60, PUMP_MODE_DAY);
+    plan_run(15 * 60, 16 * 60, PUMP_MODE_DAY);
+    plan_run(19 * 60, 20 * 60, PUMP_MODE_DAY);
+
+    vario_timer_program_t program;
+    timer_offload_report_t report;
+    TEST_ASSERT_EQUAL(ESP_OK, timer_offload_compile(&plan, NULL, &program, &report));
+    TEST_ASSERT_EQUAL(VARIO_TIMER_SLOTS, program.count);
+    TEST_ASSERT_EQUAL(5, report.plan_blocks);
+    TEST_ASSERT_EQUAL(6 * 60, program.intervals[0].start_minute);
+    TEST_ASSERT_EQUAL(8 * 60, program.intervals[0].end_minute);
+    TEST_ASSERT_EQUAL(DAILY_PLAN_SLOT_MINUTES, report.extra_minutes);
+    TEST_ASSERT_EQUAL(0, report.missing_minutes);
+}
+
+/**
+ * @brief Test an empty plan compiles to an empty program
+ */
+TEST(timer_offload_tests, test_compile_empty_plan) {
+    vario_timer_program_t program;
+    TEST_ASSERT_EQUAL(ESP_OK, timer_offload_compile(&plan, NULL, &program, NULL));
+    TEST_ASSERT_EQUAL(0, program.count);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, timer_offload_compile(NULL, NULL, &program, NULL));
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(timer_offload_tests) {
+    RUN_TEST_CASE(timer_offload_tests, test_plan_picks_cheapest_hours);
+    RUN_TEST_CASE(timer_offload_tests, test_plan_ranks_unpriced_hours_last);
+    RUN_TEST_CASE(timer_offload_tests, test_compile_exact);
+    RUN_TEST_CASE(timer_offload_tests, test_compile_merges_blocks);
+    RUN_TEST_CASE(timer_offload_tests, test_compile_empty_plan);
+}
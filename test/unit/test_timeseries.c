@@ -0,0 +1,148 @@
+/**
+ * @file test_timeseries.c
+ * @brief Unit tests for the log-structured time-series store
+ */
+
+#include "pool_pump/timeseries.h"
+#include "unity.h"
+#include <math.h>
+
+#define T0 1717200000 // 2024-06-01 00:00 UTC
+
+// Test group
+TEST_GROUP(timeseries_tests);
+
+// Test setup and teardown
+TEST_SETUP(timeseries_tests) {
+    TEST_ASSERT_EQUAL(ESP_OK, timeseries_init());
+    TEST_ASSERT_EQUAL(ESP_OK, timeseries_clear());
+}
+
+TEST_TEAR_DOWN(timeseries_tests) {
+    // Clean up after each test
+}
+
+// Water temperature at the 1/16 degree resolution of a DS18B20, with a daily swing
+static float water_temperature(int minute) {
+    float celsius = 26.0f + 1.5f * sinf(minute * 2 * 3.14159f / 1440) + 0.3f * sinf(minute * 0.013f);
+    return roundf(celsius * 16) / 16;
+}
+
+// A reading that changes in its low mantissa bits every sample, the worst case for XOR compression
+static float noisy_power(int minute) { return 450.0f + 3.7f * sinf(minute * 0.7f); }
+
+/**
+ * @brief Test irregular timestamps and values read back exactly, from flash and from the open chunk
+ */
+TEST(timeseries_tests, test_round_trip) {
+    for (int i = 0; i < 600; i++) {
+        // Jitter, repeats, sign changes and a long gap in the middle
+        uint32_t timestamp = T0 + i * 60 + (i * i) % 59 + (i >= 300 ? 86400 : 0);
+        TEST_ASSERT_EQUAL(ESP_OK, timeseries_append(0, timestamp, (i % 13) * 1.37f - 4.0f));
+    }
+
+    timeseries_iter_t iter;
+    timeseries_sample_t sample;
+    TEST_ASSERT_EQUAL(ESP_OK, timeseries_iter_begin(&iter, 0, 0, UINT32_MAX));
+    int count = 0;
+    while (timeseries_iter_next(&iter, &sample)) {
+        TEST_ASSERT_EQUAL_UINT32(T0 + count * 60 + (count * count) % 59 + (count >= 300 ? 86400 : 0), sample.timestamp);
+        TEST_ASSERT_EQUAL_FLOAT((count % 13) * 1.37f - 4.0f, sample.value);
+        count++;
+    }
+    TEST_ASSERT_EQUAL(600, count);
+
+    // Other series stay empty
+    TEST_ASSERT_EQUAL(ESP_OK, timeseries_iter_begin(&iter, 1, 0, UINT32_MAX));
+    TEST_ASSERT_FALSE(timeseries_iter_next(&iter, &sample));
+}
+
+/**
+ * @brief Test range reads return exactly the samples between the bounds and appends stay in order
+ */
+TEST(timeseries_tests, test_range_read) {
+    for (int minute = 0; minute < 180; minute++) {
+        TEST_ASSERT_EQUAL(ESP_OK, timeseries_append(0, T0 + minute * 60, water_temperature(minute)));
+        TEST_ASSERT_EQUAL(ESP_OK, timeseries_append(1, T0 + minute * 60, noisy_power(minute)));
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, timeseries_append(0, T0 + 60, 20.0f));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, timeseries_append(TIMESERIES_MAX_SERIES, T0 + 86400, 20.0f));
+
+    timeseries_iter_t iter;
+    timeseries_sample_t sample;
+    TEST_ASSERT_EQUAL(ESP_OK, timeseries_iter_begin(&iter, 1, T0 + 3600, T0 + 7200));
+    int count = 0;
+    while (timeseries_iter_next(&iter, &sample)) {
+        TEST_ASSERT_EQUAL_UINT32(T0 + 3600 + count * 60, sample.timestamp);
+        TEST_ASSERT_EQUAL_FLOAT(noisy_power(60 + count), sample.value);
+        count++;
+    }
+    TEST_ASSERT_EQUAL(61, count);
+}
+
+/**
+ * @brief Test four weeks of one-minute water temperatures take well under 64 KB
+ */
+TEST(timeseries_tests, test_weeks_fit) {
+    const int minutes = 4 * 7 * 1440;
+    for (int minute = 0; minute < minutes; minute++) {
+        TEST_ASSERT_EQUAL(ESP_OK, timeseries_append(0, T0 + minute * 60, water_temperature(minute)));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, timeseries_flush());
+
+    timeseries_info_t info;
+    TEST_ASSERT_EQUAL(ESP_OK, timeseries_get_info(&info));
+    TEST_ASSERT_EQUAL(minutes, info.samples);
+    TEST_ASSERT_EQUAL_UINT32(T0, info.oldest_timestamp);
+    TEST_ASSERT_LESS_THAN(64 * 1024, info.bytes_used);
+
+    timeseries_iter_t iter;
+    timeseries_sample_t sample;
+    TEST_ASSERT_EQUAL(ESP_OK, timeseries_iter_begin(&iter, 0, T0 + 20 * 1440 * 60, UINT32_MAX));
+    TEST_ASSERT_TRUE(timeseries_iter_next(&iter, &sample));
+    TEST_ASSERT_EQUAL_FLOAT(water_temperature(20 * 1440), sample.value);
+}
+
+/**
+ * @brief Test a full partition erases its oldest segment, also under an open iterator
+ */
+TEST(timeseries_tests, test_full_partition_drops_oldest) {
+    timeseries_iter_t iter;
+    timeseries_sample_t sample;
+    timeseries_info_t info;
+    int minute = 0;
+    for (; minute < 60; minute++) {
+        TEST_ASSERT_EQUAL(ESP_OK, timeseries_append(0, T0 + minute * 60, noisy_power(minute)));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, timeseries_flush());
+    TEST_ASSERT_EQUAL(ESP_OK, timeseries_iter_begin(&iter, 0, 0, UINT32_MAX));
+    TEST_ASSERT_TRUE(timeseries_iter_next(&iter, &sample));
+    TEST_ASSERT_EQUAL_UINT32(T0, sample.timestamp);
+
+    do {
+        TEST_ASSERT_EQUAL(ESP_OK, timeseries_append(0, T0 + minute * 60, noisy_power(minute)));
+        minute++;
+        TEST_ASSERT_EQUAL(ESP_OK, timeseries_get_info(&info));
+    } while (info.oldest_timestamp == T0 && minute < 1000000);
+    TEST_ASSERT_NOT_EQUAL(T0, info.oldest_timestamp);
+    TEST_ASSERT_EQUAL(info.segments_total, info.segments_used);
+
+    // The iterator lost the erased segment and carries on from the oldest one left
+    uint32_t previous = sample.timestamp;
+    int count = 0;
+    while (timeseries_iter_next(&iter, &sample)) {
+        TEST_ASSERT_GREATER_THAN_UINT32(previous, sample.timestamp);
+        previous = sample.timestamp;
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(T0 + (minute - 1) * 60, previous);
+    TEST_ASSERT_EQUAL(info.samples, count);
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(timeseries_tests) {
+    RUN_TEST_CASE(timeseries_tests, test_round_trip);
+    RUN_TEST_CASE(timeseries_tests, test_range_read);
+    RUN_TEST_CASE(timeseries_tests, test_weeks_fit);
+    RUN_TEST_CASE(timeseries_tests, test_full_partition_drops_oldest);
+}
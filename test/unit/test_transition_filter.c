@@ -0,0 +1,141 @@
+/**
+ * @file test_transition_filter.c
+ * @brief Unit tests for the pump transition filter
+ */
+
+#include "mock_driver_gpio.h"
+#include "pool_pump/transition_filter.h"
+#include "unity.h"
+#include <string.h>
+
+#define MINUTE_MS (60 * 1000)
+
+static const transition_filter_config_t test_config = {
+    .price_low_enter = 0.10f,
+    .price_low_exit = 0.12f,
+    .min_on_ms = 15 * MINUTE_MS,
+    .min_off_ms = 10 * MINUTE_MS,
+    .coalesce_window_ms = 90 * 1000,
+};
+
+// Test group
+TEST_GROUP(transition_filter_tests);
+
+// Test setup and teardown
+TEST_SETUP(transition_filter_tests) {
+    mock_gpio_reset();
+    pump_controller_init();
+    transition_filter_init(&test_config, PUMP_MODE_OFF);
+}
+
+TEST_TEAR_DOWN(transition_filter_tests) {
+    // Clean up after each test
+}
+
+/**
+ * @brief Test that a request is only applied after the coalescing window
+ */
+TEST(transition_filter_tests, test_request_waits_for_coalesce_window) {
+    TEST_ASSERT_EQUAL(ESP_OK, transition_filter_request(PUMP_MODE_DAY, 0));
+    TEST_ASSERT_FALSE(transition_filter_process(60 * 1000));
+    TEST_ASSERT_EQUAL(PUMP_MODE_OFF, transition_filter_get_active_mode());
+
+    TEST_ASSERT_TRUE(transition_filter_process(90 * 1000));
+    TEST_ASSERT_EQUAL(PUMP_MODE_DAY, transition_filter_get_active_mode());
+
+    pump_status_t status;
+    pump_controller_get_status(&status);
+    TEST_ASSERT_TRUE(status.is_running);
+    TEST_ASSERT_EQUAL(PUMP_MODE_DAY, status.mode);
+}
+
+/**
+ * @brief Test that requests inside the window collapse into one transition
+ */
+TEST(transition_filter_tests, test_requests_coalesce) {
+    transition_filter_request(PUMP_MODE_DAY, 0);
+    transition_filter_request(PUMP_MODE_NIGHT, 10 * 1000);
+    TEST_ASSERT_TRUE(transition_filter_process(90 * 1000));
+    TEST_ASSERT_EQUAL(PUMP_MODE_NIGHT, transition_filter_get_active_mode());
+
+    transition_filter_stats_t stats;
+    transition_filter_get_stats(&stats);
+    TEST_ASSERT_EQUAL(1, stats.applied);
+    TEST_ASSERT_EQUAL(1, stats.suppressed_coalesced);
+}
+
+/**
+ * @brief Test that a start followed by a stop inside the window never touches the relays
+ */
+TEST(transition_filter_tests, test_flip_back_is_cancelled) {
+    transition_filter_request(PUMP_MODE_DAY, 0);
+    transition_filter_request(PUMP_MODE_OFF, 30 * 1000);
+    TEST_ASSERT_FALSE(transition_filter_process(120 * 1000));
+
+    transition_filter_stats_t stats;
+    transition_filter_get_stats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.applied);
+    TEST_ASSERT_EQUAL(1, stats.cancelled);
+}
+
+/**
+ * @brief Test minimum on-time before stopping
+ */
+TEST(transition_filter_tests, test_min_on_dwell) {
+    transition_filter_request(PUMP_MODE_DAY, 0);
+    transition_filter_process(90 * 1000);
+
+    transition_filter_request(PUMP_MODE_OFF, 2 * MINUTE_MS);
+    TEST_ASSERT_FALSE(transition_filter_process(10 * MINUTE_MS));
+    TEST_ASSERT_EQUAL(PUMP_MODE_DAY, transition_filter_get_active_mode());
+
+    TEST_ASSERT_TRUE(transition_filter_process(90 * 1000 + 15 * MINUTE_MS));
+    TEST_ASSERT_EQUAL(PUMP_MODE_OFF, transition_filter_get_active_mode());
+}
+
+/**
+ * @brief Test that force bypasses dwell and coalescing
+ */
+TEST(transition_filter_tests, test_force_bypasses_dwell) {
+    transition_filter_request(PUMP_MODE_DAY, 0);
+    transition_filter_process(90 * 1000);
+
+    TEST_ASSERT_EQUAL(ESP_OK, transition_filter_force(PUMP_MODE_OFF, 2 * MINUTE_MS));
+    TEST_ASSERT_EQUAL(PUMP_MODE_OFF, transition_filter_get_active_mode());
+
+    transition_filter_stats_t stats;
+    transition_filter_get_stats(&stats);
+    TEST_ASSERT_EQUAL(1, stats.forced);
+}
+
+/**
+ * @brief Test price hysteresis band
+ */
+TEST(transition_filter_tests, test_price_hysteresis) {
+    TEST_ASSERT_FALSE(transition_filter_price_is_low(0.11f));
+    TEST_ASSERT_TRUE(transition_filter_price_is_low(0.09f));
+    TEST_ASSERT_TRUE(transition_filter_price_is_low(0.11f));
+    TEST_ASSERT_FALSE(transition_filter_price_is_low(0.13f));
+    TEST_ASSERT_FALSE(transition_filter_price_is_low(0.11f));
+    TEST_ASSERT_FALSE(transition_filter_price_is_low(0.0f));
+}
+
+/**
+ * @brief Test invalid configuration
+ */
+TEST(transition_filter_tests, test_invalid_config) {
+    transition_filter_config_t config = test_config;
+    config.price_low_exit = 0.05f;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, transition_filter_init(&config, PUMP_MODE_OFF));
+}
+
+// Test group runner
+TEST_GROUP_RUNNER(transition_filter_tests) {
+    RUN_TEST_CASE(transition_filter_tests, test_request_waits_for_coalesce_window);
+    RUN_TEST_CASE(transition_filter_tests, test_requests_coalesce);
+    RUN_TEST_CASE(transition_filter_tests, test_flip_back_is_cancelled);
+    RUN_TEST_CASE(transition_filter_tests, test_min_on_dwell);
+    RUN_TEST_CASE(transition_filter_tests, test_force_bypasses_dwell);
+    RUN_TEST_CASE(transition_filter_tests, test_price_hysteresis);
+    RUN_TEST_CASE(transition_filter_tests, test_invalid_config);
+}
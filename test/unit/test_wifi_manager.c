@@ -3,6 +3,9 @@
  * @brief Unit tests for WiFi manager component
  */
 
+#include "config.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "mock_esp_wifi.h"
 #include "unity.h"
 #include "wifi_manager.h"
@@ -11,8 +14,25 @@
 // Test group
 TEST_GROUP(wifi_manager_tests);
 
+// Events are handled on the event loop task; wait until the manager has seen the ones just posted
+static void wait_events(void) { vTaskDelay(pdMS_TO_TICKS(50)); }
+
 // Test setup and teardown
-TEST_SETUP(wifi_manager_tests) { mock_esp_wifi_reset(); }
+TEST_SETUP(wifi_manager_tests) {
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_init());
+    wifi_manager_disconnect();
+    wait_events();
+    mock_esp_wifi_reset();
+}
+
+static bool wait_disconnected(void) {
+    EventBits_t bits = xEventGroupWaitBits(wifi_manager_get_event_group(),
+                                           WIFI_MANAGER_DISCONNECTED_BIT,
+                                           pdFALSE,
+                                           pdFALSE,
+                                           pdMS_TO_TICKS(1000));
+    return (bits & WIFI_MANAGER_DISCONNECTED_BIT) != 0;
+}
 
 TEST_TEAR_DOWN(wifi_manager_tests) {
     // Clean up after each test
@@ -60,18 +80,25 @@ TEST(wifi_manager_tests, test_connect_null_password) {
  * @brief Test WiFi connection status when connected
  */
 TEST(wifi_manager_tests, test_is_connected_true) {
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_connect("TestNetwork", "testpassword"));
     mock_esp_wifi_set_connected(true);
-    bool result = wifi_manager_is_connected();
-    TEST_ASSERT_TRUE(result);
+    TEST_ASSERT_TRUE(wifi_manager_wait_connected(1000));
+    TEST_ASSERT_TRUE(wifi_manager_is_connected());
+    TEST_ASSERT_EQUAL(WIFI_MANAGER_STATE_CONNECTED, wifi_manager_get_state());
 }
 
 /**
  * @brief Test WiFi connection status when disconnected
  */
 TEST(wifi_manager_tests, test_is_connected_false) {
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_connect("TestNetwork", "testpassword"));
+    mock_esp_wifi_set_connected(true);
+    TEST_ASSERT_TRUE(wifi_manager_wait_connected(1000));
+
     mock_esp_wifi_set_connected(false);
-    bool result = wifi_manager_is_connected();
-    TEST_ASSERT_FALSE(result);
+    TEST_ASSERT_TRUE(wait_disconnected());
+    TEST_ASSERT_FALSE(wifi_manager_is_connected());
+    TEST_ASSERT_EQUAL(WIFI_MANAGER_STATE_BACKOFF, wifi_manager_get_state());
 }
 
 /**
@@ -79,13 +106,60 @@ TEST(wifi_manager_tests, test_is_connected_false) {
  */
 TEST(wifi_manager_tests, test_disconnect) {
     // First connect
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_connect("TestNetwork", "testpassword"));
     mock_esp_wifi_set_connected(true);
-    TEST_ASSERT_TRUE(wifi_manager_is_connected());
+    TEST_ASSERT_TRUE(wifi_manager_wait_connected(1000));
 
     // Then disconnect
     esp_err_t result = wifi_manager_disconnect();
     TEST_ASSERT_EQUAL(ESP_OK, result);
+    TEST_ASSERT_TRUE(wait_disconnected());
     TEST_ASSERT_FALSE(mock_esp_wifi_is_connected());
+
+    // A requested disconnect is not retried
+    wait_events();
+    TEST_ASSERT_EQUAL(WIFI_MANAGER_STATE_IDLE, wifi_manager_get_state());
+    vTaskDelay(pdMS_TO_TICKS(WIFI_RECONNECT_MIN_MS + 200));
+    TEST_ASSERT_EQUAL(1, mock_esp_wifi_get_connect_calls());
+}
+
+/**
+ * @brief Test lost connections are retried with a doubling backoff and show up in the statistics
+ */
+TEST(wifi_manager_tests, test_reconnect_backoff_and_stats) {
+    wifi_manager_stats_t before, stats;
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_get_stats(&before));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, wifi_manager_get_stats(NULL));
+
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_connect("TestNetwork", "testpassword"));
+    mock_esp_wifi_set_connected(true);
+    TEST_ASSERT_TRUE(wifi_manager_wait_connected(1000));
+    vTaskDelay(pdMS_TO_TICKS(100));
+
+    // The link drops, and the first retry fails as well
+    mock_esp_wifi_set_connected(false);
+    wait_events();
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_get_stats(&stats));
+    TEST_ASSERT_EQUAL(WIFI_RECONNECT_MIN_MS, stats.backoff_ms);
+    TEST_ASSERT_EQUAL(MOCK_WIFI_REASON_BEACON_TIMEOUT, stats.last_disconnect_reason);
+    mock_esp_wifi_set_connected(false);
+    wait_events();
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_get_stats(&stats));
+    TEST_ASSERT_EQUAL(2 * WIFI_RECONNECT_MIN_MS, stats.backoff_ms);
+
+    // The reconnect timer fires the next attempt, and a connection resets the backoff
+    vTaskDelay(pdMS_TO_TICKS(2 * WIFI_RECONNECT_MIN_MS + 200));
+    TEST_ASSERT_EQUAL(2, mock_esp_wifi_get_connect_calls());
+    mock_esp_wifi_set_connected(true);
+    TEST_ASSERT_TRUE(wifi_manager_wait_connected(1000));
+
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_get_stats(&stats));
+    TEST_ASSERT_EQUAL(0, stats.backoff_ms);
+    TEST_ASSERT_EQUAL(before.connect_attempts + 2, stats.connect_attempts);
+    TEST_ASSERT_EQUAL(before.connects + 2, stats.connects);
+    TEST_ASSERT_EQUAL(before.disconnects + 1, stats.disconnects);
+    TEST_ASSERT_TRUE(stats.uptime_ms >= before.uptime_ms + 100);
+    TEST_ASSERT_TRUE(stats.max_connect_ms >= stats.last_connect_ms);
 }
 
 /**
@@ -107,6 +181,51 @@ TEST(wifi_manager_tests, test_connect_long_ssid) {
     TEST_ASSERT_EQUAL(ESP_OK, result);
 }
 
+/**
+ * @brief Test a known network is joined on its cached access point and lease, with a full scan as fallback
+ */
+TEST(wifi_manager_tests, test_fast_reconnect_and_fallback) {
+    wifi_manager_stats_t before, stats;
+    mock_esp_wifi_set_auto_connect(true);
+
+    // Any connection leaves the access point and lease in the cache
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_connect("TestNetwork", "testpassword"));
+    TEST_ASSERT_TRUE(wifi_manager_wait_connected(1000));
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_stop());
+    TEST_ASSERT_TRUE(wait_disconnected());
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_get_stats(&before));
+
+    // The access point moved: the direct attempt fails and a full scan follows at once
+    mock_esp_wifi_set_ap_moved(true);
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_connect("TestNetwork", "testpassword"));
+    TEST_ASSERT_TRUE(wifi_manager_wait_connected(1000));
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_get_stats(&stats));
+    TEST_ASSERT_EQUAL(before.fast_fallbacks + 1, stats.fast_fallbacks);
+    TEST_ASSERT_EQUAL(before.fast_connects, stats.fast_connects);
+    TEST_ASSERT_FALSE(mock_esp_wifi_get_config()->sta.bssid_set);
+    TEST_ASSERT_EQUAL(0, stats.backoff_ms);
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_stop());
+    TEST_ASSERT_TRUE(wait_disconnected());
+
+    // The next window goes straight to the access point found by that scan
+    mock_esp_wifi_set_ap_moved(false);
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_connect("TestNetwork", "testpassword"));
+    TEST_ASSERT_TRUE(wifi_manager_wait_connected(1000));
+    const wifi_config_t *config = mock_esp_wifi_get_config();
+    TEST_ASSERT_TRUE(config->sta.bssid_set);
+    TEST_ASSERT_EQUAL(MOCK_WIFI_AP_CHANNEL, config->sta.channel);
+    TEST_ASSERT_EQUAL(WIFI_FAST_SCAN, config->sta.scan_method);
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_get_stats(&stats));
+    TEST_ASSERT_EQUAL(before.fast_connects + 1, stats.fast_connects);
+    TEST_ASSERT_TRUE(stats.last_start_to_ip_ms >= stats.last_connect_ms);
+
+    // A different network does not use the cache
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_stop());
+    TEST_ASSERT_TRUE(wait_disconnected());
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_manager_connect("OtherNetwork", "testpassword"));
+    TEST_ASSERT_FALSE(mock_esp_wifi_get_config()->sta.bssid_set);
+}
+
 // Test group runner
 TEST_GROUP_RUNNER(wifi_manager_tests) {
     RUN_TEST_CASE(wifi_manager_tests, test_init_success);
@@ -118,4 +237,6 @@ TEST_GROUP_RUNNER(wifi_manager_tests) {
     RUN_TEST_CASE(wifi_manager_tests, test_disconnect);
     RUN_TEST_CASE(wifi_manager_tests, test_connect_empty_credentials);
     RUN_TEST_CASE(wifi_manager_tests, test_connect_long_ssid);
+    RUN_TEST_CASE(wifi_manager_tests, test_reconnect_backoff_and_stats);
+    RUN_TEST_CASE(wifi_manager_tests, test_fast_reconnect_and_fallback);
 }
\ No newline at end of file
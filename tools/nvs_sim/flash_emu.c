@@ -0,0 +1,174 @@
+// mmap-backed SPI NOR flash: erase-to-0xFF sectors, 1->0 programming, wear counters and power cuts
+
+#include "flash_emu.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Typical datasheet figures for the 4 MB parts on ESP32 modules
+#define PROGRAM_SETUP_US 30
+#define PROGRAM_NS_PER_BYTE 2600 // About 0.7 ms for a 256-byte page
+#define SECTOR_ERASE_US 45000
+
+static uint8_t *image = NULL;
+static size_t image_size = 0;
+static uint32_t *sector_erases = NULL;
+static flash_emu_stats_t stats;
+static int64_t power_budget = -1;
+static bool power_lost = false;
+
+esp_err_t flash_emu_open(const char *path, size_t sectors) {
+    if (image != NULL || sectors == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    size_t size = sectors * FLASH_EMU_SECTOR_SIZE;
+    if (path != NULL) {
+        int fd = open(path, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) return ESP_FAIL;
+
+        struct stat st;
+        off_t existing = fstat(fd, &st) == 0 ? st.st_size : 0;
+        if ((size_t)existing < size && ftruncate(fd, (off_t)size) != 0) {
+            close(fd);
+            return ESP_FAIL;
+        }
+        image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (image == MAP_FAILED) {
+            image = NULL;
+            return ESP_FAIL;
+        }
+        // ftruncate() extends with zeros; the new part of the image starts out erased instead
+        if ((size_t)existing < size) {
+            memset(image + existing, 0xFF, size - (size_t)existing);
+        }
+    } else {
+        image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (image == MAP_FAILED) {
+            image = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+        memset(image, 0xFF, size);
+    }
+
+    sector_erases = calloc(sectors, sizeof(*sector_erases));
+    if (sector_erases == NULL) {
+        flash_emu_close();
+        return ESP_ERR_NO_MEM;
+    }
+    image_size = size;
+    flash_emu_reset_stats();
+    flash_emu_power_on();
+    return ESP_OK;
+}
+
+void flash_emu_close(void) {
+    if (image != NULL) {
+        msync(image, image_size, MS_SYNC);
+        munmap(image, image_size);
+    }
+    free(sector_erases);
+    image = NULL;
+    sector_erases = NULL;
+    image_size = 0;
+}
+
+size_t flash_emu_sectors(void) { return image_size / FLASH_EMU_SECTOR_SIZE; }
+
+esp_err_t flash_emu_read(size_t offset, void *dst, size_t length) {
+    if (image == NULL || offset + length > image_size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(dst, image + offset, length);
+    return ESP_OK;
+}
+
+esp_err_t flash_emu_write(size_t offset, const void *src, size_t length) {
+    if (image == NULL || offset + length > image_size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (power_lost) {
+        return ESP_FAIL;
+    }
+
+    size_t programmed = length;
+    if (power_budget >= 0 && (int64_t)length > power_budget) {
+        programmed = (size_t)power_budget;
+        power_lost = true;
+    }
+    if (power_budget >= 0) {
+        power_budget -= (int64_t)programmed;
+    }
+
+    const uint8_t *bytes = src;
+    for (size_t i = 0; i < programmed; i++) {
+        if (bytes[i] & ~image[offset + i]) {
+            stats.bit_violations++;
+        }
+        image[offset + i] &= bytes[i];
+    }
+
+    stats.bytes_programmed += programmed;
+    stats.program_ops++;
+    stats.device_us += PROGRAM_SETUP_US + (int64_t)programmed * PROGRAM_NS_PER_BYTE / 1000;
+    return power_lost ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t flash_emu_erase_sector(size_t sector) {
+    if (image == NULL || sector >= flash_emu_sectors()) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (power_lost) {
+        return ESP_FAIL;
+    }
+    if (power_budget == 0) {
+        // An interrupted erase leaves the sector partly erased
+        memset(image + sector * FLASH_EMU_SECTOR_SIZE, 0xFF, FLASH_EMU_SECTOR_SIZE / 2);
+        power_lost = true;
+        return ESP_FAIL;
+    }
+    if (power_budget > 0) {
+        power_budget--;
+    }
+
+    memset(image + sector * FLASH_EMU_SECTOR_SIZE, 0xFF, FLASH_EMU_SECTOR_SIZE);
+    sector_erases[sector]++;
+    stats.erases++;
+    stats.device_us += SECTOR_ERASE_US;
+    return ESP_OK;
+}
+
+void flash_emu_cut_power_after(int64_t budget) { power_budget = budget; }
+
+bool flash_emu_power_lost(void) { return power_lost; }
+
+void flash_emu_power_on(void) {
+    power_lost = false;
+    power_budget = -1;
+}
+
+void flash_emu_get_stats(flash_emu_stats_t *out) {
+    *out = stats;
+    out->min_sector_erases = UINT32_MAX;
+    out->max_sector_erases = 0;
+    for (size_t i = 0; i < flash_emu_sectors(); i++) {
+        if (sector_erases[i] < out->min_sector_erases) out->min_sector_erases = sector_erases[i];
+        if (sector_erases[i] > out->max_sector_erases) out->max_sector_erases = sector_erases[i];
+    }
+}
+
+void flash_emu_reset_stats(void) {
+    memset(&stats, 0, sizeof(stats));
+    if (sector_erases != NULL) {
+        memset(sector_erases, 0, flash_emu_sectors() * sizeof(*sector_erases));
+    }
+}
+
+void flash_emu_save_image(uint8_t *dst) { memcpy(dst, image, image_size); }
+
+void flash_emu_load_image(const uint8_t *src) { memcpy(image, src, image_size); }
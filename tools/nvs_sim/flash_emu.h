@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define FLASH_EMU_SECTOR_SIZE 4096
+
+typedef struct {
+    uint64_t bytes_programmed; // Bytes passed to flash_emu_write()
+    uint32_t program_ops;
+    uint32_t erases;
+    uint32_t min_sector_erases;
+    uint32_t max_sector_erases;
+    uint32_t bit_violations; // Programs that tried to turn a 0 bit back into a 1
+    int64_t device_us;       // Estimated time the same operations take on SPI NOR flash
+} flash_emu_stats_t;
+
+/**
+ * Map a NOR flash image of the given number of 4 KB sectors. With a path the image lives in that
+ * file and survives the process (a new or short file is extended with erased sectors); without
+ * one it is anonymous memory.
+ */
+esp_err_t flash_emu_open(const char *path, size_t sectors);
+void flash_emu_close(void);
+size_t flash_emu_sectors(void);
+
+esp_err_t flash_emu_read(size_t offset, void *dst, size_t length);
+
+/**
+ * Program bytes with NOR semantics: bits can only go from 1 to 0, anything else is counted in
+ * bit_violations and AND-ed in as real flash would. Fails with ESP_FAIL once the power is cut.
+ */
+esp_err_t flash_emu_write(size_t offset, const void *src, size_t length);
+esp_err_t flash_emu_erase_sector(size_t sector);
+
+/**
+ * Cut the power after the given number of further byte programs (an erase counts as one);
+ * the write in flight is torn at that byte. A negative budget never cuts.
+ */
+void flash_emu_cut_power_after(int64_t budget);
+bool flash_emu_power_lost(void);
+void flash_emu_power_on(void);
+
+void flash_emu_get_stats(flash_emu_stats_t *out);
+void flash_emu_reset_stats(void);
+
+// Copy the whole image out and back, so a sweep can replay one operation from the same state
+void flash_emu_save_image(uint8_t *dst);
+void flash_emu_load_image(const uint8_t *src);
@@ -0,0 +1,27 @@
+#pragma once
+
+// Minimal esp_err.h so the storage components build on Linux
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_INVALID_CRC 0x109
+
+#define ESP_ERROR_CHECK(x)                                                                                             \
+    do {                                                                                                               \
+        esp_err_t err_rc_ = (x);                                                                                       \
+        if (err_rc_ != ESP_OK) abort_on_error(err_rc_, #x, __FILE__, __LINE__);                                        \
+    } while (0)
+
+void abort_on_error(esp_err_t code, const char *expr, const char *file, int line);
+const char *esp_err_to_name(esp_err_t code);
@@ -0,0 +1,12 @@
+#pragma once
+
+// Just enough FreeRTOS for nvs_storage's recursive mutex; the host build is single-threaded
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
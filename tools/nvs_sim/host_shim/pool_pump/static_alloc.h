@@ -0,0 +1,9 @@
+#pragma once
+
+// The parts of static_alloc that nvs_storage uses; the host build has no pools and no heap guard
+
+#include "freertos/semphr.h"
+
+SemaphoreHandle_t static_alloc_recursive_mutex(void);
+void static_alloc_exempt_begin(void);
+void static_alloc_exempt_end(void);
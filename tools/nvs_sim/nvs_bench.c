@@ -0,0 +1,287 @@
+// Throughput, write amplification, wear and power-cut consistency of nvs_storage on the NVS emulator
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "flash_emu.h"
+#include "nvs_emu.h"
+#include "nvs_flash.h"
+#include "nvs_storage.h"
+
+#define RATED_ERASE_CYCLES 100000 // Endurance of the sectors of common SPI NOR parts
+
+typedef esp_err_t (*workload_fn)(int iteration);
+
+typedef struct {
+    const char *name;
+    workload_fn run;
+} workload_t;
+
+static esp_err_t run_int(int iteration) { return nvs_storage_save_int("bench_int", iteration); }
+
+static esp_err_t run_batch(int iteration) {
+    // Eight counters in one commit, like the nvs_cache flush
+    static const char *KEYS[] = {"c0", "c1", "c2", "c3", "c4", "c5", "c6", "c7"};
+    esp_err_t ret = nvs_storage_begin_batch();
+    if (ret != ESP_OK) return ret;
+    for (int i = 0; i < 8 && ret == ESP_OK; i++) {
+        ret = nvs_storage_save_int(KEYS[i], iteration * 8 + i);
+    }
+    esp_err_t end = nvs_storage_end_batch();
+    return ret != ESP_OK ? ret : end;
+}
+
+static esp_err_t run_config(int iteration) { return nvs_storage_set_pump_config(iteration % 3, iteration % 1440); }
+
+static uint32_t bench_date(int day) {
+    // Consecutive days from 2024-01-01; months are rounded to 28 days to keep the dates valid
+    return 20240101 + (day / (12 * 28)) * 10000 + (day / 28 % 12) * 100 + day % 28;
+}
+
+static nvs_daily_stats_t bench_day(int day) {
+    nvs_daily_stats_t stats = {
+        .date = bench_date(day),
+        .runtime_minutes = {(uint16_t)(day % 600), 60, 0},
+        .energy_kwh = (float)(day % 50) / 10.0f,
+        .cost_eur = 0.5f,
+        .avg_price = 0.12f,
+        .min_price = 0.05f,
+        .starts = (uint8_t)(day % 7),
+    };
+    return stats;
+}
+
+static esp_err_t run_daily(int iteration) {
+    nvs_daily_stats_t day = bench_day(iteration);
+    return nvs_storage_set_daily_stats(&day);
+}
+
+static const workload_t WORKLOADS[] = {
+    {"int", run_int},
+    {"batch of 8 ints", run_batch},
+    {"config blob", run_config},
+    {"daily stats", run_daily},
+};
+
+static esp_err_t reboot(void) {
+    nvs_storage_deinit();
+    nvs_flash_deinit();
+    flash_emu_power_on();
+    return nvs_storage_init();
+}
+
+static esp_err_t fresh_storage(void) {
+    nvs_storage_deinit();
+    esp_err_t ret = nvs_flash_erase();
+    if (ret == ESP_OK) ret = nvs_storage_init();
+    flash_emu_reset_stats();
+    nvs_emu_reset_stats();
+    return ret;
+}
+
+static int bench_workload(const workload_t *workload, int iterations) {
+    if (fresh_storage() != ESP_OK) {
+        fprintf(stderr, "%s: could not format the flash\n", workload->name);
+        return 1;
+    }
+
+    int errors = 0;
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        if (workload->run(i) != ESP_OK) errors++;
+    }
+    int64_t host_us = esp_timer_get_time() - start;
+
+    flash_emu_stats_t flash;
+    nvs_emu_stats_t nvs;
+    flash_emu_get_stats(&flash);
+    nvs_emu_get_stats(&nvs);
+    double per_op = iterations > 0 ? 1.0 / iterations : 0;
+
+    // Operations until the most-erased sector reaches its rated endurance at this rate
+    char wear_out[24] = "never";
+    if (flash.max_sector_erases > 0) {
+        snprintf(wear_out,
+                 sizeof(wear_out),
+                 "after %.0f ops",
+                 (double)RATED_ERASE_CYCLES * iterations / flash.max_sector_erases);
+    }
+    printf("%-16s %5d ops %3d err  host %7.1f us/op  flash %6.0f B/op  WA %5.1f  erases %4u (sector max %3u)  "
+           "device %6.2f ms/op  wear-out %s\n",
+           workload->name,
+           iterations,
+           errors,
+           host_us * per_op,
+           flash.bytes_programmed * per_op,
+           nvs.payload_bytes ? (double)flash.bytes_programmed / nvs.payload_bytes : 0,
+           flash.erases,
+           flash.max_sector_erases,
+           flash.device_us * per_op / 1000.0,
+           wear_out);
+    if (flash.bit_violations > 0) {
+        fprintf(stderr, "%s: %u programs tried to set bits without an erase\n", workload->name, flash.bit_violations);
+        errors++;
+    }
+    return errors > 0;
+}
+
+// Flash operations one call of the workload takes; a power cut can land after any of them
+static int64_t operation_cost(workload_fn run, int iteration) {
+    flash_emu_stats_t before, after;
+    flash_emu_get_stats(&before);
+    run(iteration);
+    flash_emu_get_stats(&after);
+    return (int64_t)(after.bytes_programmed - before.bytes_programmed) + (after.erases - before.erases);
+}
+
+static bool config_is(int iteration) {
+    uint8_t mode;
+    uint16_t runtime;
+    return nvs_storage_get_pump_config(&mode, &runtime) == ESP_OK && mode == iteration % 3 &&
+           runtime == iteration % 1440;
+}
+
+static bool daily_is(int days) {
+    nvs_daily_stats_t out[8];
+    size_t count = 0;
+    if (nvs_storage_get_daily_stats_range(0, 99991231, NULL, 0, &count) != ESP_OK || count != (size_t)days) {
+        return false;
+    }
+    // The newest days are the ones a torn write could have damaged
+    int first = days > 8 ? days - 8 : 0;
+    if (nvs_storage_get_daily_stats_range(bench_date(first), 99991231, out, 8, &count) != ESP_OK) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        nvs_daily_stats_t expected = bench_day(first + (int)i);
+        if (out[i].date != expected.date || out[i].runtime_minutes[0] != expected.runtime_minutes[0]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Replay one operation from the same flash image with the power cut after every possible byte,
+ * reboot, and check the data reads as either the old or the new state. Repeated from successive
+ * states so the cuts also land in page switches and reclaims.
+ */
+static int power_cut_sweep(const char *name, workload_fn run, bool (*holds)(int), int states) {
+    uint8_t *image = malloc(flash_emu_sectors() * FLASH_EMU_SECTOR_SIZE);
+    if (image == NULL || fresh_storage() != ESP_OK) {
+        free(image);
+        return 1;
+    }
+
+    int cuts = 0;
+    int inconsistent = 0;
+    int reclaims = 0;
+    run(0);
+    for (int state = 1; state <= states; state++) {
+        nvs_emu_stats_t nvs;
+        nvs_storage_deinit();
+        flash_emu_save_image(image);
+        reboot();
+        nvs_emu_reset_stats();
+        int64_t cost = operation_cost(run, state);
+        nvs_emu_get_stats(&nvs);
+        reclaims += nvs.pages_reclaimed > 0;
+
+        for (int64_t budget = 0; budget < cost; budget++) {
+            nvs_storage_deinit();
+            flash_emu_load_image(image);
+            reboot();
+            flash_emu_cut_power_after(budget);
+            run(state);
+            cuts++;
+            if (reboot() != ESP_OK || !(holds(state - 1) || holds(state))) {
+                if (inconsistent++ < 5) {
+                    fprintf(stderr, "%s: inconsistent after a cut at %lld of %lld in state %d\n",
+                            name,
+                            (long long)budget,
+                            (long long)cost,
+                            state);
+                }
+            }
+        }
+
+        // Advance to the next state with the operation completed
+        nvs_storage_deinit();
+        flash_emu_load_image(image);
+        reboot();
+        run(state);
+    }
+    free(image);
+
+    printf("power cut sweep %-12s %3d states %6d cuts (%d through a reclaim)  %d inconsistent\n",
+           name,
+           states,
+           cuts,
+           reclaims,
+           inconsistent);
+    return inconsistent > 0;
+}
+
+static bool daily_holds(int iteration) { return daily_is(iteration + 1); }
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    int sectors = NVS_EMU_DEFAULT_SECTORS;
+    int iterations = 1000;
+    int states = 40;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:s:n:p:v")) != -1) {
+        switch (opt) {
+            case 'f':
+                path = optarg;
+                break;
+            case 's':
+                sectors = atoi(optarg);
+                break;
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 'p':
+                states = atoi(optarg);
+                break;
+            case 'v':
+                host_log_level = 2;
+                break;
+            default:
+                fprintf(stderr,
+                        "usage: %s [-f image] [-s sectors] [-n iterations] [-p power-cut states] [-v]\n",
+                        argv[0]);
+                return 2;
+        }
+    }
+
+    if (flash_emu_open(path, (size_t)sectors) != ESP_OK) {
+        fprintf(stderr, "Could not map a %d-sector flash image%s%s\n", sectors, path ? " at " : "", path ? path : "");
+        return 1;
+    }
+
+    int failed = 0;
+    printf("NVS partition of %d sectors, %d iterations per workload\n", sectors, iterations);
+    for (size_t i = 0; i < sizeof(WORKLOADS) / sizeof(WORKLOADS[0]); i++) {
+        failed |= bench_workload(&WORKLOADS[i], iterations);
+    }
+
+    if (states > 0) {
+        // Torn writes make nvs_storage log errors by design
+        int level = host_log_level;
+        host_log_level = -1;
+        failed |= power_cut_sweep("config blob", run_config, config_is, states);
+        failed |= power_cut_sweep("daily stats", run_daily, daily_holds, states);
+        host_log_level = level;
+    }
+
+    nvs_storage_deinit();
+    nvs_flash_deinit();
+    flash_emu_close();
+    return failed;
+}
@@ -0,0 +1,742 @@
+// The nvs.h API on top of flash_emu, with the on-flash layout of ESP-IDF NVS:
+//
+// Each 4 KB sector is a page: a 32-byte header (state, sequence number, CRC), a 32-byte bitmap with
+// two state bits per entry, then 126 entries of 32 bytes. An item is a header entry (namespace,
+// type, span, key, CRC and either the value or the size and CRC of the data) followed by the data
+// entries of strings and blobs. Items are only ever appended to the active page; an update writes
+// the new item and then marks the old one erased, so after a power cut the last complete item
+// wins. When only one empty page is left, the full page with most erased entries is reclaimed:
+// its live items move to a fresh page and its sector is erased.
+//
+// Unlike ESP-IDF, blobs are not split into chunks, so a value has to fit in one page.
+
+#include "nvs_emu.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "flash_emu.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+
+static const char *TAG = "nvs_emu";
+
+#define ENTRY_SIZE 32
+#define ENTRIES_PER_PAGE 126
+#define BITMAP_OFFSET 32
+#define FIRST_ENTRY_OFFSET 64
+#define PAGE_FORMAT_VERSION 0xFD
+#define MAX_VALUE_SIZE ((ENTRIES_PER_PAGE - 1) * ENTRY_SIZE)
+#define MAX_HANDLES 8
+
+// Page states only ever clear bits, and consecutive states differ in one byte
+#define PAGE_EMPTY 0xFFFFFFFFu
+#define PAGE_ACTIVE 0xFFFFFFFEu
+#define PAGE_FULL 0xFFFFFFFCu
+#define PAGE_FREEING 0xFFFFFFF8u
+
+#define ENTRY_EMPTY 3
+#define ENTRY_WRITTEN 2
+#define ENTRY_ERASED 0
+
+#define TYPE_U8 0x01
+#define TYPE_I32 0x14
+#define TYPE_STR 0x21
+#define TYPE_BLOB 0x41
+
+typedef struct {
+    uint32_t state;
+    uint32_t sequence;
+    uint8_t version;
+    uint8_t reserved[19];
+    uint32_t crc; // Over sequence up to here
+} page_header_t;
+
+typedef struct {
+    uint8_t ns;
+    uint8_t type;
+    uint8_t span;  // Entries including this one
+    uint8_t chunk; // Always 0xFF
+    uint32_t crc;  // Over every other byte of the header
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    union {
+        uint8_t value[8];
+        struct {
+            uint16_t size;
+            uint16_t reserved;
+            uint32_t data_crc;
+        } var;
+    } data;
+} item_t;
+
+_Static_assert(sizeof(page_header_t) == 32, "page header is one entry");
+_Static_assert(sizeof(item_t) == ENTRY_SIZE, "item header is one entry");
+
+typedef struct {
+    uint32_t state;
+    uint32_t sequence;
+    uint16_t next_free; // Entries before this one have been used
+    uint16_t erased;
+} page_t;
+
+// Where the live copy of each key is; rebuilt from flash on every mount
+typedef struct {
+    uint8_t ns;
+    uint8_t type;
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint16_t page;
+    uint8_t index;
+    uint8_t span;
+} location_t;
+
+typedef struct {
+    bool used;
+    bool writable;
+    uint8_t ns;
+} handle_t;
+
+static page_t *pages = NULL;
+static size_t page_count = 0;
+static location_t *locations = NULL;
+static size_t location_count = 0;
+static int active = -1;
+static uint32_t next_sequence = 0;
+static uint8_t last_ns = 0;
+static bool mounted = false;
+static handle_t handles[MAX_HANDLES];
+static nvs_emu_stats_t stats;
+
+static size_t page_offset(int page) { return (size_t)page * FLASH_EMU_SECTOR_SIZE; }
+
+static size_t entry_offset(int page, int index) {
+    return page_offset(page) + FIRST_ENTRY_OFFSET + (size_t)index * ENTRY_SIZE;
+}
+
+static bool is_var_type(uint8_t type) { return type == TYPE_STR || type == TYPE_BLOB; }
+
+static int entry_state(int page, int index) {
+    uint8_t byte = 0;
+    flash_emu_read(page_offset(page) + BITMAP_OFFSET + index / 4, &byte, 1);
+    return (byte >> (index % 4 * 2)) & 3;
+}
+
+// Read-modify-write of one bitmap byte at a time; entries go in order, so an item's header is first
+static esp_err_t set_entry_states(int page, int first, int count, int state) {
+    for (int index = first; index < first + count;) {
+        size_t offset = page_offset(page) + BITMAP_OFFSET + index / 4;
+        uint8_t byte;
+        flash_emu_read(offset, &byte, 1);
+        for (int byte_index = index / 4; index < first + count && index / 4 == byte_index; index++) {
+            byte &= (uint8_t)~((~state & 3) << (index % 4 * 2));
+        }
+        esp_err_t ret = flash_emu_write(offset, &byte, 1);
+        if (ret != ESP_OK) return ret;
+    }
+    return ESP_OK;
+}
+
+static bool entry_is_blank(int page, int index) {
+    uint8_t entry[ENTRY_SIZE];
+    flash_emu_read(entry_offset(page, index), entry, sizeof(entry));
+    for (size_t i = 0; i < sizeof(entry); i++) {
+        if (entry[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+static bool sector_is_blank(int page) {
+    uint8_t sector[FLASH_EMU_SECTOR_SIZE];
+    flash_emu_read(page_offset(page), sector, sizeof(sector));
+    for (size_t i = 0; i < sizeof(sector); i++) {
+        if (sector[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+static esp_err_t set_page_state(int page, uint32_t state) {
+    pages[page].state = state;
+    return flash_emu_write(page_offset(page), &state, sizeof(state));
+}
+
+static uint32_t page_header_crc(const page_header_t *header) {
+    return esp_rom_crc32_le(0,
+                            (const uint8_t *)&header->sequence,
+                            offsetof(page_header_t, crc) - offsetof(page_header_t, sequence));
+}
+
+static uint32_t item_crc(const item_t *item) {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)item, offsetof(item_t, crc));
+    return esp_rom_crc32_le(crc, (const uint8_t *)item->key, sizeof(*item) - offsetof(item_t, key));
+}
+
+static int find_location(uint8_t ns, const char *key) {
+    for (size_t i = 0; i < location_count; i++) {
+        if (locations[i].ns == ns && strncmp(locations[i].key, key, NVS_KEY_NAME_MAX_SIZE) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static esp_err_t erase_item(size_t location) {
+    location_t *loc = &locations[location];
+    pages[loc->page].erased += loc->span;
+    esp_err_t ret = set_entry_states(loc->page, loc->index, loc->span, ENTRY_ERASED);
+    locations[location] = locations[--location_count];
+    return ret;
+}
+
+// Record a complete item; an older copy of the same key is erased, whichever order they were found in
+static esp_err_t add_location(const item_t *item, int page, int index) {
+    int existing = find_location(item->ns, item->key);
+    esp_err_t ret = existing >= 0 ? erase_item((size_t)existing) : ESP_OK;
+
+    location_t *loc = &locations[location_count++];
+    loc->ns = item->ns;
+    loc->type = item->type;
+    memcpy(loc->key, item->key, sizeof(loc->key));
+    loc->page = (uint16_t)page;
+    loc->index = (uint8_t)index;
+    loc->span = item->span;
+    if (item->ns == 0 && item->type == TYPE_U8 && item->data.value[0] > last_ns) {
+        last_ns = item->data.value[0];
+    }
+    return ret;
+}
+
+static esp_err_t start_page(int page) {
+    page_header_t header;
+    memset(&header, 0xFF, sizeof(header));
+    header.sequence = next_sequence++;
+    header.version = PAGE_FORMAT_VERSION;
+    header.crc = page_header_crc(&header);
+
+    // The state goes last: a page cut off while being set up is still EMPTY and gets erased at mount
+    esp_err_t ret = flash_emu_write(page_offset(page) + sizeof(header.state),
+                                    (const uint8_t *)&header + sizeof(header.state),
+                                    sizeof(header) - sizeof(header.state));
+    pages[page] = (page_t){.sequence = header.sequence};
+    if (ret == ESP_OK) {
+        ret = set_page_state(page, PAGE_ACTIVE);
+    }
+    active = page;
+    return ret;
+}
+
+static esp_err_t erase_page(int page) {
+    esp_err_t ret = flash_emu_erase_sector((size_t)page);
+    pages[page] = (page_t){.state = PAGE_EMPTY};
+    return ret;
+}
+
+static esp_err_t copy_item(size_t location) {
+    location_t *loc = &locations[location];
+    int index = pages[active].next_free;
+    uint8_t entries[ENTRY_SIZE * ENTRIES_PER_PAGE];
+    size_t length = (size_t)loc->span * ENTRY_SIZE;
+
+    flash_emu_read(entry_offset(loc->page, loc->index), entries, length);
+    pages[active].next_free += loc->span;
+    esp_err_t ret = flash_emu_write(entry_offset(active, index), entries, length);
+    if (ret == ESP_OK && loc->span > 1) {
+        ret = set_entry_states(active, index + 1, loc->span - 1, ENTRY_WRITTEN);
+    }
+    if (ret == ESP_OK) {
+        ret = set_entry_states(active, index, 1, ENTRY_WRITTEN);
+    }
+    loc->page = (uint16_t)active;
+    loc->index = (uint8_t)index;
+    stats.entries_relocated += loc->span;
+    return ret;
+}
+
+// Move the live items of a page to the active one and erase it
+static esp_err_t reclaim_page(int victim) {
+    esp_err_t ret = set_page_state(victim, PAGE_FREEING);
+    for (size_t i = 0; i < location_count && ret == ESP_OK; i++) {
+        if (locations[i].page == victim) {
+            ret = copy_item(i);
+        }
+    }
+    if (ret == ESP_OK) {
+        ret = erase_page(victim);
+        stats.pages_reclaimed++;
+    }
+    return ret;
+}
+
+static esp_err_t new_active_page(void) {
+    int empty = -1;
+    int empty_count = 0;
+    int victim = -1;
+    for (size_t page = 0; page < page_count; page++) {
+        if (pages[page].state == PAGE_EMPTY) {
+            empty = empty < 0 ? (int)page : empty;
+            empty_count++;
+        } else if (pages[page].state == PAGE_FULL && pages[page].erased > 0 &&
+                   (victim < 0 || pages[page].erased > pages[victim].erased)) {
+            victim = (int)page;
+        }
+    }
+
+    // The last empty page is kept for reclaiming; it only becomes active when a page is freed into it
+    if (empty_count == 0 || (empty_count == 1 && victim < 0)) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    esp_err_t ret = start_page(empty);
+    if (ret == ESP_OK && empty_count == 1) {
+        ret = reclaim_page(victim);
+    }
+    return ret;
+}
+
+static esp_err_t reserve(int span) {
+    for (size_t attempt = 0; attempt <= page_count; attempt++) {
+        if (active >= 0 && pages[active].next_free + span <= ENTRIES_PER_PAGE) {
+            return ESP_OK;
+        }
+        if (active >= 0) {
+            esp_err_t ret = set_page_state(active, PAGE_FULL);
+            active = -1;
+            if (ret != ESP_OK) return ret;
+        }
+        esp_err_t ret = new_active_page();
+        if (ret != ESP_OK) return ret;
+    }
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+// ESP-IDF skips the write when the stored item already holds the same value
+static bool matches_stored(int location, uint8_t type, const void *data, size_t size) {
+    if (location < 0 || locations[location].type != type) {
+        return false;
+    }
+    item_t stored;
+    flash_emu_read(entry_offset(locations[location].page, locations[location].index), &stored, sizeof(stored));
+    if (!is_var_type(type)) {
+        return memcmp(stored.data.value, data, size) == 0;
+    }
+    if (stored.data.var.size != size) {
+        return false;
+    }
+    uint8_t current[MAX_VALUE_SIZE];
+    flash_emu_read(entry_offset(locations[location].page, locations[location].index + 1), current, size);
+    return memcmp(current, data, size) == 0;
+}
+
+static esp_err_t write_item(uint8_t ns, uint8_t type, const char *key, const void *data, size_t size) {
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    if (size > MAX_VALUE_SIZE) {
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+
+    stats.set_calls++;
+    stats.payload_bytes += size;
+    if (matches_stored(find_location(ns, key), type, data, size)) {
+        return ESP_OK;
+    }
+
+    int span = is_var_type(type) ? 1 + (int)((size + ENTRY_SIZE - 1) / ENTRY_SIZE) : 1;
+    esp_err_t ret = reserve(span);
+    if (ret != ESP_OK) return ret;
+
+    item_t item;
+    memset(&item, 0xFF, sizeof(item));
+    item.ns = ns;
+    item.type = type;
+    item.span = (uint8_t)span;
+    memset(item.key, 0, sizeof(item.key));
+    strncpy(item.key, key, sizeof(item.key) - 1);
+    if (is_var_type(type)) {
+        item.data.var.size = (uint16_t)size;
+        item.data.var.data_crc = esp_rom_crc32_le(0, data, (uint32_t)size);
+    } else {
+        memcpy(item.data.value, data, size);
+    }
+    item.crc = item_crc(&item);
+
+    // Data, then the header, then the bitmap with the header bit last: an item is complete or invisible
+    int page = active;
+    int index = pages[page].next_free;
+    pages[page].next_free += span;
+    if (span > 1) {
+        ret = flash_emu_write(entry_offset(page, index + 1), data, size);
+    }
+    if (ret == ESP_OK) {
+        ret = flash_emu_write(entry_offset(page, index), &item, sizeof(item));
+    }
+    if (ret == ESP_OK && span > 1) {
+        ret = set_entry_states(page, index + 1, span - 1, ENTRY_WRITTEN);
+    }
+    if (ret == ESP_OK) {
+        ret = set_entry_states(page, index, 1, ENTRY_WRITTEN);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    stats.items_written++;
+    return add_location(&item, page, index);
+}
+
+static esp_err_t read_item(uint8_t ns, uint8_t type, const char *key, item_t *item, int *location) {
+    *location = find_location(ns, key);
+    if (*location < 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (locations[*location].type != type) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    return flash_emu_read(entry_offset(locations[*location].page, locations[*location].index), item, sizeof(*item));
+}
+
+static bool item_is_valid(const item_t *item, int page, int index) {
+    if (item->crc != item_crc(item) || item->span == 0 || index + item->span > ENTRIES_PER_PAGE ||
+        item->key[NVS_KEY_NAME_MAX_SIZE - 1] != '\0') {
+        return false;
+    }
+    if (!is_var_type(item->type)) {
+        return item->span == 1 && (item->type == TYPE_U8 || item->type == TYPE_I32);
+    }
+    if (item->data.var.size > (item->span - 1) * ENTRY_SIZE) {
+        return false;
+    }
+    uint8_t data[MAX_VALUE_SIZE];
+    flash_emu_read(entry_offset(page, index + 1), data, item->data.var.size);
+    return esp_rom_crc32_le(0, data, item->data.var.size) == item->data.var.data_crc;
+}
+
+// Index the complete items of a page and mark everything a power cut left half-written as erased
+static esp_err_t load_page(int page) {
+    int last_used = -1;
+    for (int index = 0; index < ENTRIES_PER_PAGE; index++) {
+        if (entry_state(page, index) != ENTRY_EMPTY || !entry_is_blank(page, index)) {
+            last_used = index;
+        }
+    }
+    pages[page].next_free = (uint16_t)(last_used + 1);
+
+    esp_err_t ret = ESP_OK;
+    for (int index = 0; index <= last_used && ret == ESP_OK;) {
+        int state = entry_state(page, index);
+        if (state == ENTRY_ERASED) {
+            pages[page].erased++;
+            index++;
+            continue;
+        }
+
+        item_t item;
+        flash_emu_read(entry_offset(page, index), &item, sizeof(item));
+        if (state != ENTRY_WRITTEN || !item_is_valid(&item, page, index)) {
+            pages[page].erased++;
+            ret = set_entry_states(page, index, 1, ENTRY_ERASED);
+            index++;
+            continue;
+        }
+        ret = add_location(&item, page, index);
+        index += item.span;
+    }
+    return ret;
+}
+
+static int compare_sequence(const void *a, const void *b) {
+    uint32_t sa = pages[*(const int *)a].sequence;
+    uint32_t sb = pages[*(const int *)b].sequence;
+    return sa < sb ? -1 : sa > sb;
+}
+
+static esp_err_t mount(void) {
+    page_count = flash_emu_sectors();
+    pages = calloc(page_count, sizeof(*pages));
+    locations = calloc(page_count * ENTRIES_PER_PAGE, sizeof(*locations));
+    int *order = calloc(page_count, sizeof(*order));
+    if (pages == NULL || locations == NULL || order == NULL) {
+        free(order);
+        return ESP_ERR_NO_MEM;
+    }
+    location_count = 0;
+    active = -1;
+    last_ns = 0;
+    next_sequence = 0;
+
+    esp_err_t ret = ESP_OK;
+    size_t used = 0;
+    for (size_t page = 0; page < page_count && ret == ESP_OK; page++) {
+        page_header_t header;
+        flash_emu_read(page_offset((int)page), &header, sizeof(header));
+        if (header.state == PAGE_EMPTY) {
+            // Set up or erased only halfway when the power went
+            ret = sector_is_blank((int)page) ? ESP_OK : erase_page((int)page);
+            pages[page].state = PAGE_EMPTY;
+            continue;
+        }
+        if (header.version != PAGE_FORMAT_VERSION) {
+            ret = ESP_ERR_NVS_NEW_VERSION_FOUND;
+            break;
+        }
+        if (header.crc != page_header_crc(&header) ||
+            (header.state != PAGE_ACTIVE && header.state != PAGE_FULL && header.state != PAGE_FREEING)) {
+            ESP_LOGW(TAG, "Page %u has a damaged header, erasing it", (unsigned)page);
+            ret = erase_page((int)page);
+            continue;
+        }
+        pages[page].state = header.state;
+        pages[page].sequence = header.sequence;
+        if (header.sequence >= next_sequence) {
+            next_sequence = header.sequence + 1;
+        }
+        order[used++] = (int)page;
+    }
+
+    // Oldest first, so a later copy of a key replaces an earlier one
+    qsort(order, used, sizeof(*order), compare_sequence);
+    for (size_t i = 0; i < used && ret == ESP_OK; i++) {
+        ret = load_page(order[i]);
+    }
+
+    // Only the newest page stays writable, and only if it is not being reclaimed
+    int freeing = -1;
+    for (size_t i = 0; i < used && ret == ESP_OK; i++) {
+        int page = order[i];
+        if (pages[page].state == PAGE_FREEING) {
+            freeing = page;
+        } else if (pages[page].state == PAGE_ACTIVE && i + 1 < used) {
+            ret = set_page_state(page, PAGE_FULL);
+        } else if (pages[page].state == PAGE_ACTIVE) {
+            active = page;
+        }
+    }
+    free(order);
+
+    // Finish a reclaim the power cut interrupted: items not yet copied still live in that page
+    if (ret == ESP_OK && freeing >= 0) {
+        if (active < 0) {
+            ret = new_active_page();
+        }
+        for (size_t i = 0; i < location_count && ret == ESP_OK; i++) {
+            if (locations[i].page == freeing) {
+                ret = reserve(locations[i].span);
+                if (ret == ESP_OK) ret = copy_item(i);
+            }
+        }
+        if (ret == ESP_OK) {
+            ret = erase_page(freeing);
+        }
+    }
+
+    if (ret == ESP_OK && active < 0) {
+        ret = reserve(1);
+        if (ret == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
+            ret = ESP_ERR_NVS_NO_FREE_PAGES;
+        }
+    }
+    return ret;
+}
+
+static void unmount(void) {
+    free(pages);
+    free(locations);
+    pages = NULL;
+    locations = NULL;
+    page_count = 0;
+    location_count = 0;
+    memset(handles, 0, sizeof(handles));
+    mounted = false;
+}
+
+esp_err_t nvs_flash_init(void) {
+    if (mounted) {
+        return ESP_OK;
+    }
+    if (flash_emu_sectors() == 0) {
+        esp_err_t ret = flash_emu_open(NULL, NVS_EMU_DEFAULT_SECTORS);
+        if (ret != ESP_OK) return ret;
+    }
+
+    esp_err_t ret = mount();
+    if (ret != ESP_OK) {
+        unmount();
+        return ret;
+    }
+    mounted = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_deinit(void) {
+    if (!mounted) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    unmount();
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    if (mounted) {
+        unmount();
+    }
+    if (flash_emu_sectors() == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    for (size_t sector = 0; sector < flash_emu_sectors(); sector++) {
+        esp_err_t ret = flash_emu_erase_sector(sector);
+        if (ret != ESP_OK) return ret;
+    }
+    return ESP_OK;
+}
+
+static handle_t *get_handle(nvs_handle_t handle) {
+    if (!mounted || handle == 0 || handle > MAX_HANDLES || !handles[handle - 1].used) {
+        return NULL;
+    }
+    return &handles[handle - 1];
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    if (!mounted) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (name == NULL || out_handle == NULL || strlen(name) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+
+    // Namespaces are U8 items in namespace 0 that map the name to an index
+    int location = find_location(0, name);
+    uint8_t ns;
+    if (location >= 0) {
+        item_t item;
+        flash_emu_read(entry_offset(locations[location].page, locations[location].index), &item, sizeof(item));
+        ns = item.data.value[0];
+    } else if (open_mode == NVS_READONLY) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    } else {
+        if (last_ns == 254) return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        ns = last_ns + 1;
+        esp_err_t ret = write_item(0, TYPE_U8, name, &ns, sizeof(ns));
+        if (ret != ESP_OK) return ret;
+    }
+
+    for (size_t i = 0; i < MAX_HANDLES; i++) {
+        if (!handles[i].used) {
+            handles[i] = (handle_t){.used = true, .writable = open_mode == NVS_READWRITE, .ns = ns};
+            *out_handle = (nvs_handle_t)(i + 1);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    handle_t *h = get_handle(handle);
+    if (h != NULL) {
+        h->used = false;
+    }
+}
+
+// Items are on flash as soon as nvs_set_* returns, so as in ESP-IDF there is nothing left to do
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    if (get_handle(handle) == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    return flash_emu_power_lost() ? ESP_FAIL : ESP_OK;
+}
+
+static esp_err_t set_value(nvs_handle_t handle, uint8_t type, const char *key, const void *value, size_t size) {
+    handle_t *h = get_handle(handle);
+    if (h == NULL) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (!h->writable) return ESP_ERR_NVS_READ_ONLY;
+    if (key == NULL) return ESP_ERR_NVS_INVALID_NAME;
+    return write_item(h->ns, type, key, value, size);
+}
+
+static esp_err_t get_var(nvs_handle_t handle, uint8_t type, const char *key, void *out, size_t *length) {
+    handle_t *h = get_handle(handle);
+    if (h == NULL) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (key == NULL || length == NULL) return ESP_ERR_INVALID_ARG;
+
+    item_t item;
+    int location;
+    esp_err_t ret = read_item(h->ns, type, key, &item, &location);
+    if (ret != ESP_OK) return ret;
+
+    size_t size = item.data.var.size;
+    if (out == NULL) {
+        *length = size;
+        return ESP_OK;
+    }
+    if (*length < size) {
+        *length = size;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    *length = size;
+    return flash_emu_read(entry_offset(locations[location].page, locations[location].index + 1), out, size);
+}
+
+esp_err_t nvs_set_i32(nvs_handle_t handle, const char *key, int32_t value) {
+    return set_value(handle, TYPE_I32, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char *key, int32_t *out_value) {
+    handle_t *h = get_handle(handle);
+    if (h == NULL) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (key == NULL || out_value == NULL) return ESP_ERR_INVALID_ARG;
+
+    item_t item;
+    int location;
+    esp_err_t ret = read_item(h->ns, TYPE_I32, key, &item, &location);
+    if (ret == ESP_OK) {
+        memcpy(out_value, item.data.value, sizeof(*out_value));
+    }
+    return ret;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    if (value == NULL) return ESP_ERR_INVALID_ARG;
+    return set_value(handle, TYPE_STR, key, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length) {
+    return get_var(handle, TYPE_STR, key, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    if (value == NULL && length > 0) return ESP_ERR_INVALID_ARG;
+    return set_value(handle, TYPE_BLOB, key, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    return get_var(handle, TYPE_BLOB, key, out_value, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    handle_t *h = get_handle(handle);
+    if (h == NULL) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (!h->writable) return ESP_ERR_NVS_READ_ONLY;
+    if (key == NULL) return ESP_ERR_NVS_INVALID_NAME;
+
+    int location = find_location(h->ns, key);
+    if (location < 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return erase_item((size_t)location);
+}
+
+void nvs_emu_get_stats(nvs_emu_stats_t *out) {
+    *out = stats;
+    out->used_entries = 0;
+    out->erased_entries = 0;
+    out->free_entries = 0;
+    for (size_t page = 0; page < page_count; page++) {
+        uint32_t used = pages[page].state == PAGE_EMPTY ? 0 : pages[page].next_free;
+        out->erased_entries += pages[page].erased;
+        out->used_entries += used - pages[page].erased;
+        out->free_entries += ENTRIES_PER_PAGE - used;
+    }
+}
+
+void nvs_emu_reset_stats(void) { memset(&stats, 0, sizeof(stats)); }
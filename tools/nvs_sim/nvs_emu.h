@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define NVS_EMU_DEFAULT_SECTORS 6 // Size of the nvs partition in the single-app partition table
+
+typedef struct {
+    uint32_t set_calls;     // nvs_set_* calls, including ones that matched the stored value
+    uint32_t items_written; // Items that reached flash
+    uint64_t payload_bytes; // Value bytes passed to nvs_set_*: the logical write volume
+    uint32_t pages_reclaimed;
+    uint32_t entries_relocated; // Live entries copied out of reclaimed pages
+    uint32_t used_entries;      // Current layout, filled in by nvs_emu_get_stats()
+    uint32_t erased_entries;
+    uint32_t free_entries;
+} nvs_emu_stats_t;
+
+void nvs_emu_get_stats(nvs_emu_stats_t *out);
+void nvs_emu_reset_stats(void);
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdio.h>
+
+extern int host_log_level; // 0 = errors only, 1 = +warnings, 2 = +info
+
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)                                                                                        \
+    do {                                                                                                               \
+        if (host_log_level >= 1) fprintf(stderr, "W (%s) " fmt "\n", tag, ##__VA_ARGS__);                              \
+    } while (0)
+#define ESP_LOGI(tag, fmt, ...)                                                                                        \
+    do {                                                                                                               \
+        if (host_log_level >= 2) fprintf(stderr, "I (%s) " fmt "\n", tag, ##__VA_ARGS__);                              \
+    } while (0)
+#define ESP_LOGD(tag, fmt, ...) (void)0
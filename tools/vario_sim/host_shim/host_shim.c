@@ -0,0 +1,41 @@
+#include <time.h>
+
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "pool_pump/modbus_rtu_uart.h"
+
+int host_log_level = 1;
+
+int64_t esp_timer_get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_FAIL:
+            return "ESP_FAIL";
+        case ESP_ERR_INVALID_ARG:
+            return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:
+            return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_TIMEOUT:
+            return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE:
+            return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC:
+            return "ESP_ERR_INVALID_CRC";
+        default:
+            return "ESP_ERR_UNKNOWN";
+    }
+}
+
+// There is no UART on the host; links are opened with vario_inverter_init_with_transport()
+esp_err_t modbus_rtu_uart_init(const modbus_rtu_uart_config_t *config, modbus_rtu_transport_t *transport) {
+    (void)config;
+    (void)transport;
+    return ESP_ERR_NOT_SUPPORTED;
+}
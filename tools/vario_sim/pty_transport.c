@@ -0,0 +1,58 @@
+#define _DEFAULT_SOURCE
+#include "pty_transport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <termios.h>
+#include <unistd.h>
+
+static esp_err_t pty_write(void *ctx, const uint8_t *data, size_t len) {
+    int fd = (int)(intptr_t)ctx;
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = write(fd, data + sent, len - sent);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return ESP_FAIL;
+        }
+        sent += (size_t)n;
+    }
+    return ESP_OK;
+}
+
+static int pty_read(void *ctx, uint8_t *buf, size_t len, uint32_t timeout_ms) {
+    int fd = (int)(intptr_t)ctx;
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    int ready = poll(&pfd, 1, (int)timeout_ms);
+    if (ready <= 0) {
+        return ready == 0 ? 0 : -1;
+    }
+    ssize_t n = read(fd, buf, len);
+    return n < 0 ? -1 : (int)n;
+}
+
+static void pty_flush(void *ctx) { tcflush((int)(intptr_t)ctx, TCIFLUSH); }
+
+int pty_transport_open(const char *path, modbus_rtu_transport_t *transport) {
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror("pty_transport: open");
+        return -1;
+    }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+
+    transport->write = pty_write;
+    transport->read = pty_read;
+    transport->flush = pty_flush;
+    transport->busy = NULL;
+    transport->ctx = (void *)(intptr_t)fd;
+    return fd;
+}
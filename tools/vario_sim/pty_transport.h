@@ -0,0 +1,9 @@
+#pragma once
+
+#include "pool_pump/modbus_rtu.h"
+
+/**
+ * Open a serial device (the simulator's pty, or a USB-RS485 adapter) in raw mode and fill
+ * a Modbus transport for it. Returns the file descriptor or -1.
+ */
+int pty_transport_open(const char *path, modbus_rtu_transport_t *transport);
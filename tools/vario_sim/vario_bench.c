@@ -0,0 +1,118 @@
+// Round-trip latency and throughput of the Modbus driver against the pty simulator
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_timer.h"
+#include "pool_pump/vario_inverter.h"
+#include "pty_transport.h"
+#include "vario_sim.h"
+
+typedef struct {
+    const char *name;
+    int64_t min_us;
+    int64_t max_us;
+    int64_t total_us;
+    int count;
+    int errors;
+} bench_result_t;
+
+static void record(bench_result_t *result, int64_t elapsed_us, esp_err_t err) {
+    if (err != ESP_OK) {
+        result->errors++;
+        return;
+    }
+    if (result->count == 0 || elapsed_us < result->min_us) result->min_us = elapsed_us;
+    if (elapsed_us > result->max_us) result->max_us = elapsed_us;
+    result->total_us += elapsed_us;
+    result->count++;
+}
+
+static void report(const bench_result_t *result) {
+    double avg = result->count ? (double)result->total_us / result->count : 0;
+    printf("%-22s %6d ok %4d err  min %7lld us  avg %9.1f us  max %7lld us  %8.1f tx/s\n",
+           result->name,
+           result->count,
+           result->errors,
+           (long long)result->min_us,
+           avg,
+           (long long)result->max_us,
+           avg > 0 ? 1e6 / avg : 0);
+}
+
+int main(int argc, char **argv) {
+    int iterations = 200;
+    uint32_t baud = 0;
+    uint32_t processing_us = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:b:p:")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 'b':
+                baud = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                processing_us = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n iterations] [-b baud] [-p processing_us]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    vario_sim_t sim;
+    if (vario_sim_start(&sim, 1, baud, processing_us) != 0) {
+        return 1;
+    }
+
+    modbus_rtu_transport_t transport;
+    int fd = pty_transport_open(sim.slave_path, &transport);
+    if (fd < 0 || vario_inverter_init_with_transport(&transport) != ESP_OK) {
+        vario_sim_stop(&sim);
+        return 1;
+    }
+
+    printf("Simulator on %s, %d iterations, wire pacing %u baud (0 = none), processing %u us\n",
+           sim.slave_path,
+           iterations,
+           baud,
+           processing_us);
+
+    bench_result_t set_speed = {.name = "set_speed (FC16 x2)"};
+    bench_result_t read_status = {.name = "read_status (FC04 x6)"};
+    vario_inverter_status_t status;
+
+    for (int i = 0; i < iterations; i++) {
+        uint16_t rpm = (uint16_t)(VARIO_MIN_RPM + (i * 37) % (VARIO_MAX_RPM - VARIO_MIN_RPM));
+
+        int64_t start = esp_timer_get_time();
+        esp_err_t err = vario_inverter_set_speed(rpm);
+        record(&set_speed, esp_timer_get_time() - start, err);
+
+        start = esp_timer_get_time();
+        err = vario_inverter_read_status(&status);
+        record(&read_status, esp_timer_get_time() - start, err);
+    }
+
+    report(&set_speed);
+    report(&read_status);
+
+    modbus_rtu_stats_t stats;
+    vario_inverter_get_link_stats(&stats);
+    printf("link: %u transactions, %u retries, %u timeouts, %u CRC errors, %u exceptions\n",
+           stats.transactions,
+           stats.retries,
+           stats.timeouts,
+           stats.crc_errors,
+           stats.exceptions);
+    printf("last status: %u RPM, %u W, flags 0x%04x\n", status.actual_rpm, status.power_w, status.status_flags);
+
+    close(fd);
+    vario_sim_stop(&sim);
+    return (set_speed.errors || read_status.errors) ? 1 : 0;
+}
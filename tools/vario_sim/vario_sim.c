@@ -0,0 +1,257 @@
+#define _GNU_SOURCE
+#include "vario_sim.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "esp_timer.h"
+#include "pool_pump/modbus_rtu.h"
+#include "pool_pump/vario_inverter.h"
+
+#define SIM_RAMP_RPM_PER_S 600.0
+#define SIM_RATED_POWER_W 1100.0
+
+static bool read_exact(int fd, uint8_t *buf, size_t len, int timeout_ms) {
+    size_t got = 0;
+    while (got < len) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        int ready = poll(&pfd, 1, timeout_ms);
+        if (ready <= 0) {
+            return false;
+        }
+        ssize_t n = read(fd, buf + got, len - got);
+        if (n <= 0) {
+            if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            return false;
+        }
+        got += (size_t)n;
+    }
+    return true;
+}
+
+static void put_u16(uint8_t *dst, uint16_t value) {
+    dst[0] = (uint8_t)(value >> 8);
+    dst[1] = (uint8_t)(value & 0xFF);
+}
+
+static uint16_t get_u16(const uint8_t *src) { return (uint16_t)((src[0] << 8) | src[1]); }
+
+static void wire_delay(const vario_sim_t *sim, size_t bytes) {
+    if (sim->baud > 0) {
+        // 10 bits per character (8N1)
+        usleep((useconds_t)((uint64_t)bytes * 10 * 1000000 / sim->baud));
+    }
+}
+
+static void send_frame(vario_sim_t *sim, uint8_t *frame, size_t len) {
+    uint16_t crc = modbus_rtu_crc16(frame, len);
+    frame[len++] = (uint8_t)(crc & 0xFF);
+    frame[len++] = (uint8_t)(crc >> 8);
+    wire_delay(sim, len);
+    if (write(sim->master_fd, frame, len) != (ssize_t)len) {
+        perror("vario_sim: write");
+    }
+}
+
+static void send_exception(vario_sim_t *sim, uint8_t function, uint8_t code) {
+    uint8_t frame[5] = {sim->address, (uint8_t)(function | 0x80), code};
+    sim->exceptions++;
+    send_frame(sim, frame, 3);
+}
+
+static void update_model(vario_sim_t *sim) {
+    int64_t now = esp_timer_get_time();
+    double dt = (now - sim->last_update_us) / 1e6;
+    sim->last_update_us = now;
+
+    double target = sim->holding[VARIO_REG_CONTROL] == VARIO_CONTROL_RUN ? sim->holding[VARIO_REG_SPEED_SETPOINT] : 0;
+    double step = SIM_RAMP_RPM_PER_S * dt;
+    if (fabs(target - sim->actual_rpm) <= step) {
+        sim->actual_rpm = target;
+    } else {
+        sim->actual_rpm += (target > sim->actual_rpm) ? step : -step;
+    }
+}
+
+static uint16_t input_register(vario_sim_t *sim, uint16_t address) {
+    double ratio = sim->actual_rpm / VARIO_MAX_RPM;
+    switch (address - VARIO_REG_STATUS_BASE) {
+        case 0:
+            return (uint16_t)lround(sim->actual_rpm);
+        case 1:
+            return (uint16_t)lround(SIM_RATED_POWER_W * ratio * ratio * ratio);
+        case 2:
+            return 0;
+        case 3:
+            return sim->actual_rpm > 0 ? VARIO_STATUS_FLAG_RUNNING : 0;
+        case 4:
+            return 325;
+        case 5:
+            return 35;
+        default:
+            return 0;
+    }
+}
+
+static void handle_request(vario_sim_t *sim, const uint8_t *req, size_t len) {
+    uint8_t reply[MODBUS_RTU_MAX_ADU];
+    uint8_t function = req[1];
+    uint16_t start = get_u16(&req[2]);
+    uint16_t count = get_u16(&req[4]);
+
+    wire_delay(sim, len);
+    if (sim->processing_us > 0) {
+        usleep(sim->processing_us);
+    }
+    update_model(sim);
+    sim->requests++;
+
+    switch (function) {
+        case MODBUS_FC_READ_HOLDING:
+        case MODBUS_FC_READ_INPUT: {
+            bool input = function == MODBUS_FC_READ_INPUT;
+            bool valid = count > 0 && count <= MODBUS_RTU_MAX_READ_REGS &&
+                         (input ? (start >= VARIO_REG_STATUS_BASE &&
+                                   start + count <= VARIO_REG_STATUS_BASE + VARIO_STATUS_REG_COUNT)
+                                : (start + count <= VARIO_SIM_HOLDING_REGS));
+            if (!valid) {
+                send_exception(sim, function, 0x02);
+                return;
+            }
+            reply[0] = sim->address;
+            reply[1] = function;
+            reply[2] = (uint8_t)(2 * count);
+            for (uint16_t i = 0; i < count; i++) {
+                uint16_t value = input ? input_register(sim, start + i) : sim->holding[start + i];
+                put_u16(&reply[3 + 2 * i], value);
+            }
+            send_frame(sim, reply, 3 + 2 * (size_t)count);
+            return;
+        }
+        case MODBUS_FC_WRITE_SINGLE:
+            if (start >= VARIO_SIM_HOLDING_REGS) {
+                send_exception(sim, function, 0x02);
+                return;
+            }
+            sim->holding[start] = count; // For 0x06 the second word is the value
+            memcpy(reply, req, 6);
+            send_frame(sim, reply, 6);
+            return;
+        case MODBUS_FC_WRITE_MULTIPLE:
+            if (count == 0 || start + count > VARIO_SIM_HOLDING_REGS || req[6] != 2 * count) {
+                send_exception(sim, function, 0x02);
+                return;
+            }
+            for (uint16_t i = 0; i < count; i++) {
+                sim->holding[start + i] = get_u16(&req[7 + 2 * i]);
+            }
+            memcpy(reply, req, 6);
+            send_frame(sim, reply, 6);
+            return;
+        default:
+            send_exception(sim, function, 0x01);
+            return;
+    }
+}
+
+static void drain(int fd) {
+    uint8_t scratch[64];
+    while (read_exact(fd, scratch, 1, 5)) {
+    }
+}
+
+static void *sim_thread(void *arg) {
+    vario_sim_t *sim = arg;
+    uint8_t req[MODBUS_RTU_MAX_ADU];
+
+    while (!sim->stop) {
+        if (!read_exact(sim->master_fd, req, 2, 50)) {
+            continue;
+        }
+
+        size_t len;
+        switch (req[1]) {
+            case MODBUS_FC_READ_HOLDING:
+            case MODBUS_FC_READ_INPUT:
+            case MODBUS_FC_WRITE_SINGLE:
+                len = 8;
+                if (!read_exact(sim->master_fd, req + 2, 6, 20)) continue;
+                break;
+            case MODBUS_FC_WRITE_MULTIPLE:
+                if (!read_exact(sim->master_fd, req + 2, 5, 20)) continue;
+                len = 9 + (size_t)req[6];
+                if (len > sizeof(req) || !read_exact(sim->master_fd, req + 7, len - 7, 20)) continue;
+                break;
+            default:
+                drain(sim->master_fd);
+                continue;
+        }
+
+        uint16_t crc = modbus_rtu_crc16(req, len - 2);
+        if (req[len - 2] != (crc & 0xFF) || req[len - 1] != (crc >> 8)) {
+            sim->crc_errors++;
+            drain(sim->master_fd);
+            continue;
+        }
+
+        // Requests for other slaves are ignored, as on a shared bus
+        if (req[0] == sim->address) {
+            handle_request(sim, req, len);
+        }
+    }
+    return NULL;
+}
+
+int vario_sim_start(vario_sim_t *sim, uint8_t address, uint32_t baud, uint32_t processing_us) {
+    memset(sim, 0, sizeof(*sim));
+    sim->address = address;
+    sim->baud = baud;
+    sim->processing_us = processing_us;
+    sim->last_update_us = esp_timer_get_time();
+
+    sim->master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (sim->master_fd < 0 || grantpt(sim->master_fd) != 0 || unlockpt(sim->master_fd) != 0) {
+        perror("vario_sim: posix_openpt");
+        return -1;
+    }
+
+    const char *name = ptsname(sim->master_fd);
+    if (name == NULL) {
+        perror("vario_sim: ptsname");
+        return -1;
+    }
+    snprintf(sim->slave_path, sizeof(sim->slave_path), "%s", name);
+
+    // Raw mode on the slave side: no echo, no line editing, no CR/LF translation
+    sim->slave_fd = open(sim->slave_path, O_RDWR | O_NOCTTY);
+    if (sim->slave_fd < 0) {
+        perror("vario_sim: open slave");
+        return -1;
+    }
+    struct termios tio;
+    tcgetattr(sim->slave_fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(sim->slave_fd, TCSANOW, &tio);
+
+    if (pthread_create(&sim->thread, NULL, sim_thread, sim) != 0) {
+        perror("vario_sim: pthread_create");
+        return -1;
+    }
+    return 0;
+}
+
+void vario_sim_stop(vario_sim_t *sim) {
+    sim->stop = true;
+    pthread_join(sim->thread, NULL);
+    close(sim->slave_fd);
+    close(sim->master_fd);
+}
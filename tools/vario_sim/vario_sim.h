@@ -0,0 +1,32 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define VARIO_SIM_HOLDING_REGS 0x0400
+
+typedef struct {
+    int master_fd;
+    uint8_t address;
+    uint32_t baud;             // > 0 adds the wire time of request + reply at this baud rate
+    uint32_t processing_us;    // Inverter-side processing delay per request
+    uint16_t holding[VARIO_SIM_HOLDING_REGS];
+    double actual_rpm;
+    int64_t last_update_us;
+    uint32_t requests;
+    uint32_t crc_errors;
+    uint32_t exceptions;
+    volatile bool stop;
+    pthread_t thread;
+    char slave_path[64];
+    int slave_fd; // Held open so the master never sees a hangup between clients
+} vario_sim_t;
+
+/**
+ * Create a pseudo-terminal and start answering Modbus requests on it from a thread.
+ * The device path for the driver side is in sim->slave_path.
+ */
+int vario_sim_start(vario_sim_t *sim, uint8_t address, uint32_t baud, uint32_t processing_us);
+
+void vario_sim_stop(vario_sim_t *sim);
@@ -0,0 +1,55 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "vario_sim.h"
+
+static volatile sig_atomic_t s_running = 1;
+
+static void on_signal(int sig) {
+    (void)sig;
+    s_running = 0;
+}
+
+int main(int argc, char **argv) {
+    uint32_t baud = 9600;
+    uint32_t processing_us = 2000;
+    int address = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:b:p:")) != -1) {
+        switch (opt) {
+            case 'a':
+                address = atoi(optarg);
+                break;
+            case 'b':
+                baud = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                processing_us = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-a address] [-b baud, 0 = no wire delay] [-p processing_us]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    vario_sim_t sim;
+    if (vario_sim_start(&sim, (uint8_t)address, baud, processing_us) != 0) {
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    printf("Vario+ simulator (slave %d, %u baud) on %s\n", address, baud, sim.slave_path);
+    fflush(stdout);
+
+    while (s_running) {
+        sleep(1);
+    }
+
+    vario_sim_stop(&sim);
+    printf("%u requests, %u CRC errors, %u exceptions\n", sim.requests, sim.crc_errors, sim.exceptions);
+    return 0;
+}